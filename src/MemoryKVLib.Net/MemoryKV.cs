@@ -22,11 +22,25 @@ namespace MemoryKVLib.Net
             MemoryKVNativeCall.MMFManager_open(_manager, dbname, options);
         }
 
+        /// <summary>
+        /// a DB nobody has created yet is filled from an image written by SaveImage, otherwise the image is ignored
+        /// </summary>
+        /// <returns>Error if the image is missing, corrupted or saved with other sizes</returns>
+        public KvStatus Open(string dbname, ConfigOptions options, string restoreFrom)
+        {
+            return MemoryKVNativeCall.MMFManager_openrestore(_manager, dbname, options, restoreFrom);
+        }
+
         public bool Put(string key, string value)
         {
             return MemoryKVNativeCall.MMFManager_put(_manager, key, value);
         }
 
+        public bool Put(string key, string value, TimeSpan ttl)
+        {
+            return MemoryKVNativeCall.MMFManager_putttl(_manager, key, value, (long)ttl.TotalMilliseconds);
+        }
+
         public string Get(string key)
         {
             IntPtr ptr = MemoryKVNativeCall.MMFManager_get(_manager, key);
@@ -39,6 +53,287 @@ namespace MemoryKVLib.Net
             MemoryKVNativeCall.MMFManager_remove(_manager, key);
         }
 
+        public KvStatus TryPut(string key, string value)
+        {
+            return MemoryKVNativeCall.MMFManager_tryput(_manager, key, key.Length, value, value.Length);
+        }
+
+        /// <summary>
+        /// copy the value into a caller-owned buffer, reuse the buffer across calls to avoid allocating a string per Get
+        /// </summary>
+        /// <returns>BufferTooSmall if the value and its terminating NUL don't fit, valueLength tells the needed length</returns>
+        public KvStatus TryGet(string key, char[] buffer, out int valueLength)
+        {
+            return MemoryKVNativeCall.MMFManager_tryget(_manager, key, key.Length, buffer, buffer?.Length ?? 0, out valueLength);
+        }
+
+        public KvStatus TryRemove(string key)
+        {
+            return MemoryKVNativeCall.MMFManager_tryremove(_manager, key, key.Length);
+        }
+
+        public KvStatus PutNumber(string key, long value)
+        {
+            return MemoryKVNativeCall.MMFManager_putnumber(_manager, key, key.Length, value);
+        }
+
+        public KvStatus GetNumber(string key, out long value)
+        {
+            return MemoryKVNativeCall.MMFManager_getnumber(_manager, key, key.Length, out value);
+        }
+
+        public KvStatus Increment(string key, long delta, out long newValue)
+        {
+            KvStatus status = MemoryKVNativeCall.MMFManager_fetchadd(_manager, key, key.Length, delta, out long oldValue);
+            newValue = oldValue + delta;
+            return status;
+        }
+
+        public KvStatus FetchAdd(string key, long delta, out long oldValue)
+        {
+            return MemoryKVNativeCall.MMFManager_fetchadd(_manager, key, key.Length, delta, out oldValue);
+        }
+
+        public KvStatus CompareAndSwap(string key, long expected, long desired, out long actual)
+        {
+            return MemoryKVNativeCall.MMFManager_compareandswap(_manager, key, key.Length, expected, desired, out actual);
+        }
+
+        public KvStatus PutDouble(string key, double value)
+        {
+            return MemoryKVNativeCall.MMFManager_putdouble(_manager, key, key.Length, value);
+        }
+
+        public KvStatus GetDouble(string key, out double value)
+        {
+            return MemoryKVNativeCall.MMFManager_getdouble(_manager, key, key.Length, out value);
+        }
+
+        public KvStatus FetchAddDouble(string key, double delta, out double oldValue)
+        {
+            return MemoryKVNativeCall.MMFManager_fetchadddouble(_manager, key, key.Length, delta, out oldValue);
+        }
+
+        public KvStatus CompareAndSwapDouble(string key, double expected, double desired, out double actual)
+        {
+            return MemoryKVNativeCall.MMFManager_compareandswapdouble(_manager, key, key.Length, expected, desired, out actual);
+        }
+
+        /// <summary>
+        /// visits the keys in [from, to) in key order, an empty to means no upper bound. needs ConfigOptions.OrderedIndex
+        /// </summary>
+        /// <param name="limit">the maximum number of keys to visit, 0 for all</param>
+        /// <param name="visitor">receives key and value, returns false to stop</param>
+        /// <returns>the number of visited keys, -1 on error</returns>
+        public int Scan(string from, string to, int limit, Func<string, string, bool> visitor)
+        {
+            MemoryKVNativeCall.KvScanVisitor callback = (key, keyLength, value, valueLength, context) =>
+                visitor(Marshal.PtrToStringUni(key, keyLength), Marshal.PtrToStringUni(value, valueLength));
+            int visited = MemoryKVNativeCall.MMFManager_scan(_manager, from, from.Length, to, to.Length, limit, callback, IntPtr.Zero);
+            GC.KeepAlive(callback);
+            return visited;
+        }
+
+        public int ScanPrefix(string prefix, int limit, Func<string, string, bool> visitor)
+        {
+            MemoryKVNativeCall.KvScanVisitor callback = (key, keyLength, value, valueLength, context) =>
+                visitor(Marshal.PtrToStringUni(key, keyLength), Marshal.PtrToStringUni(value, valueLength));
+            int visited = MemoryKVNativeCall.MMFManager_scanprefix(_manager, prefix, prefix.Length, limit, callback, IntPtr.Zero);
+            GC.KeepAlive(callback);
+            return visited;
+        }
+
+        /// <summary>
+        /// a consistent view of the whole DB, writers keep going. release it when done
+        /// </summary>
+        public KvStatus OpenSnapshot(out KvSnapshot snapshot)
+        {
+            return MemoryKVNativeCall.MMFManager_opensnapshot(_manager, out snapshot);
+        }
+
+        /// <returns>SnapshotTooOld if the snapshot was dropped because the version store ran full</returns>
+        public KvStatus IterateSnapshot(ref KvSnapshot snapshot, Func<string, string, bool> visitor, out int visited)
+        {
+            MemoryKVNativeCall.KvScanVisitor callback = (key, keyLength, value, valueLength, context) =>
+                visitor(Marshal.PtrToStringUni(key, keyLength), Marshal.PtrToStringUni(value, valueLength));
+            KvStatus status = MemoryKVNativeCall.MMFManager_iteratesnapshot(_manager, ref snapshot, callback, IntPtr.Zero, out visited);
+            GC.KeepAlive(callback);
+            return status;
+        }
+
+        public void ReleaseSnapshot(ref KvSnapshot snapshot)
+        {
+            MemoryKVNativeCall.MMFManager_releasesnapshot(_manager, ref snapshot);
+        }
+
+        /// <summary>
+        /// writes a snapshot of the whole DB to path without blocking writers, the file is replaced only on success
+        /// </summary>
+        public KvStatus Checkpoint(string path, out long bytesWritten)
+        {
+            return MemoryKVNativeCall.MMFManager_checkpoint(_manager, path, out bytesWritten);
+        }
+
+        /// <summary>
+        /// writes the MMFs as they are in memory, for Open with restoreFrom
+        /// </summary>
+        public KvStatus SaveImage(string path, out long bytesWritten)
+        {
+            return MemoryKVNativeCall.MMFManager_saveimage(_manager, path, out bytesWritten);
+        }
+
+        /// <summary>
+        /// counters of the write-ahead log, records / flushes is the group commit batch size
+        /// </summary>
+        public void GetLogStats(out long records, out long flushes)
+        {
+            MemoryKVNativeCall.MMFManager_getlogstats(_manager, out records, out flushes);
+        }
+
+        /// <summary>
+        /// writes the segment files with KvStorageMode.File, waitForDisk false only queues the writeback
+        /// </summary>
+        public KvStatus Flush(bool waitForDisk = true)
+        {
+            return MemoryKVNativeCall.MMFManager_flush(_manager, waitForDisk);
+        }
+
+        /// <summary>
+        /// one tiering pass with ConfigOptions.Tiering: values not read since the last pass go to the cold files,
+        /// cold values read since then come back
+        /// </summary>
+        public KvStatus RebalanceTiers(out int demoted, out int promoted)
+        {
+            return MemoryKVNativeCall.MMFManager_rebalancetiers(_manager, out demoted, out promoted);
+        }
+
+        /// <summary>
+        /// counters of the cold store, storedBytes is never reclaimed
+        /// </summary>
+        public void GetTieringStats(out long demoted, out long promoted, out long storedBytes)
+        {
+            MemoryKVNativeCall.MMFManager_gettieringstats(_manager, out demoted, out promoted, out storedBytes);
+        }
+
+        /// <summary>
+        /// how this instance waited for the DB mutex, waitMicroseconds is only spent on the contended acquisitions
+        /// </summary>
+        public void GetLockStats(out long acquisitions, out long contended, out long waitMicroseconds)
+        {
+            MemoryKVNativeCall.MMFManager_getlockstats(_manager, out acquisitions, out contended, out waitMicroseconds);
+        }
+
+        /// <summary>
+        /// counters of the value pool, shared counts the Puts that found their value already stored
+        /// </summary>
+        public void GetValuePoolStats(out long values, out long shared, out long storedBytes)
+        {
+            MemoryKVNativeCall.MMFManager_getvaluepoolstats(_manager, out values, out shared, out storedBytes);
+        }
+
+        /// <summary>
+        /// the bytes the DB costs, walks all the blocks under the DB mutex
+        /// </summary>
+        public KvStatus GetMemoryStats(out KvMemoryStats stats)
+        {
+            return MemoryKVNativeCall.MMFManager_getmemorystats(_manager, out stats);
+        }
+
+        /// <summary>
+        /// the counters of the shared stats page, of all the processes or only this one, read without a lock
+        /// </summary>
+        public KvStatus GetStats(out KvStats stats, bool thisProcessOnly = false)
+        {
+            return MemoryKVNativeCall.MMFManager_getstats(_manager, out stats, thisProcessOnly);
+        }
+
+        /// <summary>
+        /// the stats page of a DB this process hasn't opened, NotFound if no process has it open
+        /// </summary>
+        public static KvStatus ReadStats(string dbName, out KvStats stats)
+        {
+            return MemoryKVNativeCall.MMFManager_readstats(dbName, out stats);
+        }
+
+        /// <summary>
+        /// the latency histogram of a call in ns, recorded by the instances opened with LatencyHistograms
+        /// </summary>
+        public KvStatus GetLatencyHistogram(KvLatencyOp op, KvLatencyPhase phase, out LatencyHistogram histogram, bool thisProcessOnly = false)
+        {
+            return MemoryKVNativeCall.MMFManager_getlatencyhistogram(_manager, op, phase, out histogram, thisProcessOnly);
+        }
+
+        /// <summary>
+        /// the latency histogram of a DB this process hasn't opened, NotFound if no process records it
+        /// </summary>
+        public static KvStatus ReadLatencyHistogram(string dbName, KvLatencyOp op, KvLatencyPhase phase, out LatencyHistogram histogram)
+        {
+            return MemoryKVNativeCall.MMFManager_readlatencyhistogram(dbName, op, phase, out histogram);
+        }
+
+        /// <summary>
+        /// the most accessed keys, highest first, estimated from the Puts and Gets sampled by the instances opened with HotKeySampling
+        /// </summary>
+        public KvStatus GetHotKeys(out KvHotKey[] keys)
+        {
+            var buffer = new KvHotKey[KvHotKey.MaxCount];
+            var status = MemoryKVNativeCall.MMFManager_gethotkeys(_manager, buffer, buffer.Length, out int count);
+            Array.Resize(ref buffer, count);
+            keys = buffer;
+            return status;
+        }
+
+        /// <summary>
+        /// the hot keys of a DB this process hasn't opened, NotFound if no process samples its keys
+        /// </summary>
+        public static KvStatus ReadHotKeys(string dbName, out KvHotKey[] keys)
+        {
+            var buffer = new KvHotKey[KvHotKey.MaxCount];
+            var status = MemoryKVNativeCall.MMFManager_readhotkeys(dbName, buffer, buffer.Length, out int count);
+            Array.Resize(ref buffer, count);
+            keys = buffer;
+            return status;
+        }
+
+        /// <summary>
+        /// writes the last milliseconds of the trace ring of a DB as Chrome trace event JSON, NotFound if no process opened it with Tracing
+        /// </summary>
+        public static KvStatus WriteTrace(string dbName, string path, int milliseconds)
+        {
+            return MemoryKVNativeCall.MMFManager_writetrace(dbName, path, milliseconds);
+        }
+
+        /// <summary>
+        /// appends in place, only the fragment crosses into shared memory
+        /// </summary>
+        public KvStatus Append(string key, string fragment)
+        {
+            return MemoryKVNativeCall.MMFManager_append(_manager, key, key.Length, fragment, fragment.Length);
+        }
+
+        public int PutBatch(string[] keys, string[] values, KvStatus[] statuses)
+        {
+            return MemoryKVNativeCall.MMFManager_putbatch(_manager, keys.Length, keys, Lengths(keys), values, Lengths(values), statuses);
+        }
+
+        public int GetBatch(string[] keys, char[] buffer, int[] valueOffsets, int[] valueLengths, KvStatus[] statuses)
+        {
+            return MemoryKVNativeCall.MMFManager_getbatch(_manager, keys.Length, keys, Lengths(keys), buffer, buffer.Length, valueOffsets, valueLengths, statuses);
+        }
+
+        public int RemoveBatch(string[] keys, KvStatus[] statuses)
+        {
+            return MemoryKVNativeCall.MMFManager_removebatch(_manager, keys.Length, keys, Lengths(keys), statuses);
+        }
+
+        private static int[] Lengths(string[] items)
+        {
+            var lengths = new int[items.Length];
+            for (int i = 0; i < items.Length; i++)
+                lengths[i] = items[i].Length;
+            return lengths;
+        }
+
         public void Dispose()
         {
             MemoryKVNativeCall.MMFManager_destroy(_manager);
@@ -21,5 +21,10 @@
         {
             return MemoryKVNativeCall.MemoryKvHost_stopall();
         }
+
+        public static bool Checkpoint(string name, string path)
+        {
+            return MemoryKVNativeCall.MemoryKvHost_checkpoint(name, path);
+        }
     }
 }
\ No newline at end of file
@@ -3,7 +3,33 @@ using System.Runtime.InteropServices;
 
 namespace MemoryKVLib.Net
 {
-    [StructLayout(LayoutKind.Sequential)]
+    public enum KvEvictionMode
+    {
+        None = 0,
+        Clock = 1,
+    }
+
+    public enum KvDurabilityMode
+    {
+        None = 0,
+        Sync = 1,
+        Async = 2,
+        Periodic = 3,
+    }
+
+    public enum KvStorageMode
+    {
+        Memory = 0,
+        File = 1,
+    }
+
+    public enum KvCompressionMode
+    {
+        None = 0,
+        Lz = 1,
+    }
+
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Unicode)]
     public struct ConfigOptions
     {
         public int MaxKeySize;
@@ -11,20 +37,181 @@ namespace MemoryKVLib.Net
         public int MaxBlocksPerMmf;
         public int MaxMmfCount;
         public int LogLevel;
+        public KvEvictionMode EvictionMode;
+        [MarshalAs(UnmanagedType.Bool)]
+        public bool OrderedIndex;
+        public KvDurabilityMode Durability;
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 260)]
+        public string DataDirectory;
+        public KvStorageMode Storage;
+        [MarshalAs(UnmanagedType.Bool)]
+        public bool Tiering;
+        public KvCompressionMode Compression;
+        public int CompressionThreshold;
+        [MarshalAs(UnmanagedType.Bool)]
+        public bool Dedup;
+        public int DedupThreshold;
+        [MarshalAs(UnmanagedType.Bool)]
+        public bool LatencyHistograms;
+        public int HotKeySampling;
+        [MarshalAs(UnmanagedType.Bool)]
+        public bool Tracing;
         
-        public ConfigOptions(int maxKeySize, int maxValueSize, int maxBlocksPerMmf, int maxMmfCount, int logLevel) : this()
+        public ConfigOptions(int maxKeySize, int maxValueSize, int maxBlocksPerMmf, int maxMmfCount, int logLevel,
+            KvEvictionMode evictionMode = KvEvictionMode.None, bool orderedIndex = false,
+            KvDurabilityMode durability = KvDurabilityMode.None, string dataDirectory = "",
+            KvStorageMode storage = KvStorageMode.Memory, bool tiering = false,
+            KvCompressionMode compression = KvCompressionMode.None, int compressionThreshold = 128,
+            bool dedup = false, int dedupThreshold = 32, bool latencyHistograms = false, int hotKeySampling = 0,
+            bool tracing = false) : this()
         {
             MaxKeySize = maxKeySize;
             MaxValueSize = maxValueSize;
             MaxBlocksPerMmf = maxBlocksPerMmf;
             MaxMmfCount = maxMmfCount;
             LogLevel = logLevel;
+            EvictionMode = evictionMode;
+            OrderedIndex = orderedIndex;
+            Durability = durability;
+            DataDirectory = dataDirectory;
+            Storage = storage;
+            Tiering = tiering;
+            Compression = compression;
+            CompressionThreshold = compressionThreshold;
+            Dedup = dedup;
+            DedupThreshold = dedupThreshold;
+            LatencyHistograms = latencyHistograms;
+            HotKeySampling = hotKeySampling;
+            Tracing = tracing;
         }
 
         public static ConfigOptions Default => new ConfigOptions(64, 256,1000, 100, 1);
         
     }
 
+    [StructLayout(LayoutKind.Sequential)]
+    public struct KvSnapshot
+    {
+        public int Slot;
+        public int MmfCount;
+        public long Id;
+        public long Sequence;
+        public long OpenedAt;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct KvMemoryStats
+    {
+        public long SharedBytes;
+        public long DataBytes;
+        public long IndexBytes;
+        public long LiveKeys;
+        public long PayloadBytes;
+        public long PaddingBytes;
+        public long FreeBlockBytes;
+        public long HeadroomBytes;
+    }
+
+    public enum KvStatCounter
+    {
+        Gets = 0,
+        GetHits = 1,
+        GetMisses = 2,
+        Puts = 3,
+        Removes = 4,
+        Scans = 5,
+        Numerics = 6,
+        Merges = 7,
+        Refreshes = 8,
+        BlocksScanned = 9,
+        Expansions = 10,
+        LockAcquisitions = 11,
+        LockContentions = 12,
+        LockWaitTime = 13, // ns
+        LockHoldTime = 14, // ns
+        Count = 15,
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct KvStats
+    {
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = (int)KvStatCounter.Count)]
+        public long[] Counters;
+        public long LiveBlocks;
+        public long RemovedBlocks;
+        public long Processes;
+
+        public long this[KvStatCounter counter] => Counters[(int)counter];
+    }
+
+    public enum KvLatencyOp
+    {
+        Put = 0,
+        Get = 1,
+        Remove = 2,
+        Open = 3,
+        Expand = 4,
+    }
+
+    public enum KvLatencyPhase
+    {
+        LockWait = 0,
+        InLock = 1,
+    }
+
+    /// <summary>
+    /// HDR style histogram in ns, the same layout as LatencyHistogram.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct LatencyHistogram
+    {
+        public const int BucketCount = 640;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = BucketCount)]
+        public long[] Counts;
+        public long TotalCount;
+        public long MaxValue;
+
+        public long ValueAtPercentile(double percentile)
+        {
+            return MemoryKVNativeCall.MMFManager_latencyatpercentile(ref this, percentile);
+        }
+
+        public void Merge(LatencyHistogram other)
+        {
+            MemoryKVNativeCall.MMFManager_mergelatencyhistogram(ref this, ref other);
+        }
+    }
+
+    /// <summary>
+    /// a key of the hot key sketch, the same layout as KvHotKey in StatsPage.h
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Unicode)]
+    public struct KvHotKey
+    {
+        public const int MaxCount = 32;
+
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 64)]
+        public string Key;
+        public long Count;
+    }
+
+    public enum KvStatus
+    {
+        Ok = 0,
+        NotFound = 1,
+        BufferTooSmall = 2,
+        InvalidArgument = 3,
+        KeyTooLarge = 4,
+        ValueTooLarge = 5,
+        OutOfMemory = 6,
+        NotInitialized = 7,
+        Error = 8,
+        TypeMismatch = 9,
+        CompareFailed = 10,
+        SnapshotTooOld = 11
+    }
+
     internal class MemoryKVNativeCall
     {
 
@@ -34,13 +221,21 @@ namespace MemoryKVLib.Net
         [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_open", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         public static extern IntPtr MMFManager_open(IntPtr manager, string dbName, ConfigOptions options);
 
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_openrestore", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_openrestore(IntPtr manager, string dbName, ConfigOptions options, string restoreFrom);
+
 
         [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_destroy", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         public static extern void MMFManager_destroy(IntPtr manager);
 
         [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_put", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
         public static extern bool MMFManager_put(IntPtr manager, string key, string value);
 
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_putttl", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool MMFManager_putttl(IntPtr manager, string key, string value, long ttlMilliseconds);
+
         [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_get", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         //[return: MarshalAs(UnmanagedType.LPStr)]
         public static extern IntPtr MMFManager_get(IntPtr manager, string key);
@@ -48,6 +243,124 @@ namespace MemoryKVLib.Net
         [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_remove", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         public static extern void MMFManager_remove(IntPtr manager, string key);
 
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_tryput", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_tryput(IntPtr manager, string key, int keyLength, string value, int valueLength);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_tryget", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_tryget(IntPtr manager, string key, int keyLength, [Out] char[] buffer, int bufferLength, out int valueLength);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_tryremove", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_tryremove(IntPtr manager, string key, int keyLength);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_putnumber", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_putnumber(IntPtr manager, string key, int keyLength, long value);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getnumber", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_getnumber(IntPtr manager, string key, int keyLength, out long value);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_fetchadd", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_fetchadd(IntPtr manager, string key, int keyLength, long delta, out long oldValue);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_compareandswap", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_compareandswap(IntPtr manager, string key, int keyLength, long expected, long desired, out long actual);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_putdouble", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_putdouble(IntPtr manager, string key, int keyLength, double value);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getdouble", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_getdouble(IntPtr manager, string key, int keyLength, out double value);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_fetchadddouble", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_fetchadddouble(IntPtr manager, string key, int keyLength, double delta, out double oldValue);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_compareandswapdouble", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_compareandswapdouble(IntPtr manager, string key, int keyLength, double expected, double desired, out double actual);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public delegate bool KvScanVisitor(IntPtr key, int keyLength, IntPtr value, int valueLength, IntPtr context);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_scan", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int MMFManager_scan(IntPtr manager, string from, int fromLength, string to, int toLength, int limit, KvScanVisitor visitor, IntPtr context);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_scanprefix", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int MMFManager_scanprefix(IntPtr manager, string prefix, int prefixLength, int limit, KvScanVisitor visitor, IntPtr context);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_opensnapshot", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_opensnapshot(IntPtr manager, out KvSnapshot snapshot);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_iteratesnapshot", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_iteratesnapshot(IntPtr manager, ref KvSnapshot snapshot, KvScanVisitor visitor, IntPtr context, out int visited);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_releasesnapshot", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_releasesnapshot(IntPtr manager, ref KvSnapshot snapshot);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_checkpoint", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_checkpoint(IntPtr manager, string path, out long bytesWritten);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_saveimage", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_saveimage(IntPtr manager, string path, out long bytesWritten);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getlogstats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_getlogstats(IntPtr manager, out long records, out long flushes);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_flush", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_flush(IntPtr manager, [MarshalAs(UnmanagedType.I1)] bool waitForDisk);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_rebalancetiers", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_rebalancetiers(IntPtr manager, out int demoted, out int promoted);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_gettieringstats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_gettieringstats(IntPtr manager, out long demoted, out long promoted, out long storedBytes);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getlockstats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_getlockstats(IntPtr manager, out long acquisitions, out long contended, out long waitMicroseconds);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getvaluepoolstats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_getvaluepoolstats(IntPtr manager, out long values, out long shared, out long storedBytes);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getmemorystats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_getmemorystats(IntPtr manager, out KvMemoryStats stats);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getstats", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_getstats(IntPtr manager, out KvStats stats, [MarshalAs(UnmanagedType.I1)] bool thisProcessOnly);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_readstats", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_readstats(string dbName, out KvStats stats);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getlatencyhistogram", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_getlatencyhistogram(IntPtr manager, KvLatencyOp op, KvLatencyPhase phase, out LatencyHistogram histogram, [MarshalAs(UnmanagedType.I1)] bool thisProcessOnly);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_readlatencyhistogram", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_readlatencyhistogram(string dbName, KvLatencyOp op, KvLatencyPhase phase, out LatencyHistogram histogram);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_mergelatencyhistogram", CallingConvention = CallingConvention.Cdecl)]
+        public static extern void MMFManager_mergelatencyhistogram(ref LatencyHistogram target, ref LatencyHistogram source);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_latencyatpercentile", CallingConvention = CallingConvention.Cdecl)]
+        public static extern long MMFManager_latencyatpercentile(ref LatencyHistogram histogram, double percentile);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_gethotkeys", CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_gethotkeys(IntPtr manager, [Out] KvHotKey[] keys, int capacity, out int count);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_readhotkeys", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_readhotkeys(string dbName, [Out] KvHotKey[] keys, int capacity, out int count);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_writetrace", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_writetrace(string dbName, string path, int milliseconds);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_append", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern KvStatus MMFManager_append(IntPtr manager, string key, int keyLength, string fragment, int fragmentLength);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_putbatch", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int MMFManager_putbatch(IntPtr manager, int count, string[] keys, int[] keyLengths, string[] values, int[] valueLengths, [Out] KvStatus[] statuses);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_getbatch", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int MMFManager_getbatch(IntPtr manager, int count, string[] keys, int[] keyLengths, [Out] char[] buffer, int bufferLength, [Out] int[] valueOffsets, [Out] int[] valueLengths, [Out] KvStatus[] statuses);
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MMFManager_removebatch", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int MMFManager_removebatch(IntPtr manager, int count, string[] keys, int[] keyLengths, [Out] KvStatus[] statuses);
+
         [DllImport("MemoryKVLib.dll", EntryPoint = "MemoryKvHost_startdefault", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         public static extern bool MemoryKvHost_startdefault(string dbName);
 
@@ -59,5 +372,9 @@ namespace MemoryKVLib.Net
 
         [DllImport("MemoryKVLib.dll", EntryPoint = "MemoryKvHost_stopall", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
         public static extern bool MemoryKvHost_stopall();
+
+        [DllImport("MemoryKVLib.dll", EntryPoint = "MemoryKvHost_checkpoint", CharSet = CharSet.Unicode, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        public static extern bool MemoryKvHost_checkpoint(string dbName, string path);
     }
 }
\ No newline at end of file
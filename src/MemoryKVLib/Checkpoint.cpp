@@ -0,0 +1,348 @@
+#include "Checkpoint.h"
+#include <cstring>
+#include "Consts.h"
+
+/**
+ * \brief lookup tables of slicing-by-8, table[k][b] is the CRC of byte b followed by k zero bytes
+ */
+struct Crc32Tables
+{
+    DWORD table[8][256];
+
+    Crc32Tables()
+    {
+        for (DWORD i = 0; i < 256; i++)
+        {
+            DWORD c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[0][i] = c;
+        }
+        for (DWORD i = 0; i < 256; i++)
+            for (int k = 1; k < 8; k++)
+                table[k][i] = table[0][table[k - 1][i] & 0xFF] ^ (table[k - 1][i] >> 8);
+    }
+};
+
+DWORD Crc32(DWORD crc, const void* data, size_t size)
+{
+    static const Crc32Tables tables;
+    const DWORD (*table)[256] = tables.table;
+
+    // 8 bytes per step, so checksumming keeps up with the disk
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; size >= 8; size -= 8, bytes += 8)
+    {
+        DWORD low;
+        DWORD high;
+        memcpy(&low, bytes, sizeof(low));
+        memcpy(&high, bytes + 4, sizeof(high));
+        low ^= crc;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+            ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+    for (; size > 0; size--, bytes++)
+        crc = table[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+CheckpointWriter::CheckpointWriter()
+{
+    hFile = INVALID_HANDLE_VALUE;
+    m_used = 0;
+    m_checksum = 0;
+    m_recordCount = 0;
+    m_bytesWritten = 0;
+    m_failed = false;
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    Abort();
+}
+
+bool CheckpointWriter::Open(const wchar_t* path, const void* header, size_t headerSize)
+{
+    m_path = path;
+    m_tempPath = m_path + L".tmp";
+    hFile = CreateFile(m_tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    m_buffer.resize(CHECKPOINT_BUFFER_SIZE);
+    m_used = 0;
+    m_checksum = 0;
+    m_recordCount = 0;
+    m_bytesWritten = 0;
+    m_failed = false;
+    Write(header, headerSize);
+    return true;
+}
+
+bool CheckpointWriter::Open(const wchar_t* path, const CheckpointFileHeader& header)
+{
+    return Open(path, &header, sizeof(header));
+}
+
+void CheckpointWriter::Write(const void* data, size_t size)
+{
+    m_checksum = Crc32(m_checksum, data, size);
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        size_t chunk = m_buffer.size() - m_used;
+        if (chunk > size)
+            chunk = size;
+        memcpy(m_buffer.data() + m_used, bytes, chunk);
+        m_used += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (m_used == m_buffer.size())
+            FlushBuffer();
+    }
+}
+
+void CheckpointWriter::FlushBuffer()
+{
+    if (m_used == 0 || m_failed)
+    {
+        m_used = 0;
+        return;
+    }
+    DWORD written = 0;
+    if (!WriteFile(hFile, m_buffer.data(), static_cast<DWORD>(m_used), &written, nullptr) || written != m_used)
+        m_failed = true;
+    m_bytesWritten += written;
+    m_used = 0;
+}
+
+void CheckpointWriter::Append(const CheckpointRecordHeader& record, const wchar_t* key, const wchar_t* value)
+{
+    Write(&record, sizeof(record));
+    Write(key, record.KeyLength * sizeof(wchar_t));
+    Write(value, record.ValueLength * sizeof(wchar_t));
+    m_recordCount++;
+}
+
+bool CheckpointWriter::Commit(const void* trailer, size_t trailerSize)
+{
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    Write(trailer, trailerSize);
+    FlushBuffer();
+    if (!m_failed && !FlushFileBuffers(hFile))
+        m_failed = true;
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+
+    if (m_failed || !MoveFileEx(m_tempPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFile(m_tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointWriter::Commit()
+{
+    CheckpointFileTrailer trailer;
+    trailer.RecordCount = m_recordCount;
+    trailer.Checksum = m_checksum;
+    trailer.Magic = CHECKPOINT_MAGIC;
+    return Commit(&trailer, sizeof(trailer));
+}
+
+void CheckpointWriter::Abort()
+{
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+    DeleteFile(m_tempPath.c_str());
+}
+
+DWORD CheckpointWriter::GetChecksum() const
+{
+    return m_checksum;
+}
+
+LONGLONG CheckpointWriter::GetBytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+LONGLONG CheckpointWriter::GetRecordCount() const
+{
+    return m_recordCount;
+}
+
+CheckpointReader::CheckpointReader()
+{
+    hFile = INVALID_HANDLE_VALUE;
+    m_used = 0;
+    m_offset = 0;
+    m_remaining = 0;
+    m_recordCount = 0;
+}
+
+CheckpointReader::~CheckpointReader()
+{
+    Close();
+}
+
+bool CheckpointReader::Open(const wchar_t* path, CheckpointFileHeader& header)
+{
+    hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    m_buffer.resize(CHECKPOINT_BUFFER_SIZE);
+    m_used = 0;
+    m_offset = 0;
+    m_remaining = sizeof(header);
+    return Read(&header, sizeof(header))
+        && header.Magic == CHECKPOINT_MAGIC && header.FormatVersion == CHECKPOINT_FORMAT_VERSION;
+}
+
+bool CheckpointReader::Read(void* data, size_t size)
+{
+    if (static_cast<LONGLONG>(size) > m_remaining)
+        return false;
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        if (m_offset == m_used)
+        {
+            DWORD read = 0;
+            if (!ReadFile(hFile, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), &read, nullptr) || read == 0)
+                return false;
+            m_used = read;
+            m_offset = 0;
+        }
+        size_t chunk = m_used - m_offset;
+        if (chunk > size)
+            chunk = size;
+        memcpy(bytes, m_buffer.data() + m_offset, chunk);
+        m_offset += chunk;
+        bytes += chunk;
+        size -= chunk;
+        m_remaining -= chunk;
+    }
+    return true;
+}
+
+bool CheckpointReader::Verify()
+{
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(CheckpointFileHeader) + sizeof(CheckpointFileTrailer)))
+        return false;
+    LONGLONG bodySize = size.QuadPart - sizeof(CheckpointFileTrailer);
+
+    LARGE_INTEGER position;
+    position.QuadPart = 0;
+    if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN))
+        return false;
+    DWORD checksum = 0;
+    for (LONGLONG left = bodySize; left > 0; )
+    {
+        DWORD chunk = static_cast<DWORD>(left < static_cast<LONGLONG>(m_buffer.size()) ? left : m_buffer.size());
+        DWORD read = 0;
+        if (!ReadFile(hFile, m_buffer.data(), chunk, &read, nullptr) || read != chunk)
+            return false;
+        checksum = Crc32(checksum, m_buffer.data(), read);
+        left -= read;
+    }
+    CheckpointFileTrailer trailer;
+    DWORD read = 0;
+    if (!ReadFile(hFile, &trailer, sizeof(trailer), &read, nullptr) || read != sizeof(trailer)
+        || trailer.Magic != CHECKPOINT_MAGIC || trailer.Checksum != checksum)
+        return false;
+    m_recordCount = trailer.RecordCount;
+
+    // back to the first record
+    position.QuadPart = sizeof(CheckpointFileHeader);
+    if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN))
+        return false;
+    m_used = 0;
+    m_offset = 0;
+    m_remaining = bodySize - sizeof(CheckpointFileHeader);
+    return true;
+}
+
+bool CheckpointReader::Next(CheckpointRecordHeader& record, std::wstring& key, std::wstring& value)
+{
+    if (m_remaining <= 0 || !Read(&record, sizeof(record)) || record.KeyLength < 0 || record.ValueLength < 0)
+        return false;
+    key.resize(record.KeyLength);
+    value.resize(record.ValueLength);
+    return Read(&key[0], record.KeyLength * sizeof(wchar_t))
+        && Read(&value[0], record.ValueLength * sizeof(wchar_t));
+}
+
+LONGLONG CheckpointReader::GetRecordCount() const
+{
+    return m_recordCount;
+}
+
+void CheckpointReader::Close()
+{
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+}
+
+SegmentImageReader::SegmentImageReader()
+{
+    hFile = INVALID_HANDLE_VALUE;
+    m_checksum = 0;
+}
+
+SegmentImageReader::~SegmentImageReader()
+{
+    Close();
+}
+
+bool SegmentImageReader::Open(const wchar_t* path, SegmentImageHeader& header)
+{
+    hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    m_checksum = 0;
+    return Read(&header, sizeof(header))
+        && header.Magic == SEGMENT_IMAGE_MAGIC && header.FormatVersion >= 1 && header.FormatVersion <= SEGMENT_IMAGE_FORMAT_VERSION;
+}
+
+bool SegmentImageReader::Read(void* data, size_t size)
+{
+    // no staging buffer, the file goes straight into the MMF pages
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        DWORD chunk = static_cast<DWORD>(size < CHECKPOINT_BUFFER_SIZE * 64 ? size : CHECKPOINT_BUFFER_SIZE * 64);
+        DWORD read = 0;
+        if (!ReadFile(hFile, bytes, chunk, &read, nullptr) || read != chunk)
+            return false;
+        m_checksum = Crc32(m_checksum, bytes, read);
+        bytes += read;
+        size -= read;
+    }
+    return true;
+}
+
+bool SegmentImageReader::Finish(SegmentImageTrailer& trailer)
+{
+    DWORD checksum = m_checksum;
+    DWORD read = 0;
+    return ReadFile(hFile, &trailer, sizeof(trailer), &read, nullptr) && read == sizeof(trailer)
+        && trailer.Magic == SEGMENT_IMAGE_MAGIC && trailer.Checksum == checksum;
+}
+
+void SegmentImageReader::Close()
+{
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+#define CHECKPOINT_MAGIC 0x504B434D // "MCKP"
+#define CHECKPOINT_FORMAT_VERSION 1
+#define SEGMENT_IMAGE_MAGIC 0x494B564D // "MVKI"
+#define SEGMENT_IMAGE_FORMAT_VERSION 2 // 2 adds the table of pooled values after the blocks
+
+/**
+ * \brief a checkpoint file is this header, one record per live key, and the trailer
+ */
+struct CheckpointFileHeader
+{
+    DWORD Magic;
+    DWORD FormatVersion;
+    LONG MaxKeySize;
+    LONG MaxValueSize;
+    LONGLONG Sequence; // the commit sequence of the snapshot it was written from
+    LONGLONG CreatedAt; // CurrentTimeMs
+};
+
+/**
+ * \brief followed by KeyLength key characters and ValueLength value characters, none NUL-terminated
+ */
+struct CheckpointRecordHeader
+{
+    LONG KeyLength;
+    LONG ValueLength; // 0 for numbers, they are in Numeric
+    LONG ValueType; // KvValueType
+    LONG Reserved;
+    LONGLONG ExpireAt;
+    LONGLONG Numeric;
+};
+
+struct CheckpointFileTrailer
+{
+    LONGLONG RecordCount;
+    DWORD Checksum; // CRC-32 of everything before the trailer
+    DWORD Magic;
+};
+
+/**
+ * \brief a segment image is this header, MmfCount data block MMFs byte for byte, and the trailer.
+ * it can only be restored with the same key, value and MMF sizes
+ */
+struct SegmentImageHeader
+{
+    DWORD Magic;
+    DWORD FormatVersion;
+    LONG MaxKeySize;
+    LONG MaxValueSize;
+    LONG MaxBlocksPerMmf;
+    LONG DataBlockSize;
+    LONG MmfCount;
+    LONG Reserved;
+    LONGLONG Sequence;
+    LONGLONG CreatedAt;
+};
+
+struct SegmentImageTrailer
+{
+    LONG HighestGlobalDbPosition; // the global HKP to restore, -1 for no key
+    DWORD Checksum; // CRC-32 of the header and the MMF contents
+    DWORD Magic;
+    DWORD Reserved;
+};
+
+/**
+ * \brief CRC-32 (IEEE), continued from crc over size more bytes
+ */
+DWORD Crc32(DWORD crc, const void* data, size_t size);
+
+/**
+ * \brief streams a checkpoint into path.tmp through a fixed buffer and renames it to path on Commit, so a failed or
+ * interrupted checkpoint never replaces the previous one
+ */
+class CheckpointWriter
+{
+private:
+    std::wstring m_path;
+    std::wstring m_tempPath;
+    HANDLE hFile;
+    std::vector<char> m_buffer;
+    size_t m_used;
+    DWORD m_checksum;
+    LONGLONG m_recordCount;
+    LONGLONG m_bytesWritten;
+    bool m_failed;
+
+private:
+    void FlushBuffer();
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+    /**
+     * \brief starts the file with header, the checksum covers everything from here to the trailer
+     */
+    bool Open(const wchar_t* path, const void* header, size_t headerSize);
+    bool Open(const wchar_t* path, const CheckpointFileHeader& header);
+    void Write(const void* data, size_t size);
+    void Append(const CheckpointRecordHeader& record, const wchar_t* key, const wchar_t* value);
+    /**
+     * \brief ends the file with trailer and renames it to path
+     * \return false on any write error, the previous file at path is kept then
+     */
+    bool Commit(const void* trailer, size_t trailerSize);
+    bool Commit();
+    void Abort();
+    DWORD GetChecksum() const;
+    LONGLONG GetBytesWritten() const;
+    LONGLONG GetRecordCount() const;
+};
+
+/**
+ * \brief reads a checkpoint sequentially, call Verify first to check it's complete and intact
+ */
+class CheckpointReader
+{
+private:
+    HANDLE hFile;
+    std::vector<char> m_buffer;
+    size_t m_used;
+    size_t m_offset;
+    LONGLONG m_remaining; // record bytes not consumed yet
+    LONGLONG m_recordCount;
+
+private:
+    bool Read(void* data, size_t size);
+public:
+    CheckpointReader();
+    ~CheckpointReader();
+    bool Open(const wchar_t* path, CheckpointFileHeader& header);
+    /**
+     * \brief checks the trailer and the checksum of the whole file, then rewinds to the first record
+     */
+    bool Verify();
+    /**
+     * \return false at the end of the records
+     */
+    bool Next(CheckpointRecordHeader& record, std::wstring& key, std::wstring& value);
+    LONGLONG GetRecordCount() const;
+    void Close();
+};
+
+/**
+ * \brief reads a segment image straight into the mapped MMFs, the checksum is checked on the way
+ */
+class SegmentImageReader
+{
+private:
+    HANDLE hFile;
+    DWORD m_checksum;
+
+public:
+    SegmentImageReader();
+    ~SegmentImageReader();
+    bool Open(const wchar_t* path, SegmentImageHeader& header);
+    /**
+     * \brief fill one MMF from the image
+     */
+    bool Read(void* data, size_t size);
+    /**
+     * \return false if the trailer is missing or the checksum doesn't match what has been read
+     */
+    bool Finish(SegmentImageTrailer& trailer);
+    void Close();
+};
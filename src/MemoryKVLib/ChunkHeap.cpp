@@ -0,0 +1,197 @@
+#include "ChunkHeap.h"
+#include <cstring>
+#include <sstream>
+#include "SegmentFile.h"
+
+ChunkHeap::ChunkHeap(const wchar_t* segmentName, const wchar_t* fileName, DWORD segmentSize, int maxSegmentCount,
+    int minChunk, int chunkClasses)
+    : hMapFiles(maxSegmentCount, nullptr)
+    , hSegmentFiles(maxSegmentCount, INVALID_HANDLE_VALUE)
+    , pMapViews(maxSegmentCount, nullptr)
+    , m_segmentName(segmentName)
+    , m_fileName(fileName)
+{
+    pHeader = nullptr;
+    InitializeSRWLock(&m_mapLock);
+    m_segmentSize = segmentSize;
+    m_minChunk = minChunk;
+    m_chunkClasses = chunkClasses < MAX_CHUNK_CLASSES ? chunkClasses : MAX_CHUNK_CLASSES;
+    m_persistent = false;
+    m_readOnly = false;
+}
+
+void ChunkHeap::Setup(ChunkHeapHeader* header, const std::wstring& dbName, const wchar_t* directory, bool persistent)
+{
+    pHeader = header;
+    m_dbName = dbName;
+    m_directory = directory;
+    m_persistent = persistent;
+    m_readOnly = false;
+}
+
+void ChunkHeap::OpenReadOnly(ChunkHeapHeader* header, const std::wstring& dbName)
+{
+    pHeader = header;
+    m_dbName = dbName;
+    m_persistent = false;
+    m_readOnly = true;
+}
+
+void ChunkHeap::TearDown()
+{
+    for (size_t i = 0; i < pMapViews.size(); i++)
+    {
+        if (pMapViews[i] != nullptr)
+            UnmapViewOfFile(pMapViews[i]);
+        if (hMapFiles[i] != nullptr)
+            CloseHandle(hMapFiles[i]);
+        if (hSegmentFiles[i] != INVALID_HANDLE_VALUE)
+            CloseHandle(hSegmentFiles[i]);
+        pMapViews[i] = nullptr;
+        hMapFiles[i] = nullptr;
+        hSegmentFiles[i] = INVALID_HANDLE_VALUE;
+    }
+    pHeader = nullptr;
+}
+
+int ChunkHeap::ChunkClassOf(LONGLONG bytes) const
+{
+    int chunkClass = 0;
+    while (chunkClass < m_chunkClasses && ChunkSizeOf(chunkClass) < bytes)
+        chunkClass++;
+    return chunkClass < m_chunkClasses && ChunkSizeOf(chunkClass) <= m_segmentSize ? chunkClass : -1;
+}
+
+LONGLONG ChunkHeap::ChunkSizeOf(int chunkClass) const
+{
+    return static_cast<LONGLONG>(m_minChunk) << chunkClass;
+}
+
+bool ChunkHeap::Contains(LONGLONG chunk, LONGLONG bytes) const
+{
+    return pHeader != nullptr && chunk >= 0 && (chunk >> 32) < pHeader->SegmentCount && bytes >= 0
+        && (chunk & 0xFFFFFFFF) + bytes <= m_segmentSize;
+}
+
+/**
+ * \param create a segment past SegmentCount, its file is started empty
+ * \return nullptr if the segment can't be mapped, e.g. its file is gone
+ */
+LPVOID ChunkHeap::MapSegment(int index, bool create)
+{
+    AcquireSRWLockShared(&m_mapLock);
+    LPVOID pMapView = pMapViews[index];
+    ReleaseSRWLockShared(&m_mapLock);
+    if (pMapView != nullptr)
+        return pMapView;
+
+    AcquireSRWLockExclusive(&m_mapLock);
+    if (pMapViews[index] == nullptr)
+    {
+        std::wstringstream name;
+        name << L"Global\\MMF" << m_segmentName << L"_" << m_dbName << L"_" << index;
+        std::wstringstream path;
+        path << m_directory << L"\\" << m_dbName << L"_" << m_fileName << L"_" << index << L".seg";
+        HANDLE hFile = INVALID_HANDLE_VALUE;
+        bool existed = true;
+        LONGLONG previousSize = 0;
+        HANDLE hMapFile = m_readOnly ? OpenFileMapping(FILE_MAP_READ, FALSE, name.str().c_str())
+            : CreateSegmentMapping(name.str().c_str(), m_segmentSize, m_persistent ? path.str().c_str() : nullptr,
+                create, hFile, existed, previousSize);
+        if (hMapFile != nullptr && m_persistent && !create && !existed && previousSize != m_segmentSize)
+        {
+            CloseHandle(hMapFile); // a stored value points into it, an empty file would only give wrong values
+            CloseHandle(hFile);
+            hMapFile = nullptr;
+        }
+        if (hMapFile != nullptr)
+        {
+            pMapView = MapViewOfFile(hMapFile, m_readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, m_segmentSize);
+            if (pMapView == nullptr)
+            {
+                CloseHandle(hMapFile);
+                if (hFile != INVALID_HANDLE_VALUE)
+                    CloseHandle(hFile);
+            }
+            else
+            {
+                hMapFiles[index] = hMapFile;
+                hSegmentFiles[index] = hFile;
+                pMapViews[index] = pMapView;
+            }
+        }
+    }
+    pMapView = pMapViews[index];
+    ReleaseSRWLockExclusive(&m_mapLock);
+    return pMapView;
+}
+
+char* ChunkHeap::ChunkAt(LONGLONG chunk)
+{
+    LONGLONG index = chunk >> 32;
+    LONGLONG offset = chunk & 0xFFFFFFFF;
+    if (pHeader == nullptr || chunk < 0 || index >= pHeader->SegmentCount || offset >= m_segmentSize)
+        return nullptr;
+    LPVOID pMapView = MapSegment(static_cast<int>(index), false);
+    return pMapView == nullptr ? nullptr : static_cast<char*>(pMapView) + offset;
+}
+
+LONGLONG ChunkHeap::Allocate(int chunkClass)
+{
+    LONGLONG size = ChunkSizeOf(chunkClass);
+    LONGLONG head = pHeader->FreeChunks[chunkClass];
+    if (head != 0)
+    {
+        char* pChunk = ChunkAt(head - 1);
+        if (pChunk == nullptr)
+            return -1;
+        memcpy(&pHeader->FreeChunks[chunkClass], pChunk + size - sizeof(LONGLONG), sizeof(LONGLONG));
+        return head - 1;
+    }
+
+    if (pHeader->SegmentCount == 0 || pHeader->AppendOffset + size > m_segmentSize)
+    {
+        // the tail of the last segment is left unused, every chunk is in one segment
+        if (pHeader->SegmentCount >= static_cast<LONG>(pMapViews.size())
+            || MapSegment(pHeader->SegmentCount, true) == nullptr)
+            return -1;
+        pHeader->AppendOffset = 0;
+        pHeader->SegmentCount++;
+    }
+    LONGLONG chunk = (static_cast<LONGLONG>(pHeader->SegmentCount - 1) << 32) | pHeader->AppendOffset;
+    pHeader->AppendOffset += size;
+    return chunk;
+}
+
+void ChunkHeap::Free(LONGLONG chunk, int chunkClass)
+{
+    char* pChunk = ChunkAt(chunk);
+    if (pChunk == nullptr)
+        return; // lost with its segment
+    memcpy(pChunk + ChunkSizeOf(chunkClass) - sizeof(LONGLONG), &pHeader->FreeChunks[chunkClass], sizeof(LONGLONG));
+    pHeader->FreeChunks[chunkClass] = chunk + 1;
+}
+
+bool ChunkHeap::Flush(bool waitForDisk)
+{
+    bool flushed = true;
+    AcquireSRWLockShared(&m_mapLock);
+    for (size_t i = 0; i < pMapViews.size(); i++)
+    {
+        if (pMapViews[i] != nullptr && hSegmentFiles[i] != INVALID_HANDLE_VALUE)
+            flushed = FlushSegment(pMapViews[i], waitForDisk ? hSegmentFiles[i] : INVALID_HANDLE_VALUE) && flushed;
+    }
+    ReleaseSRWLockShared(&m_mapLock);
+    return flushed;
+}
+
+LONGLONG ChunkHeap::GetMappedBytes() const
+{
+    LONGLONG bytes = 0;
+    for (auto pMapView : pMapViews) // a view is only set once until TearDown, no need for m_mapLock to count them
+    {
+        if (pMapView != nullptr)
+            bytes += m_segmentSize;
+    }
+    return bytes;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "Consts.h"
+
+/**
+ * \brief the shared part of a ChunkHeap, in the header MMF of the store that owns it
+ */
+struct ChunkHeapHeader
+{
+    LONG SegmentCount; // segments created so far
+    LONG Reserved;
+    LONGLONG AppendOffset; // bytes used in the last segment
+    LONGLONG FreeChunks[MAX_CHUNK_CLASSES]; // chunk + 1 of the first free chunk of each size class, 0 for none
+};
+
+/**
+ * \brief power of two chunks of a minimum size and more, carved from segments shared by all the instances of a DB
+ * and put on a free list per size once freed. a chunk is (segment << 32 | offset), the link of a free chunk goes in
+ * its last 8 bytes. a segment is never unmapped, so a lock-free reader may read a chunk that has been reused since:
+ * it checks the block version afterwards, as it does for the value section. Allocate and Free are under the DB mutex
+ */
+class ChunkHeap
+{
+private:
+    ChunkHeapHeader* pHeader;
+    std::vector<HANDLE> hMapFiles;
+    std::vector<HANDLE> hSegmentFiles;
+    std::vector<LPVOID> pMapViews;
+    SRWLOCK m_mapLock; // guards the arrays above
+    std::wstring m_segmentName; // Global\MMF<segmentName>_<dbName>_<i>
+    std::wstring m_fileName; // <directory>\<dbName>_<fileName>_<i>.seg
+    std::wstring m_dbName;
+    std::wstring m_directory;
+    DWORD m_segmentSize;
+    int m_minChunk;
+    int m_chunkClasses;
+    bool m_persistent;
+    bool m_readOnly;
+
+private:
+    LPVOID MapSegment(int index, bool create);
+public:
+    ChunkHeap(const wchar_t* segmentName, const wchar_t* fileName, DWORD segmentSize, int maxSegmentCount,
+        int minChunk, int chunkClasses);
+    /**
+     * \param persistent back the segments by files, else by the page file
+     */
+    void Setup(ChunkHeapHeader* header, const std::wstring& dbName, const wchar_t* directory, bool persistent);
+    /**
+     * \brief map the segments the processes of the DB have open with FILE_MAP_READ, for ChunkAt only
+     */
+    void OpenReadOnly(ChunkHeapHeader* header, const std::wstring& dbName);
+    void TearDown();
+    /**
+     * \return the smallest class whose chunk holds bytes, -1 if none does
+     */
+    int ChunkClassOf(LONGLONG bytes) const;
+    LONGLONG ChunkSizeOf(int chunkClass) const;
+    /**
+     * \return whether bytes from the chunk stay in a segment created so far, for the chunks of a torn read
+     */
+    bool Contains(LONGLONG chunk, LONGLONG bytes) const;
+    /**
+     * \return nullptr if the chunk is out of the segments or its segment can't be mapped
+     */
+    char* ChunkAt(LONGLONG chunk);
+    /**
+     * \return the chunk, from the free list of its class or carved from the last segment, -1 if the heap is full
+     */
+    LONGLONG Allocate(int chunkClass);
+    void Free(LONGLONG chunk, int chunkClass);
+    bool Flush(bool waitForDisk);
+    /**
+     * \brief the segments this process has mapped
+     */
+    LONGLONG GetMappedBytes() const;
+};
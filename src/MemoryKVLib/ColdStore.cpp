@@ -0,0 +1,209 @@
+#include "ColdStore.h"
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include "SegmentFile.h"
+
+/**
+ * \return the bytes of a chunk that holds the value, its NUL and the link of a free chunk
+ */
+static LONGLONG ChunkBytesOf(int length)
+{
+    return (static_cast<LONGLONG>(length) + 1) * sizeof(wchar_t) + sizeof(LONGLONG);
+}
+
+ColdStore::ColdStore()
+    : m_chunks(L"ColdSegment", L"cold", COLD_SEGMENT_SIZE, MAX_COLD_SEGMENT_COUNT, COLD_MIN_CHUNK, COLD_CHUNK_CLASSES)
+{
+    pHeader = nullptr;
+    hHeaderMapFile = nullptr;
+    hHeaderFile = INVALID_HANDLE_VALUE;
+    pHeaderMapView = nullptr;
+}
+
+void ColdStore::Setup(std::wstring& dbName, const wchar_t* directory, bool persistent)
+{
+    CreateDirectory(directory, nullptr); // fails if it exists already, opening the files tells
+
+    std::wstringstream wss;
+    wss << L"Global\\MMFColdStore_" << dbName;
+    std::wstring path = std::wstring(directory) + L"\\" + dbName + L"_cold.hdr";
+
+    // a new mapping is zero-filled, which is an empty store. segments past SegmentCount are truncated when created
+    bool existed;
+    LONGLONG previousSize;
+    hHeaderMapFile = CreateSegmentMapping(wss.str().c_str(), sizeof(ColdStoreHeader), persistent ? path.c_str() : nullptr,
+        false, hHeaderFile, existed, previousSize);
+    if (hHeaderMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pHeaderMapView = MapViewOfFile(
+        hHeaderMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        sizeof(ColdStoreHeader));
+    if (pHeaderMapView == nullptr) {
+        TearDown();
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    pHeader = static_cast<ColdStoreHeader*>(pHeaderMapView);
+    m_chunks.Setup(&pHeader->Chunks, dbName, directory, persistent);
+}
+
+bool ColdStore::OpenReadOnly(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFColdStore_" << dbName;
+    hHeaderMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, wss.str().c_str());
+    if (hHeaderMapFile == nullptr)
+        return false;
+    pHeaderMapView = MapViewOfFile(hHeaderMapFile, FILE_MAP_READ, 0, 0, sizeof(ColdStoreHeader));
+    if (pHeaderMapView == nullptr)
+    {
+        TearDown();
+        return false;
+    }
+    pHeader = static_cast<ColdStoreHeader*>(pHeaderMapView);
+    m_chunks.OpenReadOnly(&pHeader->Chunks, dbName);
+    return true;
+}
+
+void ColdStore::TearDown()
+{
+    m_chunks.TearDown();
+    if (pHeaderMapView != nullptr)
+        UnmapViewOfFile(pHeaderMapView);
+    if (hHeaderMapFile != nullptr)
+        CloseHandle(hHeaderMapFile);
+    if (hHeaderFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hHeaderFile);
+    pHeaderMapView = nullptr;
+    hHeaderMapFile = nullptr;
+    hHeaderFile = INVALID_HANDLE_VALUE;
+    pHeader = nullptr;
+}
+
+bool ColdStore::IsEnabled() const
+{
+    return pHeader != nullptr;
+}
+
+/**
+ * \brief the class of a chunk that is or was stored, found from the value it still holds
+ * \return -1 if its segment can't be mapped
+ */
+int ColdStore::ChunkClassAt(LONGLONG chunk, char*& pChunk)
+{
+    pChunk = m_chunks.ChunkAt(chunk);
+    if (pChunk == nullptr)
+        return -1;
+    size_t maxLength = static_cast<size_t>(COLD_SEGMENT_SIZE - (chunk & 0xFFFFFFFF)) / sizeof(wchar_t);
+    return m_chunks.ChunkClassOf(ChunkBytesOf(static_cast<int>(wcsnlen(reinterpret_cast<const wchar_t*>(pChunk), maxLength))));
+}
+
+void ColdStore::Free(LONGLONG chunk)
+{
+    char* pChunk;
+    int chunkClass = ChunkClassAt(chunk, pChunk);
+    if (chunkClass < 0)
+        return; // lost with its segment
+    m_chunks.Free(chunk, chunkClass);
+    pHeader->StoredBytes -= m_chunks.ChunkSizeOf(chunkClass);
+}
+
+LONGLONG ColdStore::Store(const wchar_t* value, int length)
+{
+    int chunkClass = m_chunks.ChunkClassOf(ChunkBytesOf(length));
+    LONGLONG chunk = chunkClass < 0 ? -1 : m_chunks.Allocate(chunkClass);
+    wchar_t* target = chunk < 0 ? nullptr : reinterpret_cast<wchar_t*>(m_chunks.ChunkAt(chunk));
+    if (target == nullptr)
+        return -1;
+    wmemcpy(target, value, length);
+    target[length] = L'\0';
+    pHeader->StoredBytes += m_chunks.ChunkSizeOf(chunkClass);
+    InterlockedIncrement64(&pHeader->Demoted);
+    return chunk;
+}
+
+void ColdStore::Release(LONGLONG pointer, bool reclaim)
+{
+    if (pHeader == nullptr)
+        return;
+    if (reclaim)
+    {
+        Free(pointer);
+        return;
+    }
+    char* pChunk;
+    int chunkClass = ChunkClassAt(pointer, pChunk);
+    if (chunkClass < 0)
+        return;
+    // linked like a free chunk, where the free link goes later
+    memcpy(pChunk + m_chunks.ChunkSizeOf(chunkClass) - sizeof(LONGLONG), &pHeader->RetiredChunks, sizeof(LONGLONG));
+    pHeader->RetiredChunks = pointer + 1;
+}
+
+int ColdStore::Reclaim()
+{
+    if (pHeader == nullptr)
+        return 0;
+    int freed = 0;
+    while (pHeader->RetiredChunks != 0)
+    {
+        LONGLONG chunk = pHeader->RetiredChunks - 1;
+        char* pChunk;
+        int chunkClass = ChunkClassAt(chunk, pChunk);
+        if (chunkClass < 0)
+        {
+            pHeader->RetiredChunks = 0; // the rest is lost with the segment
+            break;
+        }
+        memcpy(&pHeader->RetiredChunks, pChunk + m_chunks.ChunkSizeOf(chunkClass) - sizeof(LONGLONG), sizeof(LONGLONG));
+        Free(chunk);
+        freed++;
+    }
+    return freed;
+}
+
+const wchar_t* ColdStore::Resolve(LONGLONG pointer, int length)
+{
+    // a torn read of the block may give any pointer and length, don't create files for it
+    if (pHeader == nullptr || length < 0 || !m_chunks.Contains(pointer, (static_cast<LONGLONG>(length) + 1) * sizeof(wchar_t)))
+        return nullptr;
+    const wchar_t* value = reinterpret_cast<const wchar_t*>(m_chunks.ChunkAt(pointer));
+    return value != nullptr && value[length] == L'\0' ? value : nullptr;
+}
+
+void ColdStore::CountPromotion()
+{
+    InterlockedIncrement64(&pHeader->Promoted);
+}
+
+bool ColdStore::Flush(bool waitForDisk)
+{
+    bool flushed = hHeaderFile == INVALID_HANDLE_VALUE
+        || FlushSegment(pHeaderMapView, waitForDisk ? hHeaderFile : INVALID_HANDLE_VALUE);
+    return m_chunks.Flush(waitForDisk) && flushed;
+}
+
+LONGLONG ColdStore::GetDemotedCount() const
+{
+    return pHeader == nullptr ? 0 : InterlockedCompareExchange64(&pHeader->Demoted, 0, 0);
+}
+
+LONGLONG ColdStore::GetPromotedCount() const
+{
+    return pHeader == nullptr ? 0 : InterlockedCompareExchange64(&pHeader->Promoted, 0, 0);
+}
+
+LONGLONG ColdStore::GetStoredBytes() const
+{
+    return pHeader == nullptr ? 0 : pHeader->StoredBytes;
+}
+
+LONGLONG ColdStore::GetMappedBytes() const
+{
+    return pHeaderMapView == nullptr ? 0 : sizeof(ColdStoreHeader) + m_chunks.GetMappedBytes();
+}
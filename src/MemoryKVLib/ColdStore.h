@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <Windows.h>
+#include "ChunkHeap.h"
+#include "Consts.h"
+
+/**
+ * \brief shared by all the processes of a DB, at the start of the cold store header MMF
+ */
+struct ColdStoreHeader
+{
+    ChunkHeapHeader Chunks;
+    LONGLONG RetiredChunks; // chunk + 1 of the first chunk released while a snapshot was open, 0 for none
+    LONGLONG StoredBytes; // in the chunks of the stored and retired values
+    volatile LONGLONG Demoted;
+    volatile LONGLONG Promoted;
+};
+
+/**
+ * \brief the cold tier of a DB: values moved out of their blocks are kept, NUL-terminated, in the chunks of file
+ * backed segments <directory>\<dbName>_cold_<i>.seg shared by all the instances. a chunk is freed once its block
+ * doesn't point at it anymore; its class is told by the value it holds, so a chunk leaves room for the free link
+ * after the NUL. Store, Release and Reclaim are under the DB mutex, Resolve is lock-free
+ */
+class ColdStore
+{
+private:
+    ColdStoreHeader* pHeader;
+    HANDLE hHeaderMapFile;
+    HANDLE hHeaderFile;
+    LPVOID pHeaderMapView;
+    ChunkHeap m_chunks;
+
+private:
+    int ChunkClassAt(LONGLONG chunk, char*& pChunk);
+    void Free(LONGLONG chunk);
+public:
+    ColdStore();
+    /**
+     * \param persistent keep the header in a file as well, the DB segments are files (KvStorageFile) and may point here
+     */
+    void Setup(std::wstring& dbName, const wchar_t* directory, bool persistent);
+    /**
+     * \brief map the header and the segments of a DB another process has open, read-only, for Resolve only
+     * \return false if no process has them open
+     */
+    bool OpenReadOnly(const std::wstring& dbName);
+    void TearDown();
+    bool IsEnabled() const;
+    /**
+     * \brief under the DB mutex
+     * \return the pointer to keep in the block, -1 if there's no free chunk and all MAX_COLD_SEGMENT_COUNT segments
+     * are full
+     */
+    LONGLONG Store(const wchar_t* value, int length);
+    /**
+     * \brief under the DB mutex, the block doesn't point at the value anymore
+     * \param reclaim free the chunk now, false while a snapshot may still read it: it's retired then
+     */
+    void Release(LONGLONG pointer, bool reclaim);
+    /**
+     * \brief free the retired chunks, once no snapshot is open
+     * \return the number of chunks freed
+     */
+    int Reclaim();
+    /**
+     * \return the value, nullptr if the chunk doesn't hold length characters (a torn read) or can't be mapped
+     */
+    const wchar_t* Resolve(LONGLONG pointer, int length);
+    void CountPromotion();
+    bool Flush(bool waitForDisk);
+    LONGLONG GetDemotedCount() const;
+    LONGLONG GetPromotedCount() const;
+    LONGLONG GetStoredBytes() const;
+    /**
+     * \brief the header and the segments this process has mapped
+     */
+    LONGLONG GetMappedBytes() const;
+};
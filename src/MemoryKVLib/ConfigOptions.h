@@ -1,5 +1,46 @@
 #pragma once
 
+#include "Consts.h"
+
+/**
+ * \brief what Put does once all MaxMmfCount MMFs are full
+ */
+enum KvEvictionMode : int
+{
+    KvEvictionNone = 0, // Put fails
+    KvEvictionClock = 1, // Put evicts a key not read recently, picked by the CLOCK approximation of LRU
+};
+
+/**
+ * \brief when a Put is on disk, see MemoryKV::Open. the log is <DataDirectory>\<dbName>.wal
+ */
+enum KvDurabilityMode : int
+{
+    KvDurabilityNone = 0, // memory only
+    KvDurabilitySync = 1, // Put returns once its record is flushed, concurrent Puts share one flush
+    KvDurabilityAsync = 2, // a background thread flushes right after the Puts, a crash loses the last few
+    KvDurabilityPeriodic = 3, // the background thread flushes every WAL_FLUSH_INTERVAL ms
+};
+
+/**
+ * \brief where the header and data MMFs are backed, see MemoryKV::Flush
+ */
+enum KvStorageMode : int
+{
+    KvStorageMemory = 0, // the page file, the DB is gone once no process has it open
+    KvStorageFile = 1, // <DataDirectory>\<dbName>.hdr and <dbName>_<i>.seg, reopening maps them back without a reload
+};
+
+/**
+ * \brief how Put stores a string value of CompressionThreshold characters or more, a value is kept compressed only
+ * if that makes it smaller. every instance reads compressed values whatever its own mode
+ */
+enum KvCompressionMode : int
+{
+    KvCompressionNone = 0,
+    KvCompressionLz = 1, // LzCodec, the values may then be up to MAX_COMPRESSED_VALUE_LENGTH long if they compress into MaxValueSize
+};
+
 struct __declspec(dllexport) ConfigOptions
 {
     int MaxKeySize;
@@ -7,6 +48,19 @@ struct __declspec(dllexport) ConfigOptions
     int MaxBlocksPerMmf;
     int MaxMmfCount;
     int LogLevel;
+    int EvictionMode; // KvEvictionMode
+    int OrderedIndex; // non-zero keeps the keys of this instance sorted as well, for Scan
+    int Durability; // KvDurabilityMode, all the instances of a DB must use the same
+    wchar_t DataDirectory[MAX_DATA_DIRECTORY_LENGTH]; // where the log and segment files are, required with Durability, KvStorageFile or Tiering
+    int Storage; // KvStorageMode, all the instances of a DB must use the same
+    int Tiering; // non-zero lets RebalanceTiers move the values not read recently to <DataDirectory>\<dbName>_cold_<i>.seg
+    int Compression; // KvCompressionMode
+    int CompressionThreshold; // characters, COMPRESSION_THRESHOLD by default
+    int Dedup; // non-zero stores the string values of DedupThreshold characters or more once in the shared ValuePool, the same for all the instances of a DB
+    int DedupThreshold; // characters, DEDUP_THRESHOLD by default
+    int LatencyHistograms; // non-zero records the latency of Put, Get, Remove, Open and the MMF expansions of this instance, see MemoryKV::GetLatencyHistogram
+    int HotKeySampling; // N > 0 feeds every Nth Put and Get of a thread into the shared hot key sketch, see MemoryKV::GetHotKeys
+    int Tracing; // non-zero records the entry and exit of the mutex wait and hold, the refreshes, syncs, expansions and log writes of this instance in the shared trace ring, see MemoryKV::WriteTrace
     ConfigOptions();
     bool Validate() const;
 };
@@ -5,3 +5,41 @@
 #define MAX_BLOCKS_PER_MMF 1000
 #define MAX_MMF_COUNT 100
 #define MAX_MMF_NAME_LENGTH 64
+#define MAX_SYNC_WORKER_COUNT 16
+#define EXPIRY_QUEUE_SIZE 16384
+#define MAX_EXPIRY_SPILL_COUNT 64
+#define EXPIRY_SCAN_BATCH_SIZE 4096
+#define EXPIRY_TICK_INTERVAL 100
+#define REUSE_LOG_SIZE 4096
+#define MAX_PIN_WAIT_SPINS 1000
+#define MAX_PIN_WAIT_MS 1000
+#define SCAN_BATCH_SIZE 64
+#define MAX_SNAPSHOT_COUNT 16
+#define VERSION_STORE_SIZE 4096
+#define CHECKPOINT_BUFFER_SIZE (1024 * 1024)
+#define MAX_DATA_DIRECTORY_LENGTH 260
+#define WAL_FLUSH_INTERVAL 100
+#define WAL_MAX_RECORD_SIZE (1024 * 1024)
+#define COLD_SEGMENT_SIZE (16 * 1024 * 1024)
+#define MAX_COLD_SEGMENT_COUNT 256
+#define COLD_MIN_VALUE_LENGTH 32
+#define COLD_MIN_CHUNK 128
+#define COLD_CHUNK_CLASSES 18
+#define TIERING_BATCH_SIZE 4096
+#define COMPRESSION_THRESHOLD 128
+#define MAX_COMPRESSED_VALUE_LENGTH 65536
+#define DEDUP_THRESHOLD 32
+#define MAX_POOLED_VALUE_LENGTH MAX_COMPRESSED_VALUE_LENGTH
+#define VALUE_POOL_INDEX_SIZE 65536
+#define VALUE_POOL_SEGMENT_SIZE (4 * 1024 * 1024)
+#define MAX_VALUE_POOL_SEGMENT_COUNT 256
+#define VALUE_POOL_MIN_CHUNK 64
+#define VALUE_POOL_CHUNK_CLASSES 12
+#define MAX_CHUNK_CLASSES 18 // of COLD_CHUNK_CLASSES and VALUE_POOL_CHUNK_CLASSES
+#define MAX_STATS_SLOTS 64
+#define HOT_KEY_COUNT 32
+#define HOT_KEY_LENGTH 64
+#define HOT_KEY_SKETCH_DEPTH 4
+#define HOT_KEY_SKETCH_WIDTH 4096
+#define HOT_KEY_DECAY_SAMPLES (1 << 20)
+#define TRACE_RING_SIZE (1 << 16)
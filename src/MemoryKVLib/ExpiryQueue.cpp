@@ -0,0 +1,182 @@
+#include "ExpiryQueue.h"
+#include <sstream>
+#include <stdexcept>
+#include "Consts.h"
+
+static const int QueueSize = sizeof(LONGLONG) * 2 + EXPIRY_QUEUE_SIZE * sizeof(ExpiryEntry);
+static const int SpillSize = EXPIRY_QUEUE_SIZE * sizeof(ExpiryEntry);
+
+void ExpiryQueue::Pin(LPVOID pMapView)
+{
+    if (pMapView != nullptr)
+    {
+        pHead = static_cast<DWORD*>(pMapView);
+        pTail = pHead + 1;
+        pOverflowed = reinterpret_cast<LONG*>(pHead + 2);
+        pSpillCount = pOverflowed + 1;
+        pEntries = reinterpret_cast<ExpiryEntry*>(static_cast<char*>(pMapView) + sizeof(LONGLONG) * 2);
+    }
+}
+
+ExpiryQueue::ExpiryQueue()
+{
+    pHead = nullptr;
+    pTail = nullptr;
+    pOverflowed = nullptr;
+    pSpillCount = nullptr;
+    pEntries = nullptr;
+    hQueueMapFile = nullptr;
+    pQueueMapView = nullptr;
+    for (int i = 0; i < MAX_EXPIRY_SPILL_COUNT; i++)
+    {
+        hSpillMapFiles[i] = nullptr;
+        pSpills[i] = nullptr;
+    }
+}
+
+void ExpiryQueue::Setup(std::wstring& dbName)
+{
+    m_dbName = dbName;
+    std::wstringstream wss;
+    wss << L"Global\\MMFExpiryQueue_" << dbName;
+    int queueSize = QueueSize;
+
+    // a new mapping is zero-filled, which is an empty queue
+    hQueueMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        queueSize,
+        wss.str().c_str());
+    if (hQueueMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pQueueMapView = MapViewOfFile(
+        hQueueMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        queueSize);
+    if (pQueueMapView == nullptr) {
+        CloseHandle(hQueueMapFile);
+        hQueueMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    Pin(pQueueMapView);
+}
+
+void ExpiryQueue::TearDown()
+{
+    for (int i = 0; i < MAX_EXPIRY_SPILL_COUNT; i++)
+    {
+        if (pSpills[i] != nullptr)
+            UnmapViewOfFile(pSpills[i]);
+        if (hSpillMapFiles[i] != nullptr)
+            CloseHandle(hSpillMapFiles[i]);
+        hSpillMapFiles[i] = nullptr;
+        pSpills[i] = nullptr;
+    }
+    if (pQueueMapView != nullptr)
+        UnmapViewOfFile(pQueueMapView);
+    if (hQueueMapFile != nullptr)
+        CloseHandle(hQueueMapFile);
+    pQueueMapView = nullptr;
+    hQueueMapFile = nullptr;
+    pHead = nullptr;
+    pTail = nullptr;
+    pOverflowed = nullptr;
+    pSpillCount = nullptr;
+    pEntries = nullptr;
+}
+
+/**
+ * \brief a spill segment is kept mapped until TearDown, so it lives as long as a process that filled it
+ * \param existed false if the segment was created by this call, it then holds none of the entries spilled before
+ */
+ExpiryEntry* ExpiryQueue::MapSpill(int index, bool& existed)
+{
+    existed = true;
+    if (pSpills[index] != nullptr)
+        return pSpills[index];
+
+    std::wstringstream wss;
+    wss << L"Global\\MMFExpiryQueue_" << m_dbName << L"_" << index;
+    HANDLE hMapFile = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, SpillSize, wss.str().c_str());
+    if (hMapFile == nullptr)
+        return nullptr;
+    existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, SpillSize);
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return nullptr;
+    }
+    hSpillMapFiles[index] = hMapFile;
+    pSpills[index] = static_cast<ExpiryEntry*>(pMapView);
+    return pSpills[index];
+}
+
+bool ExpiryQueue::Push(const ExpiryEntry& entry)
+{
+    if (*pTail - *pHead < EXPIRY_QUEUE_SIZE)
+    {
+        pEntries[*pTail % EXPIRY_QUEUE_SIZE] = entry;
+        (*pTail)++;
+        return true;
+    }
+
+    // the ring is full until the next drain, the entry goes to a spill segment
+    int index = *pSpillCount / EXPIRY_QUEUE_SIZE;
+    bool existed;
+    ExpiryEntry* pSpill = index < MAX_EXPIRY_SPILL_COUNT ? MapSpill(index, existed) : nullptr;
+    if (pSpill == nullptr)
+    {
+        *pOverflowed = 1;
+        return false;
+    }
+    pSpill[*pSpillCount % EXPIRY_QUEUE_SIZE] = entry;
+    (*pSpillCount)++;
+    return true;
+}
+
+bool ExpiryQueue::Drain(std::vector<ExpiryEntry>& entries)
+{
+    while (*pHead != *pTail)
+    {
+        entries.push_back(pEntries[*pHead % EXPIRY_QUEUE_SIZE]);
+        (*pHead)++;
+    }
+    bool complete = *pOverflowed == 0;
+    for (LONG spilled = 0; spilled < *pSpillCount; spilled += EXPIRY_QUEUE_SIZE)
+    {
+        bool existed;
+        ExpiryEntry* pSpill = MapSpill(spilled / EXPIRY_QUEUE_SIZE, existed);
+        if (pSpill == nullptr || !existed)
+        {
+            complete = false; // the processes that filled it are gone
+            continue;
+        }
+        LONG count = *pSpillCount - spilled < EXPIRY_QUEUE_SIZE ? *pSpillCount - spilled : EXPIRY_QUEUE_SIZE;
+        entries.insert(entries.end(), pSpill, pSpill + count);
+    }
+    *pSpillCount = 0;
+    *pOverflowed = 0;
+    return complete;
+}
+
+void ExpiryQueue::MarkOverflowed()
+{
+    *pOverflowed = 1;
+}
+
+LONGLONG ExpiryQueue::GetMappedBytes() const
+{
+    if (pQueueMapView == nullptr)
+        return 0;
+    LONGLONG bytes = QueueSize;
+    for (int i = 0; i < MAX_EXPIRY_SPILL_COUNT; i++)
+        bytes += pSpills[i] == nullptr ? 0 : SpillSize;
+    return bytes;
+}
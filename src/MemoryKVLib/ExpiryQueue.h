@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "Consts.h"
+
+/**
+ * \brief a block that will expire, the expiry time tells whether the block has been rewritten since
+ */
+struct ExpiryEntry
+{
+    LONGLONG ExpireAt; // ms since 1601-01-01 (UTC), same clock as CurrentTimeMs
+    long GlobalDbIndex;
+    LONG Reserved;
+};
+
+/**
+ * \brief wall clock in ms, shared by all processes so expiry timestamps can be compared across them
+ */
+inline LONGLONG CurrentTimeMs()
+{
+    FILETIME fileTime;
+    GetSystemTimeAsFileTime(&fileTime);
+    ULARGE_INTEGER time;
+    time.LowPart = fileTime.dwLowDateTime;
+    time.HighPart = fileTime.dwHighDateTime;
+    return static_cast<LONGLONG>(time.QuadPart / 10000);
+}
+
+/**
+ * \brief shared ring of ExpiryEntry, filled by Put with a ttl and drained by the host service.
+ * when the ring is full the entries spill into segments of the same size, mapped on demand and reused after the drain.
+ * all access is under the DB mutex
+ */
+class ExpiryQueue
+{
+private:
+    DWORD* pHead; // next entry to drain
+    DWORD* pTail; // next entry to fill
+    LONG* pOverflowed; // entries were dropped, or the blocks with a ttl were not queued
+    LONG* pSpillCount; // entries in the spill segments since the last drain
+    ExpiryEntry* pEntries;
+
+    std::wstring m_dbName;
+    HANDLE hQueueMapFile;
+    LPVOID pQueueMapView;
+    HANDLE hSpillMapFiles[MAX_EXPIRY_SPILL_COUNT];
+    ExpiryEntry* pSpills[MAX_EXPIRY_SPILL_COUNT];
+
+private:
+    void Pin(LPVOID pMapView);
+    ExpiryEntry* MapSpill(int index, bool& existed);
+public:
+    ExpiryQueue();
+    void Setup(std::wstring& dbName);
+    void TearDown();
+    LONGLONG GetMappedBytes() const;
+    /**
+     * \return false if the ring and the spill segments are full, the entry is dropped and the overflow is flagged
+     */
+    bool Push(const ExpiryEntry& entry);
+    /**
+     * \return false if entries have been dropped since the last drain, the caller needs to find them by a scan
+     */
+    bool Drain(std::vector<ExpiryEntry>& entries);
+    /**
+     * \brief the blocks with a ttl were not queued, e.g. they were restored from an image. the next drain asks for a scan
+     */
+    void MarkOverflowed();
+};
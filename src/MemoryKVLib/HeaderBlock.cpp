@@ -3,20 +3,31 @@
 #include <stdexcept>
 #include "ConfigOptions.h"
 #include "Consts.h"
+#include "SegmentFile.h"
 
 
 void HeaderBlock::Pin(LPVOID pMapView)
 {
     if (pMapView != nullptr)
     {
-        pCurrentMMFCount = static_cast<int*>(pMapView);
-        pHighestGlobalDbPosition = reinterpret_cast<long*>(static_cast<char*> (pMapView) + sizeof(int));
-        pData = static_cast<char*> (pMapView) + sizeof(int) + sizeof(long);
+        pSizes = static_cast<HeaderSizes*>(pMapView);
+        char* pCounters = static_cast<char*> (pMapView) + sizeof(HeaderSizes);
+        pCurrentMMFCount = reinterpret_cast<int*>(pCounters);
+        pHighestGlobalDbPosition = reinterpret_cast<long*>(pCounters + sizeof(int));
+        pClockHand = reinterpret_cast<long*>(pCounters + sizeof(int) + sizeof(long));
+        pReuseSequence = reinterpret_cast<DWORD*>(pCounters + sizeof(int) + sizeof(long) * 2);
+        pData = pCounters + sizeof(int) + sizeof(long) * 2 + sizeof(DWORD);
+        pReusedPositions = reinterpret_cast<long*>(static_cast<char*> (pData) + m_options.MaxMmfCount * MAX_MMF_NAME_LENGTH * sizeof(wchar_t));
     }
 }
 
-void HeaderBlock::ResetHeaderBlock(std::wstring& dbName)
+void HeaderBlock::ResetHeaderBlock(std::wstring& dbName, long dataBlockSize)
 {
+    pSizes->MaxKeySize = m_options.MaxKeySize;
+    pSizes->MaxValueSize = m_options.MaxValueSize;
+    pSizes->MaxBlocksPerMmf = m_options.MaxBlocksPerMmf;
+    pSizes->MaxMmfCount = m_options.MaxMmfCount;
+    pSizes->DataBlockSize = dataBlockSize;
     for (int i = 0; i < m_options.MaxMmfCount; i++)
     {
         std::wstringstream wss;
@@ -25,6 +36,8 @@ void HeaderBlock::ResetHeaderBlock(std::wstring& dbName)
     }
     SetCurrentMMFCount(0); //no data block yet
     SetHighestGlobalDbPosition(-1); //next highest position is 0
+    *pClockHand = 0;
+    *pReuseSequence = 0;
 }
 
 void HeaderBlock::SetMmfNameAt(int i, const wchar_t* mmfName)
@@ -36,11 +49,17 @@ void HeaderBlock::SetMmfNameAt(int i, const wchar_t* mmfName)
 
 HeaderBlock::HeaderBlock()
 {
+    pSizes = nullptr;
     pCurrentMMFCount = nullptr;
     pHighestGlobalDbPosition = nullptr;
+    pClockHand = nullptr;
+    pReuseSequence = nullptr;
+    pReusedPositions = nullptr;
     pData = nullptr;
     hHeaderMapFile = nullptr;
+    hHeaderFile = INVALID_HANDLE_VALUE;
     pHeaderMapView = nullptr;
+    m_reattached = false;
 }
 
 void HeaderBlock::SetConfigOptions(ConfigOptions& options)
@@ -73,24 +92,27 @@ long HeaderBlock::GetHighestGlobalDbPosition() const
     return *pHighestGlobalDbPosition;
 }
 
-void HeaderBlock::Setup(std::wstring& dbName)
+int HeaderBlock::GetHeaderSize() const
+{
+    int MmfNameSectionSize = m_options.MaxMmfCount * MAX_MMF_NAME_LENGTH * sizeof(wchar_t);
+    return sizeof(HeaderSizes) + sizeof(int) + sizeof(long) * 2 + sizeof(DWORD) + MmfNameSectionSize
+        + REUSE_LOG_SIZE * sizeof(long);
+}
+
+void HeaderBlock::Setup(std::wstring& dbName, long dataBlockSize, const wchar_t* path)
 {
     std::wstringstream wss;
     wss << L"Global\\MMFHeaderBlock_" << dbName;
-    int MmfNameSectionSize = m_options.MaxMmfCount * MAX_MMF_NAME_LENGTH * sizeof(wchar_t);
-    int headerSize = MmfNameSectionSize + sizeof(int) + sizeof(long);
+    int headerSize = GetHeaderSize();
 
-    hHeaderMapFile = CreateFileMapping(
-        INVALID_HANDLE_VALUE,
-        nullptr,
-        PAGE_READWRITE,
-        0,
-        headerSize,
-        wss.str().c_str());
+    bool existed;
+    LONGLONG previousSize;
+    hHeaderMapFile = CreateSegmentMapping(wss.str().c_str(), headerSize, path, false, hHeaderFile, existed, previousSize);
     if (hHeaderMapFile == nullptr) {
+        if (path != nullptr && previousSize != 0)
+            throw std::runtime_error("The header file was written with other options.");
         throw std::runtime_error("Failed to create memory-mapped file.");
     }
-    int error = GetLastError();
 
     pHeaderMapView = MapViewOfFile(
         hHeaderMapFile,
@@ -104,19 +126,80 @@ void HeaderBlock::Setup(std::wstring& dbName)
     }
     Pin(pHeaderMapView);
 
-    if (error != ERROR_ALREADY_EXISTS) //first time creates
+    m_reattached = !existed && previousSize == headerSize;
+    if (!existed && !m_reattached) //first time creates
     {
-        ResetHeaderBlock(dbName);
+        ResetHeaderBlock(dbName, dataBlockSize);
     }
 }
 
+bool HeaderBlock::IsReattached() const
+{
+    return m_reattached;
+}
+
+bool HeaderBlock::OpenReadOnly(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFHeaderBlock_" << dbName;
+    hHeaderMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, wss.str().c_str());
+    if (hHeaderMapFile == nullptr)
+        return false;
+    // the sizes first, the size of the header depends on them
+    LPVOID pSizesView = MapViewOfFile(hHeaderMapFile, FILE_MAP_READ, 0, 0, sizeof(HeaderSizes));
+    if (pSizesView != nullptr)
+    {
+        const HeaderSizes* sizes = static_cast<const HeaderSizes*>(pSizesView);
+        m_options.MaxKeySize = sizes->MaxKeySize;
+        m_options.MaxValueSize = sizes->MaxValueSize;
+        m_options.MaxBlocksPerMmf = sizes->MaxBlocksPerMmf;
+        m_options.MaxMmfCount = sizes->MaxMmfCount;
+        UnmapViewOfFile(pSizesView);
+        if (m_options.Validate())
+            pHeaderMapView = MapViewOfFile(hHeaderMapFile, FILE_MAP_READ, 0, 0, GetHeaderSize());
+    }
+    if (pHeaderMapView == nullptr)
+    {
+        CloseHandle(hHeaderMapFile);
+        hHeaderMapFile = nullptr;
+        throw std::runtime_error("The header doesn't hold the sizes of a DB.");
+    }
+    Pin(pHeaderMapView);
+    return true;
+}
+
+HeaderSizes HeaderBlock::GetSizes() const
+{
+    return *pSizes;
+}
+
+LONGLONG HeaderBlock::GetMappedBytes() const
+{
+    return pHeaderMapView == nullptr ? 0 : GetHeaderSize();
+}
+
+bool HeaderBlock::Flush(bool waitForDisk)
+{
+    return hHeaderFile == INVALID_HANDLE_VALUE
+        || FlushSegment(pHeaderMapView, waitForDisk ? hHeaderFile : INVALID_HANDLE_VALUE);
+}
+
 void HeaderBlock::TearDown()
 {
     UnmapViewOfFile(pHeaderMapView);
     CloseHandle(hHeaderMapFile);
+    if (hHeaderFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hHeaderFile);
+    hHeaderFile = INVALID_HANDLE_VALUE;
+    pHeaderMapView = nullptr;
+    hHeaderMapFile = nullptr;
     pData = nullptr;
+    pSizes = nullptr;
     pCurrentMMFCount = nullptr;
     pHighestGlobalDbPosition = nullptr;
+    pClockHand = nullptr;
+    pReuseSequence = nullptr;
+    pReusedPositions = nullptr;
 }
 
 
@@ -124,3 +207,26 @@ wchar_t* HeaderBlock::GetMmfNameAt(int nextMmfSequence)
 {
     return reinterpret_cast<wchar_t*>(pData) + nextMmfSequence * MAX_MMF_NAME_LENGTH;
 }
+
+long HeaderBlock::AdvanceClockHand(long blockCount)
+{
+    long hand = *pClockHand % blockCount;
+    *pClockHand = (hand + 1) % blockCount;
+    return hand;
+}
+
+void HeaderBlock::AppendReusedPosition(long globalDbIndex)
+{
+    pReusedPositions[*pReuseSequence % REUSE_LOG_SIZE] = globalDbIndex;
+    (*pReuseSequence)++;
+}
+
+DWORD HeaderBlock::GetReuseSequence() const
+{
+    return *pReuseSequence;
+}
+
+long HeaderBlock::GetReusedPositionAt(DWORD sequence) const
+{
+    return pReusedPositions[sequence % REUSE_LOG_SIZE];
+}
@@ -3,21 +3,41 @@
 #include <Windows.h>
 #include "ConfigOptions.h"
 
+/**
+ * \brief the sizes the DB was created with, first in the header so a reader that doesn't know them finds them
+ */
+struct HeaderSizes
+{
+    int MaxKeySize;
+    int MaxValueSize;
+    int MaxBlocksPerMmf;
+    int MaxMmfCount;
+    long DataBlockSize; // bytes, with the block header
+    long Reserved;
+};
+
 class HeaderBlock
 {
 private:
+    HeaderSizes* pSizes;
     int* pCurrentMMFCount; //starts from 1, 0 means no MMF
     long* pHighestGlobalDbPosition; //starts from 0
+    long* pClockHand; //next block the eviction looks at
+    DWORD* pReuseSequence; //count of blocks reused below the global HKP so far
+    long* pReusedPositions; //ring of the last REUSE_LOG_SIZE reused global db indexes
     void* pData; //pointer to header MMF start base address
 
     HANDLE hHeaderMapFile;
+    HANDLE hHeaderFile; // with KvStorageFile
     LPVOID pHeaderMapView;
+    bool m_reattached;
     ConfigOptions m_options;
     
 private:
     void Pin(LPVOID pMapView);
-    void ResetHeaderBlock(std::wstring& dbName);
+    void ResetHeaderBlock(std::wstring& dbName, long dataBlockSize);
     void SetMmfNameAt(int i, const wchar_t* mmfName);
+    int GetHeaderSize() const;
 public:
     HeaderBlock();
     void SetConfigOptions(ConfigOptions& options);
@@ -25,7 +45,35 @@ public:
     int GetCurrentMMFCount() const;
     void SetHighestGlobalDbPosition(long position);
     long GetHighestGlobalDbPosition() const;
-    void Setup(std::wstring& dbName);
+    /**
+     * \param dataBlockSize kept in the header with the sizes of the options when it's created
+     * \param path the file to keep the header in, null for the page file
+     */
+    void Setup(std::wstring& dbName, long dataBlockSize, const wchar_t* path = nullptr);
+    /**
+     * \return whether Setup found the header of a previous run in its file, nobody had the DB open
+     */
+    bool IsReattached() const;
+    /**
+     * \brief map the header of a DB another process has open, read-only, see KvInspector. the options are set to
+     * the sizes in the header
+     * \return false if no process has it open
+     * \throw std::runtime_error if the sizes in the header aren't valid options or it's smaller than they ask for
+     */
+    bool OpenReadOnly(const std::wstring& dbName);
+    HeaderSizes GetSizes() const;
+    bool Flush(bool waitForDisk);
     void TearDown();
+    LONGLONG GetMappedBytes() const;
     wchar_t* GetMmfNameAt(int nextMmfSequence);
+    /**
+     * \return the block the clock hand is on, the hand moves to the next one
+     */
+    long AdvanceClockHand(long blockCount);
+    /**
+     * \brief record a block that gets a new key below the global HKP, other instances won't find it by the refresh
+     */
+    void AppendReusedPosition(long globalDbIndex);
+    DWORD GetReuseSequence() const;
+    long GetReusedPositionAt(DWORD sequence) const;
 };
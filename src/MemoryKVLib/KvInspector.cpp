@@ -0,0 +1,238 @@
+#include "KvInspector.h"
+#include <cstring>
+#include <stdexcept>
+#include "ExpiryQueue.h"
+#include "LzCodec.h"
+
+KvInspector::KvInspector()
+{
+    m_dataBlockSize = 0;
+    m_attached = false;
+}
+
+KvInspector::~KvInspector()
+{
+    Detach();
+}
+
+KvStatus KvInspector::Attach(const wchar_t* dbName)
+{
+    Detach();
+    if (dbName == nullptr)
+        return KvInvalidArgument;
+    m_dbName = dbName;
+    try {
+        if (!m_headerBlock.OpenReadOnly(m_dbName))
+            return KvNotFound;
+    }
+    catch (const std::runtime_error&) {
+        return KvInvalidArgument;
+    }
+    m_attached = true;
+    HeaderSizes sizes = m_headerBlock.GetSizes();
+    m_options = ConfigOptions();
+    m_options.MaxKeySize = sizes.MaxKeySize;
+    m_options.MaxValueSize = sizes.MaxValueSize;
+    m_options.MaxBlocksPerMmf = sizes.MaxBlocksPerMmf;
+    m_options.MaxMmfCount = sizes.MaxMmfCount;
+    m_dataBlockSize = sizes.DataBlockSize;
+    if (m_dataBlockSize < static_cast<long>(sizeof(BlockHeader)
+        + (m_options.MaxKeySize + m_options.MaxValueSize) * sizeof(wchar_t)))
+    {
+        Detach();
+        return KvInvalidArgument;
+    }
+    m_mapFiles.assign(m_options.MaxMmfCount, nullptr);
+    m_mapViews.assign(m_options.MaxMmfCount, nullptr);
+    m_blockCopy.resize(m_dataBlockSize);
+    int mmfCount = m_headerBlock.GetCurrentMMFCount();
+    if (mmfCount > 0 && GetMmfCount() == 0)
+    {
+        Detach();
+        return KvInvalidArgument;
+    }
+    return KvOk;
+}
+
+void KvInspector::Detach()
+{
+    for (size_t i = 0; i < m_mapViews.size(); i++)
+    {
+        if (m_mapViews[i] != nullptr)
+            UnmapViewOfFile(m_mapViews[i]);
+        if (m_mapFiles[i] != nullptr)
+            CloseHandle(m_mapFiles[i]);
+    }
+    m_mapViews.clear();
+    m_mapFiles.clear();
+    m_coldStore.TearDown();
+    m_valuePool.TearDown();
+    if (m_attached)
+        m_headerBlock.TearDown();
+    m_attached = false;
+}
+
+HeaderSizes KvInspector::GetSizes() const
+{
+    HeaderSizes sizes = {};
+    return m_attached ? m_headerBlock.GetSizes() : sizes;
+}
+
+/**
+ * \brief a view larger than the MMF fails, so a header that doesn't hold the sizes of its DB is caught here
+ */
+bool KvInspector::MapDataBlock(int dataBlockMmfIndex)
+{
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, m_headerBlock.GetMmfNameAt(dataBlockMmfIndex));
+    if (hMapFile == nullptr)
+        return false;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, m_dataBlockSize * m_options.MaxBlocksPerMmf);
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return false;
+    }
+    m_mapFiles[dataBlockMmfIndex] = hMapFile;
+    m_mapViews[dataBlockMmfIndex] = pMapView;
+    return true;
+}
+
+int KvInspector::GetMmfCount()
+{
+    if (!m_attached)
+        return 0;
+    int mmfCount = m_headerBlock.GetCurrentMMFCount();
+    if (mmfCount > m_options.MaxMmfCount)
+        mmfCount = m_options.MaxMmfCount;
+    for (int i = 0; i < mmfCount; i++)
+    {
+        if (m_mapViews[i] == nullptr && !MapDataBlock(i))
+            return i;
+    }
+    return mmfCount;
+}
+
+long KvInspector::GetHighestPosition() const
+{
+    return m_attached ? m_headerBlock.GetHighestGlobalDbPosition() : -1;
+}
+
+/**
+ * \brief copy the block into m_blockCopy between two reads of its version. DataBlock::BeginRead reads the version
+ * with an interlocked instruction, which faults on a read-only view, so it's read plainly with fences around the copy
+ * \return false if a writer had it every time
+ */
+bool KvInspector::CopyBlock(long position)
+{
+    const char* pBlock = static_cast<const char*>(m_mapViews[position / m_options.MaxBlocksPerMmf])
+        + static_cast<LONGLONG>(position % m_options.MaxBlocksPerMmf) * m_dataBlockSize;
+    const volatile LONG& version = reinterpret_cast<const BlockHeader*>(pBlock)->Version;
+    for (int spin = 0; spin < MAX_PIN_WAIT_SPINS; spin++)
+    {
+        LONG before = version;
+        if ((before & 1) == 0)
+        {
+            MemoryBarrier();
+            std::memcpy(m_blockCopy.data(), pBlock, m_dataBlockSize);
+            MemoryBarrier();
+            if (version == before)
+                return true;
+        }
+        SwitchToThread();
+    }
+    return false;
+}
+
+/**
+ * \brief the text form of the value as MemoryKV::ValueOf gives it, from the copy of the block
+ */
+void KvInspector::DecodeValue(const DataBlock& copy, KvInspectedBlock& block)
+{
+    switch (block.ValueType)
+    {
+    case KvValueString:
+    {
+        int length = block.ValueLength;
+        if (length < 0 || length >= m_options.MaxValueSize)
+            length = static_cast<int>(wcsnlen(copy.GetValue(m_options.MaxKeySize), m_options.MaxValueSize - 1));
+        block.Value.assign(copy.GetValue(m_options.MaxKeySize), length);
+        break;
+    }
+    case KvValueInt64:
+        block.Value = std::to_wstring(*copy.NumericData());
+        break;
+    case KvValueDouble:
+    {
+        LONGLONG bits = *copy.NumericData();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        wchar_t text[32];
+        swprintf_s(text, 32, L"%.17g", value);
+        block.Value = text;
+        break;
+    }
+    case KvValueCompressed:
+    {
+        int length = block.ValueLength;
+        LONGLONG size = *copy.NumericData();
+        block.Value.clear();
+        if (length <= 0 || length >= MAX_COMPRESSED_VALUE_LENGTH
+            || size <= 0 || size > static_cast<LONGLONG>(m_options.MaxValueSize) * sizeof(wchar_t))
+            break;
+        m_text.resize(length);
+        int rawSize = length * static_cast<int>(sizeof(wchar_t));
+        if (LzDecompress(copy.GetValue(m_options.MaxKeySize), static_cast<int>(size), m_text.data(), rawSize) == rawSize)
+            block.Value.assign(m_text.data(), length);
+        break;
+    }
+    case KvValueCold:
+    case KvValuePooled:
+    {
+        // the text as Put gave it, in a segment of the store, mapped on the first value that needs it. a chunk
+        // reused since the block was copied fails the NUL check of Resolve, like a torn read
+        const wchar_t* value = nullptr;
+        if (block.ValueType == KvValueCold && (m_coldStore.IsEnabled() || m_coldStore.OpenReadOnly(m_dbName)))
+            value = m_coldStore.Resolve(copy.GetNumeric(), block.ValueLength);
+        else if (block.ValueType == KvValuePooled && (m_valuePool.IsEnabled() || m_valuePool.OpenReadOnly(m_dbName)))
+            value = m_valuePool.Resolve(copy.GetNumeric(), block.ValueLength);
+        if (value != nullptr)
+            block.Value.assign(value, block.ValueLength);
+        else
+            block.Value = block.ValueType == KvValueCold ? L"<cold>" : L"<pooled>";
+        break;
+    }
+    default:
+        block.Value.clear();
+        break;
+    }
+}
+
+KvStatus KvInspector::ReadBlock(long position, KvInspectedBlock& block)
+{
+    block.Position = position;
+    block.State = KvInspectedFree;
+    block.ValueType = KvValueString;
+    block.ValueLength = 0;
+    block.ExpireAt = 0;
+    block.Key.clear();
+    block.Value.clear();
+    if (!m_attached || position < 0 || position >= static_cast<long>(m_mapViews.size()) * m_options.MaxBlocksPerMmf
+        || m_mapViews[position / m_options.MaxBlocksPerMmf] == nullptr)
+        return KvNotFound;
+    if (!CopyBlock(position))
+    {
+        block.State = KvInspectedBusy;
+        return KvOk;
+    }
+
+    DataBlock copy(m_blockCopy.data());
+    if (copy.IsEmpty())
+        return KvOk;
+    block.Key.assign(copy.GetKey(), wcsnlen(copy.GetKey(), m_options.MaxKeySize));
+    block.ValueType = copy.GetValueType();
+    block.ValueLength = copy.GetValueLength();
+    block.ExpireAt = copy.GetExpireAt();
+    block.State = copy.IsExpired(CurrentTimeMs()) ? KvInspectedExpired : KvInspectedLive;
+    DecodeValue(copy, block);
+    return KvOk;
+}
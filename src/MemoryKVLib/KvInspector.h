@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "ColdStore.h"
+#include "ConfigOptions.h"
+#include "HeaderBlock.h"
+#include "KvStatus.h"
+#include "MemoryKV.h"
+#include "ValuePool.h"
+
+/**
+ * \brief what KvInspector found in a block below the high-water mark
+ */
+enum KvInspectedState
+{
+    KvInspectedFree = 0, // removed, not reused yet
+    KvInspectedLive,
+    KvInspectedExpired, // past its ttl, the host service hasn't reclaimed it yet
+    KvInspectedBusy, // a writer kept changing it while it was read
+};
+
+struct KvInspectedBlock
+{
+    long Position; // global db index
+    KvInspectedState State;
+    KvValueType ValueType;
+    int ValueLength; // characters
+    LONGLONG ExpireAt;
+    std::wstring Key;
+    std::wstring Value; // the text Get returns, <cold> or <pooled> if no process has the segment of the value open
+};
+
+/**
+ * \brief a read-only attach to a DB other processes have open, for the diagnostic tools. the header and the data
+ * block MMFs are mapped with FILE_MAP_READ by the names in the header, the DB mutex is never taken and nothing is
+ * written, not even the reference bits of Get. a block is copied out between two reads of its version, like the
+ * lock-free Get does. the sizes are the ones kept in the header when the DB was created. the cold and pooled values
+ * are read from the segments of the ColdStore and the ValuePool, mapped read-only as well. a page file backed DB
+ * lives on while an inspector has it attached
+ */
+class KvInspector
+{
+private:
+    std::wstring m_dbName;
+    ConfigOptions m_options;
+    long m_dataBlockSize;
+    HeaderBlock m_headerBlock;
+    bool m_attached;
+    std::vector<HANDLE> m_mapFiles;
+    std::vector<LPVOID> m_mapViews;
+    std::vector<char> m_blockCopy;
+    std::vector<wchar_t> m_text;
+    ColdStore m_coldStore;
+    ValuePool m_valuePool;
+
+private:
+    bool MapDataBlock(int dataBlockMmfIndex);
+    bool CopyBlock(long position);
+    void DecodeValue(const DataBlock& copy, KvInspectedBlock& block);
+
+public:
+    __declspec(dllexport) KvInspector();
+    __declspec(dllexport) ~KvInspector();
+
+    /**
+     * \return KvNotFound if no process has the DB open, KvInvalidArgument if the sizes in its header don't fit its MMFs
+     */
+    __declspec(dllexport) KvStatus Attach(const wchar_t* dbName);
+    __declspec(dllexport) void Detach();
+
+    /**
+     * \brief the sizes the DB was created with, from its header
+     */
+    __declspec(dllexport) HeaderSizes GetSizes() const;
+
+    /**
+     * \brief the data block MMFs of the DB, those added since the last call are mapped
+     */
+    __declspec(dllexport) int GetMmfCount();
+
+    /**
+     * \brief the highest global db index ever used, -1 for an empty DB. the blocks above it were never written
+     */
+    __declspec(dllexport) long GetHighestPosition() const;
+
+    /**
+     * \brief read the block at a global db index below GetMmfCount() * MaxBlocksPerMmf
+     * \return KvNotFound if its MMF isn't mapped
+     */
+    __declspec(dllexport) KvStatus ReadBlock(long position, KvInspectedBlock& block);
+};
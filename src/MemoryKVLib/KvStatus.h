@@ -0,0 +1,20 @@
+#pragma once
+
+/**
+ * \brief result of the length-explicit operations, the values are part of the C interface, never renumber them
+ */
+enum KvStatus : int
+{
+    KvOk = 0,
+    KvNotFound = 1,
+    KvBufferTooSmall = 2,
+    KvInvalidArgument = 3,
+    KvKeyTooLarge = 4,
+    KvValueTooLarge = 5,
+    KvOutOfMemory = 6,
+    KvNotInitialized = 7,
+    KvError = 8,
+    KvTypeMismatch = 9, // a numeric operation on a string value, or on a number of the other type
+    KvCompareFailed = 10, // CompareAndSwap found another value
+    KvSnapshotTooOld = 11 // the versions a snapshot needed were dropped because the version store ran full
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstring>
+#include <intrin.h>
+#include <Windows.h>
+
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKET_COUNT (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAGNITUDE_COUNT 40 // the last bucket starts at 2^(LATENCY_MAGNITUDE_COUNT + 2) ns, about 73 minutes
+#define LATENCY_BUCKET_COUNT (LATENCY_MAGNITUDE_COUNT * LATENCY_SUB_BUCKET_COUNT)
+
+/**
+ * \brief HDR style latency histogram in nanoseconds: the values below LATENCY_SUB_BUCKET_COUNT have a bucket each,
+ * every power of two above is split in LATENCY_SUB_BUCKET_COUNT linear buckets, so a percentile is within 1/16 of
+ * the recorded value. plain counters, each thread records into its own and they are merged for the report, or all
+ * record into a shared one with RecordShared
+ */
+struct LatencyHistogram
+{
+    LONGLONG Counts[LATENCY_BUCKET_COUNT];
+    LONGLONG TotalCount;
+    LONGLONG MaxValue;
+
+    LatencyHistogram()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        memset(Counts, 0, sizeof(Counts));
+        TotalCount = 0;
+        MaxValue = 0;
+    }
+
+    static int BucketOf(LONGLONG value)
+    {
+        if (value < LATENCY_SUB_BUCKET_COUNT)
+            return value < 0 ? 0 : static_cast<int>(value);
+        unsigned long highestBit;
+        _BitScanReverse64(&highestBit, static_cast<unsigned long long>(value));
+        int shift = static_cast<int>(highestBit) - LATENCY_SUB_BUCKET_BITS;
+        int bucket = (shift + 1) * LATENCY_SUB_BUCKET_COUNT + static_cast<int>((value >> shift) - LATENCY_SUB_BUCKET_COUNT);
+        return bucket < LATENCY_BUCKET_COUNT ? bucket : LATENCY_BUCKET_COUNT - 1;
+    }
+
+    /**
+     * \brief the highest value that falls in the bucket
+     */
+    static LONGLONG BucketUpperBound(int bucket)
+    {
+        if (bucket < LATENCY_SUB_BUCKET_COUNT)
+            return bucket;
+        int shift = bucket / LATENCY_SUB_BUCKET_COUNT - 1;
+        LONGLONG lower = static_cast<LONGLONG>(LATENCY_SUB_BUCKET_COUNT + bucket % LATENCY_SUB_BUCKET_COUNT) << shift;
+        return lower + (1LL << shift) - 1;
+    }
+
+    void Record(LONGLONG nanoseconds)
+    {
+        Counts[BucketOf(nanoseconds)]++;
+        TotalCount++;
+        if (nanoseconds > MaxValue)
+            MaxValue = nanoseconds;
+    }
+
+    /**
+     * \brief Record into a histogram shared by threads or processes, each counter is a relaxed atomic add. a reader
+     * may see TotalCount a few records off the sum of the buckets
+     */
+    void RecordShared(LONGLONG nanoseconds)
+    {
+        InterlockedExchangeAddNoFence64(&Counts[BucketOf(nanoseconds)], 1);
+        InterlockedExchangeAddNoFence64(&TotalCount, 1);
+        LONGLONG max = MaxValue;
+        while (nanoseconds > max)
+        {
+            LONGLONG seen = InterlockedCompareExchange64(&MaxValue, nanoseconds, max);
+            if (seen == max)
+                break;
+            max = seen;
+        }
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < LATENCY_BUCKET_COUNT; i++)
+            Counts[i] += other.Counts[i];
+        TotalCount += other.TotalCount;
+        if (other.MaxValue > MaxValue)
+            MaxValue = other.MaxValue;
+    }
+
+    /**
+     * \param percentile 0 to 100, e.g. 99.9
+     * \return the upper bound of the bucket holding it, 0 if nothing was recorded
+     */
+    LONGLONG ValueAtPercentile(double percentile) const
+    {
+        if (TotalCount == 0)
+            return 0;
+        LONGLONG rank = static_cast<LONGLONG>(percentile / 100 * TotalCount + 0.5);
+        if (rank < 1)
+            rank = 1;
+        LONGLONG seen = 0;
+        for (int i = 0; i < LATENCY_BUCKET_COUNT; i++)
+        {
+            seen += Counts[i];
+            if (seen >= rank)
+                return BucketUpperBound(i) < MaxValue ? BucketUpperBound(i) : MaxValue;
+        }
+        return MaxValue;
+    }
+};
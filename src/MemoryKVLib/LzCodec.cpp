@@ -0,0 +1,146 @@
+#include "LzCodec.h"
+#include <cstdint>
+#include <cstring>
+
+static uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int HashOf(uint32_t sequence)
+{
+    return static_cast<int>((sequence * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+static bool WriteLength(uint8_t*& op, const uint8_t* end, int length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (op == end)
+            return false;
+        *op++ = 255;
+    }
+    if (op == end)
+        return false;
+    *op++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+static bool ReadLength(const uint8_t*& ip, const uint8_t* end, int& length, int limit)
+{
+    uint8_t more;
+    do
+    {
+        if (ip == end)
+            return false;
+        more = *ip++;
+        length += more;
+        if (length > limit) // garbage, and keeps the sum from overflowing
+            return false;
+    } while (more == 255);
+    return true;
+}
+
+/**
+ * \param matchLength 0 for the last sequence
+ */
+static bool WriteSequence(uint8_t*& op, const uint8_t* end, const uint8_t* literals, int literalCount,
+    int offset, int matchLength)
+{
+    if (op == end)
+        return false;
+    uint8_t* token = op++;
+    int matchCode = matchLength == 0 ? 0 : matchLength - LZ_MIN_MATCH;
+    *token = static_cast<uint8_t>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalCount >= 15 && !WriteLength(op, end, literalCount - 15))
+        return false;
+    if (end - op < literalCount)
+        return false;
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+    if (matchLength == 0)
+        return true;
+    if (end - op < 2)
+        return false;
+    *op++ = static_cast<uint8_t>(offset & 0xFF);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    return matchCode < 15 || WriteLength(op, end, matchCode - 15);
+}
+
+int LzCompress(const void* source, int sourceSize, void* target, int targetCapacity)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(source);
+    uint8_t* dst = static_cast<uint8_t*>(target);
+    uint8_t* op = dst;
+    const uint8_t* end = dst + targetCapacity;
+    int table[1 << LZ_HASH_BITS]; // the last position of every hashed 4-byte sequence
+    for (int& position : table)
+        position = -1;
+
+    int anchor = 0; // the first literal not written yet
+    int position = 0;
+    while (position + LZ_MIN_MATCH <= sourceSize)
+    {
+        uint32_t sequence = Read32(src + position);
+        int& slot = table[HashOf(sequence)];
+        int candidate = slot;
+        slot = position;
+        if (candidate < 0 || position - candidate > LZ_MAX_OFFSET || Read32(src + candidate) != sequence)
+        {
+            position++;
+            continue;
+        }
+
+        int length = LZ_MIN_MATCH;
+        while (position + length < sourceSize && src[candidate + length] == src[position + length])
+            length++;
+        if (!WriteSequence(op, end, src + anchor, position - anchor, position - candidate, length))
+            return 0;
+        position += length;
+        anchor = position;
+    }
+    if (!WriteSequence(op, end, src + anchor, sourceSize - anchor, 0, 0))
+        return 0;
+    return static_cast<int>(op - dst);
+}
+
+int LzDecompress(const void* source, int sourceSize, void* target, int targetSize)
+{
+    const uint8_t* ip = static_cast<const uint8_t*>(source);
+    const uint8_t* ipEnd = ip + sourceSize;
+    uint8_t* start = static_cast<uint8_t*>(target);
+    uint8_t* op = start;
+    const uint8_t* end = start + targetSize;
+    while (ip < ipEnd)
+    {
+        int token = *ip++;
+        int literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(ip, ipEnd, literalCount, targetSize))
+            return -1;
+        if (ipEnd - ip < literalCount || end - op < literalCount)
+            return -1;
+        memcpy(op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+        if (ip == ipEnd) // the last sequence
+            break;
+
+        if (ipEnd - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        int matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength, targetSize))
+            return -1;
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - start || end - op < matchLength)
+            return -1;
+        const uint8_t* match = op - offset;
+        for (int i = 0; i < matchLength; i++) // byte by byte, an overlapping match repeats the pattern
+            op[i] = match[i];
+        op += matchLength;
+    }
+    return static_cast<int>(op - start);
+}
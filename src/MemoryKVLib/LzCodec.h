@@ -0,0 +1,20 @@
+#pragma once
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+/**
+ * \brief compress a buffer with the LZ77 codec of the values. the layout is the LZ4 block one: every sequence is a
+ * token with the literal count in the high nibble and the match length - LZ_MIN_MATCH in the low one, 255 bytes
+ * continuing a nibble of 15, the literals, a 2-byte little endian offset and the match. the last sequence has
+ * literals only
+ * \return the compressed size, 0 if it doesn't fit targetCapacity: the caller keeps the buffer as it is then
+ */
+int LzCompress(const void* source, int sourceSize, void* target, int targetCapacity);
+
+/**
+ * \brief bounds checked, a damaged or torn source never writes past targetSize
+ * \return the decompressed size, -1 if the source isn't a valid block
+ */
+int LzDecompress(const void* source, int sourceSize, void* target, int targetSize);
@@ -2,14 +2,51 @@
 #include <stdexcept>
 #include <Windows.h>
 #include <cstring>
+#include <cwchar>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "Checkpoint.h"
+#include "LzCodec.h"
+#include "SegmentFile.h"
 #include "Consts.h"
 #include "SyncCall.h"
 #include "SimpleFileLogger.h"
 
+static LONGLONG DoubleToBits(double value)
+{
+    LONGLONG bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double BitsToDouble(LONGLONG bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * \brief text form of a number for Get, valid till the next call on the thread
+ */
+static const wchar_t* FormatNumeric(LONG type, LONGLONG bits)
+{
+    thread_local wchar_t text[32];
+    if (type == KvValueDouble)
+        swprintf_s(text, 32, L"%.17g", BitsToDouble(bits));
+    else
+        swprintf_s(text, 32, L"%lld", bits);
+    return text;
+}
+
+static const wchar_t* FormatNumeric(const DataBlock& block)
+{
+    return FormatNumeric(block.GetValueType(), block.GetNumeric());
+}
+
 ConfigOptions::ConfigOptions()
 {
     MaxKeySize = MAX_KEY_SIZE;
@@ -17,6 +54,19 @@ ConfigOptions::ConfigOptions()
     MaxBlocksPerMmf = MAX_BLOCKS_PER_MMF;
     MaxMmfCount = MAX_MMF_COUNT;
     LogLevel = 1;
+    EvictionMode = KvEvictionNone;
+    OrderedIndex = 0;
+    Durability = KvDurabilityNone;
+    DataDirectory[0] = L'\0';
+    Storage = KvStorageMemory;
+    Tiering = 0;
+    Compression = KvCompressionNone;
+    CompressionThreshold = COMPRESSION_THRESHOLD;
+    Dedup = 0;
+    DedupThreshold = DEDUP_THRESHOLD;
+    LatencyHistograms = 0;
+    HotKeySampling = 0;
+    Tracing = 0;
 }
 
 bool ConfigOptions::Validate() const
@@ -24,7 +74,16 @@ bool ConfigOptions::Validate() const
     return (MaxKeySize > 0 
         && MaxValueSize > 0
         && MaxBlocksPerMmf > 0
-        && MaxMmfCount > 0);
+        && MaxMmfCount > 0
+        && (EvictionMode == KvEvictionNone || EvictionMode == KvEvictionClock)
+        && Durability >= KvDurabilityNone && Durability <= KvDurabilityPeriodic
+        && (Storage == KvStorageMemory || Storage == KvStorageFile)
+        && (Compression == KvCompressionNone || Compression == KvCompressionLz)
+        && CompressionThreshold >= 0
+        && DedupThreshold >= 0
+        && HotKeySampling >= 0
+        && ((Durability == KvDurabilityNone && Storage == KvStorageMemory && !Tiering) || (DataDirectory[0] != L'\0'
+            && wcsnlen(DataDirectory, MAX_DATA_DIRECTORY_LENGTH) < MAX_DATA_DIRECTORY_LENGTH)));
 }
 
 /// <summary>
@@ -52,7 +111,38 @@ int MemoryKV::FindNextAvailableBlock() const
 
 void MemoryKV::InitHeaderBlock()
 {
-    m_pHeaderBlock.Setup(m_dbName);
+    if (m_options.Storage != KvStorageFile)
+    {
+        m_pHeaderBlock.Setup(m_dbName, m_dataBlockSize);
+        return;
+    }
+    CreateDirectory(m_options.DataDirectory, nullptr); // fails if it exists already, opening the file tells
+    m_pHeaderBlock.Setup(m_dbName, m_dataBlockSize, GetStoragePath(L".hdr").c_str());
+    if (m_pHeaderBlock.IsReattached())
+    {
+        std::wstringstream ss;
+        ss << L"header reattached from its file, mmf count=" << m_pHeaderBlock.GetCurrentMMFCount();
+        m_logger->Log(ss.str().data());
+    }
+}
+
+/**
+ * \brief <DataDirectory>\<dbName><suffix>, empty with KvStorageMemory
+ */
+std::wstring MemoryKV::GetStoragePath(const std::wstring& suffix) const
+{
+    if (m_options.Storage != KvStorageFile)
+        return std::wstring();
+    std::wstringstream wss;
+    wss << m_options.DataDirectory << L"\\" << m_dbName << suffix;
+    return wss.str();
+}
+
+std::wstring MemoryKV::GetSegmentPath(int dataBlockMmfIndex) const
+{
+    std::wstringstream wss;
+    wss << L"_" << dataBlockMmfIndex << L".seg";
+    return GetStoragePath(wss.str());
 }
 
 void MemoryKV::InitMutex()
@@ -67,51 +157,76 @@ void MemoryKV::InitMutex()
 }
 
 /**
- * \brief create a new data block to hold more data, no matter how
+ * \brief take the DB mutex for SYNC_CALL. an uncontended acquisition reads the clock once, for the hold time
  */
-void MemoryKV::ExpandDataBlock()
+void MemoryKV::AcquireDbMutex()
 {
-    std::wstringstream wss;
-    wss << L"expand data block starts, currentMmfCount=" << m_currentMmfCount;
-    m_logger->Log(wss.str().c_str());
-
-    if (m_currentMmfCount < m_pHeaderBlock.GetCurrentMMFCount())
+    LARGE_INTEGER start;
+    if (WaitForSingleObject(m_hMutex, 0) == WAIT_TIMEOUT)
     {
-        m_currentMmfCount++;
-        wss.str(std::wstring());
-        wss << L"skip because currentMmfCount is smaller than global mmf count, increase currentMmfCount by 1 to " << m_currentMmfCount;
-        m_logger->Log(wss.str().c_str());
-        return;
+        LARGE_INTEGER end;
+        m_traceRing.Record(KvTraceLockWait, KvTraceBegin);
+        QueryPerformanceCounter(&start);
+        WaitForSingleObject(m_hMutex, INFINITE);
+        QueryPerformanceCounter(&end);
+        m_traceRing.Record(KvTraceLockWait, KvTraceEnd);
+        m_lockWaitTicks += end.QuadPart - start.QuadPart;
+        m_lockContentions++;
+        m_statsPage.Add(KvStatLockContentions);
+        m_statsPage.Add(KvStatLockWaitTime, end.QuadPart - start.QuadPart);
+        m_lockWaitedTicks = end.QuadPart - start.QuadPart;
+        start = end;
     }
-
-    if(m_pHeaderBlock.GetCurrentMMFCount() >= m_options.MaxMmfCount)
+    else
     {
-        m_logger->Log(L"expand data block oom");
-        throw KvOomException();
+        QueryPerformanceCounter(&start);
+        m_lockWaitedTicks = 0;
     }
+    m_lockAcquisitions++;
+    m_lockAcquiredAt = start.QuadPart;
+    m_statsPage.Add(KvStatLockAcquisitions);
+    m_traceRing.Record(KvTraceLockHeld, KvTraceBegin);
+}
 
-    // next MMF index, starts from 0 because it's C++ array index
-    // so current file COUNT is next file INDEX
-    int nextMmfSequence = m_pHeaderBlock.GetCurrentMMFCount();
+/**
+ * \param op the latency histograms the wait and the hold go to, KvLatencyOpCount for none
+ */
+void MemoryKV::ReleaseDbMutex(KvLatencyOp op)
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    LONGLONG heldTicks = end.QuadPart - m_lockAcquiredAt;
+    m_statsPage.Add(KvStatLockHoldTime, heldTicks);
+    if (op != KvLatencyOpCount && m_statsPage.RecordsLatency())
+    {
+        m_statsPage.RecordLatency(op, KvLatencyLockWait, m_lockWaitedTicks);
+        m_statsPage.RecordLatency(op, KvLatencyInLock, heldTicks);
+    }
+    m_traceRing.Record(KvTraceLockHeld, KvTraceEnd, op);
+    ReleaseMutex(m_hMutex);
+}
 
-    wchar_t* mmfName = m_pHeaderBlock.GetMmfNameAt(nextMmfSequence);
+/**
+ * \brief create and map the MMF of the data block zero-filled, with KvStorageFile its file is truncated
+ */
+LPVOID MemoryKV::CreateDataBlock(int dataBlockMmfIndex)
+{
+    wchar_t* mmfName = m_pHeaderBlock.GetMmfNameAt(dataBlockMmfIndex);
     
     auto mapSize = m_dataBlockSize * m_options.MaxBlocksPerMmf;
 
-    auto hMapFile = CreateFileMapping(
-        INVALID_HANDLE_VALUE,
-        nullptr,
-        PAGE_READWRITE,
-        0,
-        mapSize,
-        mmfName);
+    std::wstring path = GetSegmentPath(dataBlockMmfIndex);
+    HANDLE hFile;
+    bool existed;
+    LONGLONG previousSize;
+    auto hMapFile = CreateSegmentMapping(mmfName, mapSize, path.empty() ? nullptr : path.c_str(), true,
+        hFile, existed, previousSize);
     if (hMapFile == nullptr) 
     {
         m_logger->Log(L"MMF not created, expand failed.");
         throw std::runtime_error("MMF not created, expand failed.");
     }
-    int error = GetLastError();
-    if(error == ERROR_ALREADY_EXISTS)
+    if(existed)
     {
         m_logger->Log(L"MMF already exists, expand warning.");
         //throw std::runtime_error("MMF already exists, expand failed.");
@@ -126,15 +241,75 @@ void MemoryKV::ExpandDataBlock()
     if (pMapView == nullptr) 
     {
         CloseHandle(hMapFile);
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
         m_logger->Log(L"Failed to map view of memory-mapped file.");
         throw std::runtime_error("Failed to map view of memory-mapped file.");
     }
+    // a new MMF or file is zero-filled already, writing it would only dirty every page of the segment
+    if (existed)
+        std::memset(pMapView, 0, mapSize);
+
+    hMapFiles[dataBlockMmfIndex] = hMapFile;
+    hSegmentFiles[dataBlockMmfIndex] = hFile;
+    pMapViews[dataBlockMmfIndex] = pMapView;
+    return pMapView;
+}
+
+void MemoryKV::CloseDataBlock(int dataBlockMmfIndex)
+{
+    if (pMapViews[dataBlockMmfIndex] != nullptr)
+        UnmapViewOfFile(pMapViews[dataBlockMmfIndex]);
+    if (hMapFiles[dataBlockMmfIndex] != nullptr)
+        CloseHandle(hMapFiles[dataBlockMmfIndex]);
+    if (hSegmentFiles[dataBlockMmfIndex] != INVALID_HANDLE_VALUE)
+        CloseHandle(hSegmentFiles[dataBlockMmfIndex]);
+    pMapViews[dataBlockMmfIndex] = nullptr;
+    hMapFiles[dataBlockMmfIndex] = nullptr;
+    hSegmentFiles[dataBlockMmfIndex] = INVALID_HANDLE_VALUE;
+}
+
+/**
+ * \brief create a new data block to hold more data, no matter how
+ */
+void MemoryKV::ExpandDataBlock()
+{
+    TraceScope trace(m_traceRing, KvTraceExpand);
+    std::wstringstream wss;
+    wss << L"expand data block starts, currentMmfCount=" << m_currentMmfCount;
+    m_logger->Log(wss.str().c_str());
+
+    if (m_currentMmfCount < m_pHeaderBlock.GetCurrentMMFCount())
+    {
+        m_currentMmfCount++;
+        wss.str(std::wstring());
+        wss << L"skip because currentMmfCount is smaller than global mmf count, increase currentMmfCount by 1 to " << m_currentMmfCount;
+        m_logger->Log(wss.str().c_str());
+        return;
+    }
 
-    std::memset(pMapView, 0, mapSize);
-    hMapFiles[nextMmfSequence] = hMapFile;
-    pMapViews[nextMmfSequence] = pMapView;
+    if(m_pHeaderBlock.GetCurrentMMFCount() >= m_options.MaxMmfCount)
+    {
+        m_logger->Log(L"expand data block oom");
+        throw KvOomException();
+    }
+    m_statsPage.Add(KvStatExpansions);
+    LARGE_INTEGER start;
+    if (m_statsPage.RecordsLatency())
+        QueryPerformanceCounter(&start);
+
+    // next MMF index, starts from 0 because it's C++ array index
+    // so current file COUNT is next file INDEX
+    int nextMmfSequence = m_pHeaderBlock.GetCurrentMMFCount();
+    CreateDataBlock(nextMmfSequence);
     m_pHeaderBlock.SetCurrentMMFCount(m_pHeaderBlock.GetCurrentMMFCount() + 1);
     m_currentMmfCount = m_pHeaderBlock.GetCurrentMMFCount();
+    if (m_statsPage.RecordsLatency())
+    {
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&end);
+        m_statsPage.RecordLatency(KvLatencyExpand, KvLatencyInLock, end.QuadPart - start.QuadPart);
+    }
     std::wstringstream ss;
     ss << L"expand data block finished, currentMmfCount = " << m_currentMmfCount;
     m_logger->Log(ss.str().data());
@@ -145,29 +320,31 @@ void* MemoryKV::GetDataBlock(LPVOID pMapView, int i)
     return static_cast<char*>(static_cast<char*>(pMapView) + i * m_dataBlockSize);
 }
 
-void MemoryKV::SyncDataBlock(int dataBlockMmfIndex)
+LPVOID MemoryKV::MapDataBlock(int dataBlockMmfIndex)
 {
-    std::wstringstream ss;
-    ss << L"sync data block starts, mmf index = " << dataBlockMmfIndex;
-    m_logger->Log(ss.str().data());
+    if (pMapViews[dataBlockMmfIndex] != nullptr) // created by this instance, e.g. restored from an image
+        return pMapViews[dataBlockMmfIndex];
+
     wchar_t* mmfName = m_pHeaderBlock.GetMmfNameAt(dataBlockMmfIndex);
     auto mapSize = m_dataBlockSize * m_options.MaxBlocksPerMmf;
 
-    auto hMapFile = CreateFileMapping(
-        INVALID_HANDLE_VALUE,
-        nullptr,
-        PAGE_READWRITE,
-        0,
-        mapSize,
-        mmfName);
+    // with KvStorageFile a reattached DB has the segment files but no MMF yet
+    std::wstring path = GetSegmentPath(dataBlockMmfIndex);
+    HANDLE hFile;
+    bool existed;
+    LONGLONG previousSize;
+    auto hMapFile = CreateSegmentMapping(mmfName, mapSize, path.empty() ? nullptr : path.c_str(), false,
+        hFile, existed, previousSize);
     if (hMapFile == nullptr)
     {
         m_logger->Log(L"MMF not created, sync failed.");
         throw std::runtime_error("MMF not created, sync failed.");
     }
-    int error = GetLastError();
-    if (error != ERROR_ALREADY_EXISTS)
+    if (!existed && previousSize != mapSize)
     {
+        CloseHandle(hMapFile);
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
         m_logger->Log(L"MMF doesn't exists, sync failed.");
         throw std::runtime_error("MMF doesn't exists, sync failed.");
     }
@@ -181,13 +358,30 @@ void MemoryKV::SyncDataBlock(int dataBlockMmfIndex)
     if (pMapView == nullptr)
     {
         CloseHandle(hMapFile);
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
         m_logger->Log(L"Failed to map view of memory-mapped file.");
         throw std::runtime_error("Failed to map view of memory-mapped file.");
     }
 
+    hMapFiles[dataBlockMmfIndex] = hMapFile;
+    hSegmentFiles[dataBlockMmfIndex] = hFile;
+    pMapViews[dataBlockMmfIndex] = pMapView;
+    return pMapView;
+}
+
+void MemoryKV::SyncDataBlock(int dataBlockMmfIndex)
+{
+    std::wstringstream ss;
+    ss << L"sync data block starts, mmf index = " << dataBlockMmfIndex;
+    m_logger->Log(ss.str().data());
+
+    auto pMapView = MapDataBlock(dataBlockMmfIndex);
+    m_statsPage.Add(KvStatBlocksScanned, m_options.MaxBlocksPerMmf);
     for (int i = 0; i < m_options.MaxBlocksPerMmf; ++i)
     {
         DataBlock block(GetDataBlock(pMapView, i));
+        m_versionStore.AdvanceSequence(block.GetSequence());
         if (!block.IsEmpty())
         {
             long globalDbIndex = BuildGlobalDbIndex(dataBlockMmfIndex, i);
@@ -195,16 +389,165 @@ void MemoryKV::SyncDataBlock(int dataBlockMmfIndex)
         }
     }
 
-    hMapFiles[dataBlockMmfIndex] = hMapFile;
-    pMapViews[dataBlockMmfIndex] = pMapView;
-
     ss.str(std::wstring());
     ss << L"sync data block finished, mmf index = " << dataBlockMmfIndex;
     m_logger->Log(ss.str().data());
 }
 
+/**
+ * \brief map one existing MMF and collect its keys into a partial index, runs on a sync worker without any lock.
+ * blocks being written meanwhile are left in unstableBlocks and re-read under the mutex
+ */
+void MemoryKV::ScanDataBlock(int dataBlockMmfIndex, DataBlockScanResult& result)
+{
+    std::wstringstream ss;
+    ss << L"scan data block starts, mmf index = " << dataBlockMmfIndex;
+    m_logger->Log(ss.str().data());
+
+    auto pMapView = MapDataBlock(dataBlockMmfIndex);
+    m_statsPage.Add(KvStatBlocksScanned, m_options.MaxBlocksPerMmf);
+    int keyCount = 0;
+    bool reattached = m_pHeaderBlock.IsReattached();
+    for (int i = 0; i < m_options.MaxBlocksPerMmf; ++i)
+    {
+        DataBlock block(GetDataBlock(pMapView, i));
+        long globalDbIndex = BuildGlobalDbIndex(dataBlockMmfIndex, i);
+        if (reattached) // a pin in the file is the one of a previous run
+            block.ClearPins();
+        LONG version;
+        if (!block.BeginRead(version))
+        {
+            result.unstableBlocks.push_back(globalDbIndex);
+            continue;
+        }
+        LONGLONG sequence = block.GetSequence();
+        if (block.IsEmpty())
+        {
+            if (!block.EndRead(version))
+                result.unstableBlocks.push_back(globalDbIndex);
+            else if (sequence > result.highestSequence)
+                result.highestSequence = sequence;
+            continue;
+        }
+        std::wstring key(block.GetKey(), wcsnlen(block.GetKey(), m_options.MaxKeySize));
+        if (!block.EndRead(version))
+        {
+            result.unstableBlocks.push_back(globalDbIndex);
+            continue;
+        }
+        if (sequence > result.highestSequence)
+            result.highestSequence = sequence;
+        result.keyPositionMap[key] = globalDbIndex;
+        result.highestKeyPosition = globalDbIndex;
+        keyCount++;
+    }
+
+    ss.str(std::wstring());
+    ss << L"scan data block finished, mmf index = " << dataBlockMmfIndex << L",keys=" << keyCount;
+    m_logger->Log(ss.str().data());
+}
+
+/**
+ * \brief attach the MMFs that existed when Open took the header snapshot. they are mapped and scanned by a pool
+ * of workers into partial indexes outside the mutex, so writers keep going; the mutex is only taken to install the
+ * merged index. whatever is written meanwhile beyond the snapshot is picked up by the lazy refresh as usual
+ */
+void MemoryKV::ParallelSyncDataBlocks(int mmfCount)
+{
+    TraceScope trace(m_traceRing, KvTraceSync);
+    std::wstringstream ss;
+    ss << L"parallel sync data blocks starts, mmf count = " << mmfCount;
+    m_logger->Log(ss.str().data());
+
+    int workerCount = static_cast<int>(std::thread::hardware_concurrency());
+    if (workerCount > MAX_SYNC_WORKER_COUNT)
+        workerCount = MAX_SYNC_WORKER_COUNT;
+    if (workerCount > mmfCount)
+        workerCount = mmfCount;
+    if (workerCount < 1)
+        workerCount = 1;
+    int mmfPerWorker = (mmfCount + workerCount - 1) / workerCount;
+
+    // each worker takes a contiguous range, so merging in worker order keeps "later block wins" of the sequential sync
+    std::vector<DataBlockScanResult> results(workerCount);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < workerCount; w++)
+    {
+        workers.emplace_back([this, w, mmfPerWorker, mmfCount, &results]() {
+            try
+            {
+                for (int i = w * mmfPerWorker; i < mmfCount && i < (w + 1) * mmfPerWorker; i++)
+                    ScanDataBlock(i, results[w]);
+            }
+            catch (...)
+            {
+                results[w].error = std::current_exception();
+            }
+            });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    size_t keyCount = 0;
+    for (auto& result : results)
+    {
+        if (result.error)
+            std::rethrow_exception(result.error);
+        keyCount += result.keyPositionMap.size();
+    }
+
+    std::unordered_map<std::wstring, long> keyPositionMap;
+    keyPositionMap.reserve(keyCount);
+    std::vector<long> unstableBlocks;
+    long highestKeyPosition = -1;
+    LONGLONG highestSequence = 0;
+    for (auto& result : results)
+    {
+        for (auto& pair : result.keyPositionMap)
+            keyPositionMap[pair.first] = pair.second;
+        unstableBlocks.insert(unstableBlocks.end(), result.unstableBlocks.begin(), result.unstableBlocks.end());
+        if (result.highestKeyPosition > highestKeyPosition)
+            highestKeyPosition = result.highestKeyPosition;
+        if (result.highestSequence > highestSequence)
+            highestSequence = result.highestSequence;
+    }
+
+    SYNC_CALL(InstallSyncedIndex(mmfCount, keyPositionMap, highestKeyPosition, highestSequence, unstableBlocks))
+
+    ss.str(std::wstring());
+    ss << L"parallel sync data blocks finished, workers=" << workerCount << L",keys=" << keyCount
+        << L",unstable blocks=" << unstableBlocks.size();
+    m_logger->Log(ss.str().data());
+}
+
+void MemoryKV::InstallSyncedIndex(int mmfCount, std::unordered_map<std::wstring, long>& keyPositionMap,
+    long highestKeyPosition, LONGLONG highestSequence, const std::vector<long>& unstableBlocks)
+{
+    // blocks restored from an image or a file carry the sequences of a previous version store, new writes go after them
+    m_versionStore.AdvanceSequence(highestSequence);
+    m_keyPositionMap.swap(keyPositionMap);
+    RebuildOrderedIndex();
+    m_highestKeyPosition = highestKeyPosition;
+    m_currentMmfCount = mmfCount;
+
+    // writers are excluded now, so these blocks can be read directly
+    for (long globalDbIndex : unstableBlocks)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(globalDbIndex, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        m_versionStore.AdvanceSequence(block.GetSequence());
+        if (!block.IsEmpty())
+            MarkGlobalDbIndex(block.GetKey(), globalDbIndex, false);
+    }
+}
+
 void MemoryKV::SyncDataBlocks()
 {
+    if (m_currentMmfCount >= m_pHeaderBlock.GetCurrentMMFCount())
+        return; // every refresh comes here, only a sync that maps an MMF is traced
+    TraceScope trace(m_traceRing, KvTraceSync);
     while ( m_currentMmfCount < m_pHeaderBlock.GetCurrentMMFCount())
     {
         SyncDataBlock(m_currentMmfCount);
@@ -215,33 +558,181 @@ void MemoryKV::SyncDataBlocks()
     }
 }
 
-void MemoryKV::InitDataBlock()
+/**
+ * \param mmfCountToSync the existing MMF count to attach after the mutex is released, 0 if there is nothing to sync
+ * \param restoreFrom segment image to fill a DB that doesn't exist yet, may be null
+ */
+void MemoryKV::InitDataBlock(int& mmfCountToSync, const wchar_t* restoreFrom)
 {
+    mmfCountToSync = 0;
+    if (m_pHeaderBlock.GetCurrentMMFCount() == 0 && restoreFrom != nullptr)
+        RestoreDataBlocks(restoreFrom);
+    else if (restoreFrom != nullptr)
+        m_logger->Log(L"DB already exists, the image to restore is ignored.");
+
     if (m_pHeaderBlock.GetCurrentMMFCount() == 0) // to be deleted later
         ExpandDataBlock();
     else
     {
-        SyncDataBlocks();
+        // restored or reattached MMFs are indexed by the parallel sync like the ones of other instances
+        mmfCountToSync = m_pHeaderBlock.GetCurrentMMFCount();
+        if (m_pHeaderBlock.IsReattached())
+            m_expiryQueue.MarkOverflowed(); // the queue was in the page file, keys with a ttl are found by a scan
+    }
+}
+
+/**
+ * \brief fill the data block MMFs from a segment image and set the header counters, under the mutex before anybody
+ * else can see the DB. the blocks are read in place, nothing is done per key
+ */
+void MemoryKV::RestoreDataBlocks(const wchar_t* path)
+{
+    std::wstringstream ss;
+    ss << L"restore data blocks starts, image=" << path;
+    m_logger->Log(ss.str().data());
+
+    SegmentImageReader reader;
+    SegmentImageHeader header;
+    if (!reader.Open(path, header))
+    {
+        m_logger->Log(L"[Error]. Failed to open the image to restore.");
+        throw KvRestoreException();
+    }
+    if (header.MaxKeySize != m_options.MaxKeySize || header.MaxValueSize != m_options.MaxValueSize
+        || header.MaxBlocksPerMmf != m_options.MaxBlocksPerMmf || header.DataBlockSize != m_dataBlockSize
+        || header.MmfCount < 0 || header.MmfCount > m_options.MaxMmfCount)
+    {
+        m_logger->Log(L"[Error]. The image was saved with other options.");
+        throw KvRestoreException();
+    }
+
+    auto mapSize = m_dataBlockSize * m_options.MaxBlocksPerMmf;
+    SegmentImageTrailer trailer;
+    bool restored = true;
+    for (int i = 0; i < header.MmfCount && restored; i++)
+        restored = reader.Read(CreateDataBlock(i), mapSize);
+    std::vector<std::wstring> pooledValues;
+    LONG pooledCount = 0;
+    if (restored && header.FormatVersion >= 2)
+        restored = reader.Read(&pooledCount, sizeof(pooledCount)) && pooledCount >= 0;
+    for (LONG i = 0; i < pooledCount && restored; i++)
+    {
+        LONG length = 0;
+        restored = reader.Read(&length, sizeof(length)) && length > 0 && length < MAX_POOLED_VALUE_LENGTH;
+        if (restored)
+        {
+            pooledValues.emplace_back(length, L'\0');
+            restored = reader.Read(&pooledValues.back()[0], length * sizeof(wchar_t));
+        }
+    }
+    if (restored && !reader.Finish(trailer))
+        restored = false;
+    if (restored && trailer.HighestGlobalDbPosition >= header.MmfCount * m_options.MaxBlocksPerMmf)
+        restored = false;
+    if (restored && !RestorePooledValues(trailer.HighestGlobalDbPosition, pooledValues))
+        restored = false;
+    if (!restored)
+    {
+        // the header still says there is no MMF, drop the ones filled so far
+        for (int i = 0; i < header.MmfCount; i++)
+            CloseDataBlock(i);
+        m_logger->Log(L"[Error]. The image to restore is incomplete or corrupted.");
+        throw KvRestoreException();
+    }
+
+    m_pHeaderBlock.SetHighestGlobalDbPosition(trailer.HighestGlobalDbPosition);
+    m_pHeaderBlock.SetCurrentMMFCount(header.MmfCount);
+    m_expiryQueue.MarkOverflowed(); // keys with a ttl are found by a scan
+
+    ss.str(std::wstring());
+    ss << L"restore data blocks finished, mmf count=" << header.MmfCount << L",HKP=" << trailer.HighestGlobalDbPosition;
+    m_logger->Log(ss.str().data());
+}
+
+/**
+ * \brief intern the pooled values of a restored image again, the blocks have their index in the image table
+ * \return false if the DB has no pool, an index is out of the table or the pool is full
+ */
+bool MemoryKV::RestorePooledValues(long highestGlobalDbPosition, const std::vector<std::wstring>& pooledValues)
+{
+    for (long position = 0; position <= highestGlobalDbPosition; position++)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(position, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (block.IsEmpty() || block.GetValueType() != KvValuePooled)
+            continue;
+        LONGLONG index = block.GetNumeric();
+        if (!m_valuePool.IsEnabled() || index < 0 || index >= static_cast<LONGLONG>(pooledValues.size())
+            || static_cast<int>(pooledValues[index].size()) != block.GetValueLength())
+            return false;
+        LONG slot = m_valuePool.Intern(pooledValues[index].data(), block.GetValueLength());
+        if (slot < 0)
+            return false;
+        block.SetNumeric(KvValuePooled, slot);
+    }
+    return true;
+}
+
+/**
+ * \brief open the write-ahead log. the first instance replays it over whatever the DB has, the image it was restored
+ * from or nothing, the records are after-images so the ones older than the image change nothing
+ */
+void MemoryKV::InitWriteAheadLog(int& mmfCountToSync)
+{
+    if (m_wal.Setup(m_dbName, m_options.DataDirectory, m_options.Durability))
+    {
+        if (mmfCountToSync > 0)
+        {
+            SyncDataBlocks(); // the replay updates the restored keys in place
+            mmfCountToSync = 0;
+        }
+        LONGLONG replayed;
+        bool intact = m_wal.Replay([this](const WalRecordHeader& record, const wchar_t* key, const wchar_t* value)
+        {
+            if (record.Type == WalRemove)
+                RemoveBlockByKey(key);
+            else if (record.ValueType == KvValueString)
+                UpdateKeyValue(key, value, record.ValueLength, record.ExpireAt);
+            else
+                UpdateKeyNumber(key, static_cast<KvValueType>(record.ValueType), record.Numeric);
+        }, &replayed);
+        if (!intact)
+        {
+            m_wal.TearDown();
+            m_logger->Log(L"[Error]. Failed to replay the write-ahead log.");
+            throw KvRestoreException();
+        }
+        std::wstringstream ss;
+        ss << L"write-ahead log replayed, records=" << replayed;
+        m_logger->Log(ss.str().data());
     }
+    m_wal.Start();
 }
 
 void MemoryKV::InitLocalVars()
 {
-    m_dataBlockSize = (m_options.MaxKeySize + m_options.MaxValueSize) * sizeof(wchar_t);
+    m_dataBlockSize = sizeof(BlockHeader) + (m_options.MaxKeySize + m_options.MaxValueSize) * sizeof(wchar_t);
+    m_dataBlockSize = (m_dataBlockSize + sizeof(LONGLONG) - 1) / sizeof(LONGLONG) * sizeof(LONGLONG); // keep every block header aligned
+    m_maxValueLength = m_options.MaxValueSize > MAX_COMPRESSED_VALUE_LENGTH ? m_options.MaxValueSize : MAX_COMPRESSED_VALUE_LENGTH;
     m_currentMmfCount = 0;
     m_highestKeyPosition = -1;
     hMapFiles = new HANDLE[m_options.MaxMmfCount];
+    hSegmentFiles = new HANDLE[m_options.MaxMmfCount];
     pMapViews = new LPVOID[m_options.MaxMmfCount];
 
     for (int i = 0; i < m_options.MaxMmfCount; i++)
     {
         hMapFiles[i] = nullptr;
+        hSegmentFiles[i] = INVALID_HANDLE_VALUE;
         pMapViews[i] = nullptr;
     }
     m_keyPositionMap.clear();
+    m_orderedKeyPositions.clear();
 }
 
-void MemoryKV::InitializeData()
+void MemoryKV::InitializeData(int& mmfCountToSync, const wchar_t* restoreFrom)
 {
     std::wstringstream ss;
     ss << L"initialization starts. client_name=" << m_clientName
@@ -254,7 +745,17 @@ void MemoryKV::InitializeData()
     m_logger->Log(ss.str().data());
     InitLocalVars();
     InitHeaderBlock();
-    InitDataBlock();
+    m_reuseCursor = m_pHeaderBlock.GetReuseSequence(); // the blocks reused before are read by the sync
+    m_expiryQueue.Setup(m_dbName);
+    m_statsPage.Setup(m_dbName, m_options.LatencyHistograms != 0, m_options.HotKeySampling);
+    m_versionStore.Setup(m_dbName, m_dataBlockSize);
+    if (m_options.Tiering)
+        m_coldStore.Setup(m_dbName, m_options.DataDirectory, m_options.Storage == KvStorageFile);
+    if (m_options.Dedup)
+        m_valuePool.Setup(m_dbName, m_options.DataDirectory, m_options.Storage == KvStorageFile);
+    InitDataBlock(mmfCountToSync, restoreFrom);
+    if (m_options.Durability != KvDurabilityNone)
+        InitWriteAheadLog(mmfCountToSync);
 
     m_logger->Log(L"initialization done.");
 }
@@ -263,6 +764,7 @@ MemoryKV::MemoryKV(const wchar_t* clientName, std::unique_ptr<ILogger> logger)
     : m_clientName(clientName)
     , m_logger(std::move(logger))
 {
+    InitializeSRWLock(&m_localLock);
     if (!m_logger) {
         m_logger = std::make_unique<SimpleFileLogger>(clientName);
     }
@@ -273,6 +775,11 @@ MemoryKV::MemoryKV(const wchar_t* clientName, std::unique_ptr<ILogger> logger)
 
 
 void MemoryKV::Open(const wchar_t* dbName, ConfigOptions options)
+{
+    Open(dbName, options, nullptr);
+}
+
+void MemoryKV::Open(const wchar_t* dbName, ConfigOptions options, const wchar_t* restoreFrom)
 {
     if (dbName == nullptr || !options.Validate())
         throw KvInvalidOptionsException();
@@ -282,11 +789,21 @@ void MemoryKV::Open(const wchar_t* dbName, ConfigOptions options)
 
     m_dbName = dbName;
     m_options = options;
+    if (m_options.Tracing && !m_traceRing.IsRecording())
+    {
+        m_traceRing.Setup(m_dbName); // before the mutex, so the wait of Open is traced too
+        m_logger = std::make_unique<TracingLogger>(std::move(m_logger), m_traceRing);
+    }
     m_logger->SetLogLevel(m_options.LogLevel);
     m_pHeaderBlock.SetConfigOptions(options);
 
     InitMutex();
-    SYNC_CALL(InitializeData())
+    int mmfCountToSync;
+    TIMED_SYNC_CALL(KvLatencyOpen, InitializeData(mmfCountToSync, restoreFrom))
+    if (mmfCountToSync > 0)
+        ParallelSyncDataBlocks(mmfCountToSync);
+    if (!m_statsPage.IsSeeded())
+        SYNC_CALL(SeedBlockStats())
 }
 
 bool MemoryKV::IsInitialized() const
@@ -296,21 +813,30 @@ bool MemoryKV::IsInitialized() const
 
 MemoryKV::~MemoryKV()
 {
+    if (m_hMutex != nullptr) // the slot of the process is released under the mutex
+    {
+        WaitForSingleObject(m_hMutex, INFINITE);
+        m_statsPage.TearDown();
+        ReleaseMutex(m_hMutex);
+    }
     m_pHeaderBlock.TearDown();
+    m_expiryQueue.TearDown();
+    m_versionStore.TearDown();
+    m_wal.TearDown();
+    m_coldStore.TearDown();
+    m_valuePool.TearDown();
+    m_traceRing.TearDown();
 
     if (IsInitialized())
     {
         for (int i = 0; i < m_options.MaxMmfCount; i++)
-        {
-            if (pMapViews[i] != nullptr)
-                UnmapViewOfFile(pMapViews[i]);
-            if (hMapFiles[i] != nullptr)
-                CloseHandle(hMapFiles[i]);
-        }
+            CloseDataBlock(i);
         delete[] pMapViews;
         pMapViews = nullptr;
         delete[] hMapFiles;
         hMapFiles = nullptr;
+        delete[] hSegmentFiles;
+        hSegmentFiles = nullptr;
     }    
     CloseHandle(m_hMutex);  // Clean up the mutex handle
 }
@@ -332,6 +858,7 @@ void* MemoryKV::GetDataBlock(int dataBlockMmfIndex, int dataBlockIndex) const
 
 void MemoryKV::RefreshGlobalDbIndex()
 {
+    TraceScope trace(m_traceRing, KvTraceRefresh);
     std::wstringstream wss;
     wss << L"refresh global db index begin, current HKP=" << m_highestKeyPosition<<",globalHKP="<<m_pHeaderBlock.GetHighestGlobalDbPosition();
     m_logger->Log(wss.str().c_str());
@@ -357,6 +884,9 @@ void MemoryKV::RefreshGlobalDbIndex()
                                             m_options.MaxBlocksPerMmf-1 : // refresh to the end of current MMF because global Db is already in next Mmf
                                             highestBlockIndex; // global write cursor still in current Mmf
 
+    m_statsPage.Add(KvStatRefreshes);
+    if (targetRefreshBlockIndex > blockIndex)
+        m_statsPage.Add(KvStatBlocksScanned, targetRefreshBlockIndex - blockIndex);
     for (int i = blockIndex+1; i<= targetRefreshBlockIndex; i++)
     {
         DataBlock block(GetDataBlock(mmfIndex, i));
@@ -372,32 +902,133 @@ void MemoryKV::RefreshGlobalDbIndex()
 
     // sync new Mmf if any
     SyncDataBlocks();
+    ReplayReusedBlocks();
 
     m_logger->Log(L"refresh global db index end");
 }
 
 /**
- * \brief 
- * \param key 
- * \param globalDbIndex 
- * \param isKeyFirstAdded true for new added key, false for keys updated from other instances
+ * \brief pick up the keys put into blocks below the global HKP by other instances, i.e. evicted or removed blocks
+ * that got a new key. an instance that fell behind the log rebuilds its index from all the blocks
  */
-void MemoryKV::MarkGlobalDbIndex(const wchar_t* key, long globalDbIndex, bool isKeyFirstAdded)
+void MemoryKV::ReplayReusedBlocks()
 {
+    DWORD sequence = m_pHeaderBlock.GetReuseSequence();
+    if (sequence == m_reuseCursor)
+        return;
+
     std::wstringstream wss;
-    wss << L"mark globalDbIndex=" << globalDbIndex << L",HKP=" << m_highestKeyPosition << L",globalHKP=" << m_pHeaderBlock.GetHighestGlobalDbPosition()<<L",firstadded="<<isKeyFirstAdded;
+    wss << L"replay reused blocks, from=" << m_reuseCursor << L",to=" << sequence;
     m_logger->Log(wss.str().c_str());
-    m_keyPositionMap[key] = globalDbIndex;
-    if (globalDbIndex > m_highestKeyPosition)
+    if (sequence - m_reuseCursor > REUSE_LOG_SIZE)
     {
-        m_highestKeyPosition = globalDbIndex;
-        wss.str(std::wstring());
-        wss << L"set HKP to " << globalDbIndex;
-        m_logger->Log(wss.str().c_str());
+        m_logger->Log(L"reuse log overrun, rebuild the key index");
+        m_keyPositionMap.clear();
+        m_statsPage.Add(KvStatBlocksScanned, static_cast<LONGLONG>(m_currentMmfCount) * m_options.MaxBlocksPerMmf);
+        for (int mmfIndex = 0; mmfIndex < m_currentMmfCount; mmfIndex++)
+        {
+            for (int i = 0; i < m_options.MaxBlocksPerMmf; i++)
+            {
+                DataBlock block(GetDataBlock(mmfIndex, i));
+                if (!block.IsEmpty())
+                    m_keyPositionMap[block.GetKey()] = BuildGlobalDbIndex(mmfIndex, i);
+            }
+        }
+        RebuildOrderedIndex();
     }
-    if (isKeyFirstAdded) // this is the first time the key is created in this machine, increase the global DbPosition
+    else
     {
-        if (globalDbIndex > m_pHeaderBlock.GetHighestGlobalDbPosition())
+        m_statsPage.Add(KvStatBlocksScanned, sequence - m_reuseCursor);
+        for (; m_reuseCursor != sequence; m_reuseCursor++)
+        {
+            long globalDbIndex = m_pHeaderBlock.GetReusedPositionAt(m_reuseCursor);
+            int dataBlockMmfIndex;
+            int dataBlockIndex;
+            CrackGlobalDbIndex(globalDbIndex, dataBlockMmfIndex, dataBlockIndex);
+            if (dataBlockMmfIndex >= m_currentMmfCount)
+                continue;
+            DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+            if (!block.IsEmpty())
+                MarkGlobalDbIndex(block.GetKey(), globalDbIndex, false);
+        }
+    }
+    m_reuseCursor = sequence;
+}
+
+void MemoryKV::RebuildOrderedIndex()
+{
+    m_orderedKeyPositions.clear();
+    if (m_options.OrderedIndex)
+        m_orderedKeyPositions.insert(m_keyPositionMap.begin(), m_keyPositionMap.end());
+}
+
+bool MemoryKV::IsAtCapacity() const
+{
+    return m_currentMmfCount >= m_pHeaderBlock.GetCurrentMMFCount()
+        && m_pHeaderBlock.GetCurrentMMFCount() >= m_options.MaxMmfCount;
+}
+
+/**
+ * \brief CLOCK: the shared hand sweeps all the blocks and clears their reference bits till it comes to a block that
+ * hasn't been read since the last sweep. empty and expired blocks are taken right away
+ */
+void MemoryKV::EvictBlock(int& dataBlockMmfIndex, int& dataBlockIndex)
+{
+    const long blockCount = BuildGlobalDbIndex(m_currentMmfCount, 0);
+    LONGLONG now = CurrentTimeMs();
+    long globalDbIndex;
+    for (long step = 0; ; step++)
+    {
+        globalDbIndex = m_pHeaderBlock.AdvanceClockHand(blockCount);
+        CrackGlobalDbIndex(globalDbIndex, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        // after two rounds all the bits have been cleared once, unless readers keep setting them again
+        if (block.IsEmpty() || block.IsExpired(now) || !block.ClearReferenced() || step >= blockCount * 2)
+            break;
+    }
+
+    DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+    std::wstringstream wss;
+    wss << L"evict globalDbIndex=" << globalDbIndex;
+    if (!block.IsEmpty())
+    {
+        std::wstring victim(block.GetKey(), wcsnlen(block.GetKey(), m_options.MaxKeySize));
+        wss << L",key=" << victim;
+        RemoveData(block);
+        auto it = m_keyPositionMap.find(victim);
+        if (it != m_keyPositionMap.end() && it->second == globalDbIndex)
+        {
+            m_keyPositionMap.erase(it); // not UnmarkGlobalDbIndex, the block is refilled right away so HKP stays
+            m_orderedKeyPositions.erase(victim);
+        }
+    }
+    m_logger->Log(wss.str().c_str());
+}
+
+/**
+ * \brief 
+ * \param key 
+ * \param globalDbIndex 
+ * \param isKeyFirstAdded true for new added key, false for keys updated from other instances
+ */
+void MemoryKV::MarkGlobalDbIndex(const wchar_t* key, long globalDbIndex, bool isKeyFirstAdded)
+{
+    std::wstringstream wss;
+    wss << L"mark globalDbIndex=" << globalDbIndex << L",HKP=" << m_highestKeyPosition << L",globalHKP=" << m_pHeaderBlock.GetHighestGlobalDbPosition()<<L",firstadded="<<isKeyFirstAdded;
+    m_logger->Log(wss.str().c_str());
+    m_keyPositionMap[key] = globalDbIndex;
+    if (m_options.OrderedIndex)
+        m_orderedKeyPositions[key] = globalDbIndex;
+    if (globalDbIndex > m_highestKeyPosition)
+    {
+        m_highestKeyPosition = globalDbIndex;
+        wss.str(std::wstring());
+        wss << L"set HKP to " << globalDbIndex;
+        m_logger->Log(wss.str().c_str());
+    }
+    if (isKeyFirstAdded) // this is the first time the key is created in this machine, increase the global DbPosition
+    {
+        if (globalDbIndex > m_pHeaderBlock.GetHighestGlobalDbPosition())
         {
             m_pHeaderBlock.SetHighestGlobalDbPosition(globalDbIndex);
             wss.str(std::wstring());
@@ -416,6 +1047,7 @@ void MemoryKV::UnmarkGlobalDbIndex(const std::wstring& key, int data_block_mmf_i
     m_logger->Log(wss.str().c_str());
 
     m_keyPositionMap.erase(key);
+    m_orderedKeyPositions.erase(key);
     if(globalDbIndex > m_highestKeyPosition ||
         globalDbIndex > m_pHeaderBlock.GetHighestGlobalDbPosition())
     {
@@ -454,89 +1086,154 @@ void MemoryKV::UnmarkGlobalDbIndex(const std::wstring& key, int data_block_mmf_i
     }
 }
 
-bool MemoryKV::UpdateKeyValue(const std::wstring& key, const std::wstring& value)
+KvStatus MemoryKV::ValidateKeyForUpdate(const std::wstring& key)
 {
-    std::wstringstream ss;
-    ss << L"Put key=" << key.c_str() << L",value=" << value.c_str();
-    m_logger->Log(ss.str().data());
-
     if (!IsInitialized())
     {
         m_logger->Log(L"[Error]. KV is not initialized");
-        return false;
+        return KvNotInitialized;
     }
 
     if(key.empty())
     {
         m_logger->Log(L"[Error]. Key is empty.");
-        return false;
+        return KvInvalidArgument;
     }
 
-    if (static_cast<int>(key.size()) >= m_options.MaxKeySize || 
-        static_cast<int>(value.size()) >= m_options.MaxValueSize) 
+    if (static_cast<int>(key.size()) >= m_options.MaxKeySize) 
     {
-        m_logger->Log(L"[Error]. Key or value is too large.");
-        return false;
+        m_logger->Log(L"[Error]. Key is too large.");
+        return KvKeyTooLarge;
     }
+    return KvOk;
+}
 
-    try
+/**
+ * \brief find the block of the key, or take a new one for it (marked in the index, but not written yet)
+ * \param isNewKey set if the block is taken for the key now
+ */
+void MemoryKV::FindOrCreateBlock(const std::wstring& key, int& dataBlockMmfIndex, int& dataBlockIndex, bool& isNewKey)
+{
+    std::wstringstream ss;
+    while (true)
     {
-        int dataBlockMmfIndex;
-        int dataBlockIndex;
         _FetchAndFindTheBlock(key, dataBlockMmfIndex, dataBlockIndex);
-        if (dataBlockMmfIndex == -1 || dataBlockIndex == -1) // not exist till now, create new
+        isNewKey = dataBlockMmfIndex == -1 || dataBlockIndex == -1;
+        if (isNewKey) // not exist till now, create new
         {
             dataBlockIndex = FindNextAvailableBlock();
-            if (dataBlockIndex >= m_options.MaxBlocksPerMmf)
+            if (dataBlockIndex >= m_options.MaxBlocksPerMmf && m_options.EvictionMode == KvEvictionClock && IsAtCapacity())
+            {
+                EvictBlock(dataBlockMmfIndex, dataBlockIndex);
+            }
+            else
             {
-                ExpandDataBlock();
-                dataBlockIndex = FindNextAvailableBlock() % m_options.MaxBlocksPerMmf; // after data block expansion, it should never be full
+                if (dataBlockIndex >= m_options.MaxBlocksPerMmf)
+                {
+                    ExpandDataBlock();
+                    dataBlockIndex = FindNextAvailableBlock() % m_options.MaxBlocksPerMmf; // after data block expansion, it should never be full
+                }
+                dataBlockMmfIndex = m_pHeaderBlock.GetCurrentMMFCount() - 1;
             }
-            dataBlockMmfIndex = m_pHeaderBlock.GetCurrentMMFCount() - 1;
             long globalDbIndex = BuildGlobalDbIndex(dataBlockMmfIndex, dataBlockIndex);
+            bool reused = globalDbIndex <= m_pHeaderBlock.GetHighestGlobalDbPosition();
+            if (reused)
+                m_pHeaderBlock.AppendReusedPosition(globalDbIndex); // other instances only refresh beyond their HKP
+            m_statsPage.BlockFilled(reused);
 
             MarkGlobalDbIndex(key.c_str(), globalDbIndex, true);
             ss.str(std::wstring());
             ss << L"find new slot. mmf index=" << dataBlockMmfIndex << L",data block index=" << dataBlockIndex;
             m_logger->Log(ss.str().data());
+            return;
         }
-        else //key exist before, verify its key-position is correct
-        {
-            ss.str(std::wstring());
-            ss << L"find existing slot. mmf index=" << dataBlockMmfIndex << L",data block index=" << dataBlockIndex;
-            m_logger->Log(ss.str().data());
 
-            DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
-            BlockState state = ValidateBlock(block, key);
+        //key exist before, verify its key-position is correct
+        ss.str(std::wstring());
+        ss << L"find existing slot. mmf index=" << dataBlockMmfIndex << L",data block index=" << dataBlockIndex;
+        m_logger->Log(ss.str().data());
 
-            if (state == Empty) //this key was added before, but removed by somebody from another process, now need to add it again
-            {
-                UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
-                ss.str(std::wstring());
-                ss << L"block has been removed, unmark db index and add it back again.";
-                m_logger->Log(ss.str().data());
-                return UpdateKeyValue(key, value);
-            }
-        }
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (ValidateBlock(block, key) == Normal)
+            return;
+
+        //this key was added before, but removed or evicted by somebody from another process, now need to add it again
+        UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
+        ss.str(std::wstring());
+        ss << L"block has been removed, unmark db index and add it back again.";
+        m_logger->Log(ss.str().data());
+    }
+}
+
+KvStatus MemoryKV::UpdateKeyValue(const std::wstring& key, const wchar_t* value, int valueLength, LONGLONG expireAt)
+{
+    std::wstringstream ss;
+    ss << L"Put key=" << key.c_str() << L",value=";
+    ss.write(value, valueLength);
+    m_logger->Log(ss.str().data());
+
+    KvStatus status = ValidateKeyForUpdate(key);
+    if (status != KvOk)
+        return status;
+
+    KvValueType valueType;
+    LONGLONG encoding;
+    status = EncodeValue(value, valueLength, valueType, encoding);
+    if (status != KvOk)
+    {
+        m_logger->Log(L"[Error]. Value is too large.");
+        return status;
+    }
+
+    try
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        bool isNewKey;
+        FindOrCreateBlock(key, dataBlockMmfIndex, dataBlockIndex, isNewKey);
 
         DataBlock block = GetDataBlock(dataBlockMmfIndex, dataBlockIndex);
+        BeginVersionedWrite(block);
         block.SetKey(key.c_str(), m_options.MaxKeySize);
-        block.SetValue(value.c_str(), m_options.MaxKeySize, m_options.MaxValueSize);
+        StoreValue(block, value, valueLength, valueType, encoding);
+        block.SetExpireAt(expireAt);
+        EndVersionedWrite(block);
+        if (m_options.EvictionMode == KvEvictionClock && !isNewKey)
+            block.Touch();
+        else if (m_options.Tiering)
+            block.Touch(ReferencedTiering); // a value just written is hot
+        if (expireAt != 0 && !m_expiryQueue.Push({ expireAt, BuildGlobalDbIndex(dataBlockMmfIndex, dataBlockIndex), 0 }))
+            m_logger->Log(L"expiry queue is full, the host service will scan for it");
         m_logger->Log(L"put value successfully");
-        return true;
+        return KvOk;
     
     }
     catch(const KvOomException& e)
     {
-        return false;
+        ReleaseValue(valueType, encoding); // interned for nothing
+        return KvOutOfMemory;
     }
 }
 
 bool MemoryKV::Put(const std::wstring& key, const std::wstring& value)
 {
+    m_statsPage.Add(KvStatPuts);
+    m_statsPage.SampleKey(key);
     bool result;
-    SYNC_CALL(result = UpdateKeyValue(key, value))
-    return result;
+    TIMED_SYNC_CALL(KvLatencyPut, result = UpdateKeyValue(key, value.c_str(), static_cast<int>(value.size())) == KvOk)
+    return CommitLog() && result;
+}
+
+bool MemoryKV::Put(const std::wstring& key, const std::wstring& value, long long ttlMilliseconds)
+{
+    if (ttlMilliseconds <= 0)
+        return Put(key, value);
+
+    m_statsPage.Add(KvStatPuts);
+    m_statsPage.SampleKey(key);
+    bool result;
+    TIMED_SYNC_CALL(KvLatencyPut, result = UpdateKeyValue(key, value.c_str(), static_cast<int>(value.size()), CurrentTimeMs() + ttlMilliseconds) == KvOk)
+    return CommitLog() && result;
 }
 
 void MemoryKV::CrackGlobalDbIndex(long globalDbIndex, int& dataBlockMmfIndex, int& dataBlockIndex) const
@@ -581,7 +1278,7 @@ void MemoryKV::_FetchAndFindTheBlock(const std::wstring& key, int& dataBlockMmfI
     }
 }
 
-void MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
+KvStatus MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
 {
     std::wstringstream ss;
     ss << L"Get key=" << key.c_str();
@@ -591,7 +1288,7 @@ void MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
         result = L"";
         ss << L"\n[Error]. KV is not initialized";
         m_logger->Log(ss.str().data());
-        return;
+        return KvNotInitialized;
     }
 
     if (key.empty() || static_cast<int>(key.size()) >= m_options.MaxKeySize)
@@ -599,7 +1296,7 @@ void MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
         result = L"";
         ss << L"\n[Error]. Key size wrong.";
         m_logger->Log(ss.str().data());
-        return;
+        return key.empty() ? KvInvalidArgument : KvKeyTooLarge;
     }
     
     int dataBlockMmfIndex;
@@ -610,6 +1307,7 @@ void MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
         result = L"";
         ss << L". not found";
         m_logger->Log(ss.str().data());
+        return KvNotFound;
     }
     else 
     {
@@ -619,92 +1317,2013 @@ void MemoryKV::QueryValueByKey(const std::wstring& key, const wchar_t*& result)
 
         auto state = ValidateBlock(block, key);
 
+        if (state == BlockState::Normal && block.IsExpired(CurrentTimeMs()))
+        {
+            RemoveData(block);
+            UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, true);
+            result = L"";
+            ss.str(std::wstring());
+            ss << L"key has expired, removed.";
+            m_logger->Log(ss.str().data());
+            return KvNotFound;
+        }
+
+        if (state == BlockState::Mismatch) // evicted, the key may have been put again somewhere else
+        {
+            UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
+            return QueryValueByKey(key, result);
+        }
+
         if (state == BlockState::Normal)
         {
+            if (TracksAccess())
+                block.Touch();
             //ss.str(std::wstring());
             //ss << L"value=" << block.GetValue(m_options.MaxKeySize);
             //m_logger->Log(ss.str().data());
-            result = block.GetValue(m_options.MaxKeySize);
+            result = ValueOf(block);
+            return KvOk;
         }
-        else if(state == BlockState::Empty)
-        {
-            result = L"";
-            UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
 
-            ss.str(std::wstring());
-            ss << L"block has been removed, query failed.";
-            m_logger->Log(ss.str().data());
+        result = L"";
+        UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
+
+        ss.str(std::wstring());
+        ss << L"block has been removed, query failed.";
+        m_logger->Log(ss.str().data());
+        return KvNotFound;
+    }
+}
+
+KvStatus MemoryKV::CopyValueByKey(const std::wstring& key, wchar_t* buffer, int bufferLength, int* valueLength)
+{
+    const wchar_t* value;
+    KvStatus status = QueryValueByKey(key, value);
+    int length = (status == KvOk) ? static_cast<int>(wcsnlen(value, m_maxValueLength)) : 0;
+    if (valueLength != nullptr)
+        *valueLength = length;
+    if (status != KvOk)
+        return status;
+
+    if (buffer == nullptr || bufferLength <= length) // no room for the value and its NUL
+        return KvBufferTooSmall;
+
+    wmemcpy(buffer, value, length);
+    buffer[length] = L'\0';
+    return KvOk;
+}
+
+/**
+ * \brief find the block of a key this instance already knows, without the named mutex
+ * \return nullptr if the key is unknown, the caller must validate the block content
+ */
+void* MemoryKV::FindKnownBlock(const std::wstring& key)
+{
+    void* pBlock = nullptr;
+    AcquireSRWLockShared(&m_localLock);
+    if (IsInitialized())
+    {
+        auto it = m_keyPositionMap.find(key);
+        if (it != m_keyPositionMap.end())
+        {
+            int dataBlockMmfIndex;
+            int dataBlockIndex;
+            CrackGlobalDbIndex(it->second, dataBlockMmfIndex, dataBlockIndex);
+            pBlock = GetDataBlock(dataBlockMmfIndex, dataBlockIndex); // map views are kept till the instance is destroyed
         }
     }
+    ReleaseSRWLockShared(&m_localLock);
+    return pBlock;
+}
+
+/**
+ * \brief lock-free read for a known key, the block version tells whether a writer interfered
+ * \return false if the locked path is needed: unknown key, removed or replaced block, or a concurrent write
+ */
+bool MemoryKV::QueryKnownValueByKey(const std::wstring& key, const wchar_t*& result)
+{
+    void* pBlock = FindKnownBlock(key);
+    if (pBlock == nullptr)
+        return false;
+
+    DataBlock block(pBlock);
+    LONG version;
+    if (!block.BeginRead(version))
+        return false;
+    bool matched = !block.IsEmpty() && std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) == 0;
+    bool expired = block.IsExpired(CurrentTimeMs());
+    const wchar_t* value = matched ? ValueOf(block) : nullptr; // a cold pointer must be read before EndRead
+    if (!block.EndRead(version) || !matched || expired) // an expired block is removed by the locked path
+        return false;
+    if (TracksAccess())
+        block.Touch();
+
+    std::wstringstream ss;
+    ss << L"Get key=" << key.c_str() << L". lock free hit";
+    m_logger->Log(ss.str().data());
+    result = value;
+    return true;
+}
+
+bool MemoryKV::CopyKnownValueByKey(const std::wstring& key, wchar_t* buffer, int bufferLength, int* valueLength, KvStatus& status)
+{
+    void* pBlock = FindKnownBlock(key);
+    if (pBlock == nullptr)
+        return false;
+
+    DataBlock block(pBlock);
+    LONG version;
+    if (!block.BeginRead(version))
+        return false;
+    bool matched = !block.IsEmpty() && std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) == 0
+        && !block.IsExpired(CurrentTimeMs());
+    const wchar_t* value = matched ? ValueOf(block) : L"";
+    int length = static_cast<int>(wcsnlen(value, m_maxValueLength));
+    bool fits = buffer != nullptr && bufferLength > length;
+    if (matched && fits)
+        wmemcpy(buffer, value, length);
+    if (!block.EndRead(version) || !matched)
+        return false;
+    if (TracksAccess())
+        block.Touch();
+
+    std::wstringstream ss;
+    ss << L"Get key=" << key.c_str() << L". lock free hit";
+    m_logger->Log(ss.str().data());
+    if (valueLength != nullptr)
+        *valueLength = length;
+    if (fits)
+        buffer[length] = L'\0';
+    status = fits ? KvOk : KvBufferTooSmall;
+    return true;
+}
+
+/**
+ * \brief a found key whose value didn't fit the buffer is a hit as well
+ */
+void MemoryKV::CountGet(KvStatus status)
+{
+    m_statsPage.Add(KvStatGets);
+    if (status == KvOk || status == KvBufferTooSmall)
+        m_statsPage.Add(KvStatGetHits);
+    else if (status == KvNotFound)
+        m_statsPage.Add(KvStatGetMisses);
+}
+
+/**
+ * \brief a lock-free Get has no wait, its read is recorded as the in-lock time
+ */
+void MemoryKV::RecordLockFreeGet(const LARGE_INTEGER& start)
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    m_statsPage.RecordLatency(KvLatencyGet, KvLatencyInLock, end.QuadPart - start.QuadPart);
 }
 
 const wchar_t* MemoryKV::Get(const std::wstring& key)
 {
+    m_statsPage.SampleKey(key);
     const wchar_t* result;
-    SYNC_CALL(QueryValueByKey(key, result))
+    LARGE_INTEGER start = {};
+    if (m_statsPage.RecordsLatency())
+        QueryPerformanceCounter(&start);
+    if (QueryKnownValueByKey(key, result))
+    {
+        if (m_statsPage.RecordsLatency())
+            RecordLockFreeGet(start);
+        CountGet(KvOk);
+        return result;
+    }
+
+    KvStatus status;
+    TIMED_SYNC_CALL(KvLatencyGet, status = QueryValueByKey(key, result))
+    CountGet(status);
     return result;
 }
 
-void MemoryKV::RemoveData(DataBlock& block) const
+/**
+ * \brief the value of key if block holds it live, read between two reads of the version
+ * \return false if a writer had the block every time
+ */
+bool MemoryKV::ReadScanItem(const DataBlock& block, const std::wstring& key, LONGLONG now, bool& matched,
+    std::wstring& value)
 {
-    block.SetKey(L"", m_options.MaxKeySize);
-    block.SetValue(L"", m_options.MaxKeySize, m_options.MaxValueSize);
+    for (int spin = 0; spin < MAX_PIN_WAIT_SPINS; spin++)
+    {
+        LONG version;
+        if (block.BeginRead(version))
+        {
+            matched = !block.IsEmpty() && std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) == 0
+                && !block.IsExpired(now);
+            if (matched)
+            {
+                const wchar_t* pValue = ValueOf(block);
+                value.assign(pValue, wcsnlen(pValue, m_maxValueLength));
+            }
+            if (block.EndRead(version))
+                return true;
+        }
+        YieldProcessor();
+    }
+    return false;
 }
 
-BlockState MemoryKV::ValidateBlock(DataBlock& block, const std::wstring& key)
+/**
+ * \brief copy up to count live keys after cursor (or at it, if inclusive) out of the ordered index, under the shared
+ * local lock, and move the cursor past them. stale entries of keys removed by other instances are skipped by
+ * comparing the block key. a block a writer keeps ends the batch: the local lock is released and it's read again
+ * under the DB mutex, where only a writer that died can have it, its key is skipped then
+ * \return true if the index has more keys before to
+ */
+bool MemoryKV::CollectScanBatch(std::wstring& cursor, bool& inclusive, const std::wstring& to, size_t count,
+    std::vector<std::pair<std::wstring, std::wstring>>& items)
 {
-    if (block.IsEmpty())
+    AcquireSRWLockShared(&m_localLock);
+    LONGLONG now = CurrentTimeMs();
+    auto it = inclusive ? m_orderedKeyPositions.lower_bound(cursor) : m_orderedKeyPositions.upper_bound(cursor);
+    void* pUnstableBlock = nullptr;
+    for (; it != m_orderedKeyPositions.end() && items.size() < count; ++it)
     {
-        m_logger->Log(L"the block is empty");
-        return BlockState::Empty;
+        if (!to.empty() && it->first >= to)
+        {
+            it = m_orderedKeyPositions.end();
+            break;
+        }
+
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(it->second, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        bool matched;
+        std::wstring value;
+        if (!ReadScanItem(block, it->first, now, matched, value))
+        {
+            pUnstableBlock = block.m_pData;
+            cursor = it->first;
+            break;
+        }
+        if (matched) // scans don't set the CLOCK reference bit, they aren't a sign of a hot key
+            items.emplace_back(it->first, std::move(value));
     }
-    if (std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) != 0)
+    bool hasMore = it != m_orderedKeyPositions.end();
+    ReleaseSRWLockShared(&m_localLock);
+
+    if (pUnstableBlock != nullptr)
     {
-        std::wstringstream wss;
-        wss << L". mismatched key and position. the key in block is " << block.GetKey()<<", the input key is " <<key;
-        m_logger->Log(wss.str().data());
-        throw std::runtime_error("key and position doesn't match");
+        // the views stay mapped while this instance lives, and its own writers need the mutex too
+        bool matched = false;
+        std::wstring value;
+        AcquireDbMutex();
+        bool stable = ReadScanItem(DataBlock(pUnstableBlock), cursor, now, matched, value);
+        ReleaseDbMutex(KvLatencyOpCount);
+        if (!stable)
+        {
+            std::wstringstream ss;
+            ss << L"[Error]. Scan skips a key left half written, key=" << cursor.c_str();
+            m_logger->Log(ss.str().data());
+        }
+        else if (matched)
+            items.emplace_back(cursor, std::move(value));
     }
-    return BlockState::Normal;
+    else if (!items.empty())
+        cursor = items.back().first;
+    inclusive = inclusive && pUnstableBlock == nullptr && items.empty();
+    return hasMore;
 }
 
-void MemoryKV::RemoveBlockByKey(const std::wstring& key)
+int MemoryKV::Scan(const std::wstring& from, const std::wstring& to, int limit, KvScanVisitor visitor, void* context)
 {
     std::wstringstream ss;
-    ss << L"Remove key=" << key.c_str();
+    ss << L"Scan from=" << from.c_str() << L",to=" << to.c_str() << L",limit=" << limit;
+    m_logger->Log(ss.str().data());
 
-    if(!IsInitialized())
+    if (!IsInitialized() || !m_options.OrderedIndex || visitor == nullptr || limit < 0)
     {
-        ss << L"\n[Error] KV is not initialized";
-        m_logger->Log(ss.str().data());
-        return;
+        m_logger->Log(L"[Error]. KV is not initialized with OrderedIndex, or invalid argument.");
+        return -1;
     }
 
-    int dataBlockMmfIndex;
-    int dataBlockIndex;
-    _FetchAndFindTheBlock(key, dataBlockMmfIndex, dataBlockIndex);
-    if (dataBlockMmfIndex == -1 || dataBlockIndex == -1) // not found
+    m_statsPage.Add(KvStatScans);
+    SYNC_CALL(RefreshGlobalDbIndex()) // once, keys put during the scan may or may not be visited
+
+    int visited = 0;
+    std::wstring cursor = from;
+    bool inclusive = true;
+    std::vector<std::pair<std::wstring, std::wstring>> items;
+    for (;;)
     {
-        ss << L". not found, probably already removed.";
-        m_logger->Log(ss.str().data());
+        size_t count = SCAN_BATCH_SIZE;
+        if (limit > 0 && static_cast<size_t>(limit - visited) < count)
+            count = static_cast<size_t>(limit - visited);
+        items.clear();
+        bool hasMore = CollectScanBatch(cursor, inclusive, to, count, items);
+        for (auto& item : items)
+        {
+            visited++;
+            if (!visitor(item.first.c_str(), static_cast<int>(item.first.size()),
+                item.second.c_str(), static_cast<int>(item.second.size()), context))
+                return visited;
+        }
+        if (!hasMore || (limit > 0 && visited >= limit))
+            return visited;
     }
-    else // found it, need to remove
-    {
-        ss << L". find the slot: mmf index=" << dataBlockMmfIndex << L",data block index=" << dataBlockIndex;
-        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
-        m_logger->Log(ss.str().data());
+}
 
-        ValidateBlock(block, key);
-        ss.str(std::wstring());
-        ss << L"value=" << block.GetValue(m_options.MaxKeySize) << " is removed.";
+int MemoryKV::ScanPrefix(const std::wstring& prefix, int limit, KvScanVisitor visitor, void* context)
+{
+    // the first key after all the keys with the prefix: bump the last character that can be bumped
+    std::wstring to = prefix;
+    while (!to.empty() && to.back() == WCHAR_MAX)
+        to.pop_back();
+    if (!to.empty())
+        to.back()++;
+    return Scan(prefix, to, limit, visitor, context);
+}
 
-        RemoveData(block);
-        UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, true);
-        m_logger->Log(ss.str().data());
+/**
+ * \brief BeginWrite that stamps the commit sequence, and first keeps the current content in the version store
+ * if an open snapshot can still see it. under the mutex
+ */
+void MemoryKV::BeginVersionedWrite(DataBlock& block)
+{
+    LONGLONG sequence = m_versionStore.NextSequence();
+    LONGLONG versionHead = block.GetVersionHead();
+    if (!block.IsEmpty() && m_versionStore.NeedsVersion(block.GetSequence()))
+        versionHead = m_versionStore.Preserve(block.m_pData, block.GetSequence(), versionHead, sequence);
+    block.BeginWrite();
+    block.SetVersion(sequence, versionHead);
+}
+
+/**
+ * \brief EndWrite, then the new content goes to the write-ahead log if the DB has one
+ */
+void MemoryKV::EndVersionedWrite(DataBlock& block)
+{
+    block.EndWrite();
+    if (m_wal.IsEnabled())
+        LogBlockWrite(block, WalPut);
+}
+
+void MemoryKV::LogBlockWrite(const DataBlock& block, WalRecordType type)
+{
+    WalRecordHeader record{};
+    record.Type = type;
+    record.KeyLength = static_cast<LONG>(wcsnlen(block.GetKey(), m_options.MaxKeySize));
+    const wchar_t* value = block.GetValue(m_options.MaxKeySize);
+    if (type == WalPut)
+    {
+        record.ValueType = block.GetValueType();
+        record.ValueLength = record.ValueType == KvValueString ? block.GetValueLength() : 0;
+        record.ExpireAt = block.GetExpireAt();
+        record.Numeric = block.GetNumeric();
+        if (record.ValueType == KvValueCompressed || record.ValueType == KvValuePooled) // logged as the text, the replay encodes it again
+        {
+            value = ValueOf(block);
+            record.ValueType = KvValueString;
+            record.ValueLength = static_cast<LONG>(wcsnlen(value, m_maxValueLength));
+            record.Numeric = 0;
+        }
     }
+    if (!m_wal.Append(record, block.GetKey(), value))
+        m_logger->Log(L"[Error]. Failed to append to the write-ahead log.");
 }
 
-void MemoryKV::Remove(const std::wstring& key)
+void MemoryKV::GetLogStats(long long* records, long long* flushes) const
+{
+    if (records != nullptr)
+        *records = m_wal.GetRecordCount();
+    if (flushes != nullptr)
+        *flushes = m_wal.GetFlushCount();
+}
+
+/**
+ * \brief heap of a node based map keyed by wstring: the nodes with their links, and the key characters that don't fit
+ * in the small string buffer. links is the pointer-sized words of a node besides the value, as in the MSVC containers
+ */
+template <class KeyMap>
+static LONGLONG EstimateKeyMapBytes(const KeyMap& keyMap, size_t links)
 {
-    SYNC_CALL(RemoveBlockByKey(key))
+    LONGLONG bytes = static_cast<LONGLONG>(keyMap.size()) * (links * sizeof(void*) + sizeof(typename KeyMap::value_type));
+    size_t smallCapacity = std::wstring().capacity();
+    for (const auto& item : keyMap)
+    {
+        if (item.first.capacity() > smallCapacity)
+            bytes += static_cast<LONGLONG>(item.first.capacity() + 1) * sizeof(wchar_t);
+    }
+    return bytes;
 }
+
+/**
+ * \brief under the mutex
+ */
+void MemoryKV::CollectMemoryStats(KvMemoryStats& stats) const
+{
+    long blockCount = m_currentMmfCount * m_options.MaxBlocksPerMmf;
+    long usedCount = m_pHeaderBlock.GetHighestGlobalDbPosition() + 1;
+    if (usedCount > blockCount)
+        usedCount = blockCount;
+    stats.DataBytes = static_cast<LONGLONG>(blockCount) * m_dataBlockSize;
+    stats.SharedBytes = stats.DataBytes + m_pHeaderBlock.GetMappedBytes() + m_expiryQueue.GetMappedBytes()
+        + m_versionStore.GetMappedBytes() + m_wal.GetMappedBytes() + m_coldStore.GetMappedBytes() + m_valuePool.GetMappedBytes()
+        + m_statsPage.GetMappedBytes() + m_traceRing.GetMappedBytes();
+    stats.HeadroomBytes = static_cast<LONGLONG>(blockCount - usedCount) * m_dataBlockSize;
+
+    for (long position = 0; position < usedCount; position++)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(position, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (block.IsEmpty())
+        {
+            stats.FreeBlockBytes += m_dataBlockSize;
+            continue;
+        }
+        // the numbers live in the block header, cold and pooled strings in their own segments
+        LONGLONG payload = static_cast<LONGLONG>(wcsnlen(block.GetKey(), m_options.MaxKeySize)) * sizeof(wchar_t);
+        if (block.GetValueType() == KvValueString)
+            payload += static_cast<LONGLONG>(block.GetValueLength()) * sizeof(wchar_t);
+        else if (block.GetValueType() == KvValueCompressed)
+            payload += block.GetNumeric();
+        stats.LiveKeys++;
+        stats.PayloadBytes += payload;
+        stats.PaddingBytes += m_dataBlockSize - payload;
+    }
+
+    // MSVC: a hash node has two links and the bucket array two iterators per bucket, a tree node three links and flags
+    stats.IndexBytes = EstimateKeyMapBytes(m_keyPositionMap, 2)
+        + static_cast<LONGLONG>(m_keyPositionMap.bucket_count()) * 2 * sizeof(void*)
+        + EstimateKeyMapBytes(m_orderedKeyPositions, 4);
+}
+
+KvStatus MemoryKV::GetMemoryStats(KvMemoryStats& stats)
+{
+    stats = KvMemoryStats();
+    if (!IsInitialized())
+        return KvNotInitialized;
+    SYNC_CALL(RefreshGlobalDbIndex(); CollectMemoryStats(stats)) // maps the MMFs other instances added first
+    return KvOk;
+}
+
+/**
+ * \brief count the live and removed blocks once for a new stats page, the DB may have been restored or reattached to
+ * its files. under the mutex, after the sync of Open
+ */
+void MemoryKV::SeedBlockStats()
+{
+    if (m_statsPage.IsSeeded()) // by another instance meanwhile
+        return;
+    RefreshGlobalDbIndex();
+    long blockCount = m_currentMmfCount * m_options.MaxBlocksPerMmf;
+    long usedCount = m_pHeaderBlock.GetHighestGlobalDbPosition() + 1;
+    if (usedCount > blockCount)
+        usedCount = blockCount;
+    LONGLONG liveBlocks = 0;
+    for (long position = 0; position < usedCount; position++)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(position, dataBlockMmfIndex, dataBlockIndex);
+        if (!DataBlock(GetDataBlock(dataBlockMmfIndex, dataBlockIndex)).IsEmpty())
+            liveBlocks++;
+    }
+    m_statsPage.Seed(liveBlocks, usedCount - liveBlocks);
+}
+
+KvStatus MemoryKV::GetStats(KvStats& stats, bool thisProcessOnly) const
+{
+    if (!IsInitialized())
+    {
+        stats = KvStats();
+        return KvNotInitialized;
+    }
+    m_statsPage.Read(stats, thisProcessOnly ? GetCurrentProcessId() : 0);
+    return KvOk;
+}
+
+KvStatus MemoryKV::ReadStats(const wchar_t* dbName, KvStats& stats)
+{
+    stats = KvStats();
+    if (dbName == nullptr)
+        return KvInvalidArgument;
+    return StatsPage::Read(dbName, stats) ? KvOk : KvNotFound;
+}
+
+static bool IsLatencyHistogram(KvLatencyOp op, KvLatencyPhase phase)
+{
+    return op >= KvLatencyPut && op < KvLatencyOpCount && phase >= KvLatencyLockWait && phase < KvLatencyPhaseCount;
+}
+
+KvStatus MemoryKV::GetLatencyHistogram(KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram,
+    bool thisProcessOnly) const
+{
+    histogram.Reset();
+    if (!IsInitialized())
+        return KvNotInitialized;
+    if (!IsLatencyHistogram(op, phase))
+        return KvInvalidArgument;
+    if (m_statsPage.RecordsLatency())
+        m_statsPage.ReadLatency(op, phase, histogram, thisProcessOnly ? GetCurrentProcessId() : 0);
+    else if (!thisProcessOnly)
+        StatsPage::ReadLatency(m_dbName, op, phase, histogram);
+    return KvOk;
+}
+
+KvStatus MemoryKV::ReadLatencyHistogram(const wchar_t* dbName, KvLatencyOp op, KvLatencyPhase phase,
+    LatencyHistogram& histogram)
+{
+    histogram.Reset();
+    if (dbName == nullptr || !IsLatencyHistogram(op, phase))
+        return KvInvalidArgument;
+    return StatsPage::ReadLatency(dbName, op, phase, histogram) ? KvOk : KvNotFound;
+}
+
+KvStatus MemoryKV::GetHotKeys(KvHotKey* keys, int capacity, int* count) const
+{
+    if (count != nullptr)
+        *count = 0;
+    if (!IsInitialized())
+        return KvNotInitialized;
+    if (capacity < 0 || (keys == nullptr && capacity > 0))
+        return KvInvalidArgument;
+    int copied = m_statsPage.SamplesKeys() ? m_statsPage.ReadHotKeys(keys, capacity)
+        : StatsPage::ReadHotKeys(m_dbName, keys, capacity);
+    if (count != nullptr)
+        *count = copied < 0 ? 0 : copied;
+    return KvOk;
+}
+
+KvStatus MemoryKV::ReadHotKeys(const wchar_t* dbName, KvHotKey* keys, int capacity, int* count)
+{
+    if (count != nullptr)
+        *count = 0;
+    if (dbName == nullptr || capacity < 0 || (keys == nullptr && capacity > 0))
+        return KvInvalidArgument;
+    int copied = StatsPage::ReadHotKeys(dbName, keys, capacity);
+    if (copied < 0)
+        return KvNotFound;
+    if (count != nullptr)
+        *count = copied;
+    return KvOk;
+}
+
+KvStatus MemoryKV::WriteTrace(const wchar_t* dbName, const wchar_t* path, int milliseconds)
+{
+    if (dbName == nullptr || path == nullptr || milliseconds <= 0)
+        return KvInvalidArgument;
+    std::vector<KvTraceEvent> events;
+    LONGLONG frequency;
+    if (!TraceRing::Read(dbName, milliseconds, events, frequency))
+        return KvNotFound;
+    return TraceRing::WriteChromeTrace(path, events, frequency) ? KvOk : KvError;
+}
+
+KvStatus MemoryKV::Flush(bool waitForDisk)
+{
+    if (!IsInitialized())
+        return KvNotInitialized;
+    if (m_options.Storage != KvStorageFile)
+        return KvOk;
+
+    SYNC_CALL(RefreshGlobalDbIndex()) // maps the MMFs other instances added
+    bool flushed = m_pHeaderBlock.Flush(waitForDisk);
+    AcquireSRWLockShared(&m_localLock);
+    for (int i = 0; i < m_currentMmfCount; i++)
+        flushed = FlushSegment(pMapViews[i], waitForDisk ? hSegmentFiles[i] : INVALID_HANDLE_VALUE) && flushed;
+    ReleaseSRWLockShared(&m_localLock);
+    if (m_coldStore.IsEnabled())
+        flushed = m_coldStore.Flush(waitForDisk) && flushed;
+    if (m_valuePool.IsEnabled())
+        flushed = m_valuePool.Flush(waitForDisk) && flushed;
+    if (flushed)
+        return KvOk;
+    m_logger->Log(L"[Error]. Failed to flush the segment files.");
+    return KvError;
+}
+
+KvStatus MemoryKV::RebalanceTiers(int* demoted, int* promoted)
+{
+    if (demoted != nullptr)
+        *demoted = 0;
+    if (promoted != nullptr)
+        *promoted = 0;
+    if (!IsInitialized())
+        return KvNotInitialized;
+    if (!m_coldStore.IsEnabled())
+        return KvOk;
+
+    int demotedCount = 0;
+    int promotedCount = 0;
+    bool full = false;
+    for (long position = 0; position >= 0; )
+    {
+        SYNC_CALL(position = RebalanceBlocks(position, demotedCount, promotedCount, full))
+    }
+
+    std::wstringstream ss;
+    ss << L"rebalance tiers done, demoted=" << demotedCount << L",promoted=" << promotedCount << L",full=" << full;
+    m_logger->Log(ss.str().data());
+    if (demoted != nullptr)
+        *demoted = demotedCount;
+    if (promoted != nullptr)
+        *promoted = promotedCount;
+    return full ? KvOutOfMemory : KvOk;
+}
+
+/**
+ * \brief up to TIERING_BATCH_SIZE blocks of a tiering pass, under the mutex. moving a value doesn't change it, so the
+ * block keeps its sequence and nothing is logged; lock-free readers retry on the version as for any write
+ * \return the position to continue from, -1 once the pass is over
+ */
+long MemoryKV::RebalanceBlocks(long position, int& demoted, int& promoted, bool& full)
+{
+    RefreshGlobalDbIndex(); // maps the MMFs other instances added
+    const long blockCount = BuildGlobalDbIndex(m_currentMmfCount, 0);
+    const long end = position + TIERING_BATCH_SIZE < blockCount ? position + TIERING_BATCH_SIZE : blockCount;
+    LONGLONG now = CurrentTimeMs();
+    for (; position < end; position++)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(position, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (block.IsEmpty() || block.IsExpired(now))
+            continue;
+
+        bool referenced = block.ClearReferenced(ReferencedTiering);
+        char* firstPage;
+        SIZE_T pagesSize;
+        if (block.GetValueType() == KvValueCold && referenced)
+        {
+            block.BeginWrite();
+            PromoteValue(block);
+            block.EndWrite();
+            m_coldStore.CountPromotion();
+            promoted++;
+        }
+        else if (block.GetValueType() == KvValueString && !referenced && !full
+            && block.GetValueLength() >= COLD_MIN_VALUE_LENGTH && GetValuePages(block, firstPage, pagesSize))
+        {
+            int length = block.GetValueLength();
+            LONGLONG pointer = m_coldStore.Store(block.GetValue(m_options.MaxKeySize), length);
+            if (pointer < 0)
+            {
+                m_logger->Log(L"[Error]. The cold store is full.");
+                full = true;
+                continue;
+            }
+            block.BeginWrite();
+            block.SetNumeric(KvValueCold, pointer);
+            DiscardValuePages(firstPage, pagesSize);
+            block.EndWrite();
+            demoted++;
+        }
+    }
+    return position < blockCount ? position : -1;
+}
+
+void MemoryKV::GetLockStats(long long* acquisitions, long long* contended, long long* waitMicroseconds) const
+{
+    if (acquisitions != nullptr)
+        *acquisitions = m_lockAcquisitions;
+    if (contended != nullptr)
+        *contended = m_lockContentions;
+    if (waitMicroseconds != nullptr)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        *waitMicroseconds = m_lockWaitTicks * 1000000 / frequency.QuadPart;
+    }
+}
+
+void MemoryKV::GetValuePoolStats(long long* values, long long* shared, long long* storedBytes) const
+{
+    if (values != nullptr)
+        *values = m_valuePool.GetEntryCount();
+    if (shared != nullptr)
+        *shared = m_valuePool.GetSharedCount();
+    if (storedBytes != nullptr)
+        *storedBytes = m_valuePool.GetStoredBytes();
+}
+
+void MemoryKV::GetTieringStats(long long* demoted, long long* promoted, long long* storedBytes) const
+{
+    if (demoted != nullptr)
+        *demoted = m_coldStore.GetDemotedCount();
+    if (promoted != nullptr)
+        *promoted = m_coldStore.GetPromotedCount();
+    if (storedBytes != nullptr)
+        *storedBytes = m_coldStore.GetStoredBytes();
+}
+
+/**
+ * \brief after the mutex is released, so the Puts of other threads can join the flush
+ * \return false if a record of this thread was dropped or may not be durable
+ */
+bool MemoryKV::CommitLog()
+{
+    if (m_wal.Commit())
+        return true;
+    m_logger->Log(L"[Error]. Failed to commit to the write-ahead log.");
+    return false;
+}
+
+KvStatus MemoryKV::RegisterSnapshot(KvSnapshot& snapshot)
+{
+    RefreshGlobalDbIndex(); // maps all the MMFs
+    snapshot.Slot = m_versionStore.OpenSnapshot(snapshot.Id, snapshot.Sequence);
+    if (snapshot.Slot < 0)
+    {
+        m_logger->Log(L"[Error]. Too many open snapshots.");
+        return KvOutOfMemory;
+    }
+    snapshot.MmfCount = m_pHeaderBlock.GetCurrentMMFCount();
+    snapshot.OpenedAt = CurrentTimeMs();
+
+    std::wstringstream ss;
+    ss << L"snapshot opened, slot=" << snapshot.Slot << L",sequence=" << snapshot.Sequence;
+    m_logger->Log(ss.str().data());
+    return KvOk;
+}
+
+KvStatus MemoryKV::OpenSnapshot(KvSnapshot& snapshot)
+{
+    snapshot.Slot = -1;
+    if (!IsInitialized())
+        return KvNotInitialized;
+
+    KvStatus result;
+    SYNC_CALL(result = RegisterSnapshot(snapshot))
+    return result;
+}
+
+/**
+ * \brief copy a block between two reads of its version
+ * \return false if a writer had it every time
+ */
+bool MemoryKV::CopyStableBlock(const DataBlock& block, void* copy)
+{
+    for (int spin = 0; spin < MAX_PIN_WAIT_SPINS; spin++)
+    {
+        LONG version;
+        if (block.BeginRead(version))
+        {
+            memcpy(copy, block.m_pData, m_dataBlockSize);
+            if (block.EndRead(version))
+                return true;
+        }
+        YieldProcessor();
+    }
+    return false;
+}
+
+/**
+ * \brief hand every block position of the snapshot to visitor in order, with a copy of its content at the snapshot,
+ * or nullptr if it held no live key then. a block a writer keeps is read again under the DB mutex, one a writer
+ * that died left half written is handed as nullptr
+ */
+KvStatus MemoryKV::VisitSnapshotBlocks(const KvSnapshot& snapshot, const std::function<bool(long, const DataBlock*)>& visitor)
+{
+    std::vector<LONGLONG> copy(m_dataBlockSize / sizeof(LONGLONG)); // blocks are read into it, aligned like the MMF
+    DataBlock block(copy.data());
+    for (int mmfIndex = 0; mmfIndex < snapshot.MmfCount; mmfIndex++)
+    {
+        AcquireSRWLockShared(&m_localLock);
+        LPVOID pMapView = pMapViews[mmfIndex];
+        ReleaseSRWLockShared(&m_localLock);
+        if (pMapView == nullptr)
+        {
+            for (int i = 0; i < m_options.MaxBlocksPerMmf; i++)
+            {
+                if (!visitor(BuildGlobalDbIndex(mmfIndex, i), nullptr))
+                    return KvOk;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < m_options.MaxBlocksPerMmf; i++)
+        {
+            DataBlock current(GetDataBlock(pMapView, i));
+            if (!CopyStableBlock(current, copy.data()))
+            {
+                AcquireDbMutex(); // a writer kept it: take it again where only a writer that died can have it
+                bool stable = CopyStableBlock(current, copy.data());
+                ReleaseDbMutex(KvLatencyOpCount);
+                if (!stable)
+                {
+                    std::wstringstream ss;
+                    ss << L"[Error]. Snapshot skips a block left half written, position=" << BuildGlobalDbIndex(mmfIndex, i);
+                    m_logger->Log(ss.str().data());
+                    if (!visitor(BuildGlobalDbIndex(mmfIndex, i), nullptr))
+                        return KvOk;
+                    continue;
+                }
+            }
+
+            VersionLookup lookup = VersionFound;
+            if (block.GetSequence() > snapshot.Sequence) // written after the snapshot, find what it was then
+                lookup = m_versionStore.FindVersion(block.GetVersionHead(), snapshot.Sequence, copy.data());
+            if (lookup == VersionLost || !m_versionStore.IsSnapshotValid(snapshot.Slot, snapshot.Id))
+            {
+                m_logger->Log(L"[Error]. Snapshot has been invalidated, the version store ran full.");
+                return KvSnapshotTooOld;
+            }
+            bool live = lookup != VersionEmpty && !block.IsEmpty() && !block.IsExpired(snapshot.OpenedAt);
+            if (live && block.GetValueType() == KvValueCold)
+                ThawValue(block); // visitors, checkpoints and images see the value itself
+            if (!visitor(BuildGlobalDbIndex(mmfIndex, i), live ? &block : nullptr))
+                return KvOk;
+        }
+    }
+    return KvOk;
+}
+
+KvStatus MemoryKV::IterateSnapshot(const KvSnapshot& snapshot, KvScanVisitor visitor, void* context, int* visited)
+{
+    if (visited != nullptr)
+        *visited = 0;
+    if (!IsInitialized() || snapshot.Slot < 0 || visitor == nullptr)
+        return KvInvalidArgument;
+
+    return VisitSnapshotBlocks(snapshot, [this, visitor, context, visited](long, const DataBlock* live) {
+        if (live == nullptr)
+            return true;
+        const DataBlock& block = *live;
+        const wchar_t* key = block.GetKey();
+        const wchar_t* value = ValueOf(block);
+        if (visited != nullptr)
+            (*visited)++;
+        return visitor(key, static_cast<int>(wcsnlen(key, m_options.MaxKeySize)),
+            value, static_cast<int>(wcsnlen(value, m_maxValueLength)), context);
+        });
+}
+
+KvStatus MemoryKV::Checkpoint(const wchar_t* path, long long* bytesWritten)
+{
+    if (bytesWritten != nullptr)
+        *bytesWritten = 0;
+    if (path == nullptr)
+        return KvInvalidArgument;
+
+    std::wstringstream ss;
+    ss << L"Checkpoint to " << path;
+    m_logger->Log(ss.str().data());
+
+    KvSnapshot snapshot;
+    KvStatus status = OpenSnapshot(snapshot);
+    if (status != KvOk)
+        return status;
+
+    CheckpointFileHeader header;
+    header.Magic = CHECKPOINT_MAGIC;
+    header.FormatVersion = CHECKPOINT_FORMAT_VERSION;
+    header.MaxKeySize = m_options.MaxKeySize;
+    header.MaxValueSize = m_options.MaxValueSize;
+    header.Sequence = snapshot.Sequence;
+    header.CreatedAt = snapshot.OpenedAt;
+
+    CheckpointWriter writer;
+    if (!writer.Open(path, header))
+    {
+        ReleaseSnapshot(snapshot);
+        m_logger->Log(L"[Error]. Failed to create the checkpoint file.");
+        return KvError;
+    }
+
+    status = VisitSnapshotBlocks(snapshot, [this, &writer](long, const DataBlock* live) {
+        if (live == nullptr)
+            return true;
+        const DataBlock& block = *live;
+        CheckpointRecordHeader record;
+        const wchar_t* value = block.GetValue(m_options.MaxKeySize);
+        record.KeyLength = static_cast<LONG>(wcsnlen(block.GetKey(), m_options.MaxKeySize));
+        record.ValueType = block.GetValueType();
+        if (record.ValueType == KvValueCompressed || record.ValueType == KvValuePooled) // a checkpoint has the text
+        {
+            value = ValueOf(block);
+            record.ValueType = KvValueString;
+        }
+        record.ValueLength = record.ValueType == KvValueString ? static_cast<LONG>(wcsnlen(value, m_maxValueLength)) : 0;
+        record.Reserved = 0;
+        record.ExpireAt = block.GetExpireAt();
+        record.Numeric = record.ValueType == KvValueString ? 0 : block.GetNumeric();
+        writer.Append(record, block.GetKey(), value);
+        return true;
+        });
+    ReleaseSnapshot(snapshot);
+
+    if (status != KvOk)
+    {
+        writer.Abort();
+        return status;
+    }
+    if (!writer.Commit())
+    {
+        m_logger->Log(L"[Error]. Failed to write the checkpoint file.");
+        return KvError;
+    }
+    if (bytesWritten != nullptr)
+        *bytesWritten = writer.GetBytesWritten();
+
+    ss.str(std::wstring());
+    ss << L"Checkpoint done, keys=" << writer.GetRecordCount() << L",bytes=" << writer.GetBytesWritten();
+    m_logger->Log(ss.str().data());
+    return KvOk;
+}
+
+KvStatus MemoryKV::ReadCheckpoint(const wchar_t* path, KvScanVisitor visitor, void* context, int* visited)
+{
+    if (visited != nullptr)
+        *visited = 0;
+    if (path == nullptr || visitor == nullptr)
+        return KvInvalidArgument;
+
+    CheckpointReader reader;
+    CheckpointFileHeader header;
+    if (!reader.Open(path, header))
+        return KvNotFound;
+    if (!reader.Verify())
+        return KvError;
+
+    CheckpointRecordHeader record;
+    std::wstring key;
+    std::wstring value;
+    while (reader.Next(record, key, value))
+    {
+        if (record.ValueType != KvValueString)
+            value = FormatNumeric(record.ValueType, record.Numeric);
+        if (visited != nullptr)
+            (*visited)++;
+        if (!visitor(key.c_str(), static_cast<int>(key.size()), value.c_str(), static_cast<int>(value.size()), context))
+            break;
+    }
+    return KvOk;
+}
+
+KvStatus MemoryKV::SaveImage(const wchar_t* path, long long* bytesWritten)
+{
+    if (bytesWritten != nullptr)
+        *bytesWritten = 0;
+    if (path == nullptr)
+        return KvInvalidArgument;
+
+    std::wstringstream ss;
+    ss << L"Save image to " << path;
+    m_logger->Log(ss.str().data());
+
+    // the log records before the snapshot are in the image, the log is truncated at them once it's saved
+    KvSnapshot snapshot;
+    snapshot.Slot = -1;
+    if (!IsInitialized())
+        return KvNotInitialized;
+    KvStatus status;
+    LONGLONG logOffset;
+    SYNC_CALL(status = RegisterSnapshot(snapshot); logOffset = m_wal.GetWrittenOffset())
+    if (status != KvOk)
+        return status;
+
+    SegmentImageHeader header;
+    header.Magic = SEGMENT_IMAGE_MAGIC;
+    header.FormatVersion = SEGMENT_IMAGE_FORMAT_VERSION;
+    header.MaxKeySize = m_options.MaxKeySize;
+    header.MaxValueSize = m_options.MaxValueSize;
+    header.MaxBlocksPerMmf = m_options.MaxBlocksPerMmf;
+    header.DataBlockSize = m_dataBlockSize;
+    header.MmfCount = snapshot.MmfCount;
+    header.Reserved = 0;
+    header.Sequence = snapshot.Sequence;
+    header.CreatedAt = snapshot.OpenedAt;
+
+    CheckpointWriter writer;
+    if (!writer.Open(path, &header, sizeof(header)))
+    {
+        ReleaseSnapshot(snapshot);
+        m_logger->Log(L"[Error]. Failed to create the image file.");
+        return KvError;
+    }
+
+    // blocks go out as they would be after a fresh Put: no writer, pin, version chain or CLOCK bit.
+    // removed, expired and later added blocks are written empty. a pooled value is numbered in the table of pooled
+    // values written after the blocks, each one once
+    std::vector<char> empty(m_dataBlockSize, 0);
+    long highestKeyPosition = -1;
+    std::vector<std::wstring> pooledValues;
+    std::unordered_map<LONGLONG, LONGLONG> pooledIndexes;
+    status = VisitSnapshotBlocks(snapshot, [this, &writer, &empty, &highestKeyPosition, &pooledValues, &pooledIndexes](long globalDbIndex, const DataBlock* live) {
+        if (live == nullptr)
+        {
+            writer.Write(empty.data(), empty.size());
+            return true;
+        }
+        BlockHeader blockHeader = *static_cast<const BlockHeader*>(live->m_pData);
+        blockHeader.Version = 0;
+        blockHeader.Referenced = 0;
+        blockHeader.Pins = 0;
+        blockHeader.Sequence = 0;
+        blockHeader.VersionHead = 0;
+        if (blockHeader.ValueType == KvValuePooled)
+        {
+            auto inserted = pooledIndexes.emplace(blockHeader.Numeric, static_cast<LONGLONG>(pooledValues.size()));
+            if (inserted.second)
+                pooledValues.emplace_back(ValueOf(*live), blockHeader.ValueLength);
+            blockHeader.Numeric = inserted.first->second;
+        }
+        writer.Write(&blockHeader, sizeof(blockHeader));
+        writer.Write(static_cast<const char*>(live->m_pData) + sizeof(blockHeader), m_dataBlockSize - sizeof(blockHeader));
+        highestKeyPosition = globalDbIndex;
+        return true;
+        });
+    ReleaseSnapshot(snapshot);
+
+    if (status != KvOk)
+    {
+        writer.Abort();
+        return status;
+    }
+    LONG pooledCount = static_cast<LONG>(pooledValues.size());
+    writer.Write(&pooledCount, sizeof(pooledCount));
+    for (auto& value : pooledValues)
+    {
+        LONG length = static_cast<LONG>(value.size());
+        writer.Write(&length, sizeof(length));
+        writer.Write(value.data(), value.size() * sizeof(wchar_t));
+    }
+    SegmentImageTrailer trailer;
+    trailer.HighestGlobalDbPosition = highestKeyPosition;
+    trailer.Checksum = writer.GetChecksum();
+    trailer.Magic = SEGMENT_IMAGE_MAGIC;
+    trailer.Reserved = 0;
+    if (!writer.Commit(&trailer, sizeof(trailer)))
+    {
+        m_logger->Log(L"[Error]. Failed to write the image file.");
+        return KvError;
+    }
+    if (bytesWritten != nullptr)
+        *bytesWritten = writer.GetBytesWritten();
+
+    ss.str(std::wstring());
+    ss << L"Save image done, mmf count=" << snapshot.MmfCount << L",bytes=" << writer.GetBytesWritten();
+    m_logger->Log(ss.str().data());
+
+    bool truncated;
+    SYNC_CALL(truncated = m_wal.Truncate(logOffset))
+    if (!truncated)
+        m_logger->Log(L"[Error]. Failed to truncate the write-ahead log, it's replayed in full.");
+    return KvOk;
+}
+
+void MemoryKV::ReleaseSnapshot(KvSnapshot& snapshot)
+{
+    if (!IsInitialized() || snapshot.Slot < 0)
+        return;
+    SYNC_CALL(m_versionStore.CloseSnapshot(snapshot.Slot, snapshot.Id); ReclaimReleasedValues())
+    snapshot.Slot = -1;
+}
+
+void MemoryKV::RemoveData(DataBlock& block)
+{
+    if (m_wal.IsEnabled())
+        LogBlockWrite(block, WalRemove); // while the key is still there
+    BeginVersionedWrite(block);
+    block.SetKey(L"", m_options.MaxKeySize);
+    StoreValue(block, L"", 0, KvValueString, 0);
+    block.SetExpireAt(0);
+    block.EndWrite();
+    m_statsPage.BlockEmptied();
+}
+
+bool MemoryKV::TracksAccess() const
+{
+    return m_options.EvictionMode == KvEvictionClock || m_options.Tiering;
+}
+
+/**
+ * \brief the text of a value: its value section, the cold store, the value section decompressed or the number
+ * formatted. the last two are in a buffer of the thread, valid till its next call
+ */
+const wchar_t* MemoryKV::ValueOf(const DataBlock& block)
+{
+    switch (block.GetValueType())
+    {
+    case KvValueString:
+        return block.GetValue(m_options.MaxKeySize);
+    case KvValueCold:
+    {
+        const wchar_t* value = m_coldStore.Resolve(block.GetNumeric(), block.GetValueLength());
+        return value != nullptr ? value : L""; // torn, reused since the block was read, or its segment is gone
+    }
+    case KvValuePooled:
+    {
+        const wchar_t* value = m_valuePool.Resolve(block.GetNumeric(), block.GetValueLength());
+        return value != nullptr ? value : L""; // torn, or reused since the block was read
+    }
+    case KvValueCompressed:
+    {
+        // a lock-free reader may see a torn block: the sizes are checked, the codec is bounds checked and must give
+        // the whole value back, the reader drops what it got anyway once the version tells it
+        thread_local std::vector<wchar_t> text;
+        int length = block.GetValueLength();
+        LONGLONG size = block.GetNumeric();
+        if (length <= 0 || length >= MAX_COMPRESSED_VALUE_LENGTH
+            || size <= 0 || size > static_cast<LONGLONG>(m_options.MaxValueSize) * sizeof(wchar_t))
+            return L"";
+        text.resize(static_cast<size_t>(length) + 1);
+        int rawSize = length * static_cast<int>(sizeof(wchar_t));
+        if (LzDecompress(block.GetValue(m_options.MaxKeySize), static_cast<int>(size), text.data(), rawSize) != rawSize)
+            return L"";
+        text[length] = L'\0';
+        return text.data();
+    }
+    default:
+        return FormatNumeric(block);
+    }
+}
+
+/**
+ * \brief bring a cold value back into the value section, between BeginWrite and EndWrite or on a copy of the block
+ */
+void MemoryKV::ThawValue(DataBlock& block)
+{
+    const wchar_t* value = ValueOf(block);
+    block.SetValue(value, block.GetValueLength(), m_options.MaxKeySize, m_options.MaxValueSize);
+    block.SetNumeric(KvValueString, 0);
+}
+
+/**
+ * \brief ThawValue on the block itself, the cold chunk is released
+ */
+void MemoryKV::PromoteValue(DataBlock& block)
+{
+    LONGLONG pointer = block.GetNumeric();
+    ThawValue(block);
+    ReleaseValue(KvValueCold, pointer);
+}
+
+/**
+ * \brief the whole pages the value of a block covers, the ones its demotion gives back
+ * \return false if it covers none, demoting it would free nothing
+ */
+bool MemoryKV::GetValuePages(const DataBlock& block, char*& first, SIZE_T& size) const
+{
+    static const ULONG_PTR pageSize = []() {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<ULONG_PTR>(info.dwPageSize);
+    }();
+    ULONG_PTR start = reinterpret_cast<ULONG_PTR>(block.GetValue(m_options.MaxKeySize));
+    ULONG_PTR end = start + (static_cast<ULONG_PTR>(block.GetValueLength()) + 1) * sizeof(wchar_t);
+    start = (start + pageSize - 1) / pageSize * pageSize;
+    end = end / pageSize * pageSize;
+    if (end <= start)
+        return false;
+    first = reinterpret_cast<char*>(start);
+    size = end - start;
+    return true;
+}
+
+/**
+ * \brief between BeginWrite and EndWrite, the content of the pages is undefined afterwards. the page file backed
+ * ones are dropped without being written out; the ones of a segment file stay in it and leave the working set
+ */
+void MemoryKV::DiscardValuePages(char* first, SIZE_T size) const
+{
+    if (m_options.Storage == KvStorageFile)
+        VirtualUnlock(first, size); // fails as they aren't locked, which is what takes them out of the working set
+    else
+        VirtualAlloc(first, size, MEM_RESET, PAGE_NOACCESS);
+}
+
+/**
+ * \brief decide how a string value is stored: interned in the value pool with Dedup, else compressed when the mode
+ * and the threshold ask for it and it gets smaller, else as it is. a full pool falls back to the others
+ * \param type receives KvValueString, KvValueCompressed (the bytes are in m_compressedValue) or KvValuePooled
+ * \param encoding receives the compressed size or the pool slot, which has a reference for the block now
+ * \return KvValueTooLarge if the value fits the value section neither way
+ */
+KvStatus MemoryKV::EncodeValue(const wchar_t* value, int valueLength, KvValueType& type, LONGLONG& encoding)
+{
+    type = KvValueString;
+    encoding = 0;
+    if (m_valuePool.IsEnabled() && valueLength > 0 && valueLength >= m_options.DedupThreshold
+        && valueLength < MAX_POOLED_VALUE_LENGTH)
+    {
+        LONG slot = m_valuePool.Intern(value, valueLength);
+        if (slot < 0 && !m_versionStore.HasActiveSnapshots() && m_valuePool.Reclaim() > 0)
+            slot = m_valuePool.Intern(value, valueLength);
+        if (slot >= 0)
+        {
+            m_valuePoolFull = false;
+            type = KvValuePooled;
+            encoding = slot;
+            return KvOk;
+        }
+        if (!m_valuePoolFull) // a full pool is a steady state, the values are just not shared
+            m_logger->Log(L"The value pool is full, the values are kept in their blocks.");
+        m_valuePoolFull = true;
+    }
+
+    if (m_options.Compression != KvCompressionNone && valueLength > 0 && valueLength >= m_options.CompressionThreshold
+        && valueLength < MAX_COMPRESSED_VALUE_LENGTH)
+    {
+        int rawSize = valueLength * static_cast<int>(sizeof(wchar_t));
+        int capacity = m_options.MaxValueSize * static_cast<int>(sizeof(wchar_t));
+        if (capacity >= rawSize)
+            capacity = rawSize - 1;
+        m_compressedValue.resize(capacity);
+        encoding = LzCompress(value, rawSize, m_compressedValue.data(), capacity);
+        if (encoding > 0)
+            type = KvValueCompressed;
+    }
+    return type == KvValueString && valueLength >= m_options.MaxValueSize ? KvValueTooLarge : KvOk;
+}
+
+/**
+ * \brief write a string value the way EncodeValue left it, between BeginWrite and EndWrite. the pooled value the
+ * block had is released afterwards
+ */
+void MemoryKV::StoreValue(DataBlock& block, const wchar_t* value, int valueLength, KvValueType type, LONGLONG encoding)
+{
+    KvValueType previousType = block.GetValueType();
+    LONGLONG previousEncoding = block.GetNumeric();
+    switch (type)
+    {
+    case KvValueCompressed:
+        memcpy(block.GetMutableValue(m_options.MaxKeySize), m_compressedValue.data(), static_cast<size_t>(encoding));
+        block.SetValueLength(valueLength);
+        break;
+    case KvValuePooled:
+        block.GetMutableValue(m_options.MaxKeySize)[0] = L'\0';
+        block.SetValueLength(valueLength);
+        break;
+    default:
+        block.SetValue(value, valueLength, m_options.MaxKeySize, m_options.MaxValueSize);
+        break;
+    }
+    block.SetNumeric(type, encoding);
+    ReleaseValue(previousType, previousEncoding);
+}
+
+/**
+ * \brief free the pooled and cold values retired while snapshots were open, under the mutex once the last one is closed
+ */
+void MemoryKV::ReclaimReleasedValues()
+{
+    if (m_versionStore.HasActiveSnapshots())
+        return;
+    if (m_valuePool.IsEnabled())
+        m_valuePool.Reclaim();
+    if (m_coldStore.IsEnabled())
+        m_coldStore.Reclaim();
+}
+
+/**
+ * \brief drop the reference of a value the block doesn't have anymore. with a snapshot open the pool entry or the
+ * cold chunk is kept, an older version of the block may point at it, till the next Reclaim
+ */
+void MemoryKV::ReleaseValue(KvValueType type, LONGLONG encoding)
+{
+    if (type == KvValuePooled)
+        m_valuePool.Release(static_cast<LONG>(encoding), !m_versionStore.HasActiveSnapshots());
+    else if (type == KvValueCold)
+        m_coldStore.Release(encoding, !m_versionStore.HasActiveSnapshots());
+}
+
+BlockState MemoryKV::ValidateBlock(DataBlock& block, const std::wstring& key)
+{
+    if (block.IsEmpty())
+    {
+        m_logger->Log(L"the block is empty");
+        return BlockState::Empty;
+    }
+    if (std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) != 0)
+    {
+        std::wstringstream wss;
+        wss << L". mismatched key and position. the key in block is " << block.GetKey()<<", the input key is " <<key;
+        m_logger->Log(wss.str().data());
+        if (m_options.EvictionMode != KvEvictionNone) // the block has been evicted and taken by another key
+            return BlockState::Mismatch;
+        throw std::runtime_error("key and position doesn't match");
+    }
+    return BlockState::Normal;
+}
+
+KvStatus MemoryKV::RemoveBlockByKey(const std::wstring& key)
+{
+    std::wstringstream ss;
+    ss << L"Remove key=" << key.c_str();
+
+    if(!IsInitialized())
+    {
+        ss << L"\n[Error] KV is not initialized";
+        m_logger->Log(ss.str().data());
+        return KvNotInitialized;
+    }
+
+    int dataBlockMmfIndex;
+    int dataBlockIndex;
+    _FetchAndFindTheBlock(key, dataBlockMmfIndex, dataBlockIndex);
+    if (dataBlockMmfIndex == -1 || dataBlockIndex == -1) // not found
+    {
+        ss << L". not found, probably already removed.";
+        m_logger->Log(ss.str().data());
+        return KvNotFound;
+    }
+    else // found it, need to remove
+    {
+        ss << L". find the slot: mmf index=" << dataBlockMmfIndex << L",data block index=" << dataBlockIndex;
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        m_logger->Log(ss.str().data());
+
+        if (ValidateBlock(block, key) == BlockState::Mismatch) // evicted, the key may have been put again somewhere else
+        {
+            UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, false);
+            return RemoveBlockByKey(key);
+        }
+        ss.str(std::wstring());
+        ss << L"value=" << ValueOf(block) << " is removed.";
+
+        RemoveData(block);
+        UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, true);
+        m_logger->Log(ss.str().data());
+        return KvOk;
+    }
+}
+
+void MemoryKV::Remove(const std::wstring& key)
+{
+    m_statsPage.Add(KvStatRemoves);
+    TIMED_SYNC_CALL(KvLatencyRemove, RemoveBlockByKey(key))
+    CommitLog();
+}
+
+/**
+ * \brief per-thread key storage, so the length-explicit calls stop allocating once it has grown to the key size
+ */
+static const std::wstring& ScratchKey(const wchar_t* key, int keyLength)
+{
+    thread_local std::wstring scratch;
+    scratch.assign(key, keyLength);
+    return scratch;
+}
+
+static bool IsValidArgument(const wchar_t* str, int length)
+{
+    return length >= 0 && (str != nullptr || length == 0);
+}
+
+KvStatus MemoryKV::TryPut(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength)
+{
+    if (!IsValidArgument(key, keyLength) || !IsValidArgument(value, valueLength))
+        return KvInvalidArgument;
+
+    const std::wstring& scratchKey = ScratchKey(key, keyLength);
+    m_statsPage.Add(KvStatPuts);
+    m_statsPage.SampleKey(scratchKey);
+    KvStatus result;
+    TIMED_SYNC_CALL(KvLatencyPut, result = UpdateKeyValue(scratchKey, value, valueLength))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::TryGet(const wchar_t* key, int keyLength, wchar_t* buffer, int bufferLength, int* valueLength)
+{
+    if (valueLength != nullptr)
+        *valueLength = 0;
+    if (!IsValidArgument(key, keyLength) || bufferLength < 0)
+        return KvInvalidArgument;
+
+    const std::wstring& scratchKey = ScratchKey(key, keyLength);
+    m_statsPage.SampleKey(scratchKey);
+    KvStatus result;
+    LARGE_INTEGER start = {};
+    if (m_statsPage.RecordsLatency())
+        QueryPerformanceCounter(&start);
+    if (CopyKnownValueByKey(scratchKey, buffer, bufferLength, valueLength, result))
+    {
+        if (m_statsPage.RecordsLatency())
+            RecordLockFreeGet(start);
+        CountGet(result);
+        return result;
+    }
+
+    TIMED_SYNC_CALL(KvLatencyGet, result = CopyValueByKey(scratchKey, buffer, bufferLength, valueLength))
+    CountGet(result);
+    return result;
+}
+
+KvStatus MemoryKV::TryRemove(const wchar_t* key, int keyLength)
+{
+    if (!IsValidArgument(key, keyLength))
+        return KvInvalidArgument;
+
+    m_statsPage.Add(KvStatRemoves);
+    KvStatus result;
+    TIMED_SYNC_CALL(KvLatencyRemove, result = RemoveBlockByKey(ScratchKey(key, keyLength)))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::UpdateKeyNumber(const std::wstring& key, KvValueType type, LONGLONG bits)
+{
+    std::wstringstream ss;
+    ss << L"Put number key=" << key.c_str() << L",type=" << type;
+    m_logger->Log(ss.str().data());
+
+    KvStatus status = ValidateKeyForUpdate(key);
+    if (status != KvOk)
+        return status;
+
+    try
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        bool isNewKey;
+        FindOrCreateBlock(key, dataBlockMmfIndex, dataBlockIndex, isNewKey);
+
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        BeginVersionedWrite(block);
+        KvValueType previousType = block.GetValueType();
+        LONGLONG previousEncoding = block.GetNumeric();
+        block.SetKey(key.c_str(), m_options.MaxKeySize);
+        block.SetValue(L"", m_options.MaxKeySize, m_options.MaxValueSize);
+        block.SetExpireAt(0);
+        block.SetNumeric(type, bits);
+        ReleaseValue(previousType, previousEncoding);
+        EndVersionedWrite(block);
+        if (m_options.EvictionMode == KvEvictionClock && !isNewKey)
+            block.Touch();
+        return KvOk;
+    }
+    catch (const KvOomException&)
+    {
+        return KvOutOfMemory;
+    }
+}
+
+void MemoryKV::ApplyNumericOperation(DataBlock& block, NumericOperation& operation)
+{
+    volatile LONGLONG* target = block.NumericData();
+    switch (operation.Kind)
+    {
+    case NumericRead:
+        operation.Previous = block.GetNumeric();
+        break;
+    case NumericCompareAndSwap:
+        operation.Previous = InterlockedCompareExchange64(target, operation.Operand, operation.Expected);
+        break;
+    case NumericFetchAdd:
+        if (operation.Type == KvValueInt64)
+        {
+            operation.Previous = InterlockedExchangeAdd64(target, operation.Operand);
+        }
+        else // no interlocked add for doubles, retry till nobody interferes
+        {
+            LONGLONG previous = block.GetNumeric();
+            while (true)
+            {
+                LONGLONG desired = DoubleToBits(BitsToDouble(previous) + BitsToDouble(operation.Operand));
+                LONGLONG actual = InterlockedCompareExchange64(target, desired, previous);
+                if (actual == previous)
+                    break;
+                previous = actual;
+            }
+            operation.Previous = previous;
+        }
+        break;
+    }
+}
+
+/**
+ * \brief the operation without any lock, on a key this instance knows. the pin keeps writers from reusing the
+ * block between the validation and the interlocked instruction, the epoch keeps snapshots from opening
+ * \return false if the locked path is needed
+ */
+bool MemoryKV::TryKnownNumericOperation(const std::wstring& key, NumericOperation& operation)
+{
+    void* pBlock = FindKnownBlock(key);
+    if (pBlock == nullptr)
+        return false;
+
+    // in place updates are neither versioned nor logged
+    bool update = operation.Kind != NumericRead;
+    LONG epoch = 0;
+    if (update && (m_wal.IsEnabled() || !m_versionStore.BeginInPlaceUpdate(epoch)))
+        return false;
+
+    DataBlock block(pBlock);
+    block.Pin();
+    LONG version;
+    bool usable = block.BeginRead(version)
+        && !block.IsEmpty() && std::wcsncmp(block.GetKey(), key.c_str(), m_options.MaxKeySize) == 0
+        && block.GetValueType() == operation.Type
+        && !block.IsExpired(CurrentTimeMs())
+        && block.EndRead(version);
+    if (usable)
+    {
+        ApplyNumericOperation(block, operation);
+        if (m_options.EvictionMode == KvEvictionClock)
+            block.Touch();
+    }
+    block.Unpin();
+    if (update)
+        m_versionStore.EndInPlaceUpdate(epoch);
+    return usable;
+}
+
+KvStatus MemoryKV::LockedNumericOperation(const std::wstring& key, NumericOperation& operation)
+{
+    std::wstringstream ss;
+    ss << L"Numeric operation key=" << key.c_str() << L",kind=" << operation.Kind;
+    m_logger->Log(ss.str().data());
+
+    int dataBlockMmfIndex;
+    int dataBlockIndex;
+    if (operation.Kind == NumericRead)
+    {
+        const wchar_t* value;
+        KvStatus status = QueryValueByKey(key, value); // handles the removed, evicted and expired blocks
+        if (status != KvOk)
+            return status;
+        RetrieveGlobalDbIndexByKey(key, dataBlockMmfIndex, dataBlockIndex);
+    }
+    else
+    {
+        KvStatus status = ValidateKeyForUpdate(key);
+        if (status != KvOk)
+            return status;
+
+        bool isNewKey;
+        try
+        {
+            FindOrCreateBlock(key, dataBlockMmfIndex, dataBlockIndex, isNewKey);
+        }
+        catch (const KvOomException&)
+        {
+            return KvOutOfMemory;
+        }
+
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (isNewKey || block.IsExpired(CurrentTimeMs()))
+        {
+            BeginVersionedWrite(block);
+            KvValueType previousType = block.GetValueType();
+            LONGLONG previousEncoding = block.GetNumeric();
+            block.SetKey(key.c_str(), m_options.MaxKeySize);
+            block.SetValue(L"", m_options.MaxKeySize, m_options.MaxValueSize);
+            block.SetExpireAt(0);
+            block.SetNumeric(operation.Type, 0); // 0 is 0.0 for double too
+            ReleaseValue(previousType, previousEncoding); // of an expired key
+            EndVersionedWrite(block);
+        }
+    }
+
+    DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+    if (block.GetValueType() != operation.Type)
+    {
+        m_logger->Log(L"[Error]. Value type mismatch.");
+        return KvTypeMismatch;
+    }
+    if (operation.Kind == NumericRead)
+    {
+        ApplyNumericOperation(block, operation);
+        return KvOk;
+    }
+    BeginVersionedWrite(block);
+    ApplyNumericOperation(block, operation);
+    EndVersionedWrite(block);
+    return KvOk;
+}
+
+KvStatus MemoryKV::RunNumericOperation(const std::wstring& key, NumericOperation& operation)
+{
+    m_statsPage.Add(KvStatNumerics);
+    if (TryKnownNumericOperation(key, operation))
+        return KvOk;
+
+    KvStatus result;
+    SYNC_CALL(result = LockedNumericOperation(key, operation))
+    return CommitLog() ? result : KvError;
+}
+
+static KvStatus AppendOperator(wchar_t* value, int* length, int capacity, const wchar_t* operand, int operandLength)
+{
+    if (*length + operandLength >= capacity) // no room for the NUL
+        return KvValueTooLarge;
+    wmemcpy(value + *length, operand, operandLength);
+    *length += operandLength;
+    return KvOk;
+}
+
+KvStatus MemoryKV::MergeKeyValue(const std::wstring& key, KvMergeOperator mergeOperator, const wchar_t* operand, int operandLength)
+{
+    std::wstringstream ss;
+    ss << L"Merge key=" << key.c_str() << L",operand length=" << operandLength;
+    m_logger->Log(ss.str().data());
+
+    KvStatus status = ValidateKeyForUpdate(key);
+    if (status != KvOk)
+        return status;
+
+    try
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        bool isNewKey;
+        FindOrCreateBlock(key, dataBlockMmfIndex, dataBlockIndex, isNewKey);
+
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        bool isEmptyValue = isNewKey || block.IsExpired(CurrentTimeMs());
+        if (!isEmptyValue && block.GetValueType() != KvValueString && block.GetValueType() != KvValueCold
+            && block.GetValueType() != KvValueCompressed && block.GetValueType() != KvValuePooled)
+        {
+            m_logger->Log(L"[Error]. Value type mismatch.");
+            return KvTypeMismatch;
+        }
+
+        BeginVersionedWrite(block);
+        wchar_t* inPlaceValue = nullptr; // the value a user operator changes in place, its old text is in m_mergedValue
+        try
+        {
+            if (!isEmptyValue && block.GetValueType() == KvValueCold)
+                PromoteValue(block);
+            if (isEmptyValue)
+            {
+                block.SetKey(key.c_str(), m_options.MaxKeySize);
+                StoreValue(block, L"", 0, KvValueString, 0);
+                block.SetExpireAt(0);
+            }
+            if (m_options.Compression == KvCompressionNone && !m_options.Dedup && block.GetValueType() == KvValueString)
+            {
+                wchar_t* value = block.GetMutableValue(m_options.MaxKeySize);
+                int length = block.GetValueLength();
+                if (mergeOperator != AppendOperator) // a user operator may throw half way, keep the value to put back
+                {
+                    m_mergedValue.assign(value, value + length);
+                    inPlaceValue = value;
+                }
+                status = mergeOperator(value, &length, m_options.MaxValueSize, operand, operandLength);
+                if (status == KvOk)
+                {
+                    if (length < 0 || length >= m_options.MaxValueSize)
+                        length = 0; // a broken operator must not make the value unterminated
+                    value[length] = L'\0';
+                    block.SetValueLength(length);
+                }
+            }
+            else // the value or the result may be compressed or pooled, the operator works on the text as long as a value can be
+            {
+                const wchar_t* current = ValueOf(block);
+                int length = static_cast<int>(wcsnlen(current, m_maxValueLength - 1));
+                m_mergedValue.resize(m_maxValueLength);
+                wchar_t* value = m_mergedValue.data();
+                wmemcpy(value, current, length);
+                status = mergeOperator(value, &length, m_maxValueLength, operand, operandLength);
+                KvValueType valueType = KvValueString;
+                LONGLONG encoding = 0;
+                if (status == KvOk)
+                {
+                    if (length < 0 || length >= m_maxValueLength)
+                        length = 0;
+                    value[length] = L'\0';
+                    status = EncodeValue(value, length, valueType, encoding);
+                }
+                if (status == KvOk)
+                    StoreValue(block, value, length, valueType, encoding);
+            }
+        }
+        catch (...)
+        {
+            // the block must not stay odd, the lock-free readers would take it as being written for good
+            if (inPlaceValue != nullptr)
+            {
+                int length = static_cast<int>(m_mergedValue.size());
+                wmemcpy(inPlaceValue, m_mergedValue.data(), length);
+                inPlaceValue[length] = L'\0';
+                block.SetValueLength(length);
+            }
+            EndVersionedWrite(block);
+            if (isNewKey)
+            {
+                RemoveData(block);
+                UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, true);
+            }
+            throw;
+        }
+        EndVersionedWrite(block);
+
+        if (status != KvOk && isNewKey) // don't leave an empty key behind
+        {
+            RemoveData(block);
+            UnmarkGlobalDbIndex(key, dataBlockMmfIndex, dataBlockIndex, true);
+        }
+        else if (m_options.EvictionMode == KvEvictionClock && !isNewKey)
+        {
+            block.Touch();
+        }
+        else if (m_options.Tiering)
+        {
+            block.Touch(ReferencedTiering);
+        }
+        return status;
+    }
+    catch (const KvOomException&)
+    {
+        return KvOutOfMemory;
+    }
+}
+
+KvStatus MemoryKV::Append(const std::wstring& key, const std::wstring& fragment)
+{
+    m_statsPage.Add(KvStatMerges);
+    KvStatus result;
+    SYNC_CALL(result = MergeKeyValue(key, AppendOperator, fragment.c_str(), static_cast<int>(fragment.size())))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::Merge(const std::wstring& key, KvMergeOperator mergeOperator, const wchar_t* operand, int operandLength)
+{
+    if (mergeOperator == nullptr || !IsValidArgument(operand, operandLength))
+        return KvInvalidArgument;
+
+    m_statsPage.Add(KvStatMerges);
+    KvStatus result;
+    SYNC_CALL(result = MergeKeyValue(key, mergeOperator, operand, operandLength))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::PutNumber(const std::wstring& key, long long value)
+{
+    m_statsPage.Add(KvStatPuts);
+    m_statsPage.SampleKey(key);
+    KvStatus result;
+    TIMED_SYNC_CALL(KvLatencyPut, result = UpdateKeyNumber(key, KvValueInt64, value))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::PutDouble(const std::wstring& key, double value)
+{
+    m_statsPage.Add(KvStatPuts);
+    m_statsPage.SampleKey(key);
+    KvStatus result;
+    TIMED_SYNC_CALL(KvLatencyPut, result = UpdateKeyNumber(key, KvValueDouble, DoubleToBits(value)))
+    return CommitLog() ? result : KvError;
+}
+
+KvStatus MemoryKV::GetNumber(const std::wstring& key, long long* value)
+{
+    NumericOperation operation{ KvValueInt64, NumericRead, 0, 0, 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status == KvOk && value != nullptr)
+        *value = operation.Previous;
+    return status;
+}
+
+KvStatus MemoryKV::GetDouble(const std::wstring& key, double* value)
+{
+    NumericOperation operation{ KvValueDouble, NumericRead, 0, 0, 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status == KvOk && value != nullptr)
+        *value = BitsToDouble(operation.Previous);
+    return status;
+}
+
+KvStatus MemoryKV::Increment(const std::wstring& key, long long delta, long long* newValue)
+{
+    long long oldValue;
+    KvStatus status = FetchAdd(key, delta, &oldValue);
+    if (status == KvOk && newValue != nullptr)
+        *newValue = oldValue + delta;
+    return status;
+}
+
+KvStatus MemoryKV::FetchAdd(const std::wstring& key, long long delta, long long* oldValue)
+{
+    NumericOperation operation{ KvValueInt64, NumericFetchAdd, delta, 0, 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status == KvOk && oldValue != nullptr)
+        *oldValue = operation.Previous;
+    return status;
+}
+
+KvStatus MemoryKV::CompareAndSwap(const std::wstring& key, long long expected, long long desired, long long* actual)
+{
+    NumericOperation operation{ KvValueInt64, NumericCompareAndSwap, desired, expected, 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status != KvOk)
+        return status;
+    if (actual != nullptr)
+        *actual = operation.Previous;
+    return operation.Previous == expected ? KvOk : KvCompareFailed;
+}
+
+KvStatus MemoryKV::FetchAddDouble(const std::wstring& key, double delta, double* oldValue)
+{
+    NumericOperation operation{ KvValueDouble, NumericFetchAdd, DoubleToBits(delta), 0, 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status == KvOk && oldValue != nullptr)
+        *oldValue = BitsToDouble(operation.Previous);
+    return status;
+}
+
+KvStatus MemoryKV::CompareAndSwapDouble(const std::wstring& key, double expected, double desired, double* actual)
+{
+    NumericOperation operation{ KvValueDouble, NumericCompareAndSwap, DoubleToBits(desired), DoubleToBits(expected), 0 };
+    KvStatus status = RunNumericOperation(key, operation);
+    if (status != KvOk)
+        return status;
+    if (actual != nullptr)
+        *actual = BitsToDouble(operation.Previous);
+    return operation.Previous == operation.Expected ? KvOk : KvCompareFailed;
+}
+
+int MemoryKV::UpdateKeyValues(int count, const wchar_t* const* keys, const int* keyLengths,
+    const wchar_t* const* values, const int* valueLengths, KvStatus* statuses)
+{
+    int succeeded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        KvStatus status = KvInvalidArgument;
+        if (IsValidArgument(keys[i], keyLengths[i]) && IsValidArgument(values[i], valueLengths[i]))
+        {
+            const std::wstring& scratchKey = ScratchKey(keys[i], keyLengths[i]);
+            m_statsPage.SampleKey(scratchKey);
+            status = UpdateKeyValue(scratchKey, values[i], valueLengths[i]);
+        }
+        if (status == KvOk)
+            succeeded++;
+        if (statuses != nullptr)
+            statuses[i] = status;
+    }
+    return succeeded;
+}
+
+int MemoryKV::CopyValuesByKeys(int count, const wchar_t* const* keys, const int* keyLengths,
+    wchar_t* buffer, int bufferLength, int* valueOffsets, int* valueLengths, KvStatus* statuses)
+{
+    int copied = 0;
+    int used = 0;
+    for (int i = 0; i < count; i++)
+    {
+        KvStatus status = KvInvalidArgument;
+        int length = 0;
+        if (IsValidArgument(keys[i], keyLengths[i]))
+        {
+            wchar_t* target = buffer == nullptr ? nullptr : buffer + used;
+            const std::wstring& scratchKey = ScratchKey(keys[i], keyLengths[i]);
+            m_statsPage.SampleKey(scratchKey);
+            status = CopyValueByKey(scratchKey, target, bufferLength - used, &length);
+        }
+        CountGet(status);
+        if (valueOffsets != nullptr)
+            valueOffsets[i] = (status == KvOk) ? used : -1;
+        if (valueLengths != nullptr)
+            valueLengths[i] = length;
+        if (statuses != nullptr)
+            statuses[i] = status;
+        if (status == KvOk)
+        {
+            used += length + 1;
+            copied++;
+        }
+    }
+    return copied;
+}
+
+int MemoryKV::RemoveBlocksByKeys(int count, const wchar_t* const* keys, const int* keyLengths, KvStatus* statuses)
+{
+    int removed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        KvStatus status = KvInvalidArgument;
+        if (IsValidArgument(keys[i], keyLengths[i]))
+            status = RemoveBlockByKey(ScratchKey(keys[i], keyLengths[i]));
+        if (status == KvOk)
+            removed++;
+        if (statuses != nullptr)
+            statuses[i] = status;
+    }
+    return removed;
+}
+
+/**
+ * \brief the batch went into memory but not safely into the log
+ */
+static int FailBatch(int count, KvStatus* statuses)
+{
+    for (int i = 0; statuses != nullptr && i < count; i++)
+    {
+        if (statuses[i] == KvOk)
+            statuses[i] = KvError;
+    }
+    return 0;
+}
+
+int MemoryKV::PutBatch(int count, const wchar_t* const* keys, const int* keyLengths,
+    const wchar_t* const* values, const int* valueLengths, KvStatus* statuses)
+{
+    if (count <= 0 || keys == nullptr || keyLengths == nullptr || values == nullptr || valueLengths == nullptr)
+        return 0;
+
+    m_statsPage.Add(KvStatPuts, count);
+    int result;
+    SYNC_CALL(result = UpdateKeyValues(count, keys, keyLengths, values, valueLengths, statuses))
+    return CommitLog() ? result : FailBatch(count, statuses);
+}
+
+int MemoryKV::GetBatch(int count, const wchar_t* const* keys, const int* keyLengths,
+    wchar_t* buffer, int bufferLength, int* valueOffsets, int* valueLengths, KvStatus* statuses)
+{
+    if (count <= 0 || keys == nullptr || keyLengths == nullptr || bufferLength < 0)
+        return 0;
+
+    int result;
+    SYNC_CALL(result = CopyValuesByKeys(count, keys, keyLengths, buffer, bufferLength, valueOffsets, valueLengths, statuses))
+    return result;
+}
+
+int MemoryKV::RemoveBatch(int count, const wchar_t* const* keys, const int* keyLengths, KvStatus* statuses)
+{
+    if (count <= 0 || keys == nullptr || keyLengths == nullptr)
+        return 0;
+
+    m_statsPage.Add(KvStatRemoves, count);
+    int result;
+    SYNC_CALL(result = RemoveBlocksByKeys(count, keys, keyLengths, statuses))
+    return CommitLog() ? result : FailBatch(count, statuses);
+}
+
+/**
+ * \brief up to EXPIRY_SCAN_BATCH_SIZE blocks of a scan for the blocks with an expiry time, under the mutex
+ * \return the position to continue from, -1 once the scan is over
+ */
+long MemoryKV::ScanExpiryEntries(long position, std::vector<ExpiryEntry>& entries)
+{
+    RefreshGlobalDbIndex(); // maps the MMFs other instances added
+    const long blockCount = BuildGlobalDbIndex(m_currentMmfCount, 0);
+    const long end = position + EXPIRY_SCAN_BATCH_SIZE < blockCount ? position + EXPIRY_SCAN_BATCH_SIZE : blockCount;
+    for (; position < end; position++)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(position, dataBlockMmfIndex, dataBlockIndex);
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        if (!block.IsEmpty() && block.GetExpireAt() != 0)
+            entries.push_back({ block.GetExpireAt(), position, 0 });
+    }
+    return position < blockCount ? position : -1;
+}
+
+void MemoryKV::FetchExpiryEntries(std::vector<ExpiryEntry>& entries)
+{
+    if (!IsInitialized())
+        return;
+    bool complete;
+    SYNC_CALL(complete = m_expiryQueue.Drain(entries))
+    if (complete)
+        return;
+
+    // only after a restore, a reattach or a drop, the writers get the mutex between the batches
+    m_logger->Log(L"expiry entries were not queued, scan for blocks with expiry time");
+    for (long position = 0; position >= 0; )
+    {
+        SYNC_CALL(position = ScanExpiryEntries(position, entries))
+    }
+}
+
+int MemoryKV::RemoveExpiredBlocks(const std::vector<ExpiryEntry>& entries)
+{
+    RefreshGlobalDbIndex(); // the blocks may be in MMFs this instance hasn't mapped yet
+    LONGLONG now = CurrentTimeMs();
+    int removed = 0;
+    for (const auto& entry : entries)
+    {
+        int dataBlockMmfIndex;
+        int dataBlockIndex;
+        CrackGlobalDbIndex(entry.GlobalDbIndex, dataBlockMmfIndex, dataBlockIndex);
+        if (dataBlockMmfIndex >= m_currentMmfCount)
+            continue;
+
+        DataBlock block(GetDataBlock(dataBlockMmfIndex, dataBlockIndex));
+        // a rewritten block carries another expiry time, or none
+        if (block.IsEmpty() || block.GetExpireAt() != entry.ExpireAt || !block.IsExpired(now))
+            continue;
+
+        std::wstring key(block.GetKey(), wcsnlen(block.GetKey(), m_options.MaxKeySize));
+        if (RemoveBlockByKey(key) == KvOk)
+            removed++;
+    }
+
+    std::wstringstream ss;
+    ss << L"remove expired blocks, candidates=" << entries.size() << L",removed=" << removed;
+    m_logger->Log(ss.str().data());
+    return removed;
+}
+
+int MemoryKV::RemoveExpired(const std::vector<ExpiryEntry>& entries)
+{
+    if (!IsInitialized() || entries.empty())
+        return 0;
+
+    int result;
+    SYNC_CALL(result = RemoveExpiredBlocks(entries))
+    CommitLog();
+    return result;
+}
\ No newline at end of file
@@ -2,12 +2,106 @@
 
 #include <string>
 #include <unordered_map>
+#include <map>
 #include <Windows.h>
 #include <memory>
+#include <vector>
+#include <exception>
+#include <functional>
 
+#include "ColdStore.h"
 #include "ConfigOptions.h"
+#include "Consts.h"
+#include "ExpiryQueue.h"
 #include "HeaderBlock.h"
 #include "ILogger.h"
+#include "KvStatus.h"
+#include "StatsPage.h"
+#include "TraceRing.h"
+#include "ValuePool.h"
+#include "VersionStore.h"
+#include "WriteAheadLog.h"
+
+/**
+ * \brief how the value of a block is stored
+ */
+enum KvValueType : LONG
+{
+    KvValueString = 0, // in the value section
+    KvValueInt64 = 1, // in BlockHeader::Numeric
+    KvValueDouble = 2, // bit pattern in BlockHeader::Numeric
+    KvValueCold = 3, // a string moved to the ColdStore, BlockHeader::Numeric points to it, ValueLength is kept
+    KvValueCompressed = 4, // a string compressed in the value section, BlockHeader::Numeric is its size in bytes, ValueLength the characters
+    KvValuePooled = 5, // a string in the ValuePool, BlockHeader::Numeric is its slot, ValueLength the characters
+};
+
+/**
+ * \brief bits of BlockHeader::Referenced, Get sets them all, each sweep clears its own
+ */
+enum ReferenceBit : LONG
+{
+    ReferencedClock = 1, // the eviction sweep
+    ReferencedTiering = 2, // the tiering pass
+    ReferencedAll = 3,
+};
+
+/**
+ * \brief fixed header in front of every data block
+ */
+struct BlockHeader
+{
+    volatile LONG Version; // even when stable, odd while a writer is updating the block
+    volatile LONG Referenced; // ReferenceBit, set by Get and cleared by the eviction sweep and the tiering pass
+    LONGLONG ExpireAt; // CurrentTimeMs based, 0 means the block never expires
+    volatile LONG Pins; // lock-free numeric operations in flight, a writer waits for them after BeginWrite
+    LONG ValueType; // KvValueType
+    volatile LONGLONG Numeric; // numeric value, updated in place by interlocked operations
+    LONG ValueLength; // characters in the value section, so Append writes only the new ones
+    LONG Reserved;
+    LONGLONG Sequence; // VersionStore commit sequence of the last write
+    LONGLONG VersionHead; // the newest previous content kept in the VersionStore, 0 for none
+};
+
+/**
+ * \brief a read-only view of the whole DB at a commit sequence, see MemoryKV::OpenSnapshot
+ */
+struct KvSnapshot
+{
+    int Slot; // -1 when not open
+    int MmfCount;
+    LONGLONG Id;
+    LONGLONG Sequence;
+    LONGLONG OpenedAt; // keys expired at this time are not in the snapshot
+};
+
+/**
+ * \brief what a DB costs, see MemoryKV::GetMemoryStats. bytes, live blocks, free blocks and headroom add up to DataBytes
+ */
+struct KvMemoryStats
+{
+    LONGLONG SharedBytes; // the views of all the MMFs the instance maps: header, data blocks, queues, version store, pools
+    LONGLONG DataBytes; // the data block MMFs
+    LONGLONG IndexBytes; // heap of the key index of this process, estimated from its node count and key lengths
+    LONGLONG LiveKeys;
+    LONGLONG PayloadBytes; // key and value characters in the blocks of the live keys
+    LONGLONG PaddingBytes; // the rest of those blocks: header, NULs and the unused part of the key and value sections
+    LONGLONG FreeBlockBytes; // removed blocks below the high-water mark, not reused yet
+    LONGLONG HeadroomBytes; // blocks above the high-water mark, never used so far
+};
+
+/**
+ * \brief receives one key of a Scan, the pointers are only valid during the call
+ * \return false to stop the scan
+ */
+typedef bool (*KvScanVisitor)(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength, void* context);
+
+/**
+ * \brief merges an operand into a string value in place, runs while the block is being written (under the mutex)
+ * \param value the value section, capacity characters including the NUL, which is written by the caller
+ * \param length the current length, to be set to the new one
+ * \return KvOk, or the reason to reject the merge, in which case value must not have been changed
+ */
+typedef KvStatus (*KvMergeOperator)(wchar_t* value, int* length, int capacity, const wchar_t* operand, int operandLength);
 
 struct DataBlock {
     DataBlock(void* pData) { m_pData = pData; }
@@ -22,23 +116,216 @@ struct DataBlock {
 
     void SetKey(const wchar_t* str, int max_key_size)
     {
-        wcsncpy_s(static_cast<wchar_t*>(m_pData), max_key_size, str, (size_t)max_key_size -1);
+        wcsncpy_s(KeyData(), max_key_size, str, (size_t)max_key_size -1);
     }
 
     void SetValue(const wchar_t* str, int max_key_size, int max_value_size)
     {
-        wcsncpy_s(static_cast<wchar_t*>(m_pData) + max_key_size, max_value_size, str, (size_t)max_value_size-1);
+        wcsncpy_s(KeyData() + max_key_size, max_value_size, str, (size_t)max_value_size-1);
+        Header()->ValueLength = static_cast<LONG>(wcsnlen(str, (size_t)max_value_size - 1));
+    }
+
+    void SetValue(const wchar_t* str, int length, int max_key_size, int max_value_size)
+    {
+        wcsncpy_s(KeyData() + max_key_size, max_value_size, str, (size_t)length);
+        Header()->ValueLength = static_cast<LONG>(wcsnlen(str, (size_t)length));
+    }
+
+    /**
+     * \brief the value section to be changed in place, between BeginWrite and EndWrite
+     */
+    wchar_t* GetMutableValue(int max_key_size)
+    {
+        return KeyData() + max_key_size;
+    }
+
+    int GetValueLength() const
+    {
+        return Header()->ValueLength;
+    }
+
+    void SetValueLength(int length)
+    {
+        Header()->ValueLength = length;
     }
 
     const wchar_t* GetKey() const
     {
-        return static_cast<const wchar_t*>(m_pData);
+        return KeyData();
     }
 
 
     const wchar_t* GetValue(int max_key_size) const
     {
-        return static_cast<const wchar_t*>(m_pData) + max_key_size;
+        return KeyData() + max_key_size;
+    }
+
+    LONGLONG GetExpireAt() const
+    {
+        return Header()->ExpireAt;
+    }
+
+    void SetExpireAt(LONGLONG expireAt)
+    {
+        Header()->ExpireAt = expireAt;
+    }
+
+    bool IsExpired(LONGLONG now) const
+    {
+        LONGLONG expireAt = GetExpireAt();
+        return expireAt != 0 && expireAt <= now;
+    }
+
+    KvValueType GetValueType() const
+    {
+        return static_cast<KvValueType>(Header()->ValueType);
+    }
+
+    /**
+     * \brief only between BeginWrite and EndWrite
+     */
+    void SetNumeric(KvValueType type, LONGLONG bits)
+    {
+        Header()->ValueType = type;
+        Header()->Numeric = bits;
+    }
+
+    volatile LONGLONG* NumericData() const
+    {
+        return &Header()->Numeric;
+    }
+
+    LONGLONG GetNumeric() const
+    {
+        return InterlockedCompareExchange64(&Header()->Numeric, 0, 0);
+    }
+
+    LONGLONG GetSequence() const
+    {
+        return Header()->Sequence;
+    }
+
+    LONGLONG GetVersionHead() const
+    {
+        return Header()->VersionHead;
+    }
+
+    /**
+     * \brief only between BeginWrite and EndWrite
+     */
+    void SetVersion(LONGLONG sequence, LONGLONG versionHead)
+    {
+        Header()->Sequence = sequence;
+        Header()->VersionHead = versionHead;
+    }
+
+    /**
+     * \brief keep writers from reusing the block during a lock-free numeric operation, check the content after pinning.
+     * any number of operations pin the block at once
+     */
+    void Pin()
+    {
+        InterlockedIncrement(&Header()->Pins);
+    }
+
+    void Unpin()
+    {
+        InterlockedDecrement(&Header()->Pins);
+    }
+
+    /**
+     * \brief drop the pins of the processes of a previous run, e.g. found in a segment file
+     */
+    void ClearPins()
+    {
+        InterlockedExchange(&Header()->Pins, 0);
+    }
+
+    /**
+     * \brief mark the block as recently used, lock-free. skips the write when it's already set to keep the line clean
+     */
+    void Touch(LONG bits = ReferencedAll)
+    {
+        if ((Header()->Referenced & bits) != bits)
+            InterlockedOr(&Header()->Referenced, bits);
+    }
+
+    /**
+     * \return whether the block has been used since the last call for these bits
+     */
+    bool ClearReferenced(LONG bits = ReferencedClock)
+    {
+        return (InterlockedAnd(&Header()->Referenced, ~bits) & bits) != 0;
+    }
+
+    /**
+     * \brief writers are serialized by the named mutex, the version lets lock-free readers detect a concurrent write.
+     * a writer that died in the middle leaves the version odd, the next writer just makes it odd again
+     */
+    void BeginWrite()
+    {
+        if ((InterlockedIncrement(&Header()->Version) & 1) == 0)
+            InterlockedIncrement(&Header()->Version);
+        // an operation pinned before the version turned odd finishes first, the later ones see it odd and back off
+        WaitUnpinned();
+    }
+
+    /**
+     * \brief a pinned operation is a few instructions but may have been preempted after its checks, and it must not
+     * land on the next content, so the wait is bounded by time rather than by spins. pins still held after
+     * MAX_PIN_WAIT_MS were left by a process that died in between and are taken back
+     */
+    void WaitUnpinned() const
+    {
+        ULONGLONG start = 0;
+        for (int spin = 1; InterlockedCompareExchange(&Header()->Pins, 0, 0) > 0; spin++)
+        {
+            if (spin % MAX_PIN_WAIT_SPINS == 0)
+            {
+                ULONGLONG now = GetTickCount64();
+                if (start == 0)
+                    start = now;
+                else if (now - start >= MAX_PIN_WAIT_MS)
+                {
+                    InterlockedExchange(&Header()->Pins, 0);
+                    return;
+                }
+            }
+            SwitchToThread();
+        }
+    }
+
+    void EndWrite()
+    {
+        InterlockedIncrement(&Header()->Version);
+    }
+
+    /**
+     * \return false if a writer is updating the block
+     */
+    bool BeginRead(LONG& version) const
+    {
+        version = InterlockedCompareExchange(&Header()->Version, 0, 0);
+        return (version & 1) == 0;
+    }
+
+    /**
+     * \return true if nothing has been written since BeginRead, i.e. what was read is consistent
+     */
+    bool EndRead(LONG version) const
+    {
+        return InterlockedCompareExchange(&Header()->Version, 0, 0) == version;
+    }
+
+private:
+    BlockHeader* Header() const
+    {
+        return static_cast<BlockHeader*>(m_pData);
+    }
+
+    wchar_t* KeyData() const
+    {
+        return reinterpret_cast<wchar_t*>(static_cast<char*>(m_pData) + sizeof(BlockHeader));
     }
 };
 
@@ -54,6 +341,10 @@ struct KvInvalidOptionsException : std::exception
 struct KvMultiInitializationException: std::exception
 {};
 
+struct KvRestoreException : std::exception
+{
+};
+
 
 enum BlockState
 {
@@ -62,48 +353,162 @@ enum BlockState
     Mismatch
 };
 
+/**
+ * \brief partial index built by one worker of the parallel sync
+ */
+struct DataBlockScanResult
+{
+    std::unordered_map<std::wstring, long> keyPositionMap;
+    std::vector<long> unstableBlocks; // being written during the scan, to be read again under the mutex
+    long highestKeyPosition{-1};
+    LONGLONG highestSequence{0}; // of the stable blocks
+    std::exception_ptr error;
+};
+
+enum NumericOperationKind
+{
+    NumericRead,
+    NumericFetchAdd,
+    NumericCompareAndSwap
+};
+
+/**
+ * \brief one operation on a numeric block, double operands are passed as bit patterns
+ */
+struct NumericOperation
+{
+    KvValueType Type;
+    NumericOperationKind Kind;
+    LONGLONG Operand; // delta, or the desired value of CompareAndSwap
+    LONGLONG Expected;
+    LONGLONG Previous; // receives the value before the operation
+};
+
 class MemoryKV {
+    friend class MemoryKVInternals; // MemoryKVLib_Benchmark times the private steps one by one
 private:
     std::wstring m_dbName;
     ConfigOptions m_options;
     long m_dataBlockSize{}; // Size of each block (Key + Value)
+    int m_maxValueLength{}; // bound of a value with its NUL, a compressed one can be longer than the value section
     HANDLE *hMapFiles{};  // Handle to the memory-mapped file of data block
+    HANDLE *hSegmentFiles{};  // the file behind each data block MMF with KvStorageFile, INVALID_HANDLE_VALUE otherwise
     LPVOID *pMapViews{};  // Pointer to the memory-mapped view of data block
     HANDLE m_hMutex{};    // Handle to the named mutex
+    LONGLONG m_lockAcquisitions{}; // of m_hMutex by this instance, only changed while holding it
+    LONGLONG m_lockContentions{}; // acquisitions that had to wait
+    LONGLONG m_lockWaitTicks{}; // QueryPerformanceCounter ticks spent waiting
+    LONGLONG m_lockAcquiredAt{}; // QueryPerformanceCounter when m_hMutex was taken, for the hold time
+    LONGLONG m_lockWaitedTicks{}; // the wait for the current acquisition of m_hMutex
+    SRWLOCK m_localLock;  // guards the process-local state below, exclusive inside SYNC_CALL, shared for lock-free reads
     int m_currentMmfCount{}; //starts from 1, 0 means no data block
     int m_highestKeyPosition{};
+    DWORD m_reuseCursor{}; // the reused blocks in the header log up to this sequence are in m_keyPositionMap
     std::unordered_map<std::wstring, long> m_keyPositionMap;
+    std::map<std::wstring, long> m_orderedKeyPositions; // same content as m_keyPositionMap, only with OrderedIndex
     std::wstring m_clientName;
     std::unique_ptr<ILogger> m_logger;
     HeaderBlock m_pHeaderBlock;
+    ExpiryQueue m_expiryQueue;
+    VersionStore m_versionStore;
+    WriteAheadLog m_wal;
+    ColdStore m_coldStore;
+    ValuePool m_valuePool;
+    StatsPage m_statsPage;
+    TraceRing m_traceRing;
+    std::vector<char> m_compressedValue; // the value being written, under the mutex
+    bool m_valuePoolFull{}; // the last Intern of this instance found the pool full, it's logged once
+    std::vector<wchar_t> m_mergedValue; // Merge works on a copy with compression
 
 private:
 
     void InitMutex();
-    void InitializeData();
+    void AcquireDbMutex();
+    void ReleaseDbMutex(KvLatencyOp op);
+    void InitializeData(int& mmfCountToSync, const wchar_t* restoreFrom);
     void InitLocalVars();
     void InitHeaderBlock();
-    void InitDataBlock();
+    std::wstring GetStoragePath(const std::wstring& suffix) const;
+    std::wstring GetSegmentPath(int dataBlockMmfIndex) const;
+    void InitDataBlock(int& mmfCountToSync, const wchar_t* restoreFrom);
+    void InitWriteAheadLog(int& mmfCountToSync);
 
     int FindNextAvailableBlock() const;
+    LPVOID CreateDataBlock(int dataBlockMmfIndex);
+    void CloseDataBlock(int dataBlockMmfIndex);
     void ExpandDataBlock();
+    void RestoreDataBlocks(const wchar_t* path);
+    bool RestorePooledValues(long highestGlobalDbPosition, const std::vector<std::wstring>& pooledValues);
+    LPVOID MapDataBlock(int dataBlockMmfIndex);
     void SyncDataBlock(int dataBlockMmfIndex);
     void SyncDataBlocks();
+    void ScanDataBlock(int dataBlockMmfIndex, DataBlockScanResult& result);
+    void ParallelSyncDataBlocks(int mmfCount);
+    void InstallSyncedIndex(int mmfCount, std::unordered_map<std::wstring, long>& keyPositionMap,
+        long highestKeyPosition, LONGLONG highestSequence, const std::vector<long>& unstableBlocks);
     void RetrieveGlobalDbIndexByKey(const std::wstring& key, int& dataBlockMmfIndex, int& dataBlockIndex);
     void _FetchAndFindTheBlock(const std::wstring& key, int& dataBlockMmfIndex, int& dataBlockIndex);
-    void QueryValueByKey(const std::wstring& key, const wchar_t*& result);
+    KvStatus QueryValueByKey(const std::wstring& key, const wchar_t*& result);
+    KvStatus CopyValueByKey(const std::wstring& key, wchar_t* buffer, int bufferLength, int* valueLength);
+    void* FindKnownBlock(const std::wstring& key);
+    bool QueryKnownValueByKey(const std::wstring& key, const wchar_t*& result);
+    bool CopyKnownValueByKey(const std::wstring& key, wchar_t* buffer, int bufferLength, int* valueLength, KvStatus& status);
     LPVOID TheCurrentMapView() const;
     void* GetDataBlock(LPVOID pMapView, int i);
     void* GetDataBlock(int dataBlockMmfIndex, int dataBlockIndex) const;
     void RefreshGlobalDbIndex();
+    void RebuildOrderedIndex();
+    bool ReadScanItem(const DataBlock& block, const std::wstring& key, LONGLONG now, bool& matched, std::wstring& value);
+    bool CollectScanBatch(std::wstring& cursor, bool& inclusive, const std::wstring& to, size_t count,
+        std::vector<std::pair<std::wstring, std::wstring>>& items);
+    void ReplayReusedBlocks();
+    bool IsAtCapacity() const;
+    void EvictBlock(int& dataBlockMmfIndex, int& dataBlockIndex);
     void MarkGlobalDbIndex(const wchar_t* key, long globalDbIndex, bool isKeyFirstAdded);
     void UnmarkGlobalDbIndex(const std::wstring& key, int data_block_mmf_index, int data_block_index, bool isRemovedByMe);
-    bool UpdateKeyValue(const std::wstring& key, const std::wstring& value);
+    KvStatus ValidateKeyForUpdate(const std::wstring& key);
+    void FindOrCreateBlock(const std::wstring& key, int& dataBlockMmfIndex, int& dataBlockIndex, bool& isNewKey);
+    KvStatus UpdateKeyValue(const std::wstring& key, const wchar_t* value, int valueLength, LONGLONG expireAt = 0);
+    KvStatus UpdateKeyNumber(const std::wstring& key, KvValueType type, LONGLONG bits);
+    KvStatus MergeKeyValue(const std::wstring& key, KvMergeOperator mergeOperator, const wchar_t* operand, int operandLength);
+    static void ApplyNumericOperation(DataBlock& block, NumericOperation& operation);
+    bool TryKnownNumericOperation(const std::wstring& key, NumericOperation& operation);
+    KvStatus LockedNumericOperation(const std::wstring& key, NumericOperation& operation);
+    KvStatus RunNumericOperation(const std::wstring& key, NumericOperation& operation);
     long BuildGlobalDbIndex(int dataBlockmmfIndex, int dataBlockIndex) const;
     void CrackGlobalDbIndex(long globalDbIndex, int& dataBlockMmfIndex, int& dataBlockIndex) const;
     BlockState ValidateBlock(DataBlock& block, const std::wstring& key);
-    void RemoveBlockByKey(const std::wstring& key);
-    void RemoveData(DataBlock& block) const;
+    KvStatus RemoveBlockByKey(const std::wstring& key);
+    int UpdateKeyValues(int count, const wchar_t* const* keys, const int* keyLengths,
+        const wchar_t* const* values, const int* valueLengths, KvStatus* statuses);
+    int CopyValuesByKeys(int count, const wchar_t* const* keys, const int* keyLengths,
+        wchar_t* buffer, int bufferLength, int* valueOffsets, int* valueLengths, KvStatus* statuses);
+    int RemoveBlocksByKeys(int count, const wchar_t* const* keys, const int* keyLengths, KvStatus* statuses);
+    long ScanExpiryEntries(long position, std::vector<ExpiryEntry>& entries);
+    int RemoveExpiredBlocks(const std::vector<ExpiryEntry>& entries);
+    void RemoveData(DataBlock& block);
+    bool TracksAccess() const;
+    const wchar_t* ValueOf(const DataBlock& block);
+    void ThawValue(DataBlock& block);
+    void PromoteValue(DataBlock& block);
+    bool GetValuePages(const DataBlock& block, char*& first, SIZE_T& size) const;
+    void DiscardValuePages(char* first, SIZE_T size) const;
+    KvStatus EncodeValue(const wchar_t* value, int valueLength, KvValueType& type, LONGLONG& encoding);
+    void StoreValue(DataBlock& block, const wchar_t* value, int valueLength, KvValueType type, LONGLONG encoding);
+    void ReleaseValue(KvValueType type, LONGLONG encoding);
+    void ReclaimReleasedValues();
+    void CollectMemoryStats(KvMemoryStats& stats) const;
+    void SeedBlockStats();
+    void CountGet(KvStatus status);
+    void RecordLockFreeGet(const LARGE_INTEGER& start);
+    long RebalanceBlocks(long position, int& demoted, int& promoted, bool& full);
+    void BeginVersionedWrite(DataBlock& block);
+    void EndVersionedWrite(DataBlock& block);
+    void LogBlockWrite(const DataBlock& block, WalRecordType type);
+    bool CommitLog();
+    KvStatus RegisterSnapshot(KvSnapshot& snapshot);
+    bool CopyStableBlock(const DataBlock& block, void* copy);
+    KvStatus VisitSnapshotBlocks(const KvSnapshot& snapshot, const std::function<bool(long, const DataBlock*)>& visitor);
     bool IsInitialized() const;
 
 public:
@@ -113,10 +518,276 @@ public:
 
     __declspec(dllexport) void Open(const wchar_t* dbName, ConfigOptions options = ConfigOptions());    
 
+    /**
+     * \brief open the DB, if nobody has created it yet its MMFs are filled from a segment image written by SaveImage.
+     * the image is read straight into the MMFs, there is no Put per key. if the DB already exists the image is ignored
+     * \throw KvRestoreException if the image can't be read, is corrupted or was saved with other sizes
+     */
+    __declspec(dllexport) void Open(const wchar_t* dbName, ConfigOptions options, const wchar_t* restoreFrom);
+
     __declspec(dllexport) bool Put(const std::wstring& key, const std::wstring& value);
 
+    /**
+     * \brief put a key that expires after ttlMilliseconds, Get doesn't return it anymore after that and the host
+     * service reclaims its block. a later Put without ttl makes it permanent again
+     */
+    __declspec(dllexport) bool Put(const std::wstring& key, const std::wstring& value, long long ttlMilliseconds);
+
     __declspec(dllexport) const wchar_t* Get(const std::wstring& key);
 
     __declspec(dllexport) void Remove(const std::wstring& key);
+
+    /**
+     * \brief length-explicit put, key and value don't need to be NUL-terminated
+     * \return KvValueTooLarge if the value doesn't fit MaxValueSize, compressed with ConfigOptions::Compression
+     */
+    __declspec(dllexport) KvStatus TryPut(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength);
+
+    /**
+     * \brief copy the value into the caller buffer (NUL-terminated)
+     * \param valueLength receives the value length without NUL, also set when the buffer is too small
+     */
+    __declspec(dllexport) KvStatus TryGet(const wchar_t* key, int keyLength, wchar_t* buffer, int bufferLength, int* valueLength);
+
+    __declspec(dllexport) KvStatus TryRemove(const wchar_t* key, int keyLength);
+
+    /**
+     * \brief put count pairs under one lock acquisition
+     * \param statuses optional, receives the result of each pair
+     * \return the number of pairs put successfully
+     */
+    __declspec(dllexport) int PutBatch(int count, const wchar_t* const* keys, const int* keyLengths,
+        const wchar_t* const* values, const int* valueLengths, KvStatus* statuses);
+
+    /**
+     * \brief get count keys under one lock acquisition, values are packed NUL-terminated into buffer
+     * \param valueOffsets receives the offset of each value in buffer, -1 if it isn't copied
+     * \param valueLengths receives the length of each value, also set when the buffer runs out
+     * \return the number of values copied
+     */
+    __declspec(dllexport) int GetBatch(int count, const wchar_t* const* keys, const int* keyLengths,
+        wchar_t* buffer, int bufferLength, int* valueOffsets, int* valueLengths, KvStatus* statuses);
+
+    __declspec(dllexport) int RemoveBatch(int count, const wchar_t* const* keys, const int* keyLengths, KvStatus* statuses);
+
+    /**
+     * \brief visit the keys in [from, to) in key order, an empty to means no upper bound. needs OrderedIndex.
+     * the keys are read in batches under the local lock and visited outside of it, so the visitor may call this
+     * instance and writers aren't blocked. to continue later, scan again from the last key plus L'\0'
+     * \param limit the maximum number of keys to visit, 0 for all
+     * \return the number of visited keys, -1 if the instance isn't opened with OrderedIndex
+     */
+    __declspec(dllexport) int Scan(const std::wstring& from, const std::wstring& to, int limit, KvScanVisitor visitor, void* context);
+
+    /**
+     * \brief visit the keys starting with prefix in key order, e.g. L"machine/42/sensor/"
+     */
+    __declspec(dllexport) int ScanPrefix(const std::wstring& prefix, int limit, KvScanVisitor visitor, void* context);
+
+    /**
+     * \brief take a consistent read-only view of the whole DB without holding the mutex while reading it. writers
+     * keep going, they copy the contents the snapshot can still see into the version store. release it when done
+     * \return KvOutOfMemory if MAX_SNAPSHOT_COUNT snapshots are open on the DB
+     */
+    __declspec(dllexport) KvStatus OpenSnapshot(KvSnapshot& snapshot);
+
+    /**
+     * \brief visit every key of the snapshot, in block order. the visitor may call this instance
+     * \param visited optional, receives the number of visited keys
+     * \return KvSnapshotTooOld if the version store ran full meanwhile and the snapshot had to be dropped
+     */
+    __declspec(dllexport) KvStatus IterateSnapshot(const KvSnapshot& snapshot, KvScanVisitor visitor, void* context, int* visited = nullptr);
+
+    __declspec(dllexport) void ReleaseSnapshot(KvSnapshot& snapshot);
+
+    /**
+     * \brief write all the live keys into a checksummed binary file from a snapshot, Put/Get continue meanwhile.
+     * run it on a background thread, it takes as long as the write. the file is replaced only once it's complete
+     * \param bytesWritten optional, receives the file size
+     * \return KvSnapshotTooOld if writers filled the version store first, try again
+     */
+    __declspec(dllexport) KvStatus Checkpoint(const wchar_t* path, long long* bytesWritten = nullptr);
+
+    /**
+     * \brief visit the keys of a checkpoint file after checking its checksum, numbers are in their text form
+     * \return KvNotFound if the file can't be opened, KvError if it's incomplete or corrupted
+     */
+    __declspec(dllexport) static KvStatus ReadCheckpoint(const wchar_t* path, KvScanVisitor visitor, void* context, int* visited = nullptr);
+
+    /**
+     * \brief write the data block MMFs as of a snapshot, laid out exactly as in memory, for Open with restoreFrom.
+     * like Checkpoint, writers continue and the file is replaced only once it's complete. the write-ahead log drops the
+     * records the image has, after a crash the DB is recovered by restoring the image
+     * \return KvSnapshotTooOld if writers filled the version store first, try again
+     */
+    __declspec(dllexport) KvStatus SaveImage(const wchar_t* path, long long* bytesWritten = nullptr);
+
+    /**
+     * \brief counters of the write-ahead log shared by all the instances, records / flushes is the group commit batch size
+     */
+    __declspec(dllexport) void GetLogStats(long long* records, long long* flushes) const;
+
+    /**
+     * \brief how this instance waited for the DB mutex the writers and the index refreshes take
+     * \param acquisitions optional, receives the times it was taken
+     * \param contended optional, receives the times another thread or process had it
+     * \param waitMicroseconds optional, receives the time spent waiting for it
+     */
+    __declspec(dllexport) void GetLockStats(long long* acquisitions, long long* contended, long long* waitMicroseconds) const;
+
+    /**
+     * \brief with KvStorageFile, write the dirty pages of the header and all the segments to their files. the OS writes
+     * them back lazily anyway, Flush bounds what a power loss can take; a process crash loses nothing
+     * \param waitForDisk false only queues the writeback, cheap enough to call periodically
+     * \return KvOk at once with KvStorageMemory
+     */
+    __declspec(dllexport) KvStatus Flush(bool waitForDisk = true);
+
+    /**
+     * \brief with Tiering, one pass over all the blocks: string values not read since the last pass move to the cold
+     * store, cold values read since then come back into their blocks. only a value that covers whole pages moves,
+     * its pages are given back. Get reads a cold value in place, the OS pages it in from its file. the host server
+     * runs a pass every refresh, writers wait at most one batch of blocks
+     * \param demoted optional, receives the values moved out
+     * \param promoted optional, receives the values moved back
+     * \return KvOutOfMemory if the cold store is full, the pass still promotes
+     */
+    __declspec(dllexport) KvStatus RebalanceTiers(int* demoted = nullptr, int* promoted = nullptr);
+
+    /**
+     * \brief counters of the cold store shared by all the instances, the bytes are the ones of the chunks in use
+     */
+    __declspec(dllexport) void GetTieringStats(long long* demoted, long long* promoted, long long* storedBytes) const;
+
+    /**
+     * \brief counters of the value pool shared by all the instances, with Dedup
+     * \param values receives the distinct values stored
+     * \param shared receives the Puts that found their value in the pool and stored nothing new
+     * \param storedBytes receives the bytes of the distinct values
+     */
+    __declspec(dllexport) void GetValuePoolStats(long long* values, long long* shared, long long* storedBytes) const;
+
+    /**
+     * \brief walks all the blocks under the mutex, writers wait for it. for benchmarks and diagnostics, not the hot path
+     * \return KvNotInitialized, or KvOk with stats filled
+     */
+    __declspec(dllexport) KvStatus GetMemoryStats(KvMemoryStats& stats);
+
+    /**
+     * \brief the counters all the processes keep in the stats page of the DB, read without any lock
+     * \param thisProcessOnly only the counters of this process, summed over its instances
+     * \return KvNotInitialized, or KvOk with stats filled
+     */
+    __declspec(dllexport) KvStatus GetStats(KvStats& stats, bool thisProcessOnly = false) const;
+
+    /**
+     * \brief GetStats of a DB this process hasn't opened, for monitoring tools
+     * \return KvNotFound if no process has the DB open
+     */
+    __declspec(dllexport) static KvStatus ReadStats(const wchar_t* dbName, KvStats& stats);
+
+    /**
+     * \brief the latency histogram of a call, merged over the threads and processes that record it, see
+     * ConfigOptions::LatencyHistograms. an instance that doesn't record reads the ones of the other processes
+     * \param thisProcessOnly only the histogram of this process, summed over its instances
+     * \return KvNotInitialized, KvInvalidArgument, or KvOk with histogram filled, empty if no process records it
+     */
+    __declspec(dllexport) KvStatus GetLatencyHistogram(KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram,
+        bool thisProcessOnly = false) const;
+
+    /**
+     * \brief GetLatencyHistogram of a DB this process hasn't opened, for monitoring tools
+     * \return KvNotFound if no process records the latency of the DB
+     */
+    __declspec(dllexport) static KvStatus ReadLatencyHistogram(const wchar_t* dbName, KvLatencyOp op, KvLatencyPhase phase,
+        LatencyHistogram& histogram);
+
+    /**
+     * \brief the most accessed keys of the DB, highest first, estimated from the Puts and Gets sampled by the instances
+     * opened with ConfigOptions::HotKeySampling. an instance that doesn't sample reads the ones of the other processes
+     * \param count optional, receives the number of keys copied, at most HOT_KEY_COUNT
+     * \return KvNotInitialized, KvInvalidArgument, or KvOk, with no key if no process samples
+     */
+    __declspec(dllexport) KvStatus GetHotKeys(KvHotKey* keys, int capacity, int* count) const;
+
+    /**
+     * \brief GetHotKeys of a DB this process hasn't opened, for monitoring tools
+     * \return KvNotFound if no process samples the keys of the DB
+     */
+    __declspec(dllexport) static KvStatus ReadHotKeys(const wchar_t* dbName, KvHotKey* keys, int capacity, int* count);
+
+    /**
+     * \brief write the phases the instances opened with ConfigOptions::Tracing recorded in the last milliseconds to path,
+     * as Chrome trace event JSON for chrome://tracing or Perfetto. the ring is shared, so the trace has the threads of
+     * every process on one timeline, and the DB doesn't need to be open in this process
+     * \return KvNotFound if no process traces the DB, KvError if the file can't be written
+     */
+    __declspec(dllexport) static KvStatus WriteTrace(const wchar_t* dbName, const wchar_t* path, int milliseconds);
+
+    /**
+     * \brief append to the value in place, only the fragment is written. a missing key is created with the fragment
+     * \return KvValueTooLarge if the result doesn't fit MaxValueSize, compressed with ConfigOptions::Compression, the
+     * value is left as it was. a compressed value is rewritten whole
+     */
+    __declspec(dllexport) KvStatus Append(const std::wstring& key, const std::wstring& fragment);
+
+    /**
+     * \brief run a merge operator on the value in place under the mutex, a missing key starts as an empty value.
+     * operators are code, so every process registers nothing but calls Merge with its own function
+     */
+    __declspec(dllexport) KvStatus Merge(const std::wstring& key, KvMergeOperator mergeOperator, const wchar_t* operand, int operandLength);
+
+    /**
+     * \brief store a number that Increment/FetchAdd/CompareAndSwap update in place with one interlocked instruction.
+     * Get returns its text form (in a thread local buffer, valid till the next Get on the thread)
+     */
+    __declspec(dllexport) KvStatus PutNumber(const std::wstring& key, long long value);
+
+    __declspec(dllexport) KvStatus PutDouble(const std::wstring& key, double value);
+
+    /**
+     * \return KvTypeMismatch if the key doesn't hold an int64
+     */
+    __declspec(dllexport) KvStatus GetNumber(const std::wstring& key, long long* value);
+
+    __declspec(dllexport) KvStatus GetDouble(const std::wstring& key, double* value);
+
+    /**
+     * \brief atomic add, lock-free for a key this instance knows, a missing key is created as 0 under the mutex
+     * \param newValue optional, receives the value after the add
+     */
+    __declspec(dllexport) KvStatus Increment(const std::wstring& key, long long delta, long long* newValue = nullptr);
+
+    /**
+     * \param oldValue optional, receives the value before the add
+     */
+    __declspec(dllexport) KvStatus FetchAdd(const std::wstring& key, long long delta, long long* oldValue);
+
+    /**
+     * \brief atomically replace the value with desired if it's expected, a missing key counts as 0
+     * \param actual optional, receives the value found
+     * \return KvOk if replaced, KvCompareFailed if another value was found
+     */
+    __declspec(dllexport) KvStatus CompareAndSwap(const std::wstring& key, long long expected, long long desired, long long* actual = nullptr);
+
+    __declspec(dllexport) KvStatus FetchAddDouble(const std::wstring& key, double delta, double* oldValue);
+
+    /**
+     * \brief compares the bit patterns, so 0.0 doesn't match -0.0
+     */
+    __declspec(dllexport) KvStatus CompareAndSwapDouble(const std::wstring& key, double expected, double desired, double* actual = nullptr);
+
+    /**
+     * \brief for the host service: take the expiry entries queued by Put with ttl since the last call.
+     * if entries were dropped or never queued, e.g. after a restore, the blocks with an expiry time are collected by a
+     * scan in batches as well. an entry can come twice, the caller drops the ones it already holds
+     */
+    __declspec(dllexport) void FetchExpiryEntries(std::vector<ExpiryEntry>& entries);
+
+    /**
+     * \brief for the host service: remove the blocks of these entries that are due and haven't been rewritten since
+     * \return the number of removed blocks
+     */
+    __declspec(dllexport) int RemoveExpired(const std::vector<ExpiryEntry>& entries);
     
 };
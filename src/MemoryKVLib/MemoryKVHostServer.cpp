@@ -4,6 +4,7 @@
 #include <Windows.h>
 #include <Psapi.h>
 #include <sstream>
+#include <iomanip>
 
 #include "NamedPipeClient.h"
 
@@ -75,7 +76,20 @@ bool MemoryKVHostServer::Run(const wchar_t* dbName, ConfigOptions options, int r
         << L" -m " << options.MaxMmfCount
         << L" -b " << options.MaxBlocksPerMmf
         << L" -l " << options.LogLevel
+        << L" -e " << options.EvictionMode
         << L" -i " << refreshInterval;
+    if (options.Durability != KvDurabilityNone)
+        wss << L" -w " << options.Durability;
+    if (options.Storage != KvStorageMemory)
+        wss << L" -s " << options.Storage;
+    if (options.Tiering)
+        wss << L" -t 1";
+    if (options.Compression != KvCompressionNone)
+        wss << L" -c " << options.Compression << L" -z " << options.CompressionThreshold;
+    if (options.Dedup)
+        wss << L" -u 1 -y " << options.DedupThreshold;
+    if (options.Durability != KvDurabilityNone || options.Storage != KvStorageMemory || options.Tiering)
+        wss << L" -d " << std::quoted(options.DataDirectory);
 
     NamedPipeClient client;
     return client.Send(wss.str());
@@ -107,3 +121,17 @@ bool MemoryKVHostServer::Stop(const wchar_t* dbName)
     std::wcout << L"Sent signal to exit the watcher for db - " << dbName << std::endl;
     return client.Send(wss.str());
 }
+
+bool MemoryKVHostServer::Checkpoint(const wchar_t* dbName, const wchar_t* path)
+{
+    if (!IsProcessRunning(processName))
+    {
+        std::wcout << L"process is not running\n";
+        return false;
+    }
+
+    std::wstringstream wss;
+    wss << L"checkpoint -n " << dbName << L" -f " << std::quoted(std::wstring(path));
+    NamedPipeClient client;
+    return client.Send(wss.str());
+}
@@ -13,5 +13,9 @@ public:
     __declspec(dllexport) static bool Run(const wchar_t* dbName, ConfigOptions options=ConfigOptions(), int refreshInterval=10000);
     __declspec(dllexport) static bool StopAll();
     __declspec(dllexport) static bool Stop(const wchar_t* dbName);
+    /**
+     * \brief ask the host server to write a checkpoint of dbName to path in the background
+     */
+    __declspec(dllexport) static bool Checkpoint(const wchar_t* dbName, const wchar_t* path);
 };
 
@@ -10,13 +10,29 @@ extern "C" __declspec(dllexport) void MMFManager_open(MemoryKV* manager, const w
     manager->Open(dbName, options);
 }
 
+// Open and fill a new DB from a segment image, KvError if the image can't be restored
+extern "C" __declspec(dllexport) int MMFManager_openrestore(MemoryKV* manager, const wchar_t* dbName, ConfigOptions options,
+    const wchar_t* restoreFrom) {
+    try {
+        manager->Open(dbName, options, restoreFrom);
+        return KvOk;
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
 
 extern "C" __declspec(dllexport) void MMFManager_destroy(MemoryKV* manager) {
         delete manager;
     }
 
-extern "C" __declspec(dllexport) void MMFManager_put(MemoryKV* manager, const wchar_t* key, const wchar_t* value) {
-        manager->Put(key, value);
+extern "C" __declspec(dllexport) bool MMFManager_put(MemoryKV* manager, const wchar_t* key, const wchar_t* value) {
+        return manager->Put(key, value);
+    }
+
+extern "C" __declspec(dllexport) bool MMFManager_putttl(MemoryKV* manager, const wchar_t* key, const wchar_t* value, long long ttlMilliseconds) {
+        return manager->Put(key, value, ttlMilliseconds);
     }
 
 extern "C" __declspec(dllexport) const wchar_t* MMFManager_get(MemoryKV* manager, const wchar_t* key) {
@@ -27,6 +43,372 @@ extern "C" __declspec(dllexport) void MMFManager_remove(MemoryKV* manager, const
         manager->Remove(key);
     }
 
+// Length-explicit interface: keys and values are (pointer, length) pairs, Get copies into caller buffers,
+// every call returns a KvStatus and never lets an exception cross the boundary
+extern "C" __declspec(dllexport) int MMFManager_tryput(MemoryKV* manager, const wchar_t* key, int keyLength,
+    const wchar_t* value, int valueLength) {
+    try {
+        return manager->TryPut(key, keyLength, value, valueLength);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_tryget(MemoryKV* manager, const wchar_t* key, int keyLength,
+    wchar_t* buffer, int bufferLength, int* valueLength) {
+    try {
+        return manager->TryGet(key, keyLength, buffer, bufferLength, valueLength);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_tryremove(MemoryKV* manager, const wchar_t* key, int keyLength) {
+    try {
+        return manager->TryRemove(key, keyLength);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+// Numeric interface: values stored as int64 or double and updated in place with interlocked instructions
+extern "C" __declspec(dllexport) int MMFManager_putnumber(MemoryKV* manager, const wchar_t* key, int keyLength,
+    long long value) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->PutNumber(std::wstring(key, keyLength), value);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_getnumber(MemoryKV* manager, const wchar_t* key, int keyLength,
+    long long* value) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->GetNumber(std::wstring(key, keyLength), value);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_fetchadd(MemoryKV* manager, const wchar_t* key, int keyLength,
+    long long delta, long long* oldValue) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->FetchAdd(std::wstring(key, keyLength), delta, oldValue);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_compareandswap(MemoryKV* manager, const wchar_t* key, int keyLength,
+    long long expected, long long desired, long long* actual) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->CompareAndSwap(std::wstring(key, keyLength), expected, desired, actual);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_putdouble(MemoryKV* manager, const wchar_t* key, int keyLength,
+    double value) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->PutDouble(std::wstring(key, keyLength), value);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_getdouble(MemoryKV* manager, const wchar_t* key, int keyLength,
+    double* value) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->GetDouble(std::wstring(key, keyLength), value);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_fetchadddouble(MemoryKV* manager, const wchar_t* key, int keyLength,
+    double delta, double* oldValue) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->FetchAddDouble(std::wstring(key, keyLength), delta, oldValue);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_compareandswapdouble(MemoryKV* manager, const wchar_t* key, int keyLength,
+    double expected, double desired, double* actual) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->CompareAndSwapDouble(std::wstring(key, keyLength), expected, desired, actual);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+// Scan interface: needs OrderedIndex, returns the number of visited keys, -1 on error
+extern "C" __declspec(dllexport) int MMFManager_scan(MemoryKV* manager, const wchar_t* from, int fromLength,
+    const wchar_t* to, int toLength, int limit, KvScanVisitor visitor, void* context) {
+    if (from == nullptr || fromLength < 0 || to == nullptr || toLength < 0)
+        return -1;
+    try {
+        return manager->Scan(std::wstring(from, fromLength), std::wstring(to, toLength), limit, visitor, context);
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_scanprefix(MemoryKV* manager, const wchar_t* prefix, int prefixLength,
+    int limit, KvScanVisitor visitor, void* context) {
+    if (prefix == nullptr || prefixLength < 0)
+        return -1;
+    try {
+        return manager->ScanPrefix(std::wstring(prefix, prefixLength), limit, visitor, context);
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+// Snapshot interface: a consistent read-only view of the whole DB while writers continue
+extern "C" __declspec(dllexport) int MMFManager_opensnapshot(MemoryKV* manager, KvSnapshot* snapshot) {
+    if (snapshot == nullptr)
+        return KvInvalidArgument;
+    try {
+        return manager->OpenSnapshot(*snapshot);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_iteratesnapshot(MemoryKV* manager, const KvSnapshot* snapshot,
+    KvScanVisitor visitor, void* context, int* visited) {
+    if (snapshot == nullptr)
+        return KvInvalidArgument;
+    try {
+        return manager->IterateSnapshot(*snapshot, visitor, context, visited);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) void MMFManager_releasesnapshot(MemoryKV* manager, KvSnapshot* snapshot) {
+    if (snapshot == nullptr)
+        return;
+    try {
+        manager->ReleaseSnapshot(*snapshot);
+    }
+    catch (...) {
+    }
+}
+
+// Checkpoint interface: streams a snapshot of the DB to a file, writers are not blocked
+extern "C" __declspec(dllexport) int MMFManager_checkpoint(MemoryKV* manager, const wchar_t* path, long long* bytesWritten) {
+    if (path == nullptr)
+        return KvInvalidArgument;
+    try {
+        return manager->Checkpoint(path, bytesWritten);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_saveimage(MemoryKV* manager, const wchar_t* path, long long* bytesWritten) {
+    if (path == nullptr)
+        return KvInvalidArgument;
+    try {
+        return manager->SaveImage(path, bytesWritten);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+// counters of the write-ahead log, records / flushes is the group commit batch size
+extern "C" __declspec(dllexport) void MMFManager_getlogstats(MemoryKV* manager, long long* records, long long* flushes) {
+    manager->GetLogStats(records, flushes);
+}
+
+// writes the segment files of a DB opened with KvStorageFile
+extern "C" __declspec(dllexport) int MMFManager_flush(MemoryKV* manager, bool waitForDisk) {
+    try {
+        return manager->Flush(waitForDisk);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+// one tiering pass of a DB opened with Tiering, the host server runs it every refresh
+extern "C" __declspec(dllexport) int MMFManager_rebalancetiers(MemoryKV* manager, int* demoted, int* promoted) {
+    try {
+        return manager->RebalanceTiers(demoted, promoted);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) void MMFManager_gettieringstats(MemoryKV* manager, long long* demoted, long long* promoted, long long* storedBytes) {
+    manager->GetTieringStats(demoted, promoted, storedBytes);
+}
+
+extern "C" __declspec(dllexport) void MMFManager_getlockstats(MemoryKV* manager, long long* acquisitions, long long* contended, long long* waitMicroseconds) {
+    manager->GetLockStats(acquisitions, contended, waitMicroseconds);
+}
+
+extern "C" __declspec(dllexport) void MMFManager_getvaluepoolstats(MemoryKV* manager, long long* values, long long* shared, long long* storedBytes) {
+    manager->GetValuePoolStats(values, shared, storedBytes);
+}
+
+extern "C" __declspec(dllexport) int MMFManager_getmemorystats(MemoryKV* manager, KvMemoryStats* stats) {
+    if (stats == nullptr)
+        return KvInvalidArgument;
+    try {
+        return manager->GetMemoryStats(*stats);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_getstats(MemoryKV* manager, KvStats* stats, bool thisProcessOnly) {
+    if (stats == nullptr)
+        return KvInvalidArgument;
+    return manager->GetStats(*stats, thisProcessOnly);
+}
+
+// the stats page of a DB, without a manager, for monitoring tools
+extern "C" __declspec(dllexport) int MMFManager_readstats(const wchar_t* dbName, KvStats* stats) {
+    if (stats == nullptr)
+        return KvInvalidArgument;
+    return MemoryKV::ReadStats(dbName, *stats);
+}
+
+// latency histograms: the buckets cross the ABI as they are, so callers can merge the ones of several DBs or hosts
+extern "C" __declspec(dllexport) int MMFManager_getlatencyhistogram(MemoryKV* manager, int op, int phase,
+    LatencyHistogram* histogram, bool thisProcessOnly) {
+    if (histogram == nullptr)
+        return KvInvalidArgument;
+    return manager->GetLatencyHistogram(static_cast<KvLatencyOp>(op), static_cast<KvLatencyPhase>(phase), *histogram, thisProcessOnly);
+}
+
+extern "C" __declspec(dllexport) int MMFManager_readlatencyhistogram(const wchar_t* dbName, int op, int phase,
+    LatencyHistogram* histogram) {
+    if (histogram == nullptr)
+        return KvInvalidArgument;
+    return MemoryKV::ReadLatencyHistogram(dbName, static_cast<KvLatencyOp>(op), static_cast<KvLatencyPhase>(phase), *histogram);
+}
+
+extern "C" __declspec(dllexport) void MMFManager_mergelatencyhistogram(LatencyHistogram* target, const LatencyHistogram* source) {
+    if (target != nullptr && source != nullptr)
+        target->Merge(*source);
+}
+
+// in ns, 0 if nothing was recorded
+extern "C" __declspec(dllexport) long long MMFManager_latencyatpercentile(const LatencyHistogram* histogram, double percentile) {
+    return histogram == nullptr ? 0 : histogram->ValueAtPercentile(percentile);
+}
+
+// hot keys: the top keys of the shared sketch, highest first
+extern "C" __declspec(dllexport) int MMFManager_gethotkeys(MemoryKV* manager, KvHotKey* keys, int capacity, int* count) {
+    return manager->GetHotKeys(keys, capacity, count);
+}
+
+extern "C" __declspec(dllexport) int MMFManager_readhotkeys(const wchar_t* dbName, KvHotKey* keys, int capacity, int* count) {
+    return MemoryKV::ReadHotKeys(dbName, keys, capacity, count);
+}
+
+extern "C" __declspec(dllexport) int MMFManager_writetrace(const wchar_t* dbName, const wchar_t* path, int milliseconds) {
+    return MemoryKV::WriteTrace(dbName, path, milliseconds);
+}
+
+// Merge interface: string values changed in place under the mutex, only the operand is written
+extern "C" __declspec(dllexport) int MMFManager_append(MemoryKV* manager, const wchar_t* key, int keyLength,
+    const wchar_t* fragment, int fragmentLength) {
+    if (key == nullptr || keyLength < 0 || fragment == nullptr || fragmentLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->Append(std::wstring(key, keyLength), std::wstring(fragment, fragmentLength));
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_merge(MemoryKV* manager, const wchar_t* key, int keyLength,
+    KvMergeOperator mergeOperator, const wchar_t* operand, int operandLength) {
+    if (key == nullptr || keyLength < 0)
+        return KvInvalidArgument;
+    try {
+        return manager->Merge(std::wstring(key, keyLength), mergeOperator, operand, operandLength);
+    }
+    catch (...) {
+        return KvError;
+    }
+}
+
+// Batch interface: one call and one lock acquisition for count items, returns the number of succeeded items, -1 on error
+extern "C" __declspec(dllexport) int MMFManager_putbatch(MemoryKV* manager, int count, const wchar_t* const* keys,
+    const int* keyLengths, const wchar_t* const* values, const int* valueLengths, int* statuses) {
+    try {
+        return manager->PutBatch(count, keys, keyLengths, values, valueLengths, reinterpret_cast<KvStatus*>(statuses));
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_getbatch(MemoryKV* manager, int count, const wchar_t* const* keys,
+    const int* keyLengths, wchar_t* buffer, int bufferLength, int* valueOffsets, int* valueLengths, int* statuses) {
+    try {
+        return manager->GetBatch(count, keys, keyLengths, buffer, bufferLength, valueOffsets, valueLengths,
+            reinterpret_cast<KvStatus*>(statuses));
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+extern "C" __declspec(dllexport) int MMFManager_removebatch(MemoryKV* manager, int count, const wchar_t* const* keys,
+    const int* keyLengths, int* statuses) {
+    try {
+        return manager->RemoveBatch(count, keys, keyLengths, reinterpret_cast<KvStatus*>(statuses));
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
 extern "C" __declspec(dllexport) bool MemoryKvHost_startdefault(const wchar_t* dbName) {
     return MemoryKVHostServer::Run(dbName);
 }
@@ -41,4 +423,8 @@ extern "C" __declspec(dllexport) bool MemoryKvHost_stopall() {
 
 extern "C" __declspec(dllexport) bool MemoryKvHost_stop(const wchar_t* dbName) {
     return MemoryKVHostServer::Stop(dbName);
+}
+
+extern "C" __declspec(dllexport) bool MemoryKvHost_checkpoint(const wchar_t* dbName, const wchar_t* path) {
+    return MemoryKVHostServer::Checkpoint(dbName, path);
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "SegmentFile.h"
+
+HANDLE CreateSegmentMapping(const wchar_t* name, DWORD size, const wchar_t* path, bool truncate,
+    HANDLE& hFile, bool& existed, LONGLONG& previousSize)
+{
+    hFile = INVALID_HANDLE_VALUE;
+    existed = false;
+    previousSize = 0;
+    if (path == nullptr)
+    {
+        HANDLE hMapFile = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name);
+        existed = hMapFile != nullptr && GetLastError() == ERROR_ALREADY_EXISTS;
+        return hMapFile;
+    }
+
+    // an open MMF is the live content, its file must not be truncated under it
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name);
+    existed = hMapFile != nullptr;
+    hFile = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        truncate && !existed ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &fileSize))
+    {
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
+        if (hMapFile != nullptr)
+            CloseHandle(hMapFile);
+        hFile = INVALID_HANDLE_VALUE;
+        return nullptr;
+    }
+    previousSize = fileSize.QuadPart;
+    if (existed)
+        return hMapFile;
+
+    if (previousSize != 0 && previousSize != size)
+    {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+        return nullptr;
+    }
+    hMapFile = CreateFileMapping(hFile, nullptr, PAGE_READWRITE, 0, size, name);
+    existed = hMapFile != nullptr && GetLastError() == ERROR_ALREADY_EXISTS; // another process mapped it meanwhile
+    if (hMapFile == nullptr)
+    {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    return hMapFile;
+}
+
+bool FlushSegment(LPCVOID pMapView, HANDLE hFile)
+{
+    if (pMapView == nullptr || !FlushViewOfFile(pMapView, 0))
+        return false;
+    return hFile == INVALID_HANDLE_VALUE || FlushFileBuffers(hFile) != FALSE;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <Windows.h>
+
+/**
+ * \brief create or open the named MMF of a segment. without a path it's backed by the page file and lives as long
+ * as some process has it open. with a path it's backed by that file, which keeps the content across restarts
+ * \param truncate start the file empty (zero-filled), unless another instance has the MMF open already
+ * \param hFile receives the file, kept open for FlushFileBuffers, INVALID_HANDLE_VALUE without a path
+ * \param existed receives whether another instance had the MMF open
+ * \param previousSize receives the file size before the mapping, a file that is neither empty nor size long is
+ * not mapped: it was written with other options
+ * \return null on failure
+ */
+HANDLE CreateSegmentMapping(const wchar_t* name, DWORD size, const wchar_t* path, bool truncate,
+    HANDLE& hFile, bool& existed, LONGLONG& previousSize);
+
+/**
+ * \brief write the dirty pages of a file backed view, and wait for the disk if hFile is given
+ */
+bool FlushSegment(LPCVOID pMapView, HANDLE hFile);
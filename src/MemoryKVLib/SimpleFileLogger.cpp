@@ -27,6 +27,7 @@ void SimpleFileLogger::Log(const wchar_t* message, int logLevel, bool consolePri
     {
         std::wstring time_str;
         GetCurrentTime(time_str);
+        std::lock_guard<std::mutex> lock(m_mutex);
         if (m_logFile.is_open()) {
             m_logFile << time_str << L" - [" <<std::this_thread::get_id() <<"] " << message << std::endl;
         }
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <string>
 #include <locale>
+#include <mutex>
 
 #include "ILogger.h"
 
@@ -18,6 +19,7 @@ public:
     
 private:
     std::wofstream m_logFile; // Use wofstream for wide character output
+    std::mutex m_mutex; // one instance is shared by all threads using the same MemoryKV
     int m_logLevel{1};
     static void GetCurrentTime(std::wstring& time_str);
     static std::wstring GenerateFileName(const std::wstring& loggerName);
@@ -0,0 +1,592 @@
+#include "StatsPage.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+static const int PageSize = sizeof(StatsPageHeader) + MAX_STATS_SLOTS * sizeof(StatsSlot);
+static const int LatencyPageSize = (1 + MAX_STATS_SLOTS) * sizeof(LatencySlot); // the retired histograms first
+
+static std::wstring GetPageName(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFStats_" << dbName;
+    return wss.str();
+}
+
+static std::wstring GetLatencyPageName(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFLatency_" << dbName;
+    return wss.str();
+}
+
+static std::wstring GetHotKeyPageName(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFHotKeys_" << dbName;
+    return wss.str();
+}
+
+/**
+ * \brief FNV-1a over the bytes of the key, the same in every process
+ */
+static ULONGLONG HashKey(const std::wstring& key)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(key.c_str());
+    ULONGLONG hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size() * sizeof(wchar_t); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * \brief QueryPerformanceCounter ticks to ns, without the overflow of ticks * 10^9
+ */
+static LONGLONG TicksToNanoseconds(LONGLONG ticks)
+{
+    static const LONGLONG frequency = []()
+    {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        return value.QuadPart;
+    }();
+    return ticks / frequency * 1000000000LL + ticks % frequency * 1000000000LL / frequency;
+}
+
+void StatsPage::Pin(LPVOID pMapView)
+{
+    if (pMapView != nullptr)
+    {
+        pHeader = static_cast<StatsPageHeader*>(pMapView);
+        pSlots = reinterpret_cast<StatsSlot*>(static_cast<char*>(pMapView) + sizeof(StatsPageHeader));
+    }
+}
+
+void StatsPage::PinLatency(LPVOID pMapView)
+{
+    if (pMapView != nullptr)
+    {
+        pLatencyRetired = static_cast<LatencySlot*>(pMapView);
+        pLatencySlots = pLatencyRetired + 1;
+    }
+}
+
+StatsPage::StatsPage()
+{
+    pHeader = nullptr;
+    pSlots = nullptr;
+    pSlot = nullptr;
+    hStatsMapFile = nullptr;
+    pStatsMapView = nullptr;
+    pLatencyRetired = nullptr;
+    pLatencySlots = nullptr;
+    pLatencySlot = nullptr;
+    hLatencyMapFile = nullptr;
+    pLatencyMapView = nullptr;
+    pHotKeys = nullptr;
+    m_hotKeySampling = 0;
+    hHotKeyMapFile = nullptr;
+}
+
+void StatsPage::Setup(std::wstring& dbName, bool latencyHistograms, int hotKeySampling)
+{
+    // a new mapping is zero-filled: no slot taken, nothing counted and the block gauges to be seeded
+    hStatsMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        PageSize,
+        GetPageName(dbName).c_str());
+    if (hStatsMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pStatsMapView = MapViewOfFile(
+        hStatsMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        PageSize);
+    if (pStatsMapView == nullptr) {
+        CloseHandle(hStatsMapFile);
+        hStatsMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    Pin(pStatsMapView);
+    ClaimSlot();
+    if (latencyHistograms && pSlot != nullptr)
+        SetupLatency(dbName);
+    if (hotKeySampling > 0)
+        SetupHotKeys(dbName, hotKeySampling);
+}
+
+/**
+ * \brief the histograms are large, about 50 KB a slot, so the page is only mapped by the instances that record them
+ */
+void StatsPage::SetupLatency(std::wstring& dbName)
+{
+    hLatencyMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        LatencyPageSize,
+        GetLatencyPageName(dbName).c_str());
+    if (hLatencyMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pLatencyMapView = MapViewOfFile(
+        hLatencyMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        LatencyPageSize);
+    if (pLatencyMapView == nullptr) {
+        CloseHandle(hLatencyMapFile);
+        hLatencyMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    PinLatency(pLatencyMapView);
+    pLatencySlot = pLatencySlots + (pSlot - pSlots);
+}
+
+/**
+ * \brief under the DB mutex. a process that died while changing the heap leaves the lock taken, it's released here
+ */
+void StatsPage::SetupHotKeys(std::wstring& dbName, int sampling)
+{
+    hHotKeyMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        sizeof(HotKeyPage),
+        GetHotKeyPageName(dbName).c_str());
+    if (hHotKeyMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pHotKeys = static_cast<HotKeyPage*>(MapViewOfFile(
+        hHotKeyMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        sizeof(HotKeyPage)));
+    if (pHotKeys == nullptr) {
+        CloseHandle(hHotKeyMapFile);
+        hHotKeyMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    m_hotKeySampling = sampling;
+    LONG owner = pHotKeys->Lock;
+    if (owner != 0 && !IsProcessAlive(owner) && InterlockedCompareExchange(&pHotKeys->Lock, 0, owner) == owner)
+    {
+        if (pHotKeys->Version & 1)
+            InterlockedIncrement(&pHotKeys->Version);
+    }
+}
+
+/**
+ * \brief the slot of this process if another instance has it, a free one, or the one of a process that died with the
+ * DB open. the dead process's counts are kept in the retired totals
+ */
+void StatsPage::ClaimSlot()
+{
+    DWORD processId = GetCurrentProcessId();
+    StatsSlot* pFree = nullptr;
+    for (int i = 0; i < MAX_STATS_SLOTS; i++)
+    {
+        if (pSlots[i].ProcessId == processId)
+        {
+            pSlot = &pSlots[i];
+            pSlot->Instances++;
+            return;
+        }
+        if (pFree == nullptr && pSlots[i].ProcessId == 0)
+            pFree = &pSlots[i];
+    }
+    for (int i = 0; i < MAX_STATS_SLOTS && pFree == nullptr; i++)
+    {
+        if (!IsProcessAlive(pSlots[i].ProcessId))
+        {
+            RetireSlot(pSlots[i]);
+            pFree = &pSlots[i];
+        }
+    }
+    if (pFree == nullptr)
+        return; // this process counts nothing
+    pFree->ProcessId = processId;
+    pFree->Instances = 1;
+    pSlot = pFree;
+}
+
+/**
+ * \brief the histograms of the slot are only folded if this instance maps them, otherwise they stay with the slot
+ * and count for its next process
+ */
+void StatsPage::RetireSlot(StatsSlot& slot)
+{
+    for (int i = 0; i < KvStatCount; i++)
+    {
+        InterlockedExchangeAdd64(&pHeader->Retired[i].Value, slot.Counters[i].Value);
+        slot.Counters[i].Value = 0;
+    }
+    if (pLatencySlots != nullptr)
+    {
+        LatencySlot& latencySlot = pLatencySlots[&slot - pSlots];
+        for (int op = 0; op < KvLatencyOpCount; op++)
+        {
+            for (int phase = 0; phase < KvLatencyPhaseCount; phase++)
+            {
+                pLatencyRetired->Histograms[op][phase].Merge(latencySlot.Histograms[op][phase]);
+                latencySlot.Histograms[op][phase].Reset();
+            }
+        }
+    }
+    slot.Instances = 0;
+    slot.ProcessId = 0;
+}
+
+void StatsPage::TearDown()
+{
+    if (pSlot != nullptr && --pSlot->Instances == 0)
+        RetireSlot(*pSlot);
+    if (pLatencyMapView != nullptr)
+        UnmapViewOfFile(pLatencyMapView);
+    if (hLatencyMapFile != nullptr)
+        CloseHandle(hLatencyMapFile);
+    pLatencyMapView = nullptr;
+    hLatencyMapFile = nullptr;
+    pLatencyRetired = nullptr;
+    pLatencySlots = nullptr;
+    pLatencySlot = nullptr;
+    if (pHotKeys != nullptr)
+        UnmapViewOfFile(pHotKeys);
+    if (hHotKeyMapFile != nullptr)
+        CloseHandle(hHotKeyMapFile);
+    pHotKeys = nullptr;
+    hHotKeyMapFile = nullptr;
+    m_hotKeySampling = 0;
+    if (pStatsMapView != nullptr)
+        UnmapViewOfFile(pStatsMapView);
+    if (hStatsMapFile != nullptr)
+        CloseHandle(hStatsMapFile);
+    pStatsMapView = nullptr;
+    hStatsMapFile = nullptr;
+    pHeader = nullptr;
+    pSlots = nullptr;
+    pSlot = nullptr;
+}
+
+LONGLONG StatsPage::GetMappedBytes() const
+{
+    return (pStatsMapView == nullptr ? 0 : PageSize) + (pLatencyMapView == nullptr ? 0 : LatencyPageSize)
+        + (pHotKeys == nullptr ? 0 : sizeof(HotKeyPage));
+}
+
+void StatsPage::BlockFilled(bool reused)
+{
+    pHeader->LiveBlocks++;
+    if (reused)
+        pHeader->RemovedBlocks--;
+}
+
+void StatsPage::BlockEmptied()
+{
+    pHeader->LiveBlocks--;
+    pHeader->RemovedBlocks++;
+}
+
+bool StatsPage::IsSeeded() const
+{
+    return pHeader->Seeded != 0;
+}
+
+void StatsPage::Seed(LONGLONG liveBlocks, LONGLONG removedBlocks)
+{
+    pHeader->LiveBlocks = liveBlocks;
+    pHeader->RemovedBlocks = removedBlocks;
+    pHeader->Seeded = 1;
+}
+
+void StatsPage::Read(KvStats& stats, DWORD processId) const
+{
+    std::memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < MAX_STATS_SLOTS; i++)
+    {
+        const StatsSlot& slot = pSlots[i];
+        if (slot.ProcessId == 0 || (processId != 0 && slot.ProcessId != processId))
+            continue;
+        for (int j = 0; j < KvStatCount; j++)
+            stats.Counters[j] += slot.Counters[j].Value;
+        stats.Processes++;
+    }
+    if (processId == 0)
+    {
+        for (int j = 0; j < KvStatCount; j++)
+            stats.Counters[j] += pHeader->Retired[j].Value;
+    }
+    stats.Counters[KvStatLockWaitTime] = TicksToNanoseconds(stats.Counters[KvStatLockWaitTime]);
+    stats.Counters[KvStatLockHoldTime] = TicksToNanoseconds(stats.Counters[KvStatLockHoldTime]);
+    stats.LiveBlocks = pHeader->LiveBlocks;
+    stats.RemovedBlocks = pHeader->RemovedBlocks;
+}
+
+bool StatsPage::Read(const std::wstring& dbName, KvStats& stats)
+{
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, GetPageName(dbName).c_str());
+    if (hMapFile == nullptr)
+        return false;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, PageSize);
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return false;
+    }
+    StatsPage page;
+    page.Pin(pMapView);
+    page.Read(stats, 0);
+    UnmapViewOfFile(pMapView);
+    CloseHandle(hMapFile);
+    return true;
+}
+
+void StatsPage::RecordLatency(KvLatencyOp op, KvLatencyPhase phase, LONGLONG ticks)
+{
+    pLatencySlot->Histograms[op][phase].RecordShared(TicksToNanoseconds(ticks));
+}
+
+void StatsPage::ReadLatency(KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram, DWORD processId) const
+{
+    histogram.Reset();
+    if (pLatencySlots == nullptr)
+        return;
+    for (int i = 0; i < MAX_STATS_SLOTS; i++)
+    {
+        // a free slot keeps what its last process recorded if that one didn't map the histograms to fold them
+        if (processId == 0 || pSlots[i].ProcessId == processId)
+            histogram.Merge(pLatencySlots[i].Histograms[op][phase]);
+    }
+    if (processId == 0)
+        histogram.Merge(pLatencyRetired->Histograms[op][phase]);
+}
+
+bool StatsPage::ReadLatency(const std::wstring& dbName, KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram)
+{
+    histogram.Reset();
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, GetLatencyPageName(dbName).c_str());
+    if (hMapFile == nullptr)
+        return false;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, LatencyPageSize);
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return false;
+    }
+    const LatencySlot* pLatency = static_cast<const LatencySlot*>(pMapView);
+    for (int i = 0; i <= MAX_STATS_SLOTS; i++) // the retired histograms and every slot
+        histogram.Merge(pLatency[i].Histograms[op][phase]);
+    UnmapViewOfFile(pMapView);
+    CloseHandle(hMapFile);
+    return true;
+}
+
+/**
+ * \brief take Lock, or take it over from a process that died holding it, like ClaimSlot takes its slot. the heap it
+ * left half changed still holds counts, at worst an entry is out of place until it's raised again
+ * \return false if a live thread has it
+ */
+bool StatsPage::LockHotKeys()
+{
+    LONG processId = static_cast<LONG>(GetCurrentProcessId());
+    LONG owner = InterlockedCompareExchange(&pHotKeys->Lock, processId, 0);
+    if (owner == 0)
+        return true;
+    if (owner == processId || IsProcessAlive(owner)
+        || InterlockedCompareExchange(&pHotKeys->Lock, processId, owner) != owner)
+        return false;
+    if (pHotKeys->Version & 1)
+        InterlockedIncrement(&pHotKeys->Version); // even again, the readers take the heap as it is
+    return true;
+}
+
+/**
+ * \brief the rows of the sketch are indexed with h1 + row * h2 of the one hash. a key whose estimate doesn't beat the
+ * smallest of a full heap stops there, so the heap is only taken for the hot keys. a thread that finds it taken drops
+ * the sample, the next one of a hot key comes soon. a decay isn't dropped with it, it's left to the next holder
+ */
+void StatsPage::RecordKey(const std::wstring& key)
+{
+    thread_local LONG countdown = 0;
+    if (--countdown > 0)
+        return;
+    countdown = m_hotKeySampling;
+
+    ULONGLONG hash = HashKey(key);
+    ULONGLONG h1 = hash & 0xFFFFFFFF;
+    ULONGLONG h2 = (hash >> 32) | 1;
+    LONGLONG estimate = 0;
+    for (int row = 0; row < HOT_KEY_SKETCH_DEPTH; row++)
+    {
+        volatile LONGLONG* counter = &pHotKeys->Sketch[row][(h1 + row * h2) % HOT_KEY_SKETCH_WIDTH];
+        LONGLONG count = InterlockedExchangeAddNoFence64(counter, m_hotKeySampling) + m_hotKeySampling;
+        if (row == 0 || count < estimate)
+            estimate = count;
+    }
+    if (InterlockedIncrement64(&pHotKeys->Samples) % HOT_KEY_DECAY_SAMPLES == 0)
+        InterlockedIncrement(&pHotKeys->PendingDecays);
+    if (pHotKeys->PendingDecays == 0 && pHotKeys->Size == HOT_KEY_COUNT && estimate <= pHotKeys->Heap[0].Hot.Count)
+        return;
+
+    if (!LockHotKeys())
+        return;
+    InterlockedIncrement(&pHotKeys->Version);
+    LONG decays = InterlockedExchange(&pHotKeys->PendingDecays, 0);
+    if (decays > 0)
+    {
+        DecayHotKeys(decays);
+        estimate >>= decays < 63 ? decays : 63;
+    }
+    UpdateHotKeys(hash, key, estimate);
+    InterlockedIncrement(&pHotKeys->Version);
+    InterlockedExchange(&pHotKeys->Lock, 0);
+}
+
+static void SiftDown(HotKeyEntry* heap, int size, int i)
+{
+    for (;;)
+    {
+        int smallest = i;
+        int left = i * 2 + 1;
+        int right = left + 1;
+        if (left < size && heap[left].Hot.Count < heap[smallest].Hot.Count)
+            smallest = left;
+        if (right < size && heap[right].Hot.Count < heap[smallest].Hot.Count)
+            smallest = right;
+        if (smallest == i)
+            return;
+        std::swap(heap[i], heap[smallest]);
+        i = smallest;
+    }
+}
+
+static void SiftUp(HotKeyEntry* heap, int i)
+{
+    while (i > 0 && heap[(i - 1) / 2].Hot.Count > heap[i].Hot.Count)
+    {
+        std::swap(heap[i], heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * \brief under Lock: raise the key if it's in the heap, else add it or put it in place of the smallest
+ */
+void StatsPage::UpdateHotKeys(ULONGLONG hash, const std::wstring& key, LONGLONG count)
+{
+    HotKeyEntry* heap = pHotKeys->Heap;
+    int size = pHotKeys->Size;
+    for (int i = 0; i < size; i++)
+    {
+        if (heap[i].Hash == hash)
+        {
+            if (count > heap[i].Hot.Count)
+            {
+                heap[i].Hot.Count = count;
+                SiftDown(heap, size, i);
+            }
+            return;
+        }
+    }
+    int i;
+    if (size < HOT_KEY_COUNT)
+        i = pHotKeys->Size++;
+    else if (count > heap[0].Hot.Count)
+        i = 0;
+    else
+        return;
+    heap[i].Hash = hash;
+    heap[i].Hot.Count = count;
+    wcsncpy_s(heap[i].Hot.Key, HOT_KEY_LENGTH, key.c_str(), HOT_KEY_LENGTH - 1);
+    if (i == 0)
+        SiftDown(heap, pHotKeys->Size, 0);
+    else
+        SiftUp(heap, i);
+}
+
+/**
+ * \brief under Lock, halve the sketch and the heap so the keys that were hot long ago give way. the halving races the
+ * lock-free adds, a few of them are lost. halving keeps the order of the heap
+ */
+void StatsPage::DecayHotKeys(LONG decays)
+{
+    int shift = decays < 63 ? decays : 63; // halved once per decay
+    for (int row = 0; row < HOT_KEY_SKETCH_DEPTH; row++)
+    {
+        for (int i = 0; i < HOT_KEY_SKETCH_WIDTH; i++)
+            pHotKeys->Sketch[row][i] >>= shift;
+    }
+    for (int i = 0; i < pHotKeys->Size; i++)
+        pHotKeys->Heap[i].Hot.Count >>= shift;
+}
+
+/**
+ * \brief copy the heap between two reads of the version, plainly so it works on a read-only view
+ */
+int StatsPage::ReadHotKeys(const HotKeyPage& page, KvHotKey* keys, int capacity)
+{
+    std::vector<HotKeyEntry> heap(HOT_KEY_COUNT);
+    int size = 0;
+    for (int spin = 0; spin < MAX_PIN_WAIT_SPINS; spin++)
+    {
+        LONG version = page.Version;
+        if ((version & 1) == 0)
+        {
+            MemoryBarrier();
+            size = page.Size;
+            if (size > HOT_KEY_COUNT)
+                size = HOT_KEY_COUNT;
+            std::memcpy(heap.data(), page.Heap, sizeof(page.Heap));
+            MemoryBarrier();
+            if (page.Version == version)
+                break;
+        }
+        size = 0;
+        SwitchToThread();
+    }
+    heap.resize(size);
+    std::sort(heap.begin(), heap.end(), [](const HotKeyEntry& a, const HotKeyEntry& b) { return a.Hot.Count > b.Hot.Count; });
+    int count = size < capacity ? size : capacity;
+    for (int i = 0; i < count; i++)
+        keys[i] = heap[i].Hot;
+    return count;
+}
+
+int StatsPage::ReadHotKeys(KvHotKey* keys, int capacity) const
+{
+    return pHotKeys == nullptr ? 0 : ReadHotKeys(*pHotKeys, keys, capacity);
+}
+
+int StatsPage::ReadHotKeys(const std::wstring& dbName, KvHotKey* keys, int capacity)
+{
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, GetHotKeyPageName(dbName).c_str());
+    if (hMapFile == nullptr)
+        return -1;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, sizeof(HotKeyPage));
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return -1;
+    }
+    int count = ReadHotKeys(*static_cast<const HotKeyPage*>(pMapView), keys, capacity);
+    UnmapViewOfFile(pMapView);
+    CloseHandle(hMapFile);
+    return count;
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <string>
+#include <Windows.h>
+#include "Consts.h"
+#include "LatencyHistogram.h"
+
+/**
+ * \brief a process that can't be opened from this session is still there
+ */
+inline bool IsProcessAlive(DWORD processId)
+{
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == nullptr)
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD exitCode;
+    bool alive = GetExitCodeProcess(hProcess, &exitCode) && exitCode == STILL_ACTIVE;
+    CloseHandle(hProcess);
+    return alive;
+}
+
+/**
+ * \brief the counters of the stats page, see MemoryKV::GetStats. the times are read in ns
+ */
+enum KvStatCounter
+{
+    KvStatGets = 0, // Get, TryGet and the keys of GetBatch
+    KvStatGetHits,
+    KvStatGetMisses,
+    KvStatPuts, // Put, TryPut, PutNumber, PutDouble and the keys of PutBatch
+    KvStatRemoves, // Remove, TryRemove and the keys of RemoveBatch
+    KvStatScans,
+    KvStatNumerics, // GetNumber, Increment, CompareAndSwap and the like
+    KvStatMerges, // Append and Merge
+    KvStatRefreshes, // of the key index, by the lookups of unknown keys and the calls that map new MMFs
+    KvStatBlocksScanned, // by the refreshes and the syncs of whole MMFs
+    KvStatExpansions, // MMFs added
+    KvStatLockAcquisitions, // of the DB mutex
+    KvStatLockContentions, // acquisitions that had to wait
+    KvStatLockWaitTime,
+    KvStatLockHoldTime,
+    KvStatCount
+};
+
+/**
+ * \brief the calls with a latency histogram, see ConfigOptions::LatencyHistograms
+ */
+enum KvLatencyOp
+{
+    KvLatencyPut = 0, // Put, TryPut, PutNumber and PutDouble
+    KvLatencyGet, // Get and TryGet
+    KvLatencyRemove, // Remove and TryRemove
+    KvLatencyOpen, // the initialization under the mutex, the parallel sync of the existing MMFs runs outside it
+    KvLatencyExpand, // adding an MMF, inside the Put that needed it
+    KvLatencyOpCount
+};
+
+/**
+ * \brief a call is split into the wait for the DB mutex and the time holding it. a lock-free Get has no wait and
+ * records the read as its in-lock time, an expansion runs under the mutex of its Put and has no wait either
+ */
+enum KvLatencyPhase
+{
+    KvLatencyLockWait = 0,
+    KvLatencyInLock,
+    KvLatencyPhaseCount
+};
+
+/**
+ * \brief a read of the stats page, the sum of the process slots
+ */
+struct KvStats
+{
+    LONGLONG Counters[KvStatCount]; // by KvStatCounter
+    LONGLONG LiveBlocks; // blocks holding a key
+    LONGLONG RemovedBlocks; // emptied blocks below the high-water mark, not reused yet
+    LONGLONG Processes; // with the DB open
+};
+
+/**
+ * \brief one counter on its own cache line, so the processes and threads don't invalidate each other's counters
+ */
+struct alignas(64) StatsCounter
+{
+    volatile LONGLONG Value;
+};
+
+/**
+ * \brief the counters of one process, summed over its instances of the DB
+ */
+struct alignas(64) StatsSlot
+{
+    DWORD ProcessId; // 0 for a free slot
+    LONG Instances;
+    StatsCounter Counters[KvStatCount];
+};
+
+struct alignas(64) StatsPageHeader
+{
+    LONG Seeded; // the block gauges have been counted from the blocks once
+    LONG Reserved;
+    LONGLONG LiveBlocks;
+    LONGLONG RemovedBlocks;
+    StatsCounter Retired[KvStatCount]; // the counters of the processes that closed the DB
+};
+
+/**
+ * \brief the histograms of one slot, or the retired ones
+ */
+struct LatencySlot
+{
+    LatencyHistogram Histograms[KvLatencyOpCount][KvLatencyPhaseCount];
+};
+
+/**
+ * \brief a key of the top keys of the hot key sketch, see MemoryKV::GetHotKeys
+ */
+struct KvHotKey
+{
+    wchar_t Key[HOT_KEY_LENGTH]; // cut to HOT_KEY_LENGTH - 1 characters
+    LONGLONG Count; // estimated Puts and Gets, the sampled ones times the sampling rate, halved by every decay
+};
+
+struct HotKeyEntry
+{
+    ULONGLONG Hash;
+    KvHotKey Hot;
+};
+
+/**
+ * \brief a count-min sketch of the sampled keys and a min-heap of the keys with the highest estimates. the sketch is
+ * bumped without any lock, the heap is changed by one thread at a time under Lock and read by the version. the
+ * sketch and the heap are halved every HOT_KEY_DECAY_SAMPLES samples, by the holder of Lock
+ */
+struct HotKeyPage
+{
+    volatile LONG Lock; // the process changing the heap, 0 when free, taken over if it died
+    volatile LONG Version; // odd while the heap is being changed
+    LONG Size; // entries in the heap
+    volatile LONG PendingDecays; // due while another thread had Lock, the next holder applies them
+    volatile LONGLONG Samples;
+    HotKeyEntry Heap[HOT_KEY_COUNT];
+    volatile LONGLONG Sketch[HOT_KEY_SKETCH_DEPTH][HOT_KEY_SKETCH_WIDTH];
+};
+
+/**
+ * \brief shared counters of a DB, one slot per process. the counters are bumped without any lock and without a
+ * fence, a reader sees each of them at some recent value. the slots are claimed and released, and the block gauges
+ * changed, under the DB mutex. the latency histograms are in a second page mapped only by the instances that record
+ * them, with the same slots. the hot key sketch is in a third page, mapped by the instances that sample the keys
+ */
+class StatsPage
+{
+private:
+    StatsPageHeader* pHeader;
+    StatsSlot* pSlots;
+    StatsSlot* pSlot; // of this process, nullptr if all the slots are taken by live processes
+
+    HANDLE hStatsMapFile;
+    LPVOID pStatsMapView;
+
+    LatencySlot* pLatencyRetired;
+    LatencySlot* pLatencySlots;
+    LatencySlot* pLatencySlot; // of this process, nullptr without ConfigOptions::LatencyHistograms
+    HANDLE hLatencyMapFile;
+    LPVOID pLatencyMapView;
+
+    HotKeyPage* pHotKeys; // nullptr without ConfigOptions::HotKeySampling
+    LONG m_hotKeySampling;
+    HANDLE hHotKeyMapFile;
+
+private:
+    void Pin(LPVOID pMapView);
+    void PinLatency(LPVOID pMapView);
+    void SetupLatency(std::wstring& dbName);
+    void SetupHotKeys(std::wstring& dbName, int sampling);
+    void RecordKey(const std::wstring& key);
+    void UpdateHotKeys(ULONGLONG hash, const std::wstring& key, LONGLONG count);
+    bool LockHotKeys();
+    void DecayHotKeys(LONG decays);
+    static int ReadHotKeys(const HotKeyPage& page, KvHotKey* keys, int capacity);
+    void ClaimSlot();
+    void RetireSlot(StatsSlot& slot);
+public:
+    StatsPage();
+    /**
+     * \param hotKeySampling see ConfigOptions::HotKeySampling
+     */
+    void Setup(std::wstring& dbName, bool latencyHistograms, int hotKeySampling);
+    void TearDown();
+    LONGLONG GetMappedBytes() const;
+
+    void Add(KvStatCounter counter, LONGLONG value = 1)
+    {
+        if (pSlot != nullptr)
+            InterlockedExchangeAddNoFence64(&pSlot->Counters[counter].Value, value);
+    }
+
+    /**
+     * \brief a key was put into an empty block, a reused one was counted as removed
+     */
+    void BlockFilled(bool reused);
+    void BlockEmptied();
+    bool IsSeeded() const;
+    void Seed(LONGLONG liveBlocks, LONGLONG removedBlocks);
+    /**
+     * \brief a read racing a close may see the slot of that process both in place and retired, or in neither
+     * \param processId only the slot of this process, 0 for the whole DB
+     */
+    void Read(KvStats& stats, DWORD processId) const;
+    /**
+     * \brief read the page of a DB without opening it
+     * \return false if no process has the DB open
+     */
+    static bool Read(const std::wstring& dbName, KvStats& stats);
+
+    bool RecordsLatency() const
+    {
+        return pLatencySlot != nullptr;
+    }
+
+    void RecordLatency(KvLatencyOp op, KvLatencyPhase phase, LONGLONG ticks);
+    /**
+     * \brief merge the histograms of the slots into histogram, empty if no instance records them
+     * \param processId only the slot of this process, 0 for the whole DB
+     */
+    void ReadLatency(KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram, DWORD processId) const;
+    /**
+     * \return false if no process records the latency of the DB
+     */
+    static bool ReadLatency(const std::wstring& dbName, KvLatencyOp op, KvLatencyPhase phase, LatencyHistogram& histogram);
+
+    bool SamplesKeys() const
+    {
+        return pHotKeys != nullptr;
+    }
+
+    /**
+     * \brief a Put or Get of key, every HotKeySampling-th one of the thread goes into the sketch
+     */
+    void SampleKey(const std::wstring& key)
+    {
+        if (pHotKeys != nullptr)
+            RecordKey(key);
+    }
+
+    /**
+     * \brief the top keys by their estimates, highest first
+     * \return the number of keys copied
+     */
+    int ReadHotKeys(KvHotKey* keys, int capacity) const;
+    /**
+     * \return -1 if no process samples the keys of the DB
+     */
+    static int ReadHotKeys(const std::wstring& dbName, KvHotKey* keys, int capacity);
+};
@@ -2,19 +2,27 @@
 #include <Windows.h>
 
 /**
- * \brief call x statement in mutex
+ * \brief call x statement in mutex, the local state (m_localLock) is held exclusively as well
  * \param x please make sure x doesn't contain a return statement
  */
-#define SYNC_CALL(x) \
+#define SYNC_CALL(x) TIMED_SYNC_CALL(KvLatencyOpCount, x)
+
+/**
+ * \brief SYNC_CALL that records the wait for the mutex and the time holding it in the latency histograms of op
+ */
+#define TIMED_SYNC_CALL(op, x) \
 {\
-WaitForSingleObject(m_hMutex, INFINITE);\
+AcquireDbMutex();\
+AcquireSRWLockExclusive(&m_localLock);\
 \
 try {\
     x;\
 }\
 catch (...) {\
-    ReleaseMutex(m_hMutex);\
+    ReleaseSRWLockExclusive(&m_localLock);\
+    ReleaseDbMutex(op);\
     throw;\
 }\
-ReleaseMutex(m_hMutex);\
+ReleaseSRWLockExclusive(&m_localLock);\
+ReleaseDbMutex(op);\
 }
\ No newline at end of file
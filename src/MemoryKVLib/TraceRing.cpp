@@ -0,0 +1,203 @@
+#include "TraceRing.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include "StatsPage.h"
+
+static const int RingSize = sizeof(TraceRingHeader) + TRACE_RING_SIZE * sizeof(KvTraceEvent);
+
+static const char* PhaseNames[KvTracePhaseCount] = { "LockWait", "LockHeld", "RefreshGlobalDbIndex", "SyncDataBlocks",
+    "ExpandDataBlock", "Log" };
+static const char* OpNames[KvLatencyOpCount + 1] = { "Put", "Get", "Remove", "Open", "Expand", "Other" };
+
+static std::wstring GetRingName(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFTrace_" << dbName;
+    return wss.str();
+}
+
+void TraceRing::Pin(LPVOID pMapView)
+{
+    if (pMapView != nullptr)
+    {
+        pHeader = static_cast<TraceRingHeader*>(pMapView);
+        pEvents = reinterpret_cast<KvTraceEvent*>(static_cast<char*>(pMapView) + sizeof(TraceRingHeader));
+    }
+}
+
+TraceRing::TraceRing()
+{
+    pHeader = nullptr;
+    pEvents = nullptr;
+    m_processId = 0;
+    hTraceMapFile = nullptr;
+    pTraceMapView = nullptr;
+}
+
+void TraceRing::Setup(std::wstring& dbName)
+{
+    hTraceMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        RingSize,
+        GetRingName(dbName).c_str());
+    if (hTraceMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pTraceMapView = MapViewOfFile(
+        hTraceMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        RingSize);
+    if (pTraceMapView == nullptr) {
+        CloseHandle(hTraceMapFile);
+        hTraceMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    // the frequency is fixed at boot, every process writes the same value
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    static_cast<TraceRingHeader*>(pTraceMapView)->Frequency = frequency.QuadPart;
+    m_processId = GetCurrentProcessId();
+    Pin(pTraceMapView);
+}
+
+void TraceRing::TearDown()
+{
+    if (pTraceMapView != nullptr)
+        UnmapViewOfFile(pTraceMapView);
+    if (hTraceMapFile != nullptr)
+        CloseHandle(hTraceMapFile);
+    pTraceMapView = nullptr;
+    hTraceMapFile = nullptr;
+    pHeader = nullptr;
+    pEvents = nullptr;
+}
+
+LONGLONG TraceRing::GetMappedBytes() const
+{
+    return pTraceMapView == nullptr ? 0 : RingSize;
+}
+
+/**
+ * \brief the clock is read before the index is claimed, so the events of a thread are in the order of their indexes.
+ * a writer lapped by the whole ring while between its two sequence writes can leave a mixed event, the reader can't
+ * tell, it's one wrong event in a trace of a stall that long
+ */
+void TraceRing::Write(KvTracePhase phase, KvTraceKind kind, int arg)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    LONGLONG index = InterlockedIncrement64(&pHeader->Next) - 1;
+    KvTraceEvent& event = pEvents[index & (TRACE_RING_SIZE - 1)];
+    InterlockedExchange64(&event.Sequence, 0);
+    event.Ticks = now.QuadPart;
+    event.ProcessId = m_processId;
+    event.ThreadId = GetCurrentThreadId();
+    event.Phase = phase;
+    event.Kind = static_cast<SHORT>(kind);
+    event.Arg = static_cast<SHORT>(arg);
+    InterlockedExchange64(&event.Sequence, index + 1);
+}
+
+/**
+ * \brief an event is taken if its sequence is the one of its index before and after the copy. the view is read-only,
+ * so the sequence is read plainly with fences around the copy, like KvInspector reads a block
+ */
+bool TraceRing::Read(const std::wstring& dbName, int milliseconds, std::vector<KvTraceEvent>& events, LONGLONG& frequency)
+{
+    events.clear();
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, GetRingName(dbName).c_str());
+    if (hMapFile == nullptr)
+        return false;
+    LPVOID pMapView = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, RingSize);
+    if (pMapView == nullptr)
+    {
+        CloseHandle(hMapFile);
+        return false;
+    }
+    const TraceRingHeader* pRingHeader = static_cast<const TraceRingHeader*>(pMapView);
+    const KvTraceEvent* pRingEvents = reinterpret_cast<const KvTraceEvent*>(static_cast<const char*>(pMapView)
+        + sizeof(TraceRingHeader));
+    frequency = pRingHeader->Frequency;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    LONGLONG from = now.QuadPart - static_cast<LONGLONG>(milliseconds) * frequency / 1000;
+    LONGLONG next = pRingHeader->Next;
+    MemoryBarrier();
+    for (LONGLONG index = next > TRACE_RING_SIZE ? next - TRACE_RING_SIZE : 0; index < next; index++)
+    {
+        const KvTraceEvent& event = pRingEvents[index & (TRACE_RING_SIZE - 1)];
+        LONGLONG before = event.Sequence;
+        MemoryBarrier();
+        KvTraceEvent copy;
+        copy.Ticks = event.Ticks;
+        copy.ProcessId = event.ProcessId;
+        copy.ThreadId = event.ThreadId;
+        copy.Phase = event.Phase;
+        copy.Kind = event.Kind;
+        copy.Arg = event.Arg;
+        MemoryBarrier();
+        if (before != index + 1 || event.Sequence != before || copy.Ticks < from)
+            continue;
+        copy.Sequence = before;
+        events.push_back(copy);
+    }
+    UnmapViewOfFile(pMapView);
+    CloseHandle(hMapFile);
+    // the threads claim their indexes in about the order of their clock reads, not exactly
+    std::stable_sort(events.begin(), events.end(), [](const KvTraceEvent& a, const KvTraceEvent& b) {
+        return a.Ticks < b.Ticks;
+    });
+    return true;
+}
+
+bool TraceRing::WriteChromeTrace(const wchar_t* path, const std::vector<KvTraceEvent>& events, LONGLONG frequency)
+{
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    std::map<std::pair<DWORD, DWORD>, int> depths; // open phases of each thread
+    LONGLONG base = events.empty() ? 0 : events.front().Ticks;
+    bool first = true;
+    for (const KvTraceEvent& event : events)
+    {
+        if (event.Phase < 0 || event.Phase >= KvTracePhaseCount)
+            continue;
+        int& depth = depths[std::make_pair(event.ProcessId, event.ThreadId)];
+        if (event.Kind == KvTraceEnd && depth == 0)
+            continue;
+        depth += event.Kind == KvTraceBegin ? 1 : -1;
+
+        char line[256];
+        double microseconds = static_cast<double>(event.Ticks - base) * 1000000.0 / static_cast<double>(frequency);
+        int length = snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu",
+            first ? "" : ",", PhaseNames[event.Phase], event.Kind == KvTraceBegin ? "B" : "E", microseconds,
+            static_cast<unsigned long>(event.ProcessId), static_cast<unsigned long>(event.ThreadId));
+        json.append(line, length);
+        if (event.Phase == KvTraceLockHeld && event.Kind == KvTraceEnd && event.Arg >= 0 && event.Arg <= KvLatencyOpCount)
+        {
+            json.append(",\"args\":{\"op\":\"");
+            json.append(OpNames[event.Arg]);
+            json.append("\"}");
+        }
+        json.append("}");
+        first = false;
+    }
+    json.append("\n]}\n");
+
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD written;
+    bool succeeded = WriteFile(hFile, json.data(), static_cast<DWORD>(json.size()), &written, nullptr)
+        && written == json.size();
+    CloseHandle(hFile);
+    return succeeded;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "Consts.h"
+#include "ILogger.h"
+
+/**
+ * \brief the phases of a call with a tracepoint at their entry and exit, see ConfigOptions::Tracing
+ */
+enum KvTracePhase
+{
+    KvTraceLockWait = 0, // for the DB mutex, only when another thread holds it
+    KvTraceLockHeld, // Arg of the end is the KvLatencyOp of the call, KvLatencyOpCount for the calls without a histogram
+    KvTraceRefresh, // RefreshGlobalDbIndex
+    KvTraceSync, // SyncDataBlocks, and the parallel sync of Open outside the mutex
+    KvTraceExpand, // ExpandDataBlock
+    KvTraceLog, // a message written by the logger, the ones above the log level are dropped untraced
+    KvTracePhaseCount
+};
+
+enum KvTraceKind
+{
+    KvTraceBegin = 0,
+    KvTraceEnd,
+};
+
+struct KvTraceEvent
+{
+    volatile LONGLONG Sequence; // the index of the event plus 1, 0 while it's being written
+    LONGLONG Ticks; // QueryPerformanceCounter, one clock for all the processes
+    DWORD ProcessId;
+    DWORD ThreadId;
+    LONG Phase; // KvTracePhase
+    SHORT Kind; // KvTraceKind
+    SHORT Arg;
+};
+
+struct alignas(64) TraceRingHeader
+{
+    volatile LONGLONG Next; // events ever written, the next one goes to Next % TRACE_RING_SIZE
+    LONGLONG Frequency; // of QueryPerformanceCounter
+};
+
+/**
+ * \brief shared ring of the tracepoint events of a DB, written by the instances opened with ConfigOptions::Tracing.
+ * a writer claims an index with one interlocked increment and publishes the event by its sequence, no lock is taken.
+ * the ring only holds the latest TRACE_RING_SIZE events, a reader takes the ones of a time window on demand
+ */
+class TraceRing
+{
+private:
+    TraceRingHeader* pHeader; // nullptr without ConfigOptions::Tracing
+    KvTraceEvent* pEvents;
+    DWORD m_processId;
+
+    HANDLE hTraceMapFile;
+    LPVOID pTraceMapView;
+
+private:
+    void Pin(LPVOID pMapView);
+    void Write(KvTracePhase phase, KvTraceKind kind, int arg);
+public:
+    TraceRing();
+    void Setup(std::wstring& dbName);
+    void TearDown();
+    LONGLONG GetMappedBytes() const;
+
+    bool IsRecording() const
+    {
+        return pHeader != nullptr;
+    }
+
+    /**
+     * \brief a tracepoint, one test of a pointer when the DB isn't traced
+     */
+    void Record(KvTracePhase phase, KvTraceKind kind, int arg = 0)
+    {
+        if (pHeader != nullptr)
+            Write(phase, kind, arg);
+    }
+
+    /**
+     * \brief the events of the last milliseconds of the ring of a DB, oldest first. the ones being written are skipped
+     * \return false if no process traces the DB
+     */
+    static bool Read(const std::wstring& dbName, int milliseconds, std::vector<KvTraceEvent>& events, LONGLONG& frequency);
+
+    /**
+     * \brief write events as Chrome trace event JSON, for chrome://tracing or Perfetto. an end whose begin fell out of
+     * the window is dropped, a begin without its end runs to the end of the trace
+     */
+    static bool WriteChromeTrace(const wchar_t* path, const std::vector<KvTraceEvent>& events, LONGLONG frequency);
+};
+
+/**
+ * \brief the tracepoints of a phase that can return early or throw, the end is recorded on the way out
+ */
+class TraceScope
+{
+private:
+    TraceRing& m_ring;
+    KvTracePhase m_phase;
+public:
+    TraceScope(TraceRing& ring, KvTracePhase phase) : m_ring(ring), m_phase(phase)
+    {
+        m_ring.Record(m_phase, KvTraceBegin);
+    }
+
+    ~TraceScope()
+    {
+        m_ring.Record(m_phase, KvTraceEnd);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+/**
+ * \brief the logger of an instance opened with ConfigOptions::Tracing, the messages written by the logger it wraps are
+ * traced as KvTraceLog. the level is checked here as well, so the dropped messages leave no event
+ */
+class TracingLogger : public ILogger
+{
+private:
+    std::unique_ptr<ILogger> m_logger;
+    TraceRing& m_ring;
+    int m_logLevel;
+public:
+    TracingLogger(std::unique_ptr<ILogger> logger, TraceRing& ring) : m_logger(std::move(logger)), m_ring(ring), m_logLevel(1)
+    {
+    }
+
+    void SetLogLevel(int logLevel) override
+    {
+        m_logLevel = logLevel;
+        m_logger->SetLogLevel(logLevel);
+    }
+
+    void Log(const wchar_t* message, int logLevel = 1, bool consolePrint = false) override
+    {
+        if (m_logLevel < logLevel)
+            return;
+        TraceScope scope(m_ring, KvTraceLog);
+        m_logger->Log(message, logLevel, consolePrint);
+    }
+};
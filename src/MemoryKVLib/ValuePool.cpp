@@ -0,0 +1,293 @@
+#include "ValuePool.h"
+#include <cstring>
+#include <cwchar>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "SegmentFile.h"
+
+static const DWORD HeaderSize = sizeof(ValuePoolHeader) + VALUE_POOL_INDEX_SIZE * sizeof(ValuePoolEntry);
+static const LONG MaxEntryCount = VALUE_POOL_INDEX_SIZE / 4 * 3;
+static const LONG CompactRemovedCount = VALUE_POOL_INDEX_SIZE / 8; // new removed slots between two compactions
+static const LONG IndexMask = VALUE_POOL_INDEX_SIZE - 1;
+
+static ULONGLONG HashValue(const wchar_t* value, int length)
+{
+    // FNV-1a over the bytes
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(value);
+    ULONGLONG hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < static_cast<size_t>(length) * sizeof(wchar_t); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * \return the bytes of a chunk that holds the value and its NUL, the link of a free chunk goes over them
+ */
+static LONGLONG ChunkBytesOf(int length)
+{
+    return (static_cast<LONGLONG>(length) + 1) * sizeof(wchar_t);
+}
+
+ValuePool::ValuePool()
+    : m_chunks(L"ValuePoolSegment", L"pool", VALUE_POOL_SEGMENT_SIZE, MAX_VALUE_POOL_SEGMENT_COUNT,
+        VALUE_POOL_MIN_CHUNK, VALUE_POOL_CHUNK_CLASSES)
+{
+    pHeader = nullptr;
+    pEntries = nullptr;
+    hHeaderMapFile = nullptr;
+    hHeaderFile = INVALID_HANDLE_VALUE;
+    pHeaderMapView = nullptr;
+}
+
+void ValuePool::Setup(std::wstring& dbName, const wchar_t* directory, bool persistent)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFValuePool_" << dbName;
+    std::wstring path = std::wstring(directory) + L"\\" + dbName + L"_pool.hdr";
+
+    // a new mapping is zero-filled, which is an empty pool. segments past SegmentCount are truncated when created
+    DWORD size = HeaderSize;
+    bool existed;
+    LONGLONG previousSize;
+    hHeaderMapFile = CreateSegmentMapping(wss.str().c_str(), size, persistent ? path.c_str() : nullptr,
+        false, hHeaderFile, existed, previousSize);
+    if (hHeaderMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pHeaderMapView = MapViewOfFile(
+        hHeaderMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        size);
+    if (pHeaderMapView == nullptr) {
+        TearDown();
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    pHeader = static_cast<ValuePoolHeader*>(pHeaderMapView);
+    pEntries = reinterpret_cast<ValuePoolEntry*>(pHeader + 1);
+    m_chunks.Setup(&pHeader->Chunks, dbName, directory, persistent);
+}
+
+bool ValuePool::OpenReadOnly(const std::wstring& dbName)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFValuePool_" << dbName;
+    hHeaderMapFile = OpenFileMapping(FILE_MAP_READ, FALSE, wss.str().c_str());
+    if (hHeaderMapFile == nullptr)
+        return false;
+    pHeaderMapView = MapViewOfFile(hHeaderMapFile, FILE_MAP_READ, 0, 0, HeaderSize);
+    if (pHeaderMapView == nullptr)
+    {
+        TearDown();
+        return false;
+    }
+    pHeader = static_cast<ValuePoolHeader*>(pHeaderMapView);
+    pEntries = reinterpret_cast<ValuePoolEntry*>(pHeader + 1);
+    m_chunks.OpenReadOnly(&pHeader->Chunks, dbName);
+    return true;
+}
+
+void ValuePool::TearDown()
+{
+    m_chunks.TearDown();
+    if (pHeaderMapView != nullptr)
+        UnmapViewOfFile(pHeaderMapView);
+    if (hHeaderMapFile != nullptr)
+        CloseHandle(hHeaderMapFile);
+    if (hHeaderFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hHeaderFile);
+    pHeaderMapView = nullptr;
+    hHeaderMapFile = nullptr;
+    hHeaderFile = INVALID_HANDLE_VALUE;
+    pHeader = nullptr;
+    pEntries = nullptr;
+}
+
+bool ValuePool::IsEnabled() const
+{
+    return pHeader != nullptr;
+}
+
+/**
+ * \brief the removed slot ends a probe as well if the next slot is empty, and so do the removed slots before it
+ */
+void ValuePool::Free(LONG slot)
+{
+    ValuePoolEntry& entry = pEntries[slot];
+    int chunkClass = m_chunks.ChunkClassOf(ChunkBytesOf(entry.Length));
+    LONGLONG chunk = entry.Chunk - 1;
+    entry.Chunk = 0;
+    pHeader->EntryCount--;
+    pHeader->StoredBytes -= m_chunks.ChunkSizeOf(chunkClass);
+    if (pEntries[(slot + 1) & IndexMask].State == ValuePoolSlotEmpty)
+    {
+        entry.State = ValuePoolSlotEmpty;
+        for (LONG i = (slot - 1) & IndexMask; pEntries[i].State == ValuePoolSlotRemoved; i = (i - 1) & IndexMask)
+        {
+            pEntries[i].State = ValuePoolSlotEmpty;
+            pHeader->RemovedCount--;
+        }
+    }
+    else
+    {
+        entry.State = ValuePoolSlotRemoved;
+        pHeader->RemovedCount++;
+        if (pHeader->RemovedCount - pHeader->CompactedRemovedCount >= CompactRemovedCount)
+            CompactRemoved();
+    }
+    m_chunks.Free(chunk, chunkClass);
+}
+
+/**
+ * \brief empty the removed slots no probe passes: the ones not between the home slot of a used entry and the entry
+ */
+void ValuePool::CompactRemoved()
+{
+    std::vector<bool> passed(VALUE_POOL_INDEX_SIZE);
+    for (LONG slot = 0; slot < VALUE_POOL_INDEX_SIZE; slot++)
+    {
+        if (pEntries[slot].State != ValuePoolSlotUsed)
+            continue;
+        for (LONG i = static_cast<LONG>(pEntries[slot].Hash & IndexMask); i != slot; i = (i + 1) & IndexMask)
+            passed[i] = true;
+    }
+    pHeader->RemovedCount = 0;
+    for (LONG slot = 0; slot < VALUE_POOL_INDEX_SIZE; slot++)
+    {
+        if (pEntries[slot].State != ValuePoolSlotRemoved)
+            continue;
+        if (passed[slot])
+            pHeader->RemovedCount++;
+        else
+            pEntries[slot].State = ValuePoolSlotEmpty;
+    }
+    pHeader->CompactedRemovedCount = pHeader->RemovedCount;
+}
+
+LONG ValuePool::Intern(const wchar_t* value, int length)
+{
+    if (pHeader == nullptr || length < 0 || length >= MAX_POOLED_VALUE_LENGTH)
+        return -1;
+    ULONGLONG hash = HashValue(value, length);
+    LONG freeSlot = -1;
+    for (LONG i = 0; i < VALUE_POOL_INDEX_SIZE; i++)
+    {
+        LONG slot = static_cast<LONG>((hash + i) & IndexMask);
+        ValuePoolEntry& entry = pEntries[slot];
+        if (entry.State != ValuePoolSlotUsed)
+        {
+            if (freeSlot < 0)
+                freeSlot = slot;
+            if (entry.State == ValuePoolSlotEmpty)
+                break;
+            continue;
+        }
+        if (entry.Hash != hash || entry.Length != length)
+            continue;
+        const wchar_t* stored = Resolve(slot, length);
+        if (stored != nullptr && wmemcmp(stored, value, length) == 0)
+        {
+            if (entry.RefCount++ == 0)
+                pHeader->RetiredCount--;
+            InterlockedIncrement64(&pHeader->Shared);
+            return slot;
+        }
+    }
+    int chunkClass = m_chunks.ChunkClassOf(ChunkBytesOf(length));
+    if (freeSlot < 0 || pHeader->EntryCount >= MaxEntryCount || chunkClass < 0)
+        return -1;
+
+    LONGLONG chunk = m_chunks.Allocate(chunkClass);
+    wchar_t* target = chunk < 0 ? nullptr : reinterpret_cast<wchar_t*>(m_chunks.ChunkAt(chunk));
+    if (target == nullptr)
+        return -1;
+    wmemcpy(target, value, length);
+    target[length] = L'\0';
+    ValuePoolEntry& entry = pEntries[freeSlot];
+    if (entry.State == ValuePoolSlotRemoved)
+        pHeader->RemovedCount--;
+    entry.Hash = hash;
+    entry.Length = length;
+    entry.RefCount = 1;
+    entry.Chunk = chunk + 1;
+    entry.State = ValuePoolSlotUsed;
+    pHeader->EntryCount++;
+    pHeader->StoredBytes += m_chunks.ChunkSizeOf(chunkClass);
+    InterlockedIncrement64(&pHeader->Interned);
+    return freeSlot;
+}
+
+void ValuePool::Release(LONG slot, bool reclaim)
+{
+    if (pHeader == nullptr || slot < 0 || slot >= VALUE_POOL_INDEX_SIZE)
+        return;
+    ValuePoolEntry& entry = pEntries[slot];
+    if (entry.State != ValuePoolSlotUsed || entry.RefCount <= 0 || --entry.RefCount > 0)
+        return;
+    if (reclaim)
+        Free(slot);
+    else
+        pHeader->RetiredCount++;
+}
+
+int ValuePool::Reclaim()
+{
+    if (pHeader == nullptr || pHeader->RetiredCount == 0)
+        return 0;
+    int freed = 0;
+    for (LONG slot = 0; slot < VALUE_POOL_INDEX_SIZE; slot++)
+    {
+        if (pEntries[slot].State == ValuePoolSlotUsed && pEntries[slot].RefCount == 0)
+        {
+            Free(slot);
+            freed++;
+        }
+    }
+    pHeader->RetiredCount = 0;
+    return freed;
+}
+
+const wchar_t* ValuePool::Resolve(LONGLONG slot, int length)
+{
+    // a torn read of the block may give any slot and length, and the slot may have been reused since
+    if (pHeader == nullptr || slot < 0 || slot >= VALUE_POOL_INDEX_SIZE || length < 0 || length >= MAX_POOLED_VALUE_LENGTH)
+        return nullptr;
+    LONGLONG chunk = pEntries[slot].Chunk - 1;
+    if (!m_chunks.Contains(chunk, ChunkBytesOf(length)))
+        return nullptr;
+    const wchar_t* value = reinterpret_cast<const wchar_t*>(m_chunks.ChunkAt(chunk));
+    return value != nullptr && value[length] == L'\0' ? value : nullptr;
+}
+
+bool ValuePool::Flush(bool waitForDisk)
+{
+    bool flushed = hHeaderFile == INVALID_HANDLE_VALUE
+        || FlushSegment(pHeaderMapView, waitForDisk ? hHeaderFile : INVALID_HANDLE_VALUE);
+    return m_chunks.Flush(waitForDisk) && flushed;
+}
+
+LONGLONG ValuePool::GetEntryCount() const
+{
+    return pHeader == nullptr ? 0 : pHeader->EntryCount;
+}
+
+LONGLONG ValuePool::GetSharedCount() const
+{
+    return pHeader == nullptr ? 0 : InterlockedCompareExchange64(&pHeader->Shared, 0, 0);
+}
+
+LONGLONG ValuePool::GetStoredBytes() const
+{
+    return pHeader == nullptr ? 0 : pHeader->StoredBytes;
+}
+
+LONGLONG ValuePool::GetMappedBytes() const
+{
+    return pHeaderMapView == nullptr ? 0 : HeaderSize + m_chunks.GetMappedBytes();
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <Windows.h>
+#include "ChunkHeap.h"
+#include "Consts.h"
+
+enum ValuePoolSlotState : LONG
+{
+    ValuePoolSlotEmpty = 0, // ends a probe
+    ValuePoolSlotUsed = 1,
+    ValuePoolSlotRemoved = 2, // reclaimed, a probe goes on past it
+};
+
+/**
+ * \brief one slot of the content index, a block with a pooled value keeps the slot number
+ */
+struct ValuePoolEntry
+{
+    ULONGLONG Hash;
+    volatile LONGLONG Chunk; // (segment << 32 | offset) + 1 of the NUL-terminated value, 0 for none
+    LONG Length; // characters
+    LONG RefCount; // blocks pointing at it, under the DB mutex
+    LONG State; // ValuePoolSlotState
+    LONG Reserved;
+};
+
+/**
+ * \brief shared by all the processes of a DB, followed by the VALUE_POOL_INDEX_SIZE entries in the same MMF
+ */
+struct ValuePoolHeader
+{
+    ChunkHeapHeader Chunks;
+    LONG EntryCount; // used slots, referenced or retired
+    LONG RetiredCount; // used slots no block points at anymore, kept while a snapshot may read them
+    LONG RemovedCount; // removed slots, they lengthen the probes until they are emptied
+    LONG CompactedRemovedCount; // removed slots left by the last CompactRemoved, still on some probe
+    LONGLONG StoredBytes; // in the chunks of the used slots
+    volatile LONGLONG Interned; // values stored
+    volatile LONGLONG Shared; // values found in the pool already
+};
+
+/**
+ * \brief content addressed pool of the long string values of a DB, shared by all the instances: equal values are
+ * stored once and the blocks keep the slot of the pool entry, which counts them. the index is an open addressing
+ * table hashed by content, filled to 3/4 at most so a miss ends at an empty slot soon. the blocks keep the slots, so
+ * an entry never moves: a removed slot is emptied once no probe needs to pass it. the values are in the chunks of
+ * a ChunkHeap of VALUE_POOL_SEGMENT_SIZE segments, freed once unreferenced. Intern, Release and Reclaim are under
+ * the DB mutex
+ */
+class ValuePool
+{
+private:
+    ValuePoolHeader* pHeader;
+    ValuePoolEntry* pEntries;
+    HANDLE hHeaderMapFile;
+    HANDLE hHeaderFile;
+    LPVOID pHeaderMapView;
+    ChunkHeap m_chunks;
+
+private:
+    void Free(LONG slot);
+    void CompactRemoved();
+public:
+    ValuePool();
+    /**
+     * \param persistent keep the pool in files as well, <directory>\<dbName>_pool.hdr and _pool_<i>.seg: the DB
+     * segments are files (KvStorageFile) and may point here
+     */
+    void Setup(std::wstring& dbName, const wchar_t* directory, bool persistent);
+    /**
+     * \brief map the header and the segments of a DB another process has open, read-only, for Resolve only
+     * \return false if no process has them open
+     */
+    bool OpenReadOnly(const std::wstring& dbName);
+    void TearDown();
+    bool IsEnabled() const;
+    /**
+     * \brief find the value or store it, and count one more reference to it
+     * \return the slot, -1 if the index is at its load limit or all the segments are full
+     */
+    LONG Intern(const wchar_t* value, int length);
+    /**
+     * \param reclaim free the entry once unreferenced, false while a snapshot may still read it: it's retired then
+     */
+    void Release(LONG slot, bool reclaim);
+    /**
+     * \brief free the retired entries, once no snapshot is open
+     * \return the number of entries freed
+     */
+    int Reclaim();
+    /**
+     * \return the value, nullptr if the slot doesn't hold length characters (a torn read) or can't be mapped
+     */
+    const wchar_t* Resolve(LONGLONG slot, int length);
+    bool Flush(bool waitForDisk);
+    LONGLONG GetEntryCount() const;
+    LONGLONG GetSharedCount() const;
+    LONGLONG GetStoredBytes() const;
+    /**
+     * \brief the header with the slots and the segments this process has mapped
+     */
+    LONGLONG GetMappedBytes() const;
+};
@@ -0,0 +1,267 @@
+#include "VersionStore.h"
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+VersionStore::VersionStore()
+{
+    pHeader = nullptr;
+    pRecords = nullptr;
+    m_blockSize = 0;
+    m_recordSize = 0;
+    hStoreMapFile = nullptr;
+    pStoreMapView = nullptr;
+}
+
+void VersionStore::Setup(std::wstring& dbName, int blockSize)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFVersionStore_" << dbName;
+    m_blockSize = blockSize;
+    m_recordSize = static_cast<int>(sizeof(VersionRecordHeader)) + blockSize;
+    DWORD storeSize = static_cast<DWORD>(sizeof(VersionStoreHeader) + static_cast<size_t>(VERSION_STORE_SIZE) * m_recordSize);
+
+    // a new mapping is zero-filled: no snapshot, no record
+    hStoreMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        storeSize,
+        wss.str().c_str());
+    if (hStoreMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+
+    pStoreMapView = MapViewOfFile(
+        hStoreMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        storeSize);
+    if (pStoreMapView == nullptr) {
+        CloseHandle(hStoreMapFile);
+        hStoreMapFile = nullptr;
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    pHeader = static_cast<VersionStoreHeader*>(pStoreMapView);
+    pRecords = static_cast<char*>(pStoreMapView) + sizeof(VersionStoreHeader);
+}
+
+void VersionStore::TearDown()
+{
+    if (pStoreMapView != nullptr)
+        UnmapViewOfFile(pStoreMapView);
+    if (hStoreMapFile != nullptr)
+        CloseHandle(hStoreMapFile);
+    pStoreMapView = nullptr;
+    hStoreMapFile = nullptr;
+    pHeader = nullptr;
+    pRecords = nullptr;
+}
+
+LONGLONG VersionStore::GetMappedBytes() const
+{
+    return pStoreMapView == nullptr ? 0 : sizeof(VersionStoreHeader) + static_cast<LONGLONG>(VERSION_STORE_SIZE) * m_recordSize;
+}
+
+VersionRecordHeader* VersionStore::RecordAt(LONGLONG id) const
+{
+    return reinterpret_cast<VersionRecordHeader*>(pRecords + ((id - 1) % VERSION_STORE_SIZE) * m_recordSize);
+}
+
+LONGLONG VersionStore::NextSequence()
+{
+    return ++pHeader->CommitSequence;
+}
+
+void VersionStore::AdvanceSequence(LONGLONG sequence)
+{
+    if (sequence > pHeader->CommitSequence)
+        pHeader->CommitSequence = sequence;
+}
+
+bool VersionStore::HasActiveSnapshots() const
+{
+    return InterlockedCompareExchange(&pHeader->ActiveSnapshots, 0, 0) > 0;
+}
+
+/**
+ * \brief the update counts itself in its epoch before it checks for snapshots, and backs off if the epoch moved in
+ * between. so an update either sees the snapshot or is counted in the epoch OpenSnapshot waits for
+ */
+bool VersionStore::BeginInPlaceUpdate(LONG& epoch)
+{
+    epoch = InterlockedCompareExchange(&pHeader->Epoch, 0, 0);
+    InterlockedIncrement(&pHeader->InPlaceUpdates[epoch & 1]);
+    if (InterlockedCompareExchange(&pHeader->Epoch, 0, 0) != epoch || HasActiveSnapshots())
+    {
+        InterlockedDecrement(&pHeader->InPlaceUpdates[epoch & 1]);
+        return false;
+    }
+    return true;
+}
+
+void VersionStore::EndInPlaceUpdate(LONG epoch)
+{
+    InterlockedDecrement(&pHeader->InPlaceUpdates[epoch & 1]);
+}
+
+/**
+ * \brief an update is a few instructions but may have been preempted, the wait is bounded by time like the one for
+ * the pins of a block. updates still counted after MAX_PIN_WAIT_MS were left by a process that died in between
+ */
+void VersionStore::WaitInPlaceUpdates(LONG epoch)
+{
+    volatile LONG* inPlaceUpdates = &pHeader->InPlaceUpdates[epoch & 1];
+    ULONGLONG start = 0;
+    for (int spin = 1; InterlockedCompareExchange(inPlaceUpdates, 0, 0) > 0; spin++)
+    {
+        if (spin % MAX_PIN_WAIT_SPINS == 0)
+        {
+            ULONGLONG now = GetTickCount64();
+            if (start == 0)
+                start = now;
+            else if (now - start >= MAX_PIN_WAIT_MS)
+            {
+                InterlockedExchange(inPlaceUpdates, 0);
+                return;
+            }
+        }
+        SwitchToThread();
+    }
+}
+
+bool VersionStore::NeedsVersion(LONGLONG sequence) const
+{
+    for (int i = 0; i < MAX_SNAPSHOT_COUNT; i++)
+    {
+        const SnapshotSlot& slot = pHeader->Slots[i];
+        if (slot.State == SnapshotActive && slot.Sequence >= sequence)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * \brief free the records no snapshot can see anymore, i.e. replaced before the oldest snapshot was taken
+ */
+void VersionStore::Collect()
+{
+    bool hasSnapshot = false;
+    LONGLONG oldest = 0;
+    for (int i = 0; i < MAX_SNAPSHOT_COUNT; i++)
+    {
+        const SnapshotSlot& slot = pHeader->Slots[i];
+        if (slot.State == SnapshotActive && (!hasSnapshot || slot.Sequence < oldest))
+        {
+            oldest = slot.Sequence;
+            hasSnapshot = true;
+        }
+    }
+
+    LONGLONG tail = pHeader->Tail;
+    while (tail < pHeader->Head && (!hasSnapshot || RecordAt(tail + 1)->Superseded <= oldest))
+        tail++;
+    InterlockedExchange64(&pHeader->Tail, tail);
+}
+
+void VersionStore::InvalidateOldestSnapshot()
+{
+    int oldest = -1;
+    for (int i = 0; i < MAX_SNAPSHOT_COUNT; i++)
+    {
+        const SnapshotSlot& slot = pHeader->Slots[i];
+        if (slot.State == SnapshotActive && (oldest < 0 || slot.Sequence < pHeader->Slots[oldest].Sequence))
+            oldest = i;
+    }
+    if (oldest < 0)
+        return;
+    InterlockedExchange(&pHeader->Slots[oldest].State, SnapshotInvalidated);
+    InterlockedDecrement(&pHeader->ActiveSnapshots);
+}
+
+LONGLONG VersionStore::Preserve(const void* pBlock, LONGLONG sequence, LONGLONG next, LONGLONG superseded)
+{
+    Collect();
+    while (pHeader->Head - pHeader->Tail >= VERSION_STORE_SIZE)
+    {
+        InvalidateOldestSnapshot();
+        Collect();
+    }
+    if (!NeedsVersion(sequence)) // the snapshots that could see it have just been invalidated
+        return next;
+
+    LONGLONG id = pHeader->Head + 1;
+    VersionRecordHeader* record = RecordAt(id);
+    InterlockedExchange64(&record->Id, id);
+    record->Sequence = sequence;
+    record->Superseded = superseded;
+    record->Next = next;
+    memcpy(record + 1, pBlock, m_blockSize);
+    pHeader->Head = id; // readers come through the block version head, which is published after this
+    return id;
+}
+
+int VersionStore::OpenSnapshot(LONGLONG& id, LONGLONG& sequence)
+{
+    int chosen = -1;
+    for (int i = 0; i < MAX_SNAPSHOT_COUNT && chosen < 0; i++)
+    {
+        if (pHeader->Slots[i].State == SnapshotFree)
+            chosen = i;
+    }
+    for (int i = 0; i < MAX_SNAPSHOT_COUNT && chosen < 0; i++) // left behind by a process that didn't close it
+    {
+        if (pHeader->Slots[i].State == SnapshotInvalidated)
+            chosen = i;
+    }
+    if (chosen < 0)
+        return -1;
+
+    SnapshotSlot& slot = pHeader->Slots[chosen];
+    slot.Id = ++pHeader->NextSnapshotId;
+    slot.Sequence = pHeader->CommitSequence;
+    InterlockedExchange(&slot.State, SnapshotActive);
+    InterlockedIncrement(&pHeader->ActiveSnapshots);
+    WaitInPlaceUpdates(InterlockedIncrement(&pHeader->Epoch) - 1);
+    id = slot.Id;
+    sequence = slot.Sequence;
+    return chosen;
+}
+
+void VersionStore::CloseSnapshot(int slot, LONGLONG id)
+{
+    if (slot < 0 || slot >= MAX_SNAPSHOT_COUNT || pHeader->Slots[slot].Id != id)
+        return;
+    if (InterlockedExchange(&pHeader->Slots[slot].State, SnapshotFree) == SnapshotActive)
+        InterlockedDecrement(&pHeader->ActiveSnapshots);
+    Collect();
+}
+
+bool VersionStore::IsSnapshotValid(int slot, LONGLONG id) const
+{
+    SnapshotSlot& target = pHeader->Slots[slot];
+    return InterlockedCompareExchange(&target.State, 0, 0) == SnapshotActive && target.Id == id;
+}
+
+VersionLookup VersionStore::FindVersion(LONGLONG head, LONGLONG sequence, void* pBlockCopy) const
+{
+    // newest first. a record replaced at or before the sequence means the content at the sequence wasn't kept,
+    // which only happens to empty blocks; the freed records are all older than what an open snapshot needs
+    for (LONGLONG id = head; id != 0 && id > InterlockedCompareExchange64(&pHeader->Tail, 0, 0); )
+    {
+        const VersionRecordHeader* record = RecordAt(id);
+        if (record->Id != id)
+            return VersionLost;
+        if (record->Superseded <= sequence)
+            return VersionEmpty;
+        if (record->Sequence <= sequence)
+        {
+            memcpy(pBlockCopy, record + 1, m_blockSize);
+            return record->Id == id ? VersionFound : VersionLost;
+        }
+        id = record->Next;
+    }
+    return VersionEmpty;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <Windows.h>
+#include "Consts.h"
+
+enum SnapshotState : LONG
+{
+    SnapshotFree = 0,
+    SnapshotActive = 1,
+    SnapshotInvalidated = 2, // the version store ran full, the versions it needs may be gone
+};
+
+struct SnapshotSlot
+{
+    LONGLONG Id;
+    LONGLONG Sequence;
+    volatile LONG State; // SnapshotState
+    LONG Reserved;
+};
+
+/**
+ * \brief control area at the start of the version store MMF
+ */
+struct VersionStoreHeader
+{
+    LONGLONG CommitSequence; // stamped on every block write
+    LONGLONG Head; // records appended so far
+    volatile LONGLONG Tail; // records freed so far
+    LONGLONG NextSnapshotId;
+    volatile LONG ActiveSnapshots;
+    volatile LONG Epoch; // bumped by OpenSnapshot, the in-place updates of the previous epoch are waited for
+    volatile LONG InPlaceUpdates[2]; // lock-free in-place updates in flight, by the parity of their epoch
+    SnapshotSlot Slots[MAX_SNAPSHOT_COUNT];
+};
+
+/**
+ * \brief a previous content of a block, followed by the block copy
+ */
+struct VersionRecordHeader
+{
+    volatile LONGLONG Id; // position + 1, tells a reader whether the record has been reused
+    LONGLONG Sequence; // the content was written at this sequence
+    LONGLONG Superseded; // and replaced at this one
+    LONGLONG Next; // the older version of the same block, 0 for none
+};
+
+enum VersionLookup
+{
+    VersionFound,
+    VersionEmpty, // the block was empty at that sequence
+    VersionLost // the record has been reused, the snapshot is invalidated
+};
+
+/**
+ * \brief shared ring of block versions kept for the open snapshots. a writer copies the block into it before
+ * overwriting a content that a snapshot can still see, and links the copy from the block. records are appended in
+ * Superseded order, so they are freed from the tail once no snapshot is older than them. if the ring runs full the
+ * oldest snapshot is invalidated, writers never wait for readers.
+ * everything but FindVersion, HasActiveSnapshots, IsSnapshotValid and the in-place updates is under the DB mutex
+ */
+class VersionStore
+{
+private:
+    VersionStoreHeader* pHeader;
+    char* pRecords;
+    int m_blockSize;
+    int m_recordSize;
+
+    HANDLE hStoreMapFile;
+    LPVOID pStoreMapView;
+
+private:
+    VersionRecordHeader* RecordAt(LONGLONG id) const;
+    void Collect();
+    void InvalidateOldestSnapshot();
+    void WaitInPlaceUpdates(LONG epoch);
+public:
+    VersionStore();
+    void Setup(std::wstring& dbName, int blockSize);
+    void TearDown();
+    LONGLONG GetMappedBytes() const;
+    LONGLONG NextSequence();
+    /**
+     * \brief make the next sequences larger than one found in the blocks, they may come from an image or a file
+     */
+    void AdvanceSequence(LONGLONG sequence);
+    /**
+     * \brief lock-free, in-place updates that bypass the versions must take the locked path while it's true
+     */
+    bool HasActiveSnapshots() const;
+    /**
+     * \brief lock-free, enter an in-place update that bypasses the versions, pair it with EndInPlaceUpdate
+     * \return false if a snapshot is open or being opened, take the locked path then
+     */
+    bool BeginInPlaceUpdate(LONG& epoch);
+    void EndInPlaceUpdate(LONG epoch);
+    /**
+     * \return whether a snapshot can see a block content written at sequence
+     */
+    bool NeedsVersion(LONGLONG sequence) const;
+    /**
+     * \brief keep a copy of the block content written at sequence, which is replaced at superseded
+     * \return the new version head of the block, next if no snapshot needs the copy anymore
+     */
+    LONGLONG Preserve(const void* pBlock, LONGLONG sequence, LONGLONG next, LONGLONG superseded);
+    /**
+     * \brief the in-place updates that didn't see the snapshot finish before it returns
+     * \return the slot, -1 if all the slots are taken
+     */
+    int OpenSnapshot(LONGLONG& id, LONGLONG& sequence);
+    void CloseSnapshot(int slot, LONGLONG id);
+    bool IsSnapshotValid(int slot, LONGLONG id) const;
+    /**
+     * \brief lock-free, copy the content of a block visible at sequence by following its version chain.
+     * check IsSnapshotValid after it, a record can be reused under an invalidated snapshot
+     */
+    VersionLookup FindVersion(LONGLONG head, LONGLONG sequence, void* pBlockCopy) const;
+};
@@ -0,0 +1,414 @@
+#include "WriteAheadLog.h"
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include "Checkpoint.h"
+#include "ConfigOptions.h"
+#include "ExpiryQueue.h"
+
+// the end of the last record appended by the thread, to be made durable by its Commit
+static thread_local const WriteAheadLog* t_commitLog = nullptr;
+static thread_local LONGLONG t_commitOffset = 0;
+static thread_local bool t_appendFailed = false; // a record of the thread was dropped since its last Commit
+
+static DWORD RecordChecksum(const char* record, size_t size)
+{
+    return Crc32(0, record + sizeof(DWORD), size - sizeof(DWORD));
+}
+
+static bool WriteAt(HANDLE hFile, LONGLONG offset, const void* data, size_t size)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    DWORD written = 0;
+    return SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN)
+        && WriteFile(hFile, data, static_cast<DWORD>(size), &written, nullptr) && written == size;
+}
+
+static bool ReadAt(HANDLE hFile, LONGLONG offset, void* data, size_t size)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    DWORD read = 0;
+    return SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN)
+        && ReadFile(hFile, data, static_cast<DWORD>(size), &read, nullptr) && read == size;
+}
+
+WriteAheadLog::WriteAheadLog()
+{
+    pState = nullptr;
+    hStateMapFile = nullptr;
+    pStateMapView = nullptr;
+    hFile = INVALID_HANDLE_VALUE;
+    hFlushEvent = nullptr;
+    InitializeSRWLock(&m_flushLock);
+    InitializeConditionVariable(&m_flushDone);
+    m_flushing = false;
+    m_stopping = 0;
+    m_mode = KvDurabilityNone;
+    m_enabled = false;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    TearDown();
+}
+
+bool WriteAheadLog::Setup(std::wstring& dbName, const wchar_t* directory, int mode)
+{
+    std::wstringstream wss;
+    wss << L"Global\\MMFWal_" << dbName;
+    m_mode = mode;
+
+    // a new mapping is zero-filled, Replay sets the offsets
+    hStateMapFile = CreateFileMapping(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        sizeof(WalSharedState),
+        wss.str().c_str());
+    if (hStateMapFile == nullptr) {
+        throw std::runtime_error("Failed to create memory-mapped file.");
+    }
+    bool isFirst = GetLastError() != ERROR_ALREADY_EXISTS;
+
+    pStateMapView = MapViewOfFile(
+        hStateMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        sizeof(WalSharedState));
+    if (pStateMapView == nullptr) {
+        TearDown();
+        throw std::runtime_error("Failed to map view of memory-mapped file.");
+    }
+    pState = static_cast<WalSharedState*>(pStateMapView);
+
+    CreateDirectory(directory, nullptr); // fails if it exists already, CreateFile tells the real problems
+    std::wstring path(directory);
+    if (!path.empty() && path.back() != L'\\' && path.back() != L'/')
+        path += L'\\';
+    path += dbName + L".wal";
+    hFile = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        TearDown();
+        throw std::runtime_error("Failed to open the write-ahead log.");
+    }
+    return isFirst;
+}
+
+bool WriteAheadLog::Replay(const WalReplayVisitor& visitor, LONGLONG* replayed)
+{
+    LONGLONG count = 0;
+    if (replayed != nullptr)
+        *replayed = 0;
+
+    LARGE_INTEGER size;
+    LARGE_INTEGER position;
+    position.QuadPart = 0;
+    if (!GetFileSizeEx(hFile, &size) || !SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN))
+        return false;
+
+    LONGLONG validEnd = sizeof(WalFileHeader);
+    if (size.QuadPart < static_cast<LONGLONG>(sizeof(WalFileHeader)))
+    {
+        WalFileHeader header{ WAL_MAGIC, WAL_FORMAT_VERSION, CurrentTimeMs(), sizeof(WalFileHeader) };
+        DWORD written = 0;
+        if (!WriteFile(hFile, &header, sizeof(header), &written, nullptr) || written != sizeof(header)
+            || !SetEndOfFile(hFile) || !FlushFileBuffers(hFile))
+            return false;
+        size.QuadPart = validEnd;
+    }
+    else
+    {
+        WalFileHeader header;
+        DWORD read = 0;
+        if (!ReadFile(hFile, &header, sizeof(header), &read, nullptr) || read != sizeof(header)
+            || header.Magic != WAL_MAGIC || header.FormatVersion != WAL_FORMAT_VERSION
+            || header.StartOffset < validEnd || header.StartOffset > size.QuadPart)
+            return false;
+        validEnd = header.StartOffset;
+        position.QuadPart = validEnd;
+        if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN))
+            return false;
+    }
+
+    // records are read through a buffer, the ones crossing its end are moved to the front
+    std::vector<char> buffer(CHECKPOINT_BUFFER_SIZE);
+    size_t used = 0;
+    size_t offset = 0;
+    bool atEnd = false;
+    std::wstring key;
+    std::wstring value;
+    while (true)
+    {
+        size_t available = used - offset;
+        size_t recordSize = 0;
+        bool complete = false;
+        if (available >= sizeof(WalRecordHeader))
+        {
+            WalRecordHeader record;
+            memcpy(&record, buffer.data() + offset, sizeof(record));
+            if (record.KeyLength <= 0 || record.ValueLength < 0
+                || sizeof(record) + (static_cast<size_t>(record.KeyLength) + record.ValueLength) * sizeof(wchar_t) > WAL_MAX_RECORD_SIZE)
+                break; // garbage, the tail was torn
+            recordSize = sizeof(record) + (static_cast<size_t>(record.KeyLength) + record.ValueLength) * sizeof(wchar_t);
+            complete = available >= recordSize;
+        }
+        if (!complete)
+        {
+            if (atEnd)
+                break;
+            memmove(buffer.data(), buffer.data() + offset, available);
+            used = available;
+            offset = 0;
+            if (recordSize > buffer.size())
+                buffer.resize(recordSize);
+            DWORD read = 0;
+            if (!ReadFile(hFile, buffer.data() + used, static_cast<DWORD>(buffer.size() - used), &read, nullptr))
+                return false;
+            atEnd = read == 0;
+            used += read;
+            continue;
+        }
+
+        const char* bytes = buffer.data() + offset;
+        WalRecordHeader record;
+        memcpy(&record, bytes, sizeof(record));
+        if (record.Checksum != RecordChecksum(bytes, recordSize) || (record.Type != WalPut && record.Type != WalRemove))
+            break;
+        key.assign(reinterpret_cast<const wchar_t*>(bytes + sizeof(record)), record.KeyLength);
+        value.assign(reinterpret_cast<const wchar_t*>(bytes + sizeof(record)) + record.KeyLength, record.ValueLength);
+        visitor(record, key.c_str(), value.c_str());
+        count++;
+        offset += recordSize;
+        validEnd += recordSize;
+    }
+
+    if (validEnd < size.QuadPart)
+    {
+        // cut the torn tail so the next records follow the intact ones
+        position.QuadPart = validEnd;
+        if (!SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile) || !FlushFileBuffers(hFile))
+            return false;
+    }
+    InterlockedExchange64(&pState->BaseOffset, 0);
+    InterlockedExchange64(&pState->WrittenOffset, validEnd);
+    InterlockedExchange64(&pState->DurableOffset, validEnd);
+    if (replayed != nullptr)
+        *replayed = count;
+    return true;
+}
+
+void WriteAheadLog::Start()
+{
+    m_enabled = true;
+    if (m_mode == KvDurabilityAsync || m_mode == KvDurabilityPeriodic)
+    {
+        hFlushEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        m_stopping = 0;
+        m_flusher = std::thread(&WriteAheadLog::RunFlusher, this);
+    }
+}
+
+void WriteAheadLog::RunFlusher()
+{
+    DWORD interval = m_mode == KvDurabilityPeriodic ? WAL_FLUSH_INTERVAL : INFINITE;
+    while (true)
+    {
+        WaitForSingleObject(hFlushEvent, interval);
+        if (InterlockedCompareExchange(&m_stopping, 0, 0) != 0)
+            break;
+        Flush(InterlockedCompareExchange64(&pState->WrittenOffset, 0, 0));
+    }
+}
+
+void WriteAheadLog::TearDown()
+{
+    if (m_flusher.joinable())
+    {
+        InterlockedExchange(&m_stopping, 1);
+        SetEvent(hFlushEvent);
+        m_flusher.join();
+    }
+    if (m_enabled && m_mode != KvDurabilityNone)
+        Flush(InterlockedCompareExchange64(&pState->WrittenOffset, 0, 0)); // a clean close loses nothing in any mode
+    m_enabled = false;
+    if (hFlushEvent != nullptr)
+        CloseHandle(hFlushEvent);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    if (pStateMapView != nullptr)
+        UnmapViewOfFile(pStateMapView);
+    if (hStateMapFile != nullptr)
+        CloseHandle(hStateMapFile);
+    hFlushEvent = nullptr;
+    hFile = INVALID_HANDLE_VALUE;
+    pStateMapView = nullptr;
+    hStateMapFile = nullptr;
+    pState = nullptr;
+}
+
+bool WriteAheadLog::IsEnabled() const
+{
+    return m_enabled;
+}
+
+bool WriteAheadLog::Append(WalRecordHeader record, const wchar_t* key, const wchar_t* value)
+{
+    size_t keySize = static_cast<size_t>(record.KeyLength) * sizeof(wchar_t);
+    size_t valueSize = static_cast<size_t>(record.ValueLength) * sizeof(wchar_t);
+    size_t size = sizeof(record) + keySize + valueSize;
+    m_record.resize(size);
+    memcpy(m_record.data() + sizeof(record), key, keySize);
+    if (valueSize > 0)
+        memcpy(m_record.data() + sizeof(record) + keySize, value, valueSize);
+    record.Checksum = 0;
+    memcpy(m_record.data(), &record, sizeof(record));
+    record.Checksum = RecordChecksum(m_record.data(), size);
+    memcpy(m_record.data(), &record.Checksum, sizeof(record.Checksum));
+
+    // a failed or partial write isn't counted, the next record overwrites it. the Commit of the thread fails
+    LONGLONG offset = pState->WrittenOffset;
+    if (!WriteAt(hFile, offset - pState->BaseOffset, m_record.data(), size))
+    {
+        t_commitLog = this;
+        t_appendFailed = true;
+        return false;
+    }
+    InterlockedExchange64(&pState->WrittenOffset, offset + static_cast<LONGLONG>(size));
+    InterlockedIncrement64(&pState->RecordCount);
+    t_commitLog = this;
+    t_commitOffset = offset + static_cast<LONGLONG>(size);
+    return true;
+}
+
+bool WriteAheadLog::Commit()
+{
+    if (t_commitLog != this)
+        return true;
+    bool appended = !t_appendFailed;
+    t_appendFailed = false;
+    if (t_commitOffset == 0)
+        return appended;
+    LONGLONG offset = t_commitOffset;
+    t_commitOffset = 0;
+    if (m_mode == KvDurabilitySync)
+        return Flush(offset) && appended;
+    if (m_mode == KvDurabilityAsync)
+        SetEvent(hFlushEvent);
+    return appended;
+}
+
+LONGLONG WriteAheadLog::GetWrittenOffset() const
+{
+    return m_enabled ? pState->WrittenOffset : 0;
+}
+
+bool WriteAheadLog::Truncate(LONGLONG offset)
+{
+    if (!m_enabled)
+        return true;
+    WalFileHeader header;
+    if (!ReadAt(hFile, 0, &header, sizeof(header)))
+        return false;
+    LONGLONG base = pState->BaseOffset;
+    LONGLONG start = offset - base;
+    LONGLONG end = pState->WrittenOffset - base;
+    if (start <= header.StartOffset)
+        return true;
+
+    // the replay skips the dropped records from now on, whatever the later steps leave before start
+    header.StartOffset = start;
+    if (!WriteAt(hFile, 0, &header, sizeof(header)) || !FlushFileBuffers(hFile))
+        return false;
+
+    // the file shrinks once the later records fit in front of their current place. until the end is set, a replay
+    // from the front reads the copies, then stops at the seam or reads the older records and the originals again,
+    // the records are after-images so the content is the same
+    LONGLONG front = sizeof(WalFileHeader);
+    if (front + (end - start) <= start)
+    {
+        std::vector<char> later(static_cast<size_t>(end - start));
+        if (!later.empty() && (!ReadAt(hFile, start, later.data(), later.size())
+            || !WriteAt(hFile, front, later.data(), later.size()) || !FlushFileBuffers(hFile)))
+            return false;
+        header.StartOffset = front;
+        LARGE_INTEGER position;
+        position.QuadPart = front + (end - start);
+        if (!WriteAt(hFile, 0, &header, sizeof(header)) || !SetFilePointerEx(hFile, position, nullptr, FILE_BEGIN)
+            || !SetEndOfFile(hFile))
+            return false;
+        InterlockedExchange64(&pState->BaseOffset, base + start - front);
+    }
+    if (!FlushFileBuffers(hFile))
+        return false;
+    // everything written is flushed now, the offsets of the commits to come are unchanged
+    LONGLONG written = pState->WrittenOffset;
+    LONGLONG durable = InterlockedCompareExchange64(&pState->DurableOffset, 0, 0);
+    while (durable < written)
+    {
+        LONGLONG previous = InterlockedCompareExchange64(&pState->DurableOffset, written, durable);
+        if (previous == durable)
+            break;
+        durable = previous;
+    }
+    return true;
+}
+
+/**
+ * \brief make everything up to offset durable. one thread at a time flushes all the records written when it starts,
+ * the threads appending meanwhile wait for it and only flush again if their record came too late
+ */
+bool WriteAheadLog::Flush(LONGLONG offset)
+{
+    AcquireSRWLockExclusive(&m_flushLock);
+    while (m_flushing && InterlockedCompareExchange64(&pState->DurableOffset, 0, 0) < offset)
+        SleepConditionVariableSRW(&m_flushDone, &m_flushLock, INFINITE, 0);
+    if (InterlockedCompareExchange64(&pState->DurableOffset, 0, 0) >= offset)
+    {
+        ReleaseSRWLockExclusive(&m_flushLock);
+        return true;
+    }
+    m_flushing = true;
+    ReleaseSRWLockExclusive(&m_flushLock);
+
+    LONGLONG target = InterlockedCompareExchange64(&pState->WrittenOffset, 0, 0);
+    bool flushed = FlushFileBuffers(hFile) != FALSE;
+    if (flushed)
+    {
+        InterlockedIncrement64(&pState->FlushCount);
+        // another process may have flushed further meanwhile
+        LONGLONG durable = InterlockedCompareExchange64(&pState->DurableOffset, 0, 0);
+        while (durable < target)
+        {
+            LONGLONG previous = InterlockedCompareExchange64(&pState->DurableOffset, target, durable);
+            if (previous == durable)
+                break;
+            durable = previous;
+        }
+    }
+
+    AcquireSRWLockExclusive(&m_flushLock);
+    m_flushing = false;
+    ReleaseSRWLockExclusive(&m_flushLock);
+    WakeAllConditionVariable(&m_flushDone); // a failed flush is retried by the next waiter
+    return flushed;
+}
+
+LONGLONG WriteAheadLog::GetRecordCount() const
+{
+    return pState == nullptr ? 0 : InterlockedCompareExchange64(&pState->RecordCount, 0, 0);
+}
+
+LONGLONG WriteAheadLog::GetFlushCount() const
+{
+    return pState == nullptr ? 0 : InterlockedCompareExchange64(&pState->FlushCount, 0, 0);
+}
+
+LONGLONG WriteAheadLog::GetMappedBytes() const
+{
+    return pStateMapView == nullptr ? 0 : sizeof(WalSharedState);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+#include "Consts.h"
+
+#define WAL_MAGIC 0x4C4B564D // "MVKL"
+#define WAL_FORMAT_VERSION 2
+
+/**
+ * \brief shared by all the processes of a DB, the offsets are in the log file
+ */
+struct WalSharedState
+{
+    volatile LONGLONG WrittenOffset; // end of the last appended record, only moved under the DB mutex
+    volatile LONGLONG DurableOffset; // everything before it has been flushed
+    volatile LONGLONG BaseOffset; // of the start of the file, the offsets never go back when the log is truncated
+    volatile LONGLONG RecordCount; // appended since the log was opened
+    volatile LONGLONG FlushCount; // FlushFileBuffers calls, RecordCount / FlushCount is the group commit batch size
+};
+
+struct WalFileHeader
+{
+    DWORD Magic; // WAL_MAGIC
+    DWORD FormatVersion; // WAL_FORMAT_VERSION
+    LONGLONG CreatedAt; // CurrentTimeMs
+    LONGLONG StartOffset; // in the file, where the replay starts. the records before it are older than an image
+};
+
+enum WalRecordType : LONG
+{
+    WalPut = 1, // the content of the block after the write
+    WalRemove = 2,
+};
+
+/**
+ * \brief followed by KeyLength then ValueLength characters, no NUL. records are after-images, so replaying one twice
+ * or over a newer image gives the same content
+ */
+struct WalRecordHeader
+{
+    DWORD Checksum; // Crc32 of the rest of the record, a torn tail doesn't match
+    LONG Type; // WalRecordType
+    LONG KeyLength;
+    LONG ValueLength;
+    LONG ValueType; // KvValueType
+    LONG Reserved;
+    LONGLONG ExpireAt;
+    LONGLONG Numeric;
+};
+
+typedef std::function<void(const WalRecordHeader& record, const wchar_t* key, const wchar_t* value)> WalReplayVisitor;
+
+/**
+ * \brief write-ahead log of a DB, <directory>\<dbName>.wal. writers append the records under the DB mutex and call
+ * Commit after releasing it: with KvDurabilitySync the first committer flushes everything appended so far, the
+ * others wait for that flush and find their record durable, so concurrent Puts share one FlushFileBuffers.
+ * a process flushing the file covers the records of the other processes as well, the durable offset is shared.
+ * with KvDurabilityAsync/Periodic a background thread of the instance does the flushes
+ */
+class WriteAheadLog
+{
+private:
+    WalSharedState* pState;
+    HANDLE hStateMapFile;
+    LPVOID pStateMapView;
+    HANDLE hFile;
+    HANDLE hFlushEvent;
+    SRWLOCK m_flushLock; // guards m_flushing
+    CONDITION_VARIABLE m_flushDone;
+    bool m_flushing; // a thread of this process is in FlushFileBuffers
+    std::thread m_flusher;
+    volatile LONG m_stopping;
+    int m_mode;
+    bool m_enabled;
+    std::vector<char> m_record;
+
+private:
+    void RunFlusher();
+    bool Flush(LONGLONG offset);
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+    /**
+     * \brief open the log file shared, the directory is created if missing
+     * \return true if no other instance has the log open, the records are to be replayed then
+     */
+    bool Setup(std::wstring& dbName, const wchar_t* directory, int mode);
+    /**
+     * \brief visit the intact records, a torn tail left by a crash is cut off. a new file gets its header
+     * \param replayed optional, receives the number of visited records
+     * \return false if the file isn't a log
+     */
+    bool Replay(const WalReplayVisitor& visitor, LONGLONG* replayed = nullptr);
+    /**
+     * \brief start logging, after Replay if it was the first instance
+     */
+    void Start();
+    void TearDown();
+    bool IsEnabled() const;
+    /**
+     * \brief under the DB mutex
+     * \return false if the write failed, the record is dropped
+     */
+    bool Append(WalRecordHeader record, const wchar_t* key, const wchar_t* value);
+    /**
+     * \brief after releasing the DB mutex, makes the records appended by this thread durable as the mode says
+     * \return false if the flush failed or Append dropped a record of this thread
+     */
+    bool Commit();
+    /**
+     * \brief under the DB mutex, the offset to truncate the log at once an image of the DB as of now is saved
+     */
+    LONGLONG GetWrittenOffset() const;
+    /**
+     * \brief under the DB mutex, drop the records before offset, they're older than a saved image. the start offset
+     * of the header moves first, then the later records are copied to the front if they fit before offset, so a
+     * crash at any point leaves a log that replays to the same content
+     * \return false if the file couldn't be written
+     */
+    bool Truncate(LONGLONG offset);
+    LONGLONG GetRecordCount() const;
+    LONGLONG GetFlushCount() const;
+    LONGLONG GetMappedBytes() const;
+};
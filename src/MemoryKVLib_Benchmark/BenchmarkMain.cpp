@@ -0,0 +1,31 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+/**
+ * \brief the benchmark_main of Google Benchmark, the results also go to MemoryKVLib_Benchmark.json unless
+ * --benchmark_out names another file, so every run leaves a JSON to compare with the previous one
+ */
+int main(int argc, char** argv)
+{
+    std::vector<char*> args(argv, argv + argc);
+    std::string out = "--benchmark_out=MemoryKVLib_Benchmark.json";
+    std::string format = "--benchmark_out_format=json";
+    bool hasOut = false;
+    for (int i = 1; i < argc; ++i)
+        hasOut = hasOut || std::strncmp(argv[i], "--benchmark_out=", 16) == 0;
+    if (!hasOut)
+    {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../MemoryKVLib/MemoryKV.h"
+
+/**
+ * \brief the arguments every benchmark takes: key count, key length, value length and log level. the keys are made
+ * up front so the loops only time the DB
+ */
+struct BenchmarkShape
+{
+    long KeyCount;
+    int KeyLength;
+    int ValueLength;
+    int LogLevel;
+    std::vector<std::wstring> Keys;
+    std::wstring Value;
+
+    explicit BenchmarkShape(const benchmark::State& state)
+        : KeyCount(static_cast<long>(state.range(0)))
+        , KeyLength(static_cast<int>(state.range(1)))
+        , ValueLength(static_cast<int>(state.range(2)))
+        , LogLevel(static_cast<int>(state.range(3)))
+        , Value(ValueLength, L'v')
+    {
+        Keys.reserve(KeyCount);
+        for (long i = 0; i < KeyCount; ++i)
+            Keys.push_back(MakeKey(L"key_", i));
+    }
+
+    /**
+     * \brief prefix and number padded to KeyLength, so every key has the same length
+     */
+    std::wstring MakeKey(const wchar_t* prefix, long i) const
+    {
+        std::wstring key = prefix + std::to_wstring(i);
+        if (static_cast<int>(key.size()) < KeyLength)
+            key.append(KeyLength - key.size(), L'_');
+        return key;
+    }
+
+    ConfigOptions MakeOptions(int maxBlocksPerMmf) const
+    {
+        ConfigOptions options;
+        options.MaxKeySize = KeyLength + 1;
+        options.MaxValueSize = ValueLength + 1;
+        options.MaxBlocksPerMmf = maxBlocksPerMmf;
+        options.MaxMmfCount = static_cast<int>(KeyCount / maxBlocksPerMmf) + 2;
+        options.LogLevel = LogLevel;
+        return options;
+    }
+
+    /**
+     * \brief a new DB, the name is only used by this benchmark so nothing is left from a previous run
+     */
+    std::unique_ptr<MemoryKV> Open(const wchar_t* dbName, int maxBlocksPerMmf = BENCHMARK_BLOCKS_PER_MMF) const
+    {
+        auto kv = std::make_unique<MemoryKV>(L"benchmark");
+        kv->Open(dbName, MakeOptions(maxBlocksPerMmf));
+        return kv;
+    }
+
+    std::unique_ptr<MemoryKV> OpenFilled(const wchar_t* dbName, int maxBlocksPerMmf = BENCHMARK_BLOCKS_PER_MMF) const
+    {
+        auto kv = Open(dbName, maxBlocksPerMmf);
+        for (auto& key : Keys)
+            kv->Put(key, Value);
+        return kv;
+    }
+
+    static const int BENCHMARK_BLOCKS_PER_MMF = 10000;
+};
+
+/**
+ * \brief key count x key length x value length x log level
+ */
+inline void ShapeArguments(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({ "keys", "key_len", "value_len", "log" });
+    benchmark->ArgsProduct({ { 1000, 100000 }, { 16, 60 }, { 64, 1024 }, { 0, 1 } });
+}
@@ -0,0 +1,83 @@
+#include "BenchmarkShape.h"
+#include "MemoryKVInternals.h"
+
+// the steps behind the operations. the cross-instance ones use two instances in this process: the writer puts the
+// keys after the reader has opened the DB, so the reader has all of them still to discover
+
+/**
+ * \brief a reader and a writer on one DB whose keys all fit the first MMF, the writer has put them
+ */
+struct StaleReader
+{
+    std::unique_ptr<MemoryKV> Reader;
+    std::unique_ptr<MemoryKV> Writer;
+
+    StaleReader(const BenchmarkShape& shape, const wchar_t* dbName)
+    {
+        int maxBlocksPerMmf = static_cast<int>(shape.KeyCount) + 1;
+        Reader = shape.Open(dbName, maxBlocksPerMmf);
+        Writer = shape.Open(dbName, maxBlocksPerMmf);
+        for (auto& key : shape.Keys)
+            Writer->Put(key, shape.Value);
+    }
+};
+
+// the reader looks for a free block past the keys it knows, it walks over every key the writer put
+static void BM_FindNextAvailableBlock(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    StaleReader db(shape, L"BenchFindNextAvailableBlock");
+    for (auto _ : state)
+        benchmark::DoNotOptimize(MemoryKVInternals::FindNextAvailableBlock(*db.Reader));
+    state.SetItemsProcessed(state.iterations() * shape.KeyCount);
+}
+BENCHMARK(BM_FindNextAvailableBlock)->Apply(ShapeArguments);
+
+// the reader indexes every key the writer put
+static void BM_RefreshGlobalDbIndex(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    StaleReader db(shape, L"BenchRefreshGlobalDbIndex");
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        MemoryKVInternals::ForgetHighestKeyPosition(*db.Reader);
+        state.ResumeTiming();
+        MemoryKVInternals::RefreshGlobalDbIndex(*db.Reader);
+    }
+    state.SetItemsProcessed(state.iterations() * shape.KeyCount);
+}
+BENCHMARK(BM_RefreshGlobalDbIndex)->Apply(ShapeArguments);
+
+// one full scan of an MMF, as done for each MMF another instance added
+static void BM_SyncDataBlock(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    StaleReader db(shape, L"BenchSyncDataBlock");
+    for (auto _ : state)
+        MemoryKVInternals::SyncDataBlock(*db.Reader, 0);
+    state.SetItemsProcessed(state.iterations() * (shape.KeyCount + 1));
+}
+BENCHMARK(BM_SyncDataBlock)->Apply(ShapeArguments);
+
+// creating and mapping one more MMF of key count blocks, its pages are only committed once written
+static void BM_ExpandDataBlock(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    const int maxBlocksPerMmf = static_cast<int>(shape.KeyCount);
+    const int maxMmfCount = shape.MakeOptions(maxBlocksPerMmf).MaxMmfCount;
+    auto kv = shape.Open(L"BenchExpandDataBlock", maxBlocksPerMmf);
+    for (auto _ : state)
+    {
+        if (MemoryKVInternals::GetCurrentMmfCount(*kv) == maxMmfCount)
+        {
+            state.PauseTiming();
+            kv.reset();
+            kv = shape.Open(L"BenchExpandDataBlock", maxBlocksPerMmf);
+            state.ResumeTiming();
+        }
+        MemoryKVInternals::ExpandDataBlock(*kv);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExpandDataBlock)->Apply(ShapeArguments);
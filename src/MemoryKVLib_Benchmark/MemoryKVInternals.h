@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../MemoryKVLib/MemoryKV.h"
+
+/**
+ * \brief reaches the private steps of MemoryKV so they can be timed alone. the benchmarks are single threaded and
+ * no other instance writes meanwhile, so the DB mutex the callers inside MemoryKV hold is left out
+ */
+class MemoryKVInternals
+{
+public:
+    static int FindNextAvailableBlock(const MemoryKV& kv) { return kv.FindNextAvailableBlock(); }
+    static void RefreshGlobalDbIndex(MemoryKV& kv) { kv.RefreshGlobalDbIndex(); }
+    static void SyncDataBlock(MemoryKV& kv, int dataBlockMmfIndex) { kv.SyncDataBlock(dataBlockMmfIndex); }
+    static void ExpandDataBlock(MemoryKV& kv) { kv.ExpandDataBlock(); }
+    static int GetCurrentMmfCount(const MemoryKV& kv) { return kv.m_currentMmfCount; }
+
+    /**
+     * \brief make the instance behave as if it had seen none of the keys, the next refresh reads them all again
+     */
+    static void ForgetHighestKeyPosition(MemoryKV& kv) { kv.m_highestKeyPosition = -1; }
+};
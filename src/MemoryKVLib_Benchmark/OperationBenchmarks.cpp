@@ -0,0 +1,91 @@
+#include "BenchmarkShape.h"
+
+// the public operations one at a time, each iteration is one call
+
+static void BM_PutNewKey(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    auto kv = shape.Open(L"BenchPutNewKey");
+    long i = 0;
+    for (auto _ : state)
+    {
+        if (i == shape.KeyCount) // all the keys are in, start over with an empty DB
+        {
+            state.PauseTiming();
+            kv.reset();
+            kv = shape.Open(L"BenchPutNewKey");
+            i = 0;
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(kv->Put(shape.Keys[i++], shape.Value));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PutNewKey)->Apply(ShapeArguments);
+
+static void BM_PutUpdate(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    auto kv = shape.OpenFilled(L"BenchPutUpdate");
+    long i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(kv->Put(shape.Keys[i], shape.Value));
+        i = (i + 1) % shape.KeyCount;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PutUpdate)->Apply(ShapeArguments);
+
+static void BM_GetHit(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    auto kv = shape.OpenFilled(L"BenchGetHit");
+    long i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(kv->Get(shape.Keys[i]));
+        i = (i + 1) % shape.KeyCount;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetHit)->Apply(ShapeArguments);
+
+// a miss takes the mutex and refreshes the index in case another instance added the key
+static void BM_GetMiss(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    auto kv = shape.OpenFilled(L"BenchGetMiss");
+    std::vector<std::wstring> missing;
+    for (long i = 0; i < shape.KeyCount; ++i)
+        missing.push_back(shape.MakeKey(L"missing_", i));
+    long i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(kv->Get(missing[i]));
+        i = (i + 1) % shape.KeyCount;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetMiss)->Apply(ShapeArguments);
+
+static void BM_Remove(benchmark::State& state)
+{
+    BenchmarkShape shape(state);
+    auto kv = shape.OpenFilled(L"BenchRemove");
+    long i = 0;
+    for (auto _ : state)
+    {
+        if (i == shape.KeyCount) // removed blocks are not reused, fill a new DB
+        {
+            state.PauseTiming();
+            kv.reset();
+            kv = shape.OpenFilled(L"BenchRemove");
+            i = 0;
+            state.ResumeTiming();
+        }
+        kv->Remove(shape.Keys[i++]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Remove)->Apply(ShapeArguments);
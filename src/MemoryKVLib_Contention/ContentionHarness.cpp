@@ -0,0 +1,390 @@
+// ContentionHarness.cpp : N worker processes x M threads against one DB, so every worker has its own mappings, key
+// index and lazy refresh like real clients. prints the throughput and the latency percentiles per worker count
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+#include "../MemoryKVLib/LatencyHistogram.h"
+#include "../MemoryKVLib/MemoryKV.h"
+
+#define MAX_CONTENTION_WORKERS MAXIMUM_WAIT_OBJECTS // the driver waits for all of them at once
+
+enum ContentionOp
+{
+    ContentionGet = 0,
+    ContentionPut = 1,
+    ContentionRemove = 2,
+    ContentionOpCount = 3
+};
+
+static const wchar_t* OpNames[ContentionOpCount] = { L"get", L"put", L"remove" };
+
+/**
+ * \brief filled by one worker process once its threads are done
+ */
+struct WorkerResult
+{
+    LatencyHistogram Latency[ContentionOpCount];
+    LONGLONG Failures; // Puts that found the DB full
+    LONGLONG LockAcquisitions;
+    LONGLONG LockContentions;
+    LONGLONG LockWaitMicroseconds;
+};
+
+/**
+ * \brief Local\MemoryKVContention_<db>, shared by the driver and the workers of the current step
+ */
+struct ContentionBoard
+{
+    volatile LONG Ready; // workers whose threads wait for the start event
+    volatile LONG Stop; // set by the driver when the step is over
+    volatile LONG Reported; // workers that wrote their result and wait for Release
+    volatile LONG Release; // set by the driver once it mapped the MMFs the workers added
+    WorkerResult Workers[MAX_CONTENTION_WORKERS];
+};
+
+struct ContentionSettings
+{
+    std::wstring DbName = L"ContentionHarness";
+    int MaxWorkers = MAX_CONTENTION_WORKERS;
+    int Threads = 1; // per worker
+    int KeyCount = 100000;
+    int ValueLength = 100;
+    int ReadPercent = 90;
+    int WritePercent = 9; // the rest removes
+    int Seconds = 5; // per step
+    int MaxMmfCount = 1000; // removed blocks are not reused, the Puts after a Remove take new ones
+    std::wstring CsvPath;
+    int WorkerIndex = -1; // -1 for the driver
+
+    ConfigOptions MakeOptions() const
+    {
+        ConfigOptions options;
+        options.MaxKeySize = 32;
+        options.MaxValueSize = ValueLength + 1;
+        options.MaxBlocksPerMmf = 10000;
+        options.MaxMmfCount = MaxMmfCount;
+        options.LogLevel = 0;
+        return options;
+    }
+
+    /**
+     * \brief the arguments a worker gets, the same settings plus its index
+     */
+    std::wstring WorkerArguments(int index) const
+    {
+        std::wstringstream wss;
+        wss << L" -n " << std::quoted(DbName) << L" -t " << Threads << L" -k " << KeyCount << L" -v " << ValueLength
+            << L" -r " << ReadPercent << L" -w " << WritePercent << L" -m " << MaxMmfCount << L" --worker " << index;
+        return wss.str();
+    }
+};
+
+static bool ParseSettings(int argc, wchar_t* argv[], ContentionSettings& settings)
+{
+    try {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::wstring flag = argv[i];
+            std::wstring value = argv[i + 1];
+            if (flag == L"-n") settings.DbName = value;
+            else if (flag == L"-p") settings.MaxWorkers = std::stoi(value);
+            else if (flag == L"-t") settings.Threads = std::stoi(value);
+            else if (flag == L"-k") settings.KeyCount = std::stoi(value);
+            else if (flag == L"-v") settings.ValueLength = std::stoi(value);
+            else if (flag == L"-r") settings.ReadPercent = std::stoi(value);
+            else if (flag == L"-w") settings.WritePercent = std::stoi(value);
+            else if (flag == L"-s") settings.Seconds = std::stoi(value);
+            else if (flag == L"-m") settings.MaxMmfCount = std::stoi(value);
+            else if (flag == L"-o") settings.CsvPath = value;
+            else if (flag == L"--worker") settings.WorkerIndex = std::stoi(value);
+            else return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return settings.MaxWorkers >= 1 && settings.MaxWorkers <= MAX_CONTENTION_WORKERS && settings.Threads >= 1
+        && settings.KeyCount >= 1 && settings.ValueLength >= 1 && settings.ReadPercent >= 0 && settings.WritePercent >= 0
+        && settings.ReadPercent + settings.WritePercent <= 100 && settings.Seconds >= 1
+        && settings.WorkerIndex < MAX_CONTENTION_WORKERS;
+}
+
+static std::wstring MakeKey(int i)
+{
+    return L"key_" + std::to_wstring(i);
+}
+
+static ContentionBoard* OpenBoard(const ContentionSettings& settings, HANDLE& hBoard)
+{
+    std::wstring name = L"Local\\MemoryKVContention_" + settings.DbName;
+    hBoard = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(ContentionBoard), name.c_str());
+    if (hBoard == nullptr)
+        return nullptr;
+    return static_cast<ContentionBoard*>(MapViewOfFile(hBoard, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ContentionBoard)));
+}
+
+static HANDLE OpenStartEvent(const ContentionSettings& settings)
+{
+    std::wstring name = L"Local\\MemoryKVContentionStart_" + settings.DbName;
+    return CreateEvent(nullptr, TRUE, FALSE, name.c_str()); // manual reset, releases every thread at once
+}
+
+/**
+ * \brief one thread of a worker: random keys, the op picked by the mix, each op timed alone
+ */
+static void RunWorkerThread(MemoryKV& kv, const ContentionSettings& settings, const ContentionBoard* board,
+    HANDLE hStart, int seed, LatencyHistogram* latency, LONGLONG& failures)
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> keyDistribution(0, settings.KeyCount - 1);
+    std::uniform_int_distribution<int> opDistribution(0, 99);
+    std::wstring value(settings.ValueLength, L'v');
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    WaitForSingleObject(hStart, INFINITE);
+    while (board->Stop == 0)
+    {
+        std::wstring key = MakeKey(keyDistribution(gen));
+        int dice = opDistribution(gen);
+        ContentionOp op = dice < settings.ReadPercent ? ContentionGet
+            : dice < settings.ReadPercent + settings.WritePercent ? ContentionPut : ContentionRemove;
+        LARGE_INTEGER start;
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&start);
+        switch (op)
+        {
+        case ContentionGet:
+            kv.Get(key);
+            break;
+        case ContentionPut:
+            if (!kv.Put(key, value))
+                failures++;
+            break;
+        default:
+            kv.Remove(key);
+            break;
+        }
+        QueryPerformanceCounter(&end);
+        latency[op].Record((end.QuadPart - start.QuadPart) * 1000000000 / frequency.QuadPart);
+    }
+}
+
+static int RunWorker(const ContentionSettings& settings)
+{
+    HANDLE hBoard;
+    ContentionBoard* board = OpenBoard(settings, hBoard);
+    HANDLE hStart = OpenStartEvent(settings);
+    if (board == nullptr || hStart == nullptr)
+        return 1;
+
+    MemoryKV kv(L"contention_worker");
+    kv.Open(settings.DbName.c_str(), settings.MakeOptions());
+    std::vector<LatencyHistogram> latency(settings.Threads * ContentionOpCount);
+    std::vector<LONGLONG> failures(settings.Threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < settings.Threads; t++)
+    {
+        threads.emplace_back(RunWorkerThread, std::ref(kv), std::cref(settings), board, hStart,
+            settings.WorkerIndex * 1000 + t, &latency[t * ContentionOpCount], std::ref(failures[t]));
+    }
+    InterlockedIncrement(&board->Ready);
+    for (auto& thread : threads)
+        thread.join();
+
+    WorkerResult& result = board->Workers[settings.WorkerIndex];
+    for (int t = 0; t < settings.Threads; t++)
+    {
+        for (int op = 0; op < ContentionOpCount; op++)
+            result.Latency[op].Merge(latency[t * ContentionOpCount + op]);
+        result.Failures += failures[t];
+    }
+    kv.GetLockStats(&result.LockAcquisitions, &result.LockContentions, &result.LockWaitMicroseconds);
+
+    // an MMF lives as long as an instance maps it, the worker keeps the DB open until the driver mapped the new ones
+    InterlockedIncrement(&board->Reported);
+    while (board->Release == 0)
+        Sleep(1);
+    UnmapViewOfFile(board);
+    CloseHandle(hBoard);
+    CloseHandle(hStart);
+    return 0;
+}
+
+/**
+ * \brief one point of the scaling curve: start the workers, let them run for Seconds and merge what they report
+ */
+static bool RunStep(const ContentionSettings& settings, int workers, MemoryKV& kv, ContentionBoard* board,
+    HANDLE hStart, std::wostream* csv)
+{
+    board->Ready = 0;
+    board->Stop = 0;
+    board->Reported = 0;
+    board->Release = 0;
+    for (auto& result : board->Workers)
+        result = WorkerResult();
+    ResetEvent(hStart);
+
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileName(nullptr, exePath, MAX_PATH);
+    std::vector<HANDLE> processes;
+    for (int i = 0; i < workers; i++)
+    {
+        std::wstring commandLine = L"\"" + std::wstring(exePath) + L"\"" + settings.WorkerArguments(i);
+        STARTUPINFO startupInfo = { sizeof(startupInfo) };
+        PROCESS_INFORMATION processInfo;
+        if (!CreateProcess(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+        {
+            std::wcerr << L"failed to start worker " << i << L", error " << GetLastError() << std::endl;
+            for (auto process : processes)
+            {
+                TerminateProcess(process, 1);
+                CloseHandle(process);
+            }
+            return false;
+        }
+        CloseHandle(processInfo.hThread);
+        processes.push_back(processInfo.hProcess);
+    }
+    while (board->Ready < workers) // the workers open the DB and start their threads first
+    {
+        if (WaitForMultipleObjects(workers, processes.data(), FALSE, 10) != WAIT_TIMEOUT)
+        {
+            std::wcerr << L"a worker exited before the start" << std::endl;
+            for (auto process : processes)
+            {
+                TerminateProcess(process, 1);
+                CloseHandle(process);
+            }
+            return false;
+        }
+    }
+
+    SetEvent(hStart);
+    Sleep(settings.Seconds * 1000);
+    InterlockedExchange(&board->Stop, 1);
+    while (board->Reported < workers && WaitForMultipleObjects(workers, processes.data(), TRUE, 10) == WAIT_TIMEOUT)
+        ;
+    kv.Get(L"contention_sync"); // a miss refreshes the index, which maps the MMFs the workers added
+    InterlockedExchange(&board->Release, 1);
+    WaitForMultipleObjects(workers, processes.data(), TRUE, INFINITE);
+    for (auto process : processes)
+        CloseHandle(process);
+
+    WorkerResult total = {};
+    for (int i = 0; i < workers; i++)
+    {
+        const WorkerResult& result = board->Workers[i];
+        for (int op = 0; op < ContentionOpCount; op++)
+            total.Latency[op].Merge(result.Latency[op]);
+        total.Failures += result.Failures;
+        total.LockAcquisitions += result.LockAcquisitions;
+        total.LockContentions += result.LockContentions;
+        total.LockWaitMicroseconds += result.LockWaitMicroseconds;
+    }
+    LONGLONG ops = 0;
+    for (int op = 0; op < ContentionOpCount; op++)
+        ops += total.Latency[op].TotalCount;
+    double waitPerAcquisition = total.LockAcquisitions == 0 ? 0 : static_cast<double>(total.LockWaitMicroseconds) / total.LockAcquisitions;
+
+    std::wcout << std::setw(7) << workers << std::setw(12) << ops / settings.Seconds;
+    for (int op = 0; op < ContentionOpCount; op++)
+    {
+        const LatencyHistogram& latency = total.Latency[op];
+        std::wcout << std::setw(11) << latency.ValueAtPercentile(50) / 1000.0 << std::setw(9) << latency.ValueAtPercentile(99) / 1000.0
+            << std::setw(9) << latency.ValueAtPercentile(99.9) / 1000.0;
+    }
+    std::wcout << std::setw(12) << total.LockContentions << std::setw(12) << waitPerAcquisition;
+    if (total.Failures > 0)
+        std::wcout << L"  (" << total.Failures << L" Puts failed, the DB is full)";
+    std::wcout << std::endl;
+
+    if (csv != nullptr)
+    {
+        *csv << workers << L"," << settings.Threads << L"," << ops / settings.Seconds;
+        for (int op = 0; op < ContentionOpCount; op++)
+        {
+            const LatencyHistogram& latency = total.Latency[op];
+            *csv << L"," << latency.TotalCount << L"," << latency.ValueAtPercentile(50) << L","
+                << latency.ValueAtPercentile(99) << L"," << latency.ValueAtPercentile(99.9) << L"," << latency.MaxValue;
+        }
+        *csv << L"," << total.LockAcquisitions << L"," << total.LockContentions << L"," << total.LockWaitMicroseconds << std::endl;
+    }
+    return true;
+}
+
+static int RunDriver(const ContentionSettings& settings)
+{
+    HANDLE hBoard;
+    ContentionBoard* board = OpenBoard(settings, hBoard);
+    HANDLE hStart = OpenStartEvent(settings);
+    if (board == nullptr || hStart == nullptr)
+    {
+        std::wcerr << L"failed to create the shared board, error " << GetLastError() << std::endl;
+        return 1;
+    }
+
+    // the driver keeps the DB open between the steps, it starts full so Get mostly hits
+    MemoryKV kv(L"contention_driver");
+    kv.Open(settings.DbName.c_str(), settings.MakeOptions());
+    std::wstring value(settings.ValueLength, L'v');
+    for (int i = 0; i < settings.KeyCount; i++)
+        kv.Put(MakeKey(i), value);
+
+    std::wofstream csvFile;
+    if (!settings.CsvPath.empty())
+    {
+        csvFile.open(settings.CsvPath);
+        csvFile << L"workers,threads,ops_per_sec";
+        for (int op = 0; op < ContentionOpCount; op++)
+            csvFile << L"," << OpNames[op] << L"_count," << OpNames[op] << L"_p50_ns," << OpNames[op] << L"_p99_ns,"
+                << OpNames[op] << L"_p999_ns," << OpNames[op] << L"_max_ns";
+        csvFile << L",lock_acquisitions,lock_contended,lock_wait_us" << std::endl;
+    }
+
+    std::wcout << L"db=" << settings.DbName << L", threads per worker=" << settings.Threads << L", keys=" << settings.KeyCount
+        << L", mix get/put/remove=" << settings.ReadPercent << L"/" << settings.WritePercent << L"/"
+        << 100 - settings.ReadPercent - settings.WritePercent << L", " << settings.Seconds << L" s per step, latency in us"
+        << std::endl;
+    std::wcout << std::setw(7) << L"workers" << std::setw(12) << L"ops/s";
+    for (int op = 0; op < ContentionOpCount; op++)
+        std::wcout << std::setw(11) << (std::wstring(OpNames[op]) + L" p50") << std::setw(9) << L"p99" << std::setw(9) << L"p99.9";
+    std::wcout << std::setw(12) << L"contended" << std::setw(12) << L"wait us/acq" << std::endl;
+    std::wcout << std::fixed << std::setprecision(1);
+
+    std::vector<int> steps; // 1, 2, 4 ... and the max
+    for (int workers = 1; workers < settings.MaxWorkers; workers *= 2)
+        steps.push_back(workers);
+    steps.push_back(settings.MaxWorkers);
+    int exitCode = 0;
+    for (size_t i = 0; i < steps.size() && exitCode == 0; i++)
+    {
+        if (!RunStep(settings, steps[i], kv, board, hStart, csvFile.is_open() ? &csvFile : nullptr))
+            exitCode = 1;
+    }
+    UnmapViewOfFile(board);
+    CloseHandle(hBoard);
+    CloseHandle(hStart);
+    return exitCode;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    ContentionSettings settings;
+    if (!ParseSettings(argc, argv, settings))
+    {
+        std::wcout << L"usage: MemoryKVLib_Contention [-n db] [-p max workers, up to 64] [-t threads per worker] [-k keys]"
+            << L" [-v value length] [-r get %] [-w put %, the rest removes] [-s seconds per step] [-m max mmf count]"
+            << L" [-o csv file]" << std::endl;
+        return 1;
+    }
+    return settings.WorkerIndex >= 0 ? RunWorker(settings) : RunDriver(settings);
+}
@@ -126,6 +126,77 @@ TEST_F(BoundaryTest, MemoryUsageLimit) {
     }
 }
 
+// 测试满容量时的CLOCK淘汰
+TEST_F(BoundaryTest, ClockEvictionAtCapacity) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 2;
+    options.LogLevel = 0;
+    options.EvictionMode = KvEvictionClock;
+
+    kv->Open(L"ClockEvictionAtCapacity", options);
+    MemoryKV other(L"test_client_2", std::make_unique<MockLogger>(true));
+    other.Open(L"ClockEvictionAtCapacity", options);
+
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    // 读过的key在下一轮淘汰中被保留
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_STREQ(kv->Get(L"key_" + std::to_wstring(i)), (L"value_" + std::to_wstring(i)).c_str());
+    }
+    for (int i = 20; i < 30; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+
+    for (int i = 0; i < 30; ++i) {
+        std::wstring key = L"key_" + std::to_wstring(i);
+        std::wstring expected = (i >= 10 && i < 20) ? L"" : L"value_" + std::to_wstring(i);
+        EXPECT_STREQ(kv->Get(key), expected.c_str());
+        EXPECT_STREQ(other.Get(key), expected.c_str()); // the reused blocks are visible to other instances too
+    }
+}
+
+static bool CountKeys(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength, void* context)
+{
+    ++*static_cast<int*>(context);
+    return true;
+}
+
+// 测试版本存储写满时快照失效
+TEST_F(BoundaryTest, SnapshotTooOld) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 1000;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+
+    kv->Open(L"SnapshotTooOld", options);
+    const int keyCount = VERSION_STORE_SIZE + 100;
+    for (int i = 0; i < keyCount; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"old"));
+    }
+
+    KvSnapshot snapshot;
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+    for (int i = 0; i < keyCount; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"new")); // writers never wait for the snapshot
+    }
+    int visited = 0;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CountKeys, &visited), KvSnapshotTooOld);
+    kv->ReleaseSnapshot(snapshot);
+
+    // 释放后可以重新打开
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+    int count = 0;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CountKeys, &count), KvOk);
+    EXPECT_EQ(count, keyCount);
+    kv->ReleaseSnapshot(snapshot);
+}
+
 // 测试空键和空值
 TEST_F(BoundaryTest, EmptyKeyAndValue) {
     ConfigOptions options;
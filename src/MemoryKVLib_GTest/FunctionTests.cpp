@@ -1,10 +1,16 @@
 #include "pch.h"
 #include <gtest/gtest.h>
 #include "../MemoryKVLib/MemoryKV.h"
+#include "../MemoryKVLib/KvInspector.h"
+#include "../WindowsMemoryKVService/TimingWheel.h"
 #include <thread>
 #include <vector>
+#include <map>
+#include <set>
 #include <chrono>
 #include <random>
+#include <atomic>
+#include <algorithm>
 
 #include "MockLogger.h"
 
@@ -151,6 +157,63 @@ TEST_F(FunctionTest, MultiThreadOperations) {
     }
 }
 
+// 一个实例被多个线程共享, 读不加全局锁
+TEST_F(FunctionTest, SharedInstanceConcurrentReads) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"SharedInstanceConcurrentReads", options);
+
+    const int num_keys = 100;
+    for (int i = 0; i < num_keys; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    EXPECT_TRUE(kv->Put(L"pair", L"0_0"));
+
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        // rewrite the same key while readers copy it, and keep adding new keys to grow the local index
+        for (int i = 1; i < 5000; ++i) {
+            std::wstring half = std::to_wstring(i);
+            EXPECT_TRUE(kv->Put(L"pair", half + L"_" + half));
+            EXPECT_TRUE(kv->Put(L"new_key_" + std::to_wstring(i % 500), half));
+        }
+        stop = true;
+        });
+
+    const int num_readers = 8;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < num_readers; ++r) {
+        readers.emplace_back([&, r]() {
+            wchar_t buffer[256];
+            int length;
+            int j = r;
+            while (!stop) {
+                int i = j++ % num_keys;
+                std::wstring key = L"key_" + std::to_wstring(i);
+                std::wstring expected = L"value_" + std::to_wstring(i);
+                EXPECT_STREQ(kv->Get(key), expected.c_str());
+
+                // a copied value is never torn
+                ASSERT_EQ(kv->TryGet(L"pair", 4, buffer, 256, &length), KvOk);
+                std::wstring pair(buffer, length);
+                size_t separator = pair.find(L'_');
+                ASSERT_NE(separator, std::wstring::npos);
+                EXPECT_EQ(pair.substr(0, separator), pair.substr(separator + 1));
+            }
+            });
+    }
+
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+}
+
 TEST_F(FunctionTest, MultiInstanceOperations) {
     ConfigOptions options;
     options.MaxKeySize = 64;
@@ -205,6 +268,7 @@ TEST_F(FunctionTest, PerformanceTest) {
     options.MaxBlocksPerMmf = 100;
     options.MaxMmfCount = 100;
     options.LogLevel = 0;
+    options.LatencyHistograms = 1;
     
     kv->Open(L"PerformanceTest", options);
     
@@ -226,6 +290,205 @@ TEST_F(FunctionTest, PerformanceTest) {
     
     std::cout << "Performance test completed in " << duration.count() << " ms" << std::endl;
     std::cout << "Average operation time: " << (double)duration.count() / num_operations << " ms" << std::endl;
+
+    // 平均值看不到长尾, 按操作打出持锁时间的分位数
+    const char* names[] = { "put", "get", "remove" };
+    for (int op = KvLatencyPut; op <= KvLatencyRemove; ++op) {
+        LatencyHistogram histogram;
+        ASSERT_EQ(kv->GetLatencyHistogram(static_cast<KvLatencyOp>(op), KvLatencyInLock, histogram), KvOk);
+        EXPECT_EQ(histogram.TotalCount, num_operations);
+        std::cout << names[op] << " ns: p50=" << histogram.ValueAtPercentile(50) << " p99=" << histogram.ValueAtPercentile(99)
+            << " p99.9=" << histogram.ValueAtPercentile(99.9) << " max=" << histogram.MaxValue << std::endl;
+    }
+}
+
+// 第二个实例 Open 时并行同步已有的多个 MMF
+TEST_F(FunctionTest, OpenSyncsExistingSegments) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"OpenSyncsExistingSegments", options);
+    const int num_keys = 500;
+    for (int i = 0; i < num_keys; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    for (int i = 0; i < num_keys; i += 7) {
+        kv->Remove(L"key_" + std::to_wstring(i));
+    }
+
+    MemoryKV kv2(L"test_client2", std::make_unique<MockLogger>());
+    kv2.Open(L"OpenSyncsExistingSegments", options);
+    for (int i = 0; i < num_keys; ++i) {
+        std::wstring expected = (i % 7 == 0) ? L"" : L"value_" + std::to_wstring(i);
+        EXPECT_STREQ(kv2.Get(L"key_" + std::to_wstring(i)), expected.c_str());
+    }
+
+    // the attached instance keeps appending after the last used block
+    EXPECT_TRUE(kv2.Put(L"key_new", L"value_new"));
+    EXPECT_STREQ(kv->Get(L"key_new"), L"value_new");
+}
+
+// Open 时间随 key 数量变化, 耗时较长, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_OpenTimeByKeyCount) {
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 16;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    const int batch_size = 1000;
+    for (int key_count = 1000; key_count <= 10000000; key_count *= 10) {
+        std::wstring db_name = L"OpenTimeByKeyCount_" + std::to_wstring(key_count);
+        MemoryKV writer(L"test_writer", std::make_unique<MockLogger>());
+        writer.Open(db_name.c_str(), options);
+
+        std::vector<std::wstring> keys(batch_size);
+        std::vector<const wchar_t*> key_ptrs(batch_size);
+        std::vector<int> key_lengths(batch_size);
+        for (int i = 0; i < key_count; i += batch_size) {
+            for (int j = 0; j < batch_size; ++j) {
+                keys[j] = L"key_" + std::to_wstring(i + j);
+                key_ptrs[j] = keys[j].c_str();
+                key_lengths[j] = static_cast<int>(keys[j].size());
+            }
+            ASSERT_EQ(writer.PutBatch(batch_size, key_ptrs.data(), key_lengths.data(), key_ptrs.data(), key_lengths.data(), nullptr), batch_size);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        MemoryKV reader(L"test_reader", std::make_unique<MockLogger>());
+        reader.Open(db_name.c_str(), options);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+        EXPECT_STREQ(reader.Get(L"key_" + std::to_wstring(key_count - 1)), (L"key_" + std::to_wstring(key_count - 1)).c_str());
+        std::cout << "Open with " << key_count << " keys: " << duration.count() / 1000.0 << " ms" << std::endl;
+    }
+}
+
+// 启动时从 image 恢复和逐个 Put 重放的时间对比, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_RestoreTimeByKeyCount) {
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 64;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    for (int key_count = 10000; key_count <= 1000000; key_count *= 10) {
+        std::wstring db_name = L"RestoreTimeByKeyCount_" + std::to_wstring(key_count);
+        std::wstring value(60, L'v');
+
+        // 逐个 Put 重放
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            MemoryKV replay(L"test_replay", std::make_unique<MockLogger>());
+            replay.Open(db_name.c_str(), options);
+            for (int i = 0; i < key_count; ++i) {
+                ASSERT_TRUE(replay.Put(L"key_" + std::to_wstring(i), value));
+            }
+            std::cout << "Replay " << key_count << " keys by Put: "
+                << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms" << std::endl;
+
+            long long bytes = 0;
+            ASSERT_EQ(replay.SaveImage(L"RestoreTimeByKeyCount.img", &bytes), KvOk);
+        }
+
+        // 最后一个实例关闭后 DB 就没了, 再从 image 恢复
+        std::wstring restored_name = db_name + L"_Restored";
+        start = std::chrono::high_resolution_clock::now();
+        MemoryKV restored(L"test_restored", std::make_unique<MockLogger>());
+        restored.Open(restored_name.c_str(), options, L"RestoreTimeByKeyCount.img");
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        EXPECT_STREQ(restored.Get(L"key_" + std::to_wstring(key_count - 1)), value.c_str());
+        std::cout << "Restore " << key_count << " keys from image: " << ms << " ms" << std::endl;
+        _wremove(L"RestoreTimeByKeyCount.img");
+    }
+}
+
+// checkpoint 写入速度, 以及对前台 Put 延迟的影响, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_CheckpointThroughput) {
+    ConfigOptions options;
+    options.MaxKeySize = 32;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 20;
+    options.LogLevel = 0;
+
+    kv->Open(L"CheckpointThroughput", options);
+    const int key_count = 1000000;
+    std::wstring value(200, L'v');
+    for (int i = 0; i < key_count; ++i) {
+        ASSERT_TRUE(kv->Put(L"key_" + std::to_wstring(i), value));
+    }
+
+    // 没有写入时 checkpoint 的速度
+    long long bytes = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_EQ(kv->Checkpoint(L"CheckpointThroughput.ckpt", &bytes), KvOk);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Checkpoint of " << key_count << " keys: " << bytes << " bytes in " << seconds << " s, "
+        << bytes / seconds / (1024.0 * 1024 * 1024) << " GB/s" << std::endl;
+
+    // 前台按固定速率 Put, 分别在没有和有 checkpoint 的时候测延迟.
+    // checkpoint 期间被覆盖的 key 不能超过 VERSION_STORE_SIZE 个, 否则只能返回 KvSnapshotTooOld
+    MemoryKV instance(L"foreground", std::make_unique<MockLogger>());
+    instance.Open(L"CheckpointThroughput", options);
+    const auto put_interval = std::chrono::microseconds(1000);
+    auto measure = [&instance, &value, put_interval](std::atomic<bool>& stop, std::vector<double>& latencies) {
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<> dis(0, key_count - 1);
+        auto next = std::chrono::high_resolution_clock::now();
+        while (!stop) {
+            std::wstring key = L"key_" + std::to_wstring(dis(gen));
+            while (std::chrono::high_resolution_clock::now() < next) {}
+            auto begin = std::chrono::high_resolution_clock::now();
+            instance.Put(key, value);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+            next += put_interval;
+        }
+    };
+    auto report = [](const char* name, std::vector<double>& latencies) {
+        if (latencies.empty())
+            return;
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << name << ": puts=" << latencies.size()
+            << " p50=" << latencies[latencies.size() / 2] << "us"
+            << " p99=" << latencies[latencies.size() * 99 / 100] << "us"
+            << " max=" << latencies.back() << "us" << std::endl;
+    };
+
+    std::atomic<bool> stop(false);
+    std::vector<double> idle;
+    std::thread baseline([&]() { measure(stop, idle); });
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    stop = true;
+    baseline.join();
+    report("Put without checkpoint", idle);
+
+    stop = false;
+    std::vector<double> busy;
+    std::thread foreground([&]() { measure(stop, busy); });
+    KvStatus status = KvSnapshotTooOld;
+    int attempts = 0;
+    start = std::chrono::high_resolution_clock::now();
+    while (status == KvSnapshotTooOld && attempts < 5) {
+        ++attempts;
+        status = kv->Checkpoint(L"CheckpointThroughput.ckpt", &bytes);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    stop = true;
+    foreground.join();
+    report("Put during checkpoint", busy);
+
+    std::cout << "Checkpoint under writes: status=" << status << " " << bytes << " bytes in " << seconds
+        << " s, attempts=" << attempts << std::endl;
+    _wremove(L"CheckpointThroughput.ckpt");
 }
 
 // 压力测试
@@ -307,6 +570,1800 @@ TEST_F(FunctionTest, OperationWithoutOpen) {
     EXPECT_STREQ(kv->Get(L"key"), L"");
 }
 
+TEST_F(FunctionTest, LengthExplicitOperations) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"LengthExplicitOperations", options);
+
+    // key and value are taken by length, the trailing characters are not part of them
+    const wchar_t* key = L"test_key_ignored";
+    const wchar_t* value = L"test_value_ignored";
+    EXPECT_EQ(kv->TryPut(key, 8, value, 10), KvOk);
+    EXPECT_STREQ(kv->Get(L"test_key"), L"test_value");
+
+    wchar_t buffer[16];
+    int length = -1;
+    EXPECT_EQ(kv->TryGet(key, 8, buffer, 16, &length), KvOk);
+    EXPECT_EQ(length, 10);
+    EXPECT_STREQ(buffer, L"test_value");
+
+    // no room for the NUL, the needed length is still reported
+    EXPECT_EQ(kv->TryGet(key, 8, buffer, 10, &length), KvBufferTooSmall);
+    EXPECT_EQ(length, 10);
+    EXPECT_EQ(kv->TryGet(key, 8, nullptr, 0, &length), KvBufferTooSmall);
+    EXPECT_EQ(length, 10);
+
+    // failure reasons
+    std::wstring too_long_key(64, L'a');
+    std::wstring too_long_value(256, L'b');
+    EXPECT_EQ(kv->TryPut(key, 0, value, 10), KvInvalidArgument);
+    EXPECT_EQ(kv->TryPut(nullptr, 8, value, 10), KvInvalidArgument);
+    EXPECT_EQ(kv->TryPut(too_long_key.c_str(), 64, value, 10), KvKeyTooLarge);
+    EXPECT_EQ(kv->TryPut(key, 8, too_long_value.c_str(), 256), KvValueTooLarge);
+    EXPECT_EQ(kv->TryGet(L"nonexistent", 11, buffer, 16, &length), KvNotFound);
+    EXPECT_EQ(length, 0);
+
+    EXPECT_EQ(kv->TryRemove(key, 8), KvOk);
+    EXPECT_EQ(kv->TryRemove(key, 8), KvNotFound);
+    EXPECT_EQ(kv->TryGet(key, 8, buffer, 16, &length), KvNotFound);
+}
+
+TEST_F(FunctionTest, BatchOperations) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"BatchOperations", options);
+
+    const int count = 4;
+    const wchar_t* keys[count] = { L"key_0", L"key_1", L"", L"key_3" };
+    const int keyLengths[count] = { 5, 5, 0, 5 };
+    const wchar_t* values[count] = { L"value_0", L"v1", L"value_2", L"" };
+    const int valueLengths[count] = { 7, 2, 7, 0 };
+    KvStatus statuses[count];
+
+    EXPECT_EQ(kv->PutBatch(count, keys, keyLengths, values, valueLengths, statuses), 3);
+    EXPECT_EQ(statuses[0], KvOk);
+    EXPECT_EQ(statuses[2], KvInvalidArgument);
+
+    // values are packed NUL-terminated one after another
+    wchar_t buffer[12];
+    int offsets[count];
+    int lengths[count];
+    const wchar_t* queryKeys[count] = { L"key_0", L"missing", L"key_1", L"key_3" };
+    const int queryKeyLengths[count] = { 5, 7, 5, 5 };
+    EXPECT_EQ(kv->GetBatch(count, queryKeys, queryKeyLengths, buffer, 12, offsets, lengths, statuses), 3);
+    EXPECT_EQ(statuses[0], KvOk);
+    EXPECT_STREQ(buffer + offsets[0], L"value_0");
+    EXPECT_EQ(statuses[1], KvNotFound);
+    EXPECT_EQ(offsets[1], -1);
+    EXPECT_EQ(statuses[2], KvOk);
+    EXPECT_STREQ(buffer + offsets[2], L"v1");
+    EXPECT_EQ(statuses[3], KvOk);
+    EXPECT_EQ(offsets[3], 11);
+    EXPECT_EQ(lengths[3], 0);
+
+    EXPECT_EQ(kv->GetBatch(1, queryKeys, queryKeyLengths, buffer, 7, offsets, lengths, statuses), 0);
+    EXPECT_EQ(statuses[0], KvBufferTooSmall);
+    EXPECT_EQ(lengths[0], 7);
+
+    EXPECT_EQ(kv->RemoveBatch(count, queryKeys, queryKeyLengths, statuses), 3);
+    EXPECT_EQ(statuses[1], KvNotFound);
+    EXPECT_STREQ(kv->Get(L"key_0"), L"");
+}
+
+TEST_F(FunctionTest, PutWithTtl) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"PutWithTtl", options);
+
+    EXPECT_TRUE(kv->Put(L"short", L"value1", 50));
+    EXPECT_TRUE(kv->Put(L"long", L"value2", 60000));
+    EXPECT_TRUE(kv->Put(L"rewritten", L"value3", 50));
+    EXPECT_TRUE(kv->Put(L"rewritten", L"value3")); // 不带ttl的Put使其永久有效
+    EXPECT_STREQ(kv->Get(L"short"), L"value1");
+
+    std::vector<ExpiryEntry> entries;
+    kv->FetchExpiryEntries(entries);
+    EXPECT_EQ(entries.size(), 3);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // only the due entry whose block hasn't been rewritten is removed
+    EXPECT_EQ(kv->RemoveExpired(entries), 1);
+    EXPECT_STREQ(kv->Get(L"short"), L"");
+    EXPECT_STREQ(kv->Get(L"long"), L"value2");
+    EXPECT_STREQ(kv->Get(L"rewritten"), L"value3");
+
+    // an expired key is not returned even before the host service removes it
+    EXPECT_TRUE(kv->Put(L"lazy", L"value4", 50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    wchar_t buffer[16];
+    int length = -1;
+    EXPECT_EQ(kv->TryGet(L"lazy", 4, buffer, 16, &length), KvNotFound);
+    EXPECT_STREQ(kv->Get(L"lazy"), L"");
+}
+
+TEST_F(FunctionTest, ExpiryQueueSpill) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 1000;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"ExpiryQueueSpill", options);
+
+    // 超过队列长度的条目进入溢出段, 不需要扫描
+    const int count = EXPIRY_QUEUE_SIZE + 3000;
+    for (int i = 0; i < count; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value", 3600 * 1000));
+    }
+    std::vector<ExpiryEntry> entries;
+    kv->FetchExpiryEntries(entries);
+    EXPECT_EQ(entries.size(), count);
+    std::set<long> blocks;
+    for (const auto& entry : entries)
+        blocks.insert(entry.GlobalDbIndex);
+    EXPECT_EQ(blocks.size(), count);
+
+    // 溢出段被重复使用
+    EXPECT_TRUE(kv->Put(L"key_0", L"value", 3600 * 1000));
+    entries.clear();
+    kv->FetchExpiryEntries(entries);
+    EXPECT_EQ(entries.size(), 1);
+
+    // 恢复的 DB 没有队列, 分批扫描找到带 ttl 的块
+    ASSERT_EQ(kv->SaveImage(L"ExpiryQueueSpill.img"), KvOk);
+    {
+        MemoryKV restored(L"restored", std::make_unique<MockLogger>(true));
+        restored.Open(L"ExpiryQueueSpill_Restored", options, L"ExpiryQueueSpill.img");
+        EXPECT_TRUE(restored.Put(L"permanent", L"value"));
+        entries.clear();
+        restored.FetchExpiryEntries(entries);
+        EXPECT_EQ(entries.size(), count);
+        entries.clear();
+        restored.FetchExpiryEntries(entries);
+        EXPECT_TRUE(entries.empty());
+    }
+    _wremove(L"ExpiryQueueSpill.img");
+}
+
+TEST_F(FunctionTest, TimingWheel) {
+    TimingWheel wheel(100);
+    LONGLONG now = CurrentTimeMs();
+    EXPECT_TRUE(wheel.Add({ now + 50, 1, 0 }));
+    EXPECT_FALSE(wheel.Add({ now + 50, 1, 0 })); // 同一个条目只保留一份
+    EXPECT_TRUE(wheel.Add({ now + 60000, 1, 0 })); // 块被重写, 新的过期时间另算
+    EXPECT_TRUE(wheel.Add({ now - 1000, 2, 0 })); // 已经过期
+    EXPECT_TRUE(wheel.Add({ now + 25LL * 24 * 3600 * 1000, 3, 0 })); // 超出最高层的范围
+    EXPECT_EQ(wheel.Size(), 4);
+
+    std::vector<ExpiryEntry> due;
+    wheel.Advance(now, due);
+    ASSERT_EQ(due.size(), 1);
+    EXPECT_EQ(due[0].GlobalDbIndex, 2);
+
+    // 不会提前取出
+    due.clear();
+    wheel.Advance(now + 40, due);
+    EXPECT_TRUE(due.empty());
+    wheel.Advance(now + 150, due);
+    ASSERT_EQ(due.size(), 1);
+    EXPECT_EQ(due[0].ExpireAt, now + 50);
+    EXPECT_TRUE(wheel.Add({ now + 50, 1, 0 })); // 取出之后可以再加入
+
+    due.clear();
+    wheel.Advance(now + 60000 + 100, due);
+    EXPECT_EQ(due.size(), 2);
+    EXPECT_EQ(wheel.Size(), 1);
+
+    // 上层的条目逐层下移, 到期时取出
+    due.clear();
+    wheel.Advance(now + 25LL * 24 * 3600 * 1000 - 1000, due);
+    EXPECT_TRUE(due.empty());
+    wheel.Advance(now + 25LL * 24 * 3600 * 1000 + 100, due);
+    ASSERT_EQ(due.size(), 1);
+    EXPECT_EQ(due[0].GlobalDbIndex, 3);
+    EXPECT_EQ(wheel.Size(), 0);
+}
+
+TEST_F(FunctionTest, NumericOperations) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"NumericOperations", options);
+
+    // 不存在的key按0创建
+    long long value = -1;
+    EXPECT_EQ(kv->Increment(L"counter", 5, &value), KvOk);
+    EXPECT_EQ(value, 5);
+    EXPECT_EQ(kv->FetchAdd(L"counter", 3, &value), KvOk);
+    EXPECT_EQ(value, 5);
+    EXPECT_EQ(kv->GetNumber(L"counter", &value), KvOk);
+    EXPECT_EQ(value, 8);
+    EXPECT_STREQ(kv->Get(L"counter"), L"8");
+
+    EXPECT_EQ(kv->CompareAndSwap(L"counter", 7, 100, &value), KvCompareFailed);
+    EXPECT_EQ(value, 8);
+    EXPECT_EQ(kv->CompareAndSwap(L"counter", 8, 100), KvOk);
+    EXPECT_EQ(kv->GetNumber(L"counter", &value), KvOk);
+    EXPECT_EQ(value, 100);
+
+    double number = 0;
+    EXPECT_EQ(kv->PutDouble(L"gauge", 1.5), KvOk);
+    EXPECT_EQ(kv->FetchAddDouble(L"gauge", 0.25, &number), KvOk);
+    EXPECT_EQ(number, 1.5);
+    EXPECT_EQ(kv->GetDouble(L"gauge", &number), KvOk);
+    EXPECT_EQ(number, 1.75);
+    EXPECT_STREQ(kv->Get(L"gauge"), L"1.75");
+
+    // type checks, a string Put turns a number back into a string
+    EXPECT_TRUE(kv->Put(L"text", L"abc"));
+    EXPECT_EQ(kv->Increment(L"text", 1), KvTypeMismatch);
+    EXPECT_EQ(kv->GetNumber(L"gauge", &value), KvTypeMismatch);
+    EXPECT_EQ(kv->GetNumber(L"missing", &value), KvNotFound);
+    EXPECT_TRUE(kv->Put(L"counter", L"reset"));
+    EXPECT_EQ(kv->Increment(L"counter", 1), KvTypeMismatch);
+    EXPECT_STREQ(kv->Get(L"counter"), L"reset");
+}
+
+TEST_F(FunctionTest, ConcurrentIncrementAcrossInstances) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"ConcurrentIncrementAcrossInstances", options);
+    EXPECT_EQ(kv->PutNumber(L"counter", 0), KvOk);
+
+    const int num_instance = 4;
+    const int num_operations = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_instance; ++i) {
+        threads.emplace_back([&options, num_operations, i]() {
+            MemoryKV instance((L"increment_" + std::to_wstring(i)).c_str(), std::make_unique<MockLogger>(true));
+            instance.Open(L"ConcurrentIncrementAcrossInstances", options);
+            for (int j = 0; j < num_operations; ++j) {
+                EXPECT_EQ(instance.Increment(L"counter", 1), KvOk);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    long long value = 0;
+    EXPECT_EQ(kv->GetNumber(L"counter", &value), KvOk);
+    EXPECT_EQ(value, num_instance * num_operations);
+}
+
+// 数值操作的 pin 没放开前, 写者不能复用这个块, 快照也要等进行中的原地更新; 已退出进程的 pin 超时后被收回
+TEST_F(FunctionTest, NumericPinWait) {
+    alignas(64) char buffer[sizeof(BlockHeader)] = {};
+    DataBlock block(buffer);
+    block.Pin();
+    block.Pin(); // 多个操作可以同时持有
+
+    std::atomic<bool> written(false);
+    std::thread writer([&block, &written]() {
+        block.BeginWrite();
+        written = true;
+        block.EndWrite();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(written.load());
+    block.Unpin();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(written.load());
+    block.Unpin();
+    writer.join();
+    EXPECT_TRUE(written.load());
+
+    // 进程在操作中途退出, 留下的pin超时后被收回
+    block.Pin();
+    auto start = std::chrono::steady_clock::now();
+    block.BeginWrite();
+    block.EndWrite();
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(MAX_PIN_WAIT_MS / 2));
+    EXPECT_EQ(reinterpret_cast<BlockHeader*>(buffer)->Pins, 0);
+
+    VersionStore store;
+    std::wstring name = L"NumericPinWait";
+    store.Setup(name, sizeof(BlockHeader));
+    LONG epoch;
+    ASSERT_TRUE(store.BeginInPlaceUpdate(epoch));
+    std::atomic<bool> opened(false);
+    int slot = -1;
+    LONGLONG id = 0;
+    std::thread opener([&store, &opened, &slot, &id]() {
+        LONGLONG sequence;
+        slot = store.OpenSnapshot(id, sequence);
+        opened = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(opened.load());
+    LONG other;
+    EXPECT_FALSE(store.BeginInPlaceUpdate(other)); // 快照打开期间走加锁的路径
+    store.EndInPlaceUpdate(epoch);
+    opener.join();
+    EXPECT_TRUE(opened.load());
+    EXPECT_FALSE(store.BeginInPlaceUpdate(other));
+    store.CloseSnapshot(slot, id);
+    EXPECT_TRUE(store.BeginInPlaceUpdate(other));
+    store.EndInPlaceUpdate(other);
+    store.TearDown();
+}
+
+// 只保留最后capacity-1个字符，最近的ID列表
+static KvStatus KeepRecentOperator(wchar_t* value, int* length, int capacity, const wchar_t* operand, int operandLength)
+{
+    if (operandLength >= capacity)
+        return KvValueTooLarge;
+    int keep = *length < capacity - 1 - operandLength ? *length : capacity - 1 - operandLength;
+    wmemmove(value, value + *length - keep, keep);
+    wmemcpy(value + keep, operand, operandLength);
+    *length = keep + operandLength;
+    return KvOk;
+}
+
+// 改了一半就抛异常
+static KvStatus ThrowingOperator(wchar_t* value, int* length, int capacity, const wchar_t* operand, int operandLength)
+{
+    value[0] = L'!';
+    throw std::runtime_error("merge failed");
+}
+
+TEST_F(FunctionTest, AppendAndMerge) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 8;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"AppendAndMerge", options);
+
+    // 不存在的key按空值创建
+    EXPECT_EQ(kv->Append(L"tags", L"ab"), KvOk);
+    EXPECT_EQ(kv->Append(L"tags", L"cd"), KvOk);
+    EXPECT_STREQ(kv->Get(L"tags"), L"abcd");
+    EXPECT_EQ(kv->Append(L"tags", L""), KvOk);
+    EXPECT_EQ(kv->Append(L"tags", L"efg"), KvOk);
+    EXPECT_STREQ(kv->Get(L"tags"), L"abcdefg");
+
+    // 放不下时保留原值
+    EXPECT_EQ(kv->Append(L"tags", L"h"), KvValueTooLarge);
+    EXPECT_STREQ(kv->Get(L"tags"), L"abcdefg");
+    EXPECT_EQ(kv->Append(L"missing", L"123456789"), KvValueTooLarge);
+    EXPECT_STREQ(kv->Get(L"missing"), L"");
+
+    // Put之后的长度同样生效
+    EXPECT_TRUE(kv->Put(L"tags", L"x"));
+    EXPECT_EQ(kv->Append(L"tags", L"y"), KvOk);
+    EXPECT_STREQ(kv->Get(L"tags"), L"xy");
+
+    EXPECT_EQ(kv->PutNumber(L"counter", 1), KvOk);
+    EXPECT_EQ(kv->Append(L"counter", L"1"), KvTypeMismatch);
+
+    EXPECT_EQ(kv->Merge(L"recent", KeepRecentOperator, L"123", 3), KvOk);
+    EXPECT_EQ(kv->Merge(L"recent", KeepRecentOperator, L"4567", 4), KvOk);
+    EXPECT_EQ(kv->Merge(L"recent", KeepRecentOperator, L"89", 2), KvOk);
+    EXPECT_STREQ(kv->Get(L"recent"), L"3456789");
+    EXPECT_EQ(kv->Merge(L"recent", nullptr, L"1", 1), KvInvalidArgument);
+
+    // 异常穿出 Merge, 原值恢复, block 仍可读写, 新 key 不留下
+    EXPECT_THROW(kv->Merge(L"recent", ThrowingOperator, L"1", 1), std::runtime_error);
+    EXPECT_STREQ(kv->Get(L"recent"), L"3456789");
+    EXPECT_THROW(kv->Merge(L"thrown", ThrowingOperator, L"1", 1), std::runtime_error);
+    EXPECT_STREQ(kv->Get(L"thrown"), L"");
+    EXPECT_EQ(kv->Merge(L"recent", KeepRecentOperator, L"0", 1), KvOk);
+    EXPECT_STREQ(kv->Get(L"recent"), L"4567890");
+}
+
+static bool CollectKeys(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength, void* context)
+{
+    auto keys = static_cast<std::vector<std::wstring>*>(context);
+    keys->emplace_back(key, keyLength);
+    return keys->size() < 3 || keys->back() != L"stop";
+}
+
+TEST_F(FunctionTest, OrderedScan) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.OrderedIndex = 1;
+
+    kv->Open(L"OrderedScan", options);
+    for (int i = 99; i >= 0; --i) {
+        wchar_t key[32];
+        swprintf_s(key, 32, L"machine/%02d/sensor", i);
+        EXPECT_TRUE(kv->Put(key, std::to_wstring(i)));
+    }
+    EXPECT_TRUE(kv->Put(L"machine0", L"x"));
+    EXPECT_TRUE(kv->Put(L"aaa", L"x"));
+
+    // 其他实例写入和删除的key也要能扫到
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"OrderedScan", options);
+    other.Put(L"machine/42/sensor/a", L"a");
+    other.Remove(L"machine/43/sensor");
+
+    std::vector<std::wstring> keys;
+    EXPECT_EQ(kv->ScanPrefix(L"machine/4", 0, CollectKeys, &keys), 10);
+    ASSERT_EQ(keys.size(), 10u);
+    EXPECT_EQ(keys[0], L"machine/40/sensor");
+    EXPECT_EQ(keys[2], L"machine/42/sensor");
+    EXPECT_EQ(keys[3], L"machine/42/sensor/a");
+    EXPECT_EQ(keys[4], L"machine/44/sensor");
+    EXPECT_EQ(keys[9], L"machine/49/sensor");
+
+    // 分页: 从上一页的最后一个key之后继续
+    keys.clear();
+    EXPECT_EQ(kv->Scan(L"machine/", L"machine0", 70, CollectKeys, &keys), 70);
+    std::wstring next = keys.back() + L'\0';
+    keys.clear();
+    EXPECT_EQ(kv->Scan(next, L"machine0", 0, CollectKeys, &keys), 30);
+    EXPECT_EQ(keys.back(), L"machine/99/sensor");
+
+    keys.clear();
+    EXPECT_EQ(kv->Scan(L"", L"", 0, CollectKeys, &keys), 102);
+    EXPECT_EQ(keys.front(), L"aaa");
+    EXPECT_EQ(keys.back(), L"machine0");
+
+    // visitor返回false时停止
+    EXPECT_TRUE(kv->Put(L"stop", L"x"));
+    keys.clear();
+    EXPECT_EQ(kv->ScanPrefix(L"s", 0, CollectKeys, &keys), 1);
+
+    keys.clear();
+    EXPECT_EQ(other.ScanPrefix(L"machine/", 0, CollectKeys, &keys), 100);
+    options.OrderedIndex = 0;
+    MemoryKV unordered(L"unordered", std::make_unique<MockLogger>(true));
+    unordered.Open(L"OrderedScan", options);
+    EXPECT_EQ(unordered.ScanPrefix(L"machine/", 0, CollectKeys, &keys), -1);
+}
+
+// 写者死在写一半时块的版本停在奇数, 扫描不能一直等它
+TEST_F(FunctionTest, ScanPastDeadWriter) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.OrderedIndex = 1;
+
+    kv->Open(L"ScanPastDeadWriter", options);
+    EXPECT_TRUE(kv->Put(L"a", L"1")); // 第一个块
+    EXPECT_TRUE(kv->Put(L"b", L"2"));
+    EXPECT_TRUE(kv->Put(L"c", L"3"));
+
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, L"Global\\MMFDataBlock_ScanPastDeadWriter_0");
+    ASSERT_NE(hMapFile, nullptr);
+    auto pHeader = static_cast<BlockHeader*>(MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(BlockHeader)));
+    ASSERT_NE(pHeader, nullptr);
+    InterlockedIncrement(&pHeader->Version);
+
+    std::vector<std::wstring> keys;
+    EXPECT_EQ(kv->Scan(L"", L"", 0, CollectKeys, &keys), 2);
+    ASSERT_EQ(keys.size(), 2u);
+    EXPECT_EQ(keys[0], L"b");
+
+    // 快照遍历也一样
+    KvSnapshot snapshot;
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+    int visited = 0;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CollectKeys, &keys, &visited), KvOk);
+    EXPECT_EQ(visited, 2);
+    kv->ReleaseSnapshot(snapshot);
+
+    InterlockedIncrement(&pHeader->Version);
+    keys.clear();
+    EXPECT_EQ(kv->Scan(L"", L"", 0, CollectKeys, &keys), 3);
+    UnmapViewOfFile(pHeader);
+    CloseHandle(hMapFile);
+}
+
+static bool CollectPairs(const wchar_t* key, int keyLength, const wchar_t* value, int valueLength, void* context)
+{
+    auto pairs = static_cast<std::map<std::wstring, std::wstring>*>(context);
+    (*pairs)[std::wstring(key, keyLength)] = std::wstring(value, valueLength);
+    return true;
+}
+
+TEST_F(FunctionTest, SnapshotIteration) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"SnapshotIteration", options);
+    for (int i = 0; i < 25; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    EXPECT_EQ(kv->PutNumber(L"counter", 1), KvOk);
+
+    KvSnapshot snapshot;
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+
+    // 快照打开后，其他实例继续写入
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"SnapshotIteration", options);
+    EXPECT_TRUE(other.Put(L"key_0", L"changed"));
+    EXPECT_TRUE(other.Put(L"key_0", L"changed again"));
+    other.Remove(L"key_1");
+    EXPECT_TRUE(other.Put(L"key_new", L"new"));
+    EXPECT_EQ(other.Increment(L"counter", 10), KvOk);
+    EXPECT_EQ(other.Append(L"key_2", L"+"), KvOk);
+    for (int i = 30; i < 50; ++i) {
+        EXPECT_TRUE(other.Put(L"key_" + std::to_wstring(i), L"later"));
+    }
+
+    std::map<std::wstring, std::wstring> pairs;
+    int visited = 0;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CollectPairs, &pairs, &visited), KvOk);
+    EXPECT_EQ(visited, 26);
+    ASSERT_EQ(pairs.size(), 26u);
+    EXPECT_EQ(pairs[L"key_0"], L"value_0");
+    EXPECT_EQ(pairs[L"key_1"], L"value_1");
+    EXPECT_EQ(pairs[L"key_2"], L"value_2");
+    EXPECT_EQ(pairs[L"counter"], L"1");
+    EXPECT_EQ(pairs.count(L"key_new"), 0u);
+    kv->ReleaseSnapshot(snapshot);
+    EXPECT_EQ(snapshot.Slot, -1);
+
+    // 当前值不受影响
+    EXPECT_STREQ(kv->Get(L"key_0"), L"changed again");
+    EXPECT_STREQ(kv->Get(L"key_2"), L"value_2+");
+    long long value = 0;
+    EXPECT_EQ(kv->GetNumber(L"counter", &value), KvOk);
+    EXPECT_EQ(value, 11);
+
+    pairs.clear();
+    ASSERT_EQ(other.OpenSnapshot(snapshot), KvOk);
+    EXPECT_EQ(other.IterateSnapshot(snapshot, CollectPairs, &pairs), KvOk);
+    other.ReleaseSnapshot(snapshot);
+    EXPECT_EQ(pairs.size(), 46u);
+    EXPECT_EQ(pairs[L"key_new"], L"new");
+}
+
+TEST_F(FunctionTest, CheckpointAndRead) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"CheckpointAndRead", options);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    EXPECT_EQ(kv->PutNumber(L"counter", 42), KvOk);
+    EXPECT_EQ(kv->PutDouble(L"gauge", 0.5), KvOk);
+    kv->Remove(L"key_7");
+
+    // 写checkpoint的同时继续写入
+    std::atomic<bool> done(false);
+    std::thread writer([&options, &done]() {
+        MemoryKV instance(L"writer", std::make_unique<MockLogger>(true));
+        instance.Open(L"CheckpointAndRead", options);
+        for (int i = 0; !done; i = (i + 1) % 1000) {
+            instance.Put(L"key_" + std::to_wstring(i), L"changed");
+        }
+    });
+    long long bytes = 0;
+    KvStatus status;
+    do {
+        status = kv->Checkpoint(L"CheckpointAndRead.ckpt", &bytes);
+    } while (status == KvSnapshotTooOld);
+    done = true;
+    writer.join();
+    EXPECT_EQ(status, KvOk);
+    EXPECT_GT(bytes, 0);
+
+    std::map<std::wstring, std::wstring> pairs;
+    int visited = 0;
+    EXPECT_EQ(MemoryKV::ReadCheckpoint(L"CheckpointAndRead.ckpt", CollectPairs, &pairs, &visited), KvOk);
+    EXPECT_EQ(visited, 1001);
+    EXPECT_EQ(pairs.size(), 1001u);
+    EXPECT_EQ(pairs.count(L"key_7"), 0u);
+    EXPECT_EQ(pairs[L"counter"], L"42");
+    EXPECT_EQ(pairs[L"gauge"], L"0.5");
+
+    // 损坏或不存在的文件
+    FILE* file = nullptr;
+    ASSERT_EQ(_wfopen_s(&file, L"CheckpointAndRead.ckpt", L"r+b"), 0);
+    fseek(file, 100, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, 100, SEEK_SET);
+    fputc(byte ^ 0x55, file);
+    fclose(file);
+    EXPECT_EQ(MemoryKV::ReadCheckpoint(L"CheckpointAndRead.ckpt", CollectPairs, &pairs), KvError);
+    EXPECT_EQ(MemoryKV::ReadCheckpoint(L"missing.ckpt", CollectPairs, &pairs), KvNotFound);
+    _wremove(L"CheckpointAndRead.ckpt");
+}
+
+// 从 segment image 恢复: 数据块直接读进 MMF, 不需要逐个 Put
+TEST_F(FunctionTest, RestoreFromImage) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+
+    kv->Open(L"RestoreFromImage", options);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    EXPECT_EQ(kv->PutNumber(L"counter", 42), KvOk);
+    EXPECT_TRUE(kv->Put(L"session", L"token", 3600 * 1000));
+    kv->Remove(L"key_7");
+
+    long long bytes = 0;
+    ASSERT_EQ(kv->SaveImage(L"RestoreFromImage.img", &bytes), KvOk);
+    EXPECT_GT(bytes, 0);
+    kv->Put(L"key_0", L"after the image");
+
+    // 新的 DB 由 image 填充
+    MemoryKV restored(L"restored", std::make_unique<MockLogger>(true));
+    restored.Open(L"RestoreFromImage_Restored", options, L"RestoreFromImage.img");
+    EXPECT_STREQ(restored.Get(L"key_0"), L"value_0");
+    EXPECT_STREQ(restored.Get(L"key_999"), L"value_999");
+    EXPECT_STREQ(restored.Get(L"key_7"), L"");
+    EXPECT_STREQ(restored.Get(L"session"), L"token");
+    long long counter = 0;
+    EXPECT_EQ(restored.Increment(L"counter", 1, &counter), KvOk);
+    EXPECT_EQ(counter, 43);
+    EXPECT_TRUE(restored.Put(L"new_key", L"new_value"));
+
+    // 其他实例看到的是同一份数据, image 在 DB 已存在时被忽略
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"RestoreFromImage_Restored", options, L"missing.img");
+    EXPECT_STREQ(other.Get(L"key_500"), L"value_500");
+    EXPECT_STREQ(other.Get(L"new_key"), L"new_value");
+    long long number = 0;
+    EXPECT_EQ(other.GetNumber(L"counter", &number), KvOk);
+    EXPECT_EQ(number, 43);
+
+    // 大小不同, 不存在或损坏的 image
+    ConfigOptions smaller = options;
+    smaller.MaxValueSize = 128;
+    MemoryKV mismatch(L"mismatch", std::make_unique<MockLogger>(true));
+    EXPECT_THROW(mismatch.Open(L"RestoreFromImage_Mismatch", smaller, L"RestoreFromImage.img"), KvRestoreException);
+    MemoryKV missing(L"missing", std::make_unique<MockLogger>(true));
+    EXPECT_THROW(missing.Open(L"RestoreFromImage_Missing", options, L"missing.img"), KvRestoreException);
+
+    FILE* file = nullptr;
+    ASSERT_EQ(_wfopen_s(&file, L"RestoreFromImage.img", L"r+b"), 0);
+    fseek(file, 5000, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, 5000, SEEK_SET);
+    fputc(byte ^ 0x55, file);
+    fclose(file);
+    MemoryKV corrupted(L"corrupted", std::make_unique<MockLogger>(true));
+    EXPECT_THROW(corrupted.Open(L"RestoreFromImage_Corrupted", options, L"RestoreFromImage.img"), KvRestoreException);
+    _wremove(L"RestoreFromImage.img");
+}
+
+TEST_F(FunctionTest, WriteAheadLogReplay) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Durability = KvDurabilitySync;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+    _wremove(L".\\WriteAheadLogReplay.wal");
+
+    {
+        MemoryKV writer(L"writer", std::make_unique<MockLogger>(true));
+        writer.Open(L"WriteAheadLogReplay", options);
+        for (int i = 0; i < 500; ++i) {
+            EXPECT_TRUE(writer.Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+        }
+        writer.Put(L"key_1", L"updated");
+        writer.Remove(L"key_2");
+        EXPECT_EQ(writer.Append(L"key_3", L"+tail"), KvOk);
+        EXPECT_EQ(writer.PutNumber(L"counter", 40), KvOk);
+        EXPECT_EQ(writer.Increment(L"counter", 2), KvOk);
+        EXPECT_EQ(writer.PutDouble(L"ratio", 0.5), KvOk);
+        EXPECT_TRUE(writer.Put(L"session", L"token", 3600 * 1000));
+
+        // 多个线程同时 Put, 一次 flush 覆盖多条记录
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&writer, t]() {
+                for (int i = 0; i < 100; ++i) {
+                    writer.Put(L"thread_" + std::to_wstring(t) + L"_" + std::to_wstring(i), L"v");
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        long long records = 0;
+        long long flushes = 0;
+        writer.GetLogStats(&records, &flushes);
+        EXPECT_EQ(records, 507 + 800);
+        EXPECT_GT(flushes, 0);
+        EXPECT_LE(flushes, records);
+    }
+
+    // 最后一个实例关闭后 DB 就没了, 再打开时从日志恢复
+    {
+        MemoryKV reader(L"reader", std::make_unique<MockLogger>(true));
+        reader.Open(L"WriteAheadLogReplay", options);
+        EXPECT_STREQ(reader.Get(L"key_0"), L"value_0");
+        EXPECT_STREQ(reader.Get(L"key_499"), L"value_499");
+        EXPECT_STREQ(reader.Get(L"key_1"), L"updated");
+        EXPECT_STREQ(reader.Get(L"key_2"), L"");
+        EXPECT_STREQ(reader.Get(L"key_3"), L"value_3+tail");
+        EXPECT_STREQ(reader.Get(L"session"), L"token");
+        EXPECT_STREQ(reader.Get(L"thread_7_99"), L"v");
+        long long counter = 0;
+        EXPECT_EQ(reader.GetNumber(L"counter", &counter), KvOk);
+        EXPECT_EQ(counter, 42);
+        double ratio = 0;
+        EXPECT_EQ(reader.GetDouble(L"ratio", &ratio), KvOk);
+        EXPECT_EQ(ratio, 0.5);
+        EXPECT_TRUE(reader.Put(L"after_replay", L"yes"));
+    }
+
+    // 崩溃留下的半条记录被截掉, 之前的记录照常恢复
+    FILE* file = nullptr;
+    ASSERT_EQ(_wfopen_s(&file, L".\\WriteAheadLogReplay.wal", L"ab"), 0);
+    const char torn[] = "torn record";
+    fwrite(torn, 1, sizeof(torn), file);
+    fclose(file);
+    {
+        MemoryKV recovered(L"recovered", std::make_unique<MockLogger>(true));
+        recovered.Open(L"WriteAheadLogReplay", options);
+        EXPECT_STREQ(recovered.Get(L"after_replay"), L"yes");
+        EXPECT_TRUE(recovered.Put(L"after_torn", L"yes"));
+    }
+    {
+        MemoryKV reopened(L"reopened", std::make_unique<MockLogger>(true));
+        reopened.Open(L"WriteAheadLogReplay", options);
+        EXPECT_STREQ(reopened.Get(L"after_torn"), L"yes");
+        EXPECT_STREQ(reopened.Get(L"key_1"), L"updated");
+    }
+
+    // 保存 image 后, 日志只留下 image 之后的记录, 从 image 恢复再重放它们
+    std::atomic<int> during(0);
+    {
+        MemoryKV saver(L"saver", std::make_unique<MockLogger>(true));
+        saver.Open(L"WriteAheadLogReplay", options);
+        std::atomic<bool> saved(false);
+        std::thread writer([&saver, &saved, &during]() {
+            while (!saved) {
+                EXPECT_TRUE(saver.Put(L"during_" + std::to_wstring(during), L"v"));
+                during++;
+            }
+        });
+        EXPECT_EQ(saver.SaveImage(L"WriteAheadLogReplay.img"), KvOk);
+        saved = true;
+        writer.join();
+        EXPECT_TRUE(saver.Put(L"key_1", L"after the image"));
+    }
+    FILE* log = nullptr;
+    ASSERT_EQ(_wfopen_s(&log, L".\\WriteAheadLogReplay.wal", L"rb"), 0);
+    fseek(log, 0, SEEK_END);
+    long logSize = ftell(log);
+    fclose(log);
+    EXPECT_LT(logSize, 100 * (during + 1) + 1000); // 之前的 1300 多条记录没了
+    {
+        MemoryKV restored(L"restored", std::make_unique<MockLogger>(true));
+        restored.Open(L"WriteAheadLogReplay", options, L"WriteAheadLogReplay.img");
+        EXPECT_STREQ(restored.Get(L"key_0"), L"value_0");
+        EXPECT_STREQ(restored.Get(L"key_1"), L"after the image");
+        EXPECT_STREQ(restored.Get(L"after_torn"), L"yes");
+        EXPECT_STREQ(restored.Get((L"during_" + std::to_wstring(during - 1)).c_str()), L"v");
+    }
+    _wremove(L"WriteAheadLogReplay.img");
+    _wremove(L".\\WriteAheadLogReplay.wal");
+}
+
+static void RemoveSegmentFiles(const std::wstring& dbName, int mmfCount) {
+    _wremove((L".\\" + dbName + L".hdr").c_str());
+    for (int i = 0; i < mmfCount; ++i) {
+        _wremove((L".\\" + dbName + L"_" + std::to_wstring(i) + L".seg").c_str());
+    }
+}
+
+TEST_F(FunctionTest, FileBackedSegments) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 256;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Storage = KvStorageFile;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+    RemoveSegmentFiles(L"FileBackedSegments", 10);
+
+    {
+        MemoryKV writer(L"writer", std::make_unique<MockLogger>(true));
+        writer.Open(L"FileBackedSegments", options);
+        for (int i = 0; i < 500; ++i) {
+            EXPECT_TRUE(writer.Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+        }
+        writer.Remove(L"key_2");
+        EXPECT_EQ(writer.PutNumber(L"counter", 42), KvOk);
+        EXPECT_EQ(writer.Flush(), KvOk);
+        EXPECT_EQ(writer.Flush(false), KvOk);
+        EXPECT_TRUE(writer.Put(L"after_flush", L"yes")); // 没有 Flush 的修改在进程正常退出时也会写回文件
+    }
+
+    // 所有实例都关闭后, 重新打开直接映射文件, 不需要重放
+    {
+        MemoryKV reader(L"reader", std::make_unique<MockLogger>(true));
+        reader.Open(L"FileBackedSegments", options);
+        EXPECT_STREQ(reader.Get(L"key_0"), L"value_0");
+        EXPECT_STREQ(reader.Get(L"key_499"), L"value_499");
+        EXPECT_STREQ(reader.Get(L"key_2"), L"");
+        EXPECT_STREQ(reader.Get(L"after_flush"), L"yes");
+        long long counter = 0;
+        EXPECT_EQ(reader.GetNumber(L"counter", &counter), KvOk);
+        EXPECT_EQ(counter, 42);
+
+        // 文件里的块带着上次的 commit sequence, 新的快照要能看到它们, 之后的写入不能被看到
+        KvSnapshot snapshot;
+        ASSERT_EQ(reader.OpenSnapshot(snapshot), KvOk);
+        EXPECT_TRUE(reader.Put(L"key_0", L"changed"));
+        EXPECT_TRUE(reader.Put(L"key_new", L"new"));
+        std::map<std::wstring, std::wstring> pairs;
+        EXPECT_EQ(reader.IterateSnapshot(snapshot, CollectPairs, &pairs), KvOk);
+        reader.ReleaseSnapshot(snapshot);
+        EXPECT_EQ(pairs.size(), 501u);
+        EXPECT_EQ(pairs[L"key_0"], L"value_0");
+        EXPECT_EQ(pairs.count(L"key_new"), 0u);
+
+        // 同时打开的实例共享同一份映射
+        MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+        other.Open(L"FileBackedSegments", options);
+        EXPECT_STREQ(other.Get(L"key_0"), L"changed");
+        EXPECT_STREQ(other.Get(L"key_new"), L"new");
+    }
+
+    // 选项不同, 文件大小对不上, 不会被截断
+    ConfigOptions other_options = options;
+    other_options.MaxMmfCount = 50;
+    {
+        MemoryKV mismatched(L"mismatched", std::make_unique<MockLogger>(true));
+        EXPECT_THROW(mismatched.Open(L"FileBackedSegments", other_options), std::runtime_error);
+    }
+    {
+        MemoryKV reopened(L"reopened", std::make_unique<MockLogger>(true));
+        reopened.Open(L"FileBackedSegments", options);
+        EXPECT_STREQ(reopened.Get(L"key_0"), L"changed");
+    }
+
+    // 内存模式下 Flush 什么都不做
+    kv->Open(L"FileBackedSegments_Memory", ConfigOptions());
+    EXPECT_EQ(kv->Flush(), KvOk);
+    RemoveSegmentFiles(L"FileBackedSegments", 10);
+}
+
+// 覆盖整页的值才会变冷, 4096 个字符以上无论从哪开始都至少有一页
+static std::wstring ColdTestValue(int i) {
+    return L"value_" + std::to_wstring(i) + L"_" + std::wstring(4200, L'x');
+}
+
+TEST_F(FunctionTest, TieredColdValues) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 8192;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Tiering = 1;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+
+    {
+        // 冷文件在所有实例关闭后才能删除
+        MemoryKV tiered(L"tiered", std::make_unique<MockLogger>(true));
+        tiered.Open(L"TieredColdValues", options);
+        for (int i = 0; i < 200; ++i) {
+            EXPECT_TRUE(tiered.Put(L"key_" + std::to_wstring(i), ColdTestValue(i)));
+        }
+        EXPECT_TRUE(tiered.Put(L"short", L"tiny"));
+        EXPECT_EQ(tiered.PutNumber(L"counter", 42), KvOk);
+
+        // 刚写入的值是热的, 第一轮只清掉访问位
+        int demoted = -1;
+        int promoted = -1;
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        EXPECT_EQ(demoted, 0);
+        EXPECT_EQ(promoted, 0);
+
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_STREQ(tiered.Get(L"key_" + std::to_wstring(i)), ColdTestValue(i).c_str());
+        }
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        EXPECT_EQ(demoted, 190); // 短值和数字留在块里
+
+        EXPECT_EQ(promoted, 0);
+
+        // 冷值直接从冷文件读, 其他实例也一样
+        EXPECT_STREQ(tiered.Get(L"key_100"), ColdTestValue(100).c_str());
+        std::vector<wchar_t> buffer(8192);
+        int length = 0;
+        std::wstring key = L"key_101";
+        EXPECT_EQ(tiered.TryGet(key.c_str(), static_cast<int>(key.size()), buffer.data(), 8192, &length), KvOk);
+        EXPECT_STREQ(buffer.data(), ColdTestValue(101).c_str());
+        MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+        other.Open(L"TieredColdValues", options);
+        EXPECT_STREQ(other.Get(L"key_150"), ColdTestValue(150).c_str());
+        EXPECT_STREQ(other.Get(L"short"), L"tiny");
+        {
+            // 只读挂载也从冷文件读出冷值
+            KvInspector inspector;
+            ASSERT_EQ(inspector.Attach(L"TieredColdValues"), KvOk);
+            inspector.GetMmfCount();
+            KvInspectedBlock block;
+            long position = 0;
+            for (; position <= inspector.GetHighestPosition(); ++position) {
+                ASSERT_EQ(inspector.ReadBlock(position, block), KvOk);
+                if (block.Key == L"key_160")
+                    break;
+            }
+            EXPECT_EQ(block.ValueType, KvValueCold);
+            EXPECT_EQ(block.Value, ColdTestValue(160));
+        }
+
+        KvSnapshot snapshot;
+        ASSERT_EQ(tiered.OpenSnapshot(snapshot), KvOk);
+        std::map<std::wstring, std::wstring> pairs;
+        EXPECT_EQ(tiered.IterateSnapshot(snapshot, CollectPairs, &pairs), KvOk);
+        tiered.ReleaseSnapshot(snapshot);
+        EXPECT_EQ(pairs.size(), 202u);
+        EXPECT_EQ(pairs[L"key_199"], ColdTestValue(199));
+        EXPECT_EQ(pairs[L"counter"], L"42");
+
+        // 写冷值: Append 先把值取回块里, Put 和 Remove 直接覆盖
+        EXPECT_EQ(tiered.Append(L"key_20", L"+tail"), KvOk);
+        EXPECT_STREQ(tiered.Get(L"key_20"), (ColdTestValue(20) + L"+tail").c_str());
+        EXPECT_TRUE(tiered.Put(L"key_30", L"new"));
+        EXPECT_STREQ(tiered.Get(L"key_30"), L"new");
+        tiered.Remove(L"key_31");
+        EXPECT_STREQ(tiered.Get(L"key_31"), L"");
+        EXPECT_EQ(tiered.Increment(L"key_32", 1), KvTypeMismatch);
+
+        // 被读过的冷值回到块里, 上一轮之后没人读的热值变冷
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        EXPECT_EQ(promoted, 3); // key_100, key_101, key_150
+        EXPECT_EQ(demoted, 10); // key_0 .. key_9
+        EXPECT_STREQ(other.Get(L"key_100"), ColdTestValue(100).c_str());
+        EXPECT_STREQ(other.Get(L"key_5"), ColdTestValue(5).c_str());
+
+        long long total_demoted = 0;
+        long long total_promoted = 0;
+        long long stored_bytes = 0;
+        other.GetTieringStats(&total_demoted, &total_promoted, &stored_bytes);
+        EXPECT_EQ(total_demoted, 200);
+        EXPECT_EQ(total_promoted, 3);
+        long long chunk = 128; // 值, 结尾的 0 和空闲链表的 8 字节放得下的 2 的幂
+        while (chunk < static_cast<long long>((ColdTestValue(100).size() + 1) * sizeof(wchar_t) + 8))
+            chunk *= 2;
+        EXPECT_EQ(stored_bytes, 194 * chunk); // 取回, 覆盖和删除的冷值的块已经空出来了
+
+        // 冷热来回切换复用同一个块, 冷文件不再增长
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk); // 上面读过的 key_5, key_100 先回到块里再变冷
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        long long settled_bytes = 0;
+        other.GetTieringStats(&total_demoted, &total_promoted, &settled_bytes);
+        for (int i = 0; i < 1100; ++i) {
+            tiered.Get(L"key_50");
+            EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+            EXPECT_EQ(promoted, 1);
+            EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+            EXPECT_EQ(demoted, 1);
+        }
+        other.GetTieringStats(&total_demoted, &total_promoted, &stored_bytes);
+        EXPECT_EQ(stored_bytes, settled_bytes);
+
+        EXPECT_TRUE(tiered.Put(L"medium", std::wstring(500, L'm')));
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        EXPECT_EQ(tiered.RebalanceTiers(&demoted, &promoted), KvOk);
+        EXPECT_EQ(demoted, 0); // 不到一页, 变冷也省不了内存
+        EXPECT_STREQ(other.Get(L"key_50"), ColdTestValue(50).c_str());
+        FILE* file = nullptr;
+        EXPECT_NE(_wfopen_s(&file, L".\\TieredColdValues_cold_1.seg", L"rb"), 0);
+        if (file != nullptr)
+            fclose(file);
+    }
+    _wremove(L".\\TieredColdValues_cold_0.seg");
+    _wremove(L".\\TieredColdValues_cold_1.seg");
+}
+
+// 类似 JSON 的值, 压缩后远小于原文
+static std::wstring JsonTestValue(int i, int fields) {
+    std::wstring value = L"{\"id\":" + std::to_wstring(i);
+    for (int f = 0; f < fields; ++f) {
+        value += L",\"field_" + std::to_wstring(f) + L"\":\"status_ok\"";
+    }
+    return value + L"}";
+}
+
+TEST_F(FunctionTest, CompressedValues) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Compression = KvCompressionLz;
+    options.CompressionThreshold = 64;
+
+    kv->Open(L"CompressedValues", options);
+    // 压缩后放得下的值可以比 MaxValueSize 长
+    std::wstring large = JsonTestValue(1, 40);
+    ASSERT_GT(large.size(), 800u);
+    EXPECT_TRUE(kv->Put(L"large", large));
+    EXPECT_STREQ(kv->Get(L"large"), large.c_str());
+    EXPECT_TRUE(kv->Put(L"short", L"tiny"));
+    EXPECT_STREQ(kv->Get(L"short"), L"tiny");
+
+    // 压不下去的值照旧受 MaxValueSize 限制
+    std::wstring random;
+    std::mt19937 gen(7);
+    for (int i = 0; i < 500; ++i) {
+        random += static_cast<wchar_t>(L'!' + gen() % 90);
+    }
+    EXPECT_EQ(kv->TryPut(L"random", 6, random.c_str(), static_cast<int>(random.size())), KvValueTooLarge);
+    std::wstring medium = random.substr(0, 100); // 超过阈值但压缩不划算, 原样存
+    EXPECT_TRUE(kv->Put(L"medium", medium));
+    EXPECT_STREQ(kv->Get(L"medium"), medium.c_str());
+
+    std::vector<wchar_t> buffer(1024);
+    int length = 0;
+    EXPECT_EQ(kv->TryGet(L"large", 5, buffer.data(), 16, &length), KvBufferTooSmall);
+    EXPECT_EQ(length, static_cast<int>(large.size()));
+    EXPECT_EQ(kv->TryGet(L"large", 5, buffer.data(), 1024, &length), KvOk);
+    EXPECT_EQ(std::wstring(buffer.data(), length), large);
+
+    // 不压缩的实例也能读, 但写不了这么长的值
+    ConfigOptions plain = options;
+    plain.Compression = KvCompressionNone;
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"CompressedValues", plain);
+    EXPECT_STREQ(other.Get(L"large"), large.c_str());
+    EXPECT_FALSE(other.Put(L"large_2", large));
+
+    // Append 解压后整体重写
+    EXPECT_EQ(kv->Append(L"large", L"+tail"), KvOk);
+    EXPECT_STREQ(other.Get(L"large"), (large + L"+tail").c_str());
+    EXPECT_EQ(kv->Append(L"short", std::wstring(100, L'a')), KvOk); // 追加后超过阈值, 被压缩
+    EXPECT_STREQ(other.Get(L"short"), (L"tiny" + std::wstring(100, L'a')).c_str());
+    EXPECT_EQ(other.Append(L"short", std::wstring(100, L'a')), KvValueTooLarge);
+    EXPECT_EQ(kv->Increment(L"large", 1), KvTypeMismatch);
+
+    // 快照和 checkpoint 里是原文
+    KvSnapshot snapshot;
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+    std::map<std::wstring, std::wstring> pairs;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CollectPairs, &pairs), KvOk);
+    kv->ReleaseSnapshot(snapshot);
+    EXPECT_EQ(pairs[L"large"], large + L"+tail");
+    EXPECT_EQ(kv->Checkpoint(L"CompressedValues.ckpt"), KvOk);
+    pairs.clear();
+    EXPECT_EQ(MemoryKV::ReadCheckpoint(L"CompressedValues.ckpt", CollectPairs, &pairs), KvOk);
+    EXPECT_EQ(pairs.size(), 3u);
+    EXPECT_EQ(pairs[L"large"], large + L"+tail");
+    EXPECT_EQ(pairs[L"medium"], medium);
+    _wremove(L"CompressedValues.ckpt");
+}
+
+// 相同的长值在 value pool 里只存一份, 数据块指向它
+TEST_F(FunctionTest, ValuePoolDedup) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Dedup = 1;
+
+    kv->Open(L"ValuePoolDedup", options);
+    std::wstring shared = JsonTestValue(1, 40); // 比 MaxValueSize 长
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), shared));
+    }
+    EXPECT_TRUE(kv->Put(L"short", L"tiny")); // 低于阈值, 放在数据块里
+    long long values = 0;
+    long long found = 0;
+    long long bytes = 0;
+    kv->GetValuePoolStats(&values, &found, &bytes);
+    EXPECT_EQ(values, 1);
+    EXPECT_EQ(found, 99);
+    EXPECT_GE(bytes, static_cast<long long>(shared.size() * sizeof(wchar_t)));
+    EXPECT_STREQ(kv->Get(L"key_42"), shared.c_str());
+    EXPECT_STREQ(kv->Get(L"short"), L"tiny");
+
+    // 覆盖和删除释放引用, 最后一个引用释放后条目被回收
+    std::wstring other_value = JsonTestValue(2, 40);
+    EXPECT_TRUE(kv->Put(L"key_0", other_value));
+    kv->Remove(L"key_1");
+    EXPECT_EQ(kv->PutNumber(L"key_2", 7), KvOk);
+    kv->GetValuePoolStats(&values, &found, nullptr);
+    EXPECT_EQ(values, 2);
+    EXPECT_EQ(found, 99); // 找到已有值的 Put 次数, 不随释放减少
+    EXPECT_TRUE(kv->Put(L"key_0", L"tiny"));
+    kv->GetValuePoolStats(&values, nullptr, nullptr);
+    EXPECT_EQ(values, 1);
+
+    // 其他实例通过同一个 pool 读写
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"ValuePoolDedup", options);
+    EXPECT_STREQ(other.Get(L"key_99"), shared.c_str());
+    EXPECT_TRUE(other.Put(L"key_100", shared));
+    kv->GetValuePoolStats(&values, &found, nullptr);
+    EXPECT_EQ(values, 1);
+    EXPECT_EQ(found, 100);
+
+    // 快照打开时被覆盖的值要保留到快照关闭
+    KvSnapshot snapshot;
+    ASSERT_EQ(kv->OpenSnapshot(snapshot), KvOk);
+    EXPECT_TRUE(kv->Put(L"unique", other_value));
+    std::wstring changed = JsonTestValue(3, 40);
+    EXPECT_TRUE(kv->Put(L"unique", changed));
+    std::map<std::wstring, std::wstring> pairs;
+    EXPECT_EQ(kv->IterateSnapshot(snapshot, CollectPairs, &pairs), KvOk);
+    EXPECT_EQ(pairs[L"key_50"], shared);
+    kv->ReleaseSnapshot(snapshot);
+    kv->GetValuePoolStats(&values, nullptr, nullptr);
+    EXPECT_EQ(values, 2);
+
+    // Append 把追加后的值重新放进 pool
+    EXPECT_EQ(kv->Append(L"key_3", L"+tail"), KvOk);
+    EXPECT_STREQ(other.Get(L"key_3"), (shared + L"+tail").c_str());
+    EXPECT_STREQ(other.Get(L"key_4"), shared.c_str());
+    EXPECT_EQ(kv->Increment(L"key_4", 1), KvTypeMismatch);
+
+    // checkpoint 和 image 里是原文, 恢复时重新放进新 DB 的 pool
+    EXPECT_EQ(kv->Checkpoint(L"ValuePoolDedup.ckpt"), KvOk);
+    pairs.clear();
+    EXPECT_EQ(MemoryKV::ReadCheckpoint(L"ValuePoolDedup.ckpt", CollectPairs, &pairs), KvOk);
+    EXPECT_EQ(pairs[L"key_3"], shared + L"+tail");
+    EXPECT_EQ(pairs[L"unique"], changed);
+    _wremove(L"ValuePoolDedup.ckpt");
+    ASSERT_EQ(kv->SaveImage(L"ValuePoolDedup.img"), KvOk);
+    MemoryKV restored(L"restored", std::make_unique<MockLogger>(true));
+    restored.Open(L"ValuePoolDedup_Restored", options, L"ValuePoolDedup.img");
+    EXPECT_STREQ(restored.Get(L"key_99"), shared.c_str());
+    EXPECT_STREQ(restored.Get(L"unique"), changed.c_str());
+    restored.GetValuePoolStats(&values, &found, nullptr);
+    EXPECT_EQ(values, 3);
+    EXPECT_EQ(found, 96);
+    ConfigOptions plain = options;
+    plain.Dedup = 0;
+    MemoryKV no_pool(L"no_pool", std::make_unique<MockLogger>(true));
+    EXPECT_THROW(no_pool.Open(L"ValuePoolDedup_NoPool", plain, L"ValuePoolDedup.img"), KvRestoreException);
+    _wremove(L"ValuePoolDedup.img");
+}
+
+// 反复覆盖留下的已删除槽位会被清空, 不会拖长查找; pool 到了负载上限后新值放在数据块里
+TEST_F(FunctionTest, ValuePoolChurn) {
+    ConfigOptions options;
+    options.MaxKeySize = 64;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 1000;
+    options.MaxMmfCount = 100;
+    options.LogLevel = 0;
+    options.Dedup = 1;
+
+    kv->Open(L"ValuePoolChurn", options);
+    for (int i = 0; i < 200000; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i % 64), L"churned value number " + std::to_wstring(i) + L" of the test"));
+    }
+    long long values = 0;
+    long long found = 0;
+    kv->GetValuePoolStats(&values, &found, nullptr);
+    EXPECT_EQ(values, 64);
+    EXPECT_EQ(found, 0);
+    EXPECT_TRUE(kv->Put(L"copy", L"churned value number 199999 of the test"));
+    kv->GetValuePoolStats(&values, &found, nullptr);
+    EXPECT_EQ(found, 1);
+
+    const int limit = VALUE_POOL_INDEX_SIZE / 4 * 3;
+    for (int i = 0; i < limit; ++i) {
+        EXPECT_TRUE(kv->Put(L"fill_" + std::to_wstring(i), L"distinct value for the fill number " + std::to_wstring(i)));
+    }
+    kv->GetValuePoolStats(&values, nullptr, nullptr);
+    EXPECT_EQ(values, limit);
+    EXPECT_STREQ(kv->Get(L"fill_" + std::to_wstring(limit - 1)),
+        (L"distinct value for the fill number " + std::to_wstring(limit - 1)).c_str());
+    EXPECT_STREQ(kv->Get(L"key_7"), L"churned value number 199943 of the test");
+}
+
+// 内存统计: 数据块分成有效块, 已删除未复用的块和高水位以上的块, 有效块再分成内容和填充
+TEST_F(FunctionTest, MemoryStats) {
+    KvMemoryStats stats;
+    EXPECT_EQ(kv->GetMemoryStats(stats), KvNotInitialized);
+
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 32;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    kv->Open(L"MemoryStats", options);
+    for (int i = 0; i < 15; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    kv->Remove(L"key_3");
+    EXPECT_EQ(kv->PutNumber(L"n", 7), KvOk); // 数字在块头里, 只有 key 算内容
+
+    long long blockSize = (sizeof(BlockHeader) + (16 + 32) * sizeof(wchar_t) + 7) / 8 * 8;
+    ASSERT_EQ(kv->GetMemoryStats(stats), KvOk);
+    EXPECT_EQ(stats.LiveKeys, 15);
+    EXPECT_EQ(stats.DataBytes, 2 * 10 * blockSize);
+    EXPECT_EQ(stats.PayloadBytes, static_cast<long long>((10 * 5 + 5 * 6 - 5 + 14 * 5 + 1) * sizeof(wchar_t)));
+    EXPECT_EQ(stats.PayloadBytes + stats.PaddingBytes, 15 * blockSize);
+    EXPECT_EQ(stats.FreeBlockBytes, blockSize); // 新 key 只用高水位以上的块, key_3 的块还空着
+    EXPECT_EQ(stats.HeadroomBytes, 4 * blockSize);
+    EXPECT_GT(stats.SharedBytes, stats.DataBytes); // 还有头块, 过期队列和版本区
+    EXPECT_GT(stats.IndexBytes, 0);
+
+    // 其他实例看到同样的共享内存, 索引是自己的
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"MemoryStats", options);
+    KvMemoryStats other_stats;
+    ASSERT_EQ(other.GetMemoryStats(other_stats), KvOk);
+    EXPECT_EQ(other_stats.LiveKeys, 15);
+    EXPECT_EQ(other_stats.DataBytes, stats.DataBytes);
+    EXPECT_EQ(other_stats.PayloadBytes, stats.PayloadBytes);
+    EXPECT_GT(other_stats.IndexBytes, 0);
+}
+
+// 共享统计页: 各进程的操作计数, 块数量和锁的等待/持有时间
+TEST_F(FunctionTest, SharedStats) {
+    KvStats stats;
+    EXPECT_EQ(kv->GetStats(stats), KvNotInitialized);
+    EXPECT_EQ(MemoryKV::ReadStats(L"SharedStats", stats), KvNotFound); // 没有进程打开这个 DB
+
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 32;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    kv->Open(L"SharedStats", options);
+    for (int i = 0; i < 15; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    EXPECT_STREQ(kv->Get(L"key_0"), L"value");
+    EXPECT_STREQ(kv->Get(L"missing"), L"");
+    kv->Remove(L"key_3");
+    EXPECT_EQ(kv->PutNumber(L"n", 7), KvOk);
+    EXPECT_EQ(kv->Increment(L"n", 1, nullptr), KvOk);
+
+    ASSERT_EQ(kv->GetStats(stats), KvOk);
+    EXPECT_EQ(stats.Counters[KvStatPuts], 16);
+    EXPECT_EQ(stats.Counters[KvStatGets], 2);
+    EXPECT_EQ(stats.Counters[KvStatGetHits], 1);
+    EXPECT_EQ(stats.Counters[KvStatGetMisses], 1);
+    EXPECT_EQ(stats.Counters[KvStatRemoves], 1);
+    EXPECT_EQ(stats.Counters[KvStatNumerics], 1);
+    EXPECT_EQ(stats.Counters[KvStatExpansions], 2);
+    EXPECT_EQ(stats.LiveBlocks, 15);
+    EXPECT_EQ(stats.RemovedBlocks, 1);
+    EXPECT_EQ(stats.Processes, 1);
+    EXPECT_GT(stats.Counters[KvStatRefreshes], 0); // 新 key 和不存在的 key 都会刷新索引
+    EXPECT_GE(stats.Counters[KvStatLockAcquisitions], 18);
+    EXPECT_GT(stats.Counters[KvStatLockHoldTime], 0);
+
+    // 同一进程的其他实例共用一个槽, 监控工具不打开 DB 也能读
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"SharedStats", options);
+    EXPECT_STREQ(other.Get(L"key_1"), L"value");
+    EXPECT_TRUE(other.Put(L"key_3", L"again")); // 新 key 用高水位以上的块, 删除的块还空着
+    KvStats shared;
+    ASSERT_EQ(MemoryKV::ReadStats(L"SharedStats", shared), KvOk);
+    EXPECT_EQ(shared.Counters[KvStatGets], 3);
+    EXPECT_EQ(shared.Counters[KvStatGetHits], 2);
+    EXPECT_EQ(shared.Counters[KvStatPuts], 17);
+    EXPECT_EQ(shared.LiveBlocks, 16);
+    EXPECT_EQ(shared.RemovedBlocks, 1);
+    EXPECT_EQ(shared.Processes, 1);
+    ASSERT_EQ(other.GetStats(stats, true), KvOk);
+    EXPECT_EQ(stats.Counters[KvStatPuts], 17);
+}
+
+// 延迟直方图: 分成等锁时间和持锁时间, 不记录的实例和监控工具也能读
+TEST_F(FunctionTest, LatencyHistograms) {
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 32;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    options.LatencyHistograms = 1;
+    kv->Open(L"LatencyHistograms", options);
+    for (int i = 0; i < 15; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    EXPECT_STREQ(kv->Get(L"key_0"), L"value"); // 无锁读
+    EXPECT_STREQ(kv->Get(L"missing"), L"");
+    kv->Remove(L"key_3");
+
+    LatencyHistogram histogram;
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyPut, KvLatencyLockWait, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 15);
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyPut, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 15);
+    EXPECT_GT(histogram.MaxValue, 0);
+    EXPECT_GT(histogram.ValueAtPercentile(99), 0);
+    EXPECT_LE(histogram.ValueAtPercentile(99), histogram.MaxValue);
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyGet, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 2);
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyGet, KvLatencyLockWait, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 1); // 无锁读没有等锁时间
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyRemove, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 1);
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyOpen, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 1);
+    ASSERT_EQ(kv->GetLatencyHistogram(KvLatencyExpand, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 2);
+    EXPECT_EQ(kv->GetLatencyHistogram(KvLatencyOpCount, KvLatencyInLock, histogram), KvInvalidArgument);
+
+    // 没开直方图的实例不记录, 但能读到别的实例记录的
+    options.LatencyHistograms = 0;
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"LatencyHistograms", options);
+    EXPECT_TRUE(other.Put(L"key_15", L"value"));
+    ASSERT_EQ(other.GetLatencyHistogram(KvLatencyPut, KvLatencyInLock, histogram), KvOk);
+    EXPECT_EQ(histogram.TotalCount, 15);
+    LatencyHistogram shared;
+    ASSERT_EQ(MemoryKV::ReadLatencyHistogram(L"LatencyHistograms", KvLatencyPut, KvLatencyInLock, shared), KvOk);
+    EXPECT_EQ(shared.TotalCount, 15);
+    shared.Merge(histogram);
+    EXPECT_EQ(shared.TotalCount, 30);
+    EXPECT_EQ(MemoryKV::ReadLatencyHistogram(L"NoLatencyHistograms", KvLatencyPut, KvLatencyInLock, shared), KvNotFound);
+}
+
+// 只读挂载: 不拿锁也不写, 按块读出 key 和值的文本形式
+TEST_F(FunctionTest, Inspector) {
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 64;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    options.Compression = KvCompressionLz;
+    options.CompressionThreshold = 32;
+    options.Dedup = 1;
+    options.DedupThreshold = 300;
+    KvInspector inspector;
+    EXPECT_EQ(inspector.Attach(L"Inspector"), KvNotFound); // 没有进程打开这个 DB
+
+    kv->Open(L"Inspector", options);
+    for (int i = 0; i < 12; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value_" + std::to_wstring(i)));
+    }
+    kv->Remove(L"key_3");
+    EXPECT_EQ(kv->PutNumber(L"n", 42), KvOk);
+    EXPECT_EQ(kv->PutDouble(L"d", 0.5), KvOk);
+    std::wstring packed(200, L'x');
+    EXPECT_TRUE(kv->Put(L"packed", packed)); // 压缩后才放得下
+    std::wstring shared(400, L'y');
+    EXPECT_TRUE(kv->Put(L"pooled", shared)); // 值在 ValuePool 的段里
+    EXPECT_TRUE(kv->Put(L"short_lived", L"gone", 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // 大小从 DB 的头里读, 不用再传选项
+    ASSERT_EQ(inspector.Attach(L"Inspector"), KvOk);
+    EXPECT_EQ(inspector.GetSizes().MaxKeySize, 16);
+    EXPECT_EQ(inspector.GetSizes().MaxValueSize, 64);
+    EXPECT_EQ(inspector.GetSizes().MaxBlocksPerMmf, 10);
+    EXPECT_EQ(inspector.GetSizes().MaxMmfCount, 10);
+    EXPECT_EQ(inspector.GetMmfCount(), 2);
+    EXPECT_EQ(inspector.GetHighestPosition(), 16);
+    std::map<std::wstring, KvInspectedBlock> found;
+    int freeBlocks = 0;
+    for (long position = 0; position <= inspector.GetHighestPosition(); ++position) {
+        KvInspectedBlock block;
+        ASSERT_EQ(inspector.ReadBlock(position, block), KvOk);
+        EXPECT_EQ(block.Position, position);
+        if (block.State == KvInspectedFree)
+            freeBlocks++;
+        else
+            found[block.Key] = block;
+    }
+    EXPECT_EQ(freeBlocks, 1);
+    EXPECT_EQ(found.size(), 16u);
+    EXPECT_EQ(found[L"key_7"].State, KvInspectedLive);
+    EXPECT_EQ(found[L"key_7"].Value, L"value_7");
+    EXPECT_EQ(found[L"n"].ValueType, KvValueInt64);
+    EXPECT_EQ(found[L"n"].Value, L"42");
+    EXPECT_EQ(found[L"d"].Value, L"0.5");
+    EXPECT_EQ(found[L"packed"].ValueType, KvValueCompressed);
+    EXPECT_EQ(found[L"packed"].Value, packed);
+    EXPECT_EQ(found[L"pooled"].ValueType, KvValuePooled);
+    EXPECT_EQ(found[L"pooled"].Value, shared);
+    EXPECT_EQ(found[L"short_lived"].State, KvInspectedExpired);
+    KvInspectedBlock block;
+    EXPECT_EQ(inspector.ReadBlock(20, block), KvNotFound);
+
+    // 新加的 MMF 在下次 GetMmfCount 时映射
+    for (int i = 12; i < 20; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    EXPECT_EQ(inspector.GetMmfCount(), 3);
+    ASSERT_EQ(inspector.ReadBlock(20, block), KvOk);
+    EXPECT_EQ(block.State, KvInspectedLive);
+    EXPECT_STREQ(kv->Get(L"key_7"), L"value_7");
+}
+
+// 热点 key: 采样的 Put/Get 进共享的 count-min sketch, 堆里留估计值最高的 key
+TEST_F(FunctionTest, HotKeys) {
+    KvHotKey keys[HOT_KEY_COUNT];
+    int count = -1;
+    EXPECT_EQ(kv->GetHotKeys(keys, HOT_KEY_COUNT, &count), KvNotInitialized);
+    EXPECT_EQ(MemoryKV::ReadHotKeys(L"HotKeys", keys, HOT_KEY_COUNT, &count), KvNotFound);
+
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 32;
+    options.MaxBlocksPerMmf = 100;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    options.HotKeySampling = 1;
+    kv->Open(L"HotKeys", options);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(kv->Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    for (int i = 0; i < 500; ++i) {
+        kv->Get(L"hot");
+        if (i % 5 == 0)
+            kv->Get(L"key_7");
+    }
+    EXPECT_EQ(kv->PutNumber(L"hot", 1), KvOk);
+
+    ASSERT_EQ(kv->GetHotKeys(keys, HOT_KEY_COUNT, &count), KvOk);
+    EXPECT_EQ(count, HOT_KEY_COUNT);
+    EXPECT_STREQ(keys[0].Key, L"hot");
+    EXPECT_GE(keys[0].Count, 501); // count-min 只会高估
+    EXPECT_STREQ(keys[1].Key, L"key_7");
+    EXPECT_GE(keys[1].Count, 101);
+    EXPECT_LT(keys[1].Count, keys[0].Count);
+    for (int i = 2; i < count; ++i) {
+        EXPECT_LE(keys[i].Count, keys[i - 1].Count);
+    }
+    ASSERT_EQ(kv->GetHotKeys(keys, 1, &count), KvOk);
+    EXPECT_EQ(count, 1);
+    EXPECT_EQ(kv->GetHotKeys(nullptr, 1, &count), KvInvalidArgument);
+
+    // 不采样的实例和监控工具读同一个 sketch, 采样率 N 的实例每个样本记 N 次
+    options.HotKeySampling = 0;
+    MemoryKV other(L"other", std::make_unique<MockLogger>(true));
+    other.Open(L"HotKeys", options);
+    ASSERT_EQ(other.GetHotKeys(keys, HOT_KEY_COUNT, &count), KvOk);
+    EXPECT_STREQ(keys[0].Key, L"hot");
+    options.HotKeySampling = 4;
+    MemoryKV sampled(L"sampled", std::make_unique<MockLogger>(true));
+    sampled.Open(L"HotKeys", options);
+    for (int i = 0; i < 2000; ++i) {
+        sampled.Get(L"key_9");
+    }
+    ASSERT_EQ(MemoryKV::ReadHotKeys(L"HotKeys", keys, HOT_KEY_COUNT, &count), KvOk);
+    EXPECT_STREQ(keys[0].Key, L"key_9");
+    EXPECT_GE(keys[0].Count, 2000);
+    EXPECT_LT(keys[0].Count, 2100);
+
+    // 没拿到锁时到期的衰减不丢, 留给下一个拿到锁的线程
+    HANDLE hMapFile = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, L"Global\\MMFHotKeys_HotKeys");
+    ASSERT_NE(hMapFile, nullptr);
+    auto pPage = static_cast<HotKeyPage*>(MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(HotKeyPage)));
+    ASSERT_NE(pPage, nullptr);
+    pPage->Lock = static_cast<LONG>(GetCurrentProcessId()); // 本进程的另一个线程拿着锁
+    pPage->Samples = HOT_KEY_DECAY_SAMPLES - 1;
+    kv->Get(L"key_9");
+    kv->Get(L"key_9");
+    EXPECT_EQ(pPage->PendingDecays, 1);
+
+    // 拿着锁的进程死了, 下一个样本接手它改到一半的堆
+    pPage->Lock = 0x7FFFFFF0;
+    InterlockedIncrement(&pPage->Version);
+    kv->Get(L"key_9");
+    EXPECT_EQ(pPage->Lock, 0);
+    EXPECT_EQ(pPage->PendingDecays, 0);
+    EXPECT_EQ(pPage->Version & 1, 0);
+    ASSERT_EQ(MemoryKV::ReadHotKeys(L"HotKeys", keys, HOT_KEY_COUNT, &count), KvOk);
+    EXPECT_STREQ(keys[0].Key, L"key_9");
+    EXPECT_GE(keys[0].Count, 1000); // 减半了
+    EXPECT_LT(keys[0].Count, 1060);
+    UnmapViewOfFile(pPage);
+    CloseHandle(hMapFile);
+}
+
+// 跟踪: 持锁的操作, 刷新索引, 同步, 扩容和日志记进共享的环, 导出成 Chrome trace JSON, 每个 B 都有对应的 E
+TEST_F(FunctionTest, TraceExport) {
+    EXPECT_EQ(MemoryKV::WriteTrace(L"TraceExport", L"TraceExport.json", 1000), KvNotFound);
+
+    ConfigOptions options;
+    options.MaxKeySize = 16;
+    options.MaxValueSize = 32;
+    options.MaxBlocksPerMmf = 10;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 1;
+    options.Tracing = 1;
+    kv->Open(L"TraceExport", options);
+    EXPECT_EQ(MemoryKV::WriteTrace(L"TraceExport", L"TraceExport.json", 0), KvInvalidArgument);
+
+    // 不跟踪的实例扩容, 跟踪的实例查找新 key 时刷新索引并同步新的 MMF
+    options.Tracing = 0;
+    MemoryKV other(L"other", std::make_unique<MockLogger>());
+    other.Open(L"TraceExport", options);
+    for (int i = 0; i < 25; ++i) {
+        EXPECT_TRUE(other.Put(L"key_" + std::to_wstring(i), L"value"));
+    }
+    EXPECT_STREQ(kv->Get(L"key_24"), L"value");
+    EXPECT_TRUE(kv->Put(L"mine", L"value"));
+
+    ASSERT_EQ(MemoryKV::WriteTrace(L"TraceExport", L"TraceExport.json", 60000), KvOk);
+    FILE* file = nullptr;
+    ASSERT_EQ(_wfopen_s(&file, L"TraceExport.json", L"rb"), 0);
+    std::string json;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        json.append(buffer, read);
+    fclose(file);
+    _wremove(L"TraceExport.json");
+
+    EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0u);
+    EXPECT_NE(json.find("\"name\":\"LockHeld\",\"ph\":\"B\""), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"op\":\"Open\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"op\":\"Get\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"op\":\"Put\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"RefreshGlobalDbIndex\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"SyncDataBlocks\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"Log\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"ExpandDataBlock\""), std::string::npos); // Open 建第一个 MMF
+    size_t begins = 0;
+    size_t ends = 0;
+    for (size_t at = json.find("\"ph\":\"B\""); at != std::string::npos; at = json.find("\"ph\":\"B\"", at + 1))
+        begins++;
+    for (size_t at = json.find("\"ph\":\"E\""); at != std::string::npos; at = json.find("\"ph\":\"E\"", at + 1))
+        ends++;
+    EXPECT_GT(begins, 0u);
+    EXPECT_EQ(begins, ends);
+}
+
+// 约 1000 字符的 JSON 值: 原样存需要 1024 的值区, 压缩后 256 就够, 对比占用和 Put/Get 耗时, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_CompressedValueFootprint) {
+    const int key_count = 50000;
+    const wchar_t* names[] = { L"plain", L"lz" };
+    for (int compressed = 0; compressed <= 1; ++compressed) {
+        ConfigOptions options;
+        options.MaxKeySize = 32;
+        options.MaxValueSize = compressed ? 256 : 1024;
+        options.MaxBlocksPerMmf = 10000;
+        options.MaxMmfCount = 10;
+        options.LogLevel = 0;
+        options.Compression = compressed ? KvCompressionLz : KvCompressionNone;
+
+        MemoryKV instance(L"test_compression", std::make_unique<MockLogger>());
+        instance.Open(compressed ? L"CompressedFootprintLz" : L"CompressedFootprintPlain", options);
+        std::vector<std::wstring> values;
+        for (int i = 0; i < key_count; ++i) {
+            values.push_back(JsonTestValue(i, 30));
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < key_count; ++i) {
+            instance.Put(L"key_" + std::to_wstring(i), values[i]);
+        }
+        double put_ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < key_count; ++i) {
+            instance.Get(L"key_" + std::to_wstring(i));
+        }
+        double get_ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+        long long block_bytes = (options.MaxKeySize + options.MaxValueSize) * static_cast<long long>(sizeof(wchar_t));
+        std::wcout << names[compressed] << L": value length=" << values[0].size()
+            << L", data MB=" << block_bytes * key_count / (1024.0 * 1024)
+            << L", Put " << put_ns / key_count << L" ns, Get " << get_ns / key_count << L" ns" << std::endl;
+    }
+}
+
+// 10 万个 key 只有 100 种约 1000 字符的值: 原样存需要 1024 的值区, 去重后只存 100 份, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_DedupFootprint) {
+    const int key_count = 100000;
+    const int distinct_count = 100;
+    const wchar_t* names[] = { L"plain", L"dedup" };
+    std::vector<std::wstring> values;
+    for (int i = 0; i < distinct_count; ++i) {
+        values.push_back(JsonTestValue(i, 30));
+    }
+    for (int dedup = 0; dedup <= 1; ++dedup) {
+        ConfigOptions options;
+        options.MaxKeySize = 32;
+        options.MaxValueSize = dedup ? 16 : 1024;
+        options.MaxBlocksPerMmf = 10000;
+        options.MaxMmfCount = 20;
+        options.LogLevel = 0;
+        options.Dedup = dedup;
+
+        MemoryKV instance(L"test_dedup", std::make_unique<MockLogger>());
+        instance.Open(dedup ? L"DedupFootprintPool" : L"DedupFootprintPlain", options);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < key_count; ++i) {
+            instance.Put(L"key_" + std::to_wstring(i), values[i % distinct_count]);
+        }
+        double put_ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < key_count; ++i) {
+            instance.Get(L"key_" + std::to_wstring(i));
+        }
+        double get_ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+        long long pool_bytes = 0;
+        instance.GetValuePoolStats(nullptr, nullptr, &pool_bytes);
+        long long block_bytes = (options.MaxKeySize + options.MaxValueSize) * static_cast<long long>(sizeof(wchar_t));
+        std::wcout << names[dedup] << L": value length=" << values[0].size()
+            << L", data MB=" << (block_bytes * key_count + pool_bytes) / (1024.0 * 1024)
+            << L", Put " << put_ns / key_count << L" ns, Get " << get_ns / key_count << L" ns" << std::endl;
+    }
+}
+
+// 热值和冷值的 Get 耗时, 以及一轮 tiering 的耗时, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_TieredGetLatency) {
+    ConfigOptions options;
+    options.MaxKeySize = 32;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    options.Tiering = 1;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+
+    const int key_count = 200000;
+    {
+        MemoryKV instance(L"test_tiering", std::make_unique<MockLogger>());
+        instance.Open(L"TieredGetLatency", options);
+        for (int i = 0; i < key_count; ++i) {
+            instance.Put(L"key_" + std::to_wstring(i), std::wstring(100, L'v'));
+        }
+        instance.RebalanceTiers();
+        for (int i = 0; i < key_count / 2; ++i) { // 前一半保持热
+            instance.Get(L"key_" + std::to_wstring(i));
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        int demoted = 0;
+        int promoted = 0;
+        instance.RebalanceTiers(&demoted, &promoted);
+        double pass_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::wcout << L"tiering pass over " << key_count << L" keys: " << pass_ms << L" ms, demoted=" << demoted << std::endl;
+
+        const wchar_t* names[] = { L"hot", L"cold" };
+        for (int cold = 0; cold <= 1; ++cold) {
+            start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < key_count / 2; ++i) {
+                instance.Get(L"key_" + std::to_wstring(cold * key_count / 2 + i));
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+            std::wcout << names[cold] << L" Get: " << ns / (key_count / 2) << L" ns" << std::endl;
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        _wremove((L".\\TieredGetLatency_cold_" + std::to_wstring(i) + L".seg").c_str());
+    }
+}
+
+// 文件映射的 DB 重新打开的耗时和日志重放对比, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_FileBackedReattachTime) {
+    ConfigOptions options;
+    options.MaxKeySize = 32;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+
+    const int key_count = 500000;
+    std::wstring value(100, L'v');
+    const wchar_t* names[] = { L"segment files", L"log replay" };
+    for (int file_backed = 1; file_backed >= 0; --file_backed) {
+        options.Storage = file_backed ? KvStorageFile : KvStorageMemory;
+        options.Durability = file_backed ? KvDurabilityNone : KvDurabilityAsync;
+        std::wstring db_name = L"FileBackedReattachTime_" + std::to_wstring(file_backed);
+        RemoveSegmentFiles(db_name, options.MaxMmfCount);
+        _wremove((L".\\" + db_name + L".wal").c_str());
+        {
+            MemoryKV writer(L"writer", std::make_unique<MockLogger>());
+            writer.Open(db_name.c_str(), options);
+            for (int i = 0; i < key_count; ++i) {
+                writer.Put(L"key_" + std::to_wstring(i), value);
+            }
+            writer.Flush();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        MemoryKV reader(L"reader", std::make_unique<MockLogger>());
+        reader.Open(db_name.c_str(), options);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        EXPECT_STREQ(reader.Get(L"key_" + std::to_wstring(key_count - 1)), value.c_str());
+        std::wcout << L"reopen " << key_count << L" keys from " << names[1 - file_backed] << L": " << seconds * 1000 << L" ms" << std::endl;
+        RemoveSegmentFiles(db_name, options.MaxMmfCount);
+        _wremove((L".\\" + db_name + L".wal").c_str());
+    }
+}
+
+// 各种 durability 下多线程 Put 的吞吐量和每次 flush 覆盖的记录数, 用 --gtest_also_run_disabled_tests 运行
+TEST_F(FunctionTest, DISABLED_WriteAheadLogThroughput) {
+    ConfigOptions options;
+    options.MaxKeySize = 32;
+    options.MaxValueSize = 128;
+    options.MaxBlocksPerMmf = 100000;
+    options.MaxMmfCount = 10;
+    options.LogLevel = 0;
+    wcscpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, L".");
+
+    const int puts_per_thread = 2000;
+    std::wstring value(100, L'v');
+    const wchar_t* mode_names[] = { L"None", L"Sync", L"Async", L"Periodic" };
+    for (int mode = KvDurabilityNone; mode <= KvDurabilityPeriodic; ++mode) {
+        for (int thread_count = 1; thread_count <= 16; thread_count *= 4) {
+            options.Durability = mode;
+            std::wstring db_name = L"WriteAheadLogThroughput_" + std::to_wstring(mode) + L"_" + std::to_wstring(thread_count);
+            std::wstring wal_path = L".\\" + db_name + L".wal";
+            _wremove(wal_path.c_str());
+
+            MemoryKV instance(L"test_wal", std::make_unique<MockLogger>());
+            instance.Open(db_name.c_str(), options);
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&instance, &value, t]() {
+                    for (int i = 0; i < puts_per_thread; ++i) {
+                        instance.Put(L"key_" + std::to_wstring(t) + L"_" + std::to_wstring(i), value);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            long long records = 0;
+            long long flushes = 0;
+            instance.GetLogStats(&records, &flushes);
+            std::wcout << L"Durability=" << mode_names[mode] << L" threads=" << thread_count
+                << L": " << static_cast<long long>(thread_count * puts_per_thread / seconds) << L" puts/s"
+                << L", records=" << records << L", flushes=" << flushes
+                << L", records per flush=" << (flushes > 0 ? static_cast<double>(records) / flushes : 0) << std::endl;
+            _wremove(wal_path.c_str());
+        }
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
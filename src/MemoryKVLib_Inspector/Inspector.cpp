@@ -0,0 +1,399 @@
+// Inspector.cpp : looks into a DB other processes have open, read-only: no DB mutex, nothing written, so it's safe
+// against a busy production DB. top prints the shared counters as rates, dump streams every key and value, scan the
+// keys matching a wildcard pattern, segments the occupancy of each data block MMF, hot the most accessed keys, trace
+// the recent phases of the traced instances as Chrome trace event JSON
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+#include "../MemoryKVLib/KvInspector.h"
+#include "../MemoryKVLib/MemoryKV.h"
+
+enum InspectorMode
+{
+    InspectTop = 0,
+    InspectDump = 1,
+    InspectScan = 2,
+    InspectSegments = 3,
+    InspectHot = 4,
+    InspectTrace = 5,
+    InspectModeCount = 6
+};
+
+static const wchar_t* ModeNames[InspectModeCount] = { L"top", L"dump", L"scan", L"segments", L"hot", L"trace" };
+
+struct InspectorSettings
+{
+    InspectorMode Mode = InspectTop;
+    std::wstring DbName;
+    int BlocksPerMmf = 0; // the sizes the DB was created with, from its header once attached
+    int MaxMmfCount = 0;
+    int IntervalMs = 1000; // top
+    int Rows = 0; // top, 0 until Ctrl+C
+    std::wstring Pattern = L"*"; // scan, * for any characters and ? for one
+    int Limit = 0; // dump, scan and hot, 0 for all keys
+    int MapWidth = 64; // segments, cells per MMF
+    int TraceMs = 5000; // trace, the window before now
+    std::wstring TracePath = L"trace.json"; // trace
+};
+
+static bool ParseSettings(int argc, wchar_t* argv[], InspectorSettings& settings)
+{
+    if (argc < 2)
+        return false;
+    int mode = 0;
+    while (mode < InspectModeCount && argv[1] != std::wstring(ModeNames[mode]))
+        mode++;
+    if (mode == InspectModeCount)
+        return false;
+    settings.Mode = static_cast<InspectorMode>(mode);
+    try {
+        for (int i = 2; i + 1 < argc; i += 2)
+        {
+            std::wstring flag = argv[i];
+            std::wstring value = argv[i + 1];
+            if (flag == L"-n") settings.DbName = value;
+            else if (flag == L"-i") settings.IntervalMs = std::stoi(value);
+            else if (flag == L"-c") settings.Rows = std::stoi(value);
+            else if (flag == L"-p") settings.Pattern = value;
+            else if (flag == L"-l") settings.Limit = std::stoi(value);
+            else if (flag == L"-w") settings.MapWidth = std::stoi(value);
+            else if (flag == L"-t") settings.TraceMs = std::stoi(value);
+            else if (flag == L"-f") settings.TracePath = value;
+            else return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return argc % 2 == 0 && !settings.DbName.empty() && settings.IntervalMs >= 1 && settings.Rows >= 0
+        && settings.Limit >= 0 && settings.MapWidth >= 1 && settings.TraceMs >= 1 && !settings.TracePath.empty();
+}
+
+/**
+ * \brief * matches any characters, ? one. backtracks to the last * only, so it's linear in practice
+ */
+static bool MatchPattern(const std::wstring& pattern, const std::wstring& text)
+{
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = std::wstring::npos;
+    size_t resume = 0;
+    while (t < text.size())
+    {
+        if (p < pattern.size() && (pattern[p] == L'?' || pattern[p] == text[t]))
+        {
+            p++;
+            t++;
+        }
+        else if (p < pattern.size() && pattern[p] == L'*')
+        {
+            star = p++;
+            resume = t;
+        }
+        else if (star != std::wstring::npos)
+        {
+            p = star + 1;
+            t = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == L'*')
+        p++;
+    return p == pattern.size();
+}
+
+/**
+ * \brief the blocks below the high-water mark in the mapped MMFs, the ones above it were never written
+ */
+static long UsedBlocks(KvInspector& inspector, const InspectorSettings& settings)
+{
+    long mapped = static_cast<long>(inspector.GetMmfCount()) * settings.BlocksPerMmf;
+    long used = inspector.GetHighestPosition() + 1;
+    return used < mapped ? used : mapped;
+}
+
+static double Rate(LONGLONG delta, double seconds)
+{
+    return seconds <= 0 ? 0 : delta / seconds;
+}
+
+/**
+ * \brief a row per interval like vmstat, the rates are the differences of the stats page between two reads
+ */
+static int RunTop(KvInspector& inspector, const InspectorSettings& settings)
+{
+    KvStats previous;
+    if (MemoryKV::ReadStats(settings.DbName.c_str(), previous) != KvOk)
+    {
+        std::wcerr << L"no process has the stats page of " << settings.DbName << L" open" << std::endl;
+        return 1;
+    }
+    LONGLONG capacity = static_cast<LONGLONG>(settings.MaxMmfCount) * settings.BlocksPerMmf;
+    std::wcout << L"db=" << settings.DbName << L", every " << settings.IntervalMs << L" ms, lock wait in us per acquisition,"
+        << L" hold% the share of the interval some process held the mutex" << std::endl;
+    std::wcout << std::setw(6) << L"procs" << std::setw(10) << L"get/s" << std::setw(7) << L"hit%" << std::setw(10) << L"put/s"
+        << std::setw(9) << L"rm/s" << std::setw(9) << L"other/s" << std::setw(9) << L"refr/s" << std::setw(10) << L"lock/s"
+        << std::setw(7) << L"cont%" << std::setw(8) << L"wait" << std::setw(7) << L"hold%" << std::setw(11) << L"live"
+        << std::setw(9) << L"removed" << std::setw(7) << L"fill%" << std::setw(6) << L"mmfs" << std::endl;
+    std::wcout << std::fixed << std::setprecision(1);
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER last;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&last);
+    for (int row = 0; settings.Rows == 0 || row < settings.Rows; row++)
+    {
+        Sleep(settings.IntervalMs);
+        KvStats stats;
+        if (MemoryKV::ReadStats(settings.DbName.c_str(), stats) != KvOk)
+        {
+            std::wcout << L"the DB was closed" << std::endl;
+            return 0;
+        }
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        double seconds = static_cast<double>(now.QuadPart - last.QuadPart) / frequency.QuadPart;
+        last = now;
+
+        LONGLONG delta[KvStatCount];
+        for (int i = 0; i < KvStatCount; i++)
+            delta[i] = stats.Counters[i] - previous.Counters[i];
+        previous = stats;
+        LONGLONG gets = delta[KvStatGets];
+        LONGLONG acquisitions = delta[KvStatLockAcquisitions];
+        std::wcout << std::setw(6) << stats.Processes << std::setw(10) << Rate(gets, seconds)
+            << std::setw(7) << (gets == 0 ? 0 : 100.0 * delta[KvStatGetHits] / gets)
+            << std::setw(10) << Rate(delta[KvStatPuts], seconds) << std::setw(9) << Rate(delta[KvStatRemoves], seconds)
+            << std::setw(9) << Rate(delta[KvStatScans] + delta[KvStatNumerics] + delta[KvStatMerges], seconds)
+            << std::setw(9) << Rate(delta[KvStatRefreshes], seconds) << std::setw(10) << Rate(acquisitions, seconds)
+            << std::setw(7) << (acquisitions == 0 ? 0 : 100.0 * delta[KvStatLockContentions] / acquisitions)
+            << std::setw(8) << (acquisitions == 0 ? 0 : delta[KvStatLockWaitTime] / 1000.0 / acquisitions)
+            << std::setw(7) << delta[KvStatLockHoldTime] / 1e7 / seconds
+            << std::setw(11) << stats.LiveBlocks << std::setw(9) << stats.RemovedBlocks
+            << std::setw(7) << 100.0 * stats.LiveBlocks / capacity << std::setw(6) << inspector.GetMmfCount() << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * \brief key TAB value per line, in block order. the expired keys Get doesn't return are left out
+ */
+static int RunDump(KvInspector& inspector, const InspectorSettings& settings, bool filter)
+{
+    long used = UsedBlocks(inspector, settings);
+    int printed = 0;
+    int busy = 0;
+    KvInspectedBlock block;
+    for (long position = 0; position < used && (settings.Limit == 0 || printed < settings.Limit); position++)
+    {
+        inspector.ReadBlock(position, block);
+        if (block.State == KvInspectedBusy)
+            busy++;
+        if (block.State != KvInspectedLive || (filter && !MatchPattern(settings.Pattern, block.Key)))
+            continue;
+        std::wcout << block.Key << L'\t' << block.Value << L'\n';
+        printed++;
+    }
+    std::wcout.flush();
+    std::wcerr << printed << L" keys";
+    if (busy > 0)
+        std::wcerr << L", " << busy << L" blocks skipped, a writer kept changing them";
+    std::wcerr << std::endl;
+    return 0;
+}
+
+/**
+ * \brief counts of one MMF, and a map of MapWidth cells over its blocks
+ */
+struct SegmentRow
+{
+    long Live = 0;
+    long Expired = 0;
+    long Free = 0;
+    long Busy = 0;
+    long Headroom = 0;
+    std::wstring Map;
+};
+
+/**
+ * \brief # every used block of the cell live, + most, . some, _ none: removed blocks not reused yet. a blank cell
+ * was never used
+ */
+static wchar_t MapCell(long live, long used)
+{
+    if (used == 0)
+        return L' ';
+    if (live == used)
+        return L'#';
+    if (live * 2 >= used)
+        return L'+';
+    return live > 0 ? L'.' : L'_';
+}
+
+static SegmentRow ReadSegment(KvInspector& inspector, const InspectorSettings& settings, int mmfIndex, long used)
+{
+    SegmentRow row;
+    int width = settings.MapWidth < settings.BlocksPerMmf ? settings.MapWidth : settings.BlocksPerMmf;
+    KvInspectedBlock block;
+    for (int cell = 0; cell < width; cell++)
+    {
+        long first = static_cast<long>(static_cast<LONGLONG>(settings.BlocksPerMmf) * cell / width);
+        long last = static_cast<long>(static_cast<LONGLONG>(settings.BlocksPerMmf) * (cell + 1) / width);
+        long cellLive = 0;
+        long cellUsed = 0;
+        for (long i = first; i < last; i++)
+        {
+            long position = static_cast<long>(mmfIndex) * settings.BlocksPerMmf + i;
+            if (position >= used)
+            {
+                row.Headroom++;
+                continue;
+            }
+            cellUsed++;
+            inspector.ReadBlock(position, block);
+            switch (block.State)
+            {
+            case KvInspectedLive: row.Live++; cellLive++; break;
+            case KvInspectedExpired: row.Expired++; cellLive++; break; // still takes the block
+            case KvInspectedBusy: row.Busy++; cellLive++; break;
+            default: row.Free++; break;
+            }
+        }
+        row.Map += MapCell(cellLive, cellUsed);
+    }
+    return row;
+}
+
+static void PrintSegment(const std::wstring& name, const SegmentRow& row)
+{
+    long used = row.Live + row.Expired + row.Free + row.Busy;
+    std::wcout << std::setw(6) << name << std::setw(9) << row.Live << std::setw(9) << row.Expired << std::setw(9) << row.Free
+        << std::setw(9) << row.Headroom << std::setw(7) << (used == 0 ? 0 : 100.0 * row.Free / used);
+    if (!row.Map.empty())
+        std::wcout << L"  |" << row.Map << L"|";
+    std::wcout << std::endl;
+}
+
+/**
+ * \brief per MMF: live, expired and removed blocks, the headroom above the high-water mark and frag%, the removed
+ * share of the used blocks. Put takes new blocks above the mark, the removed ones only come back with eviction
+ */
+static int RunSegments(KvInspector& inspector, const InspectorSettings& settings)
+{
+    int mmfCount = inspector.GetMmfCount();
+    long used = UsedBlocks(inspector, settings);
+    std::wcout << L"db=" << settings.DbName << L", " << mmfCount << L" of " << settings.MaxMmfCount << L" MMFs, "
+        << settings.BlocksPerMmf << L" blocks each, map: # live, + mostly live, . partly live, _ removed, blank never used"
+        << std::endl;
+    std::wcout << std::setw(6) << L"mmf" << std::setw(9) << L"live" << std::setw(9) << L"expired" << std::setw(9) << L"removed"
+        << std::setw(9) << L"headroom" << std::setw(7) << L"frag%" << std::endl;
+    std::wcout << std::fixed << std::setprecision(1);
+    SegmentRow total;
+    for (int i = 0; i < mmfCount; i++)
+    {
+        SegmentRow row = ReadSegment(inspector, settings, i, used);
+        PrintSegment(std::to_wstring(i), row);
+        total.Live += row.Live;
+        total.Expired += row.Expired;
+        total.Free += row.Free;
+        total.Busy += row.Busy;
+        total.Headroom += row.Headroom;
+    }
+    PrintSegment(L"all", total);
+    if (total.Busy > 0)
+        std::wcout << total.Busy << L" blocks were being written, counted as live" << std::endl;
+    return 0;
+}
+
+/**
+ * \brief the top keys of the hot key sketch, fed by the instances opened with ConfigOptions::HotKeySampling
+ */
+static int RunHot(const InspectorSettings& settings)
+{
+    KvHotKey keys[HOT_KEY_COUNT];
+    int count;
+    int capacity = settings.Limit == 0 || settings.Limit > HOT_KEY_COUNT ? HOT_KEY_COUNT : settings.Limit;
+    if (MemoryKV::ReadHotKeys(settings.DbName.c_str(), keys, capacity, &count) != KvOk)
+    {
+        std::wcerr << L"no process samples the keys of " << settings.DbName << L", open it with HotKeySampling" << std::endl;
+        return 1;
+    }
+    std::wcout << L"db=" << settings.DbName << L", estimated Puts and Gets, halved every "
+        << HOT_KEY_DECAY_SAMPLES << L" samples" << std::endl;
+    std::wcout << std::setw(5) << L"rank" << std::setw(14) << L"count" << L"  key" << std::endl;
+    for (int i = 0; i < count; i++)
+        std::wcout << std::setw(5) << i + 1 << std::setw(14) << keys[i].Count << L"  " << keys[i].Key << std::endl;
+    return 0;
+}
+
+/**
+ * \brief the phases recorded by the instances opened with ConfigOptions::Tracing, run it right after a stall
+ */
+static int RunTrace(const InspectorSettings& settings)
+{
+    KvStatus status = MemoryKV::WriteTrace(settings.DbName.c_str(), settings.TracePath.c_str(), settings.TraceMs);
+    if (status == KvNotFound)
+    {
+        std::wcerr << L"no process traces " << settings.DbName << L", open it with Tracing" << std::endl;
+        return 1;
+    }
+    if (status != KvOk)
+    {
+        std::wcerr << L"failed to write " << settings.TracePath << std::endl;
+        return 1;
+    }
+    std::wcout << L"the last " << settings.TraceMs << L" ms of " << settings.DbName << L" written to " << settings.TracePath
+        << L", open it in chrome://tracing or ui.perfetto.dev" << std::endl;
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    InspectorSettings settings;
+    if (!ParseSettings(argc, argv, settings))
+    {
+        std::wcout << L"usage: MemoryKVLib_Inspector top|dump|scan|segments|hot|trace -n db [-i top interval ms]"
+            << L" [-c top rows] [-p scan pattern with * and ?] [-l max keys]"
+            << L" [-w segment map width] [-t trace window ms] [-f trace file]" << std::endl;
+        return 1;
+    }
+
+    if (settings.Mode == InspectHot)
+        return RunHot(settings); // the page of the sketch only, the DB isn't attached
+    if (settings.Mode == InspectTrace)
+        return RunTrace(settings); // the trace ring only
+
+    KvInspector inspector;
+    KvStatus status = inspector.Attach(settings.DbName.c_str());
+    if (status == KvNotFound)
+    {
+        std::wcerr << L"no process has " << settings.DbName << L" open" << std::endl;
+        return 1;
+    }
+    if (status != KvOk)
+    {
+        std::wcerr << L"the header of " << settings.DbName << L" doesn't hold the sizes of its MMFs" << std::endl;
+        return 1;
+    }
+    HeaderSizes sizes = inspector.GetSizes();
+    settings.BlocksPerMmf = sizes.MaxBlocksPerMmf;
+    settings.MaxMmfCount = sizes.MaxMmfCount;
+    switch (settings.Mode)
+    {
+    case InspectTop:
+        return RunTop(inspector, settings);
+    case InspectDump:
+        return RunDump(inspector, settings, false);
+    case InspectScan:
+        return RunDump(inspector, settings, true);
+    default:
+        return RunSegments(inspector, settings);
+    }
+}
@@ -0,0 +1,268 @@
+// MemoryBenchmark.cpp : what a DB costs. loads keys and values of the given length distributions, then churns them
+// (removes a share of the live keys and puts as many new ones) and samples the memory after each round
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include <psapi.h>
+
+#include "../MemoryKVLib/MemoryKV.h"
+
+#define MB (1024.0 * 1024.0)
+
+enum LengthShape
+{
+    LengthUniform = 0, // every length in [min, max] alike
+    LengthExponential = 1 // mostly short, a long tail up to max, like most real key and value sizes
+};
+
+static const wchar_t* ShapeNames[] = { L"uniform", L"exponential" };
+
+/**
+ * \brief a length distribution: 100, or a range 16-64 of the given shape
+ */
+struct LengthSpec
+{
+    int Min;
+    int Max;
+
+    bool Parse(const std::wstring& text)
+    {
+        size_t dash = text.find(L'-');
+        Min = std::stoi(text.substr(0, dash));
+        Max = dash == std::wstring::npos ? Min : std::stoi(text.substr(dash + 1));
+        return Min >= 1 && Max >= Min;
+    }
+
+    template <class Random>
+    int Next(Random& gen, LengthShape shape) const
+    {
+        if (Min == Max)
+            return Min;
+        if (shape == LengthUniform)
+            return std::uniform_int_distribution<int>(Min, Max)(gen);
+        // mean at a quarter of the range, the draws past max are clamped
+        double length = Min + std::exponential_distribution<double>(4.0 / (Max - Min))(gen);
+        return length < Max ? static_cast<int>(length) : Max;
+    }
+};
+
+struct MemorySettings
+{
+    std::wstring DbName = L"MemoryBenchmark";
+    int KeyCount = 100000;
+    LengthSpec KeyLength = { 16, 16 };
+    LengthSpec ValueLength = { 100, 100 };
+    LengthShape Shape = LengthUniform;
+    int BlocksPerMmf = 10000;
+    int MaxMmfCount = 1000;
+    int ChurnRounds = 20;
+    int ChurnPercent = 10; // of the live keys removed and put again per round
+    std::wstring CsvPath;
+
+    ConfigOptions MakeOptions() const
+    {
+        ConfigOptions options;
+        options.MaxKeySize = KeyLength.Max + 1;
+        options.MaxValueSize = ValueLength.Max + 1;
+        options.MaxBlocksPerMmf = BlocksPerMmf;
+        options.MaxMmfCount = MaxMmfCount;
+        options.LogLevel = 0;
+        return options;
+    }
+};
+
+static bool ParseSettings(int argc, wchar_t* argv[], MemorySettings& settings)
+{
+    try {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::wstring flag = argv[i];
+            std::wstring value = argv[i + 1];
+            if (flag == L"-n") settings.DbName = value;
+            else if (flag == L"-k") settings.KeyCount = std::stoi(value);
+            else if (flag == L"-K") { if (!settings.KeyLength.Parse(value)) return false; }
+            else if (flag == L"-v") { if (!settings.ValueLength.Parse(value)) return false; }
+            else if (flag == L"-d")
+            {
+                if (value == ShapeNames[LengthUniform]) settings.Shape = LengthUniform;
+                else if (value == ShapeNames[LengthExponential]) settings.Shape = LengthExponential;
+                else return false;
+            }
+            else if (flag == L"-b") settings.BlocksPerMmf = std::stoi(value);
+            else if (flag == L"-m") settings.MaxMmfCount = std::stoi(value);
+            else if (flag == L"-c") settings.ChurnRounds = std::stoi(value);
+            else if (flag == L"-r") settings.ChurnPercent = std::stoi(value);
+            else if (flag == L"-o") settings.CsvPath = value;
+            else return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return settings.KeyCount >= 1 && settings.BlocksPerMmf >= 1 && settings.MaxMmfCount >= 1 && settings.ChurnRounds >= 0
+        && settings.ChurnPercent >= 0 && settings.ChurnPercent <= 100;
+}
+
+/**
+ * \brief the key number padded to the drawn length, so every key is unique whatever its length
+ */
+static std::wstring MakeKey(LONGLONG number, int length)
+{
+    std::wstring key = L"k" + std::to_wstring(number);
+    if (static_cast<int>(key.size()) < length)
+        key.append(length - key.size(), L'_');
+    return key;
+}
+
+/**
+ * \brief one point of the curve
+ */
+struct MemorySample
+{
+    std::wstring Phase;
+    KvMemoryStats Stats;
+    LONGLONG WorkingSetBytes; // RSS
+    LONGLONG PrivateBytes; // the heap of the process, the key index is most of it
+};
+
+static MemorySample TakeSample(MemoryKV& kv, const std::wstring& phase)
+{
+    MemorySample sample;
+    sample.Phase = phase;
+    kv.GetMemoryStats(sample.Stats);
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    counters.cb = sizeof(counters);
+    GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters));
+    sample.WorkingSetBytes = counters.WorkingSetSize;
+    sample.PrivateBytes = counters.PrivateUsage;
+    return sample;
+}
+
+/**
+ * \brief (padding + free blocks) / the blocks below the high-water mark, the headroom is capacity, not waste
+ */
+static double WasteRatio(const KvMemoryStats& stats)
+{
+    LONGLONG usedBlockBytes = stats.DataBytes - stats.HeadroomBytes;
+    return usedBlockBytes == 0 ? 0 : static_cast<double>(stats.PaddingBytes + stats.FreeBlockBytes) / usedBlockBytes;
+}
+
+static double BytesPerKey(const KvMemoryStats& stats)
+{
+    return stats.LiveKeys == 0 ? 0 : static_cast<double>(stats.SharedBytes + stats.IndexBytes) / stats.LiveKeys;
+}
+
+static void PrintSample(const MemorySample& sample)
+{
+    const KvMemoryStats& stats = sample.Stats;
+    std::wcout << std::setw(10) << sample.Phase << std::setw(10) << stats.LiveKeys << std::setw(9) << sample.WorkingSetBytes / MB
+        << std::setw(9) << sample.PrivateBytes / MB << std::setw(9) << stats.SharedBytes / MB << std::setw(9)
+        << stats.IndexBytes / MB << std::setw(10) << BytesPerKey(stats) << std::setw(10)
+        << (stats.LiveKeys == 0 ? 0 : static_cast<double>(stats.PayloadBytes) / stats.LiveKeys) << std::setw(8)
+        << WasteRatio(stats) * 100 << std::setw(9) << stats.FreeBlockBytes / MB << std::endl;
+}
+
+static void WriteSample(std::wostream& csv, const MemorySample& sample)
+{
+    const KvMemoryStats& stats = sample.Stats;
+    csv << sample.Phase << L"," << stats.LiveKeys << L"," << sample.WorkingSetBytes << L"," << sample.PrivateBytes << L","
+        << stats.SharedBytes << L"," << stats.DataBytes << L"," << stats.IndexBytes << L"," << stats.PayloadBytes << L","
+        << stats.PaddingBytes << L"," << stats.FreeBlockBytes << L"," << stats.HeadroomBytes << L"," << BytesPerKey(stats)
+        << L"," << WasteRatio(stats) << std::endl;
+}
+
+static int RunBenchmark(const MemorySettings& settings)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int> letter(L'a', L'z');
+    std::wstring text(settings.ValueLength.Max * 2, L' ');
+    for (auto& c : text)
+        c = static_cast<wchar_t>(letter(gen));
+    auto nextValue = [&]()
+    {
+        int length = settings.ValueLength.Next(gen, settings.Shape);
+        return text.substr(std::uniform_int_distribution<size_t>(0, text.size() - length)(gen), length);
+    };
+
+    std::vector<MemorySample> samples;
+    MemoryKV kv(L"memory_benchmark");
+    kv.Open(settings.DbName.c_str(), settings.MakeOptions());
+    samples.push_back(TakeSample(kv, L"empty"));
+
+    std::vector<std::wstring> liveKeys;
+    liveKeys.reserve(settings.KeyCount);
+    LONGLONG nextNumber = 0;
+    LONGLONG failures = 0;
+    for (int i = 0; i < settings.KeyCount; i++)
+    {
+        std::wstring key = MakeKey(nextNumber++, settings.KeyLength.Next(gen, settings.Shape));
+        if (kv.Put(key, nextValue()))
+            liveKeys.push_back(key);
+        else
+            failures++;
+    }
+    samples.push_back(TakeSample(kv, L"loaded"));
+
+    // each round removes random live keys and puts as many new ones, the key count stays the same
+    int churnCount = static_cast<int>(static_cast<LONGLONG>(settings.KeyCount) * settings.ChurnPercent / 100);
+    for (int round = 1; round <= settings.ChurnRounds; round++)
+    {
+        for (int i = 0; i < churnCount && !liveKeys.empty(); i++)
+        {
+            size_t victim = std::uniform_int_distribution<size_t>(0, liveKeys.size() - 1)(gen);
+            kv.Remove(liveKeys[victim]);
+            liveKeys[victim] = liveKeys.back();
+            liveKeys.pop_back();
+        }
+        for (int i = 0; i < churnCount; i++)
+        {
+            std::wstring key = MakeKey(nextNumber++, settings.KeyLength.Next(gen, settings.Shape));
+            if (kv.Put(key, nextValue()))
+                liveKeys.push_back(key);
+            else
+                failures++;
+        }
+        samples.push_back(TakeSample(kv, L"churn " + std::to_wstring(round)));
+    }
+
+    std::wcout << L"db=" << settings.DbName << L", keys=" << settings.KeyCount << L", key length " << settings.KeyLength.Min
+        << L"-" << settings.KeyLength.Max << L", value length " << settings.ValueLength.Min << L"-" << settings.ValueLength.Max
+        << L" " << ShapeNames[settings.Shape] << L", " << settings.BlocksPerMmf << L" blocks per MMF, churn "
+        << settings.ChurnPercent << L"% x " << settings.ChurnRounds << L", sizes in MB" << std::endl;
+    std::wcout << std::setw(10) << L"phase" << std::setw(10) << L"keys" << std::setw(9) << L"rss" << std::setw(9) << L"private"
+        << std::setw(9) << L"shared" << std::setw(9) << L"index" << std::setw(10) << L"bytes/key" << std::setw(10)
+        << L"payload" << std::setw(8) << L"waste%" << std::setw(9) << L"free" << std::endl;
+    std::wcout << std::fixed << std::setprecision(1);
+    for (const auto& sample : samples)
+        PrintSample(sample);
+    if (failures > 0)
+        std::wcout << failures << L" Puts failed, the DB is full, raise -m" << std::endl;
+
+    if (!settings.CsvPath.empty())
+    {
+        std::wofstream csv(settings.CsvPath);
+        csv << L"phase,live_keys,rss_bytes,private_bytes,shared_bytes,data_bytes,index_bytes,payload_bytes,padding_bytes,"
+            << L"free_block_bytes,headroom_bytes,bytes_per_key,waste_ratio" << std::endl;
+        for (const auto& sample : samples)
+            WriteSample(csv, sample);
+    }
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    MemorySettings settings;
+    if (!ParseSettings(argc, argv, settings))
+    {
+        std::wcout << L"usage: MemoryKVLib_Memory [-k keys] [-K key length, or a range min-max] [-v value length, or a range]"
+            << L" [-d uniform|exponential] [-b blocks per mmf] [-m max mmf count] [-c churn rounds] [-r churn % per round]"
+            << L" [-n db] [-o csv file]" << std::endl;
+        return 1;
+    }
+    return RunBenchmark(settings);
+}
@@ -0,0 +1,406 @@
+// Ycsb.cpp : the YCSB core workloads A-F against one DB, keys picked by a uniform, zipfian or latest distribution.
+// loads the records, runs a warm-up phase that isn't recorded, then prints the throughput and latency of the measure phase
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+#include "../MemoryKVLib/LatencyHistogram.h"
+#include "../MemoryKVLib/MemoryKV.h"
+#include "YcsbGenerators.h"
+
+enum YcsbOp
+{
+    YcsbRead = 0,
+    YcsbUpdate = 1,
+    YcsbInsert = 2,
+    YcsbScan = 3,
+    YcsbReadModifyWrite = 4,
+    YcsbOpCount = 5
+};
+
+static const wchar_t* OpNames[YcsbOpCount] = { L"read", L"update", L"insert", L"scan", L"rmw" };
+static const wchar_t* DistributionNames[] = { L"uniform", L"zipfian", L"latest" };
+
+/**
+ * \brief the operation mix in percent and the default distribution of a core workload
+ */
+struct YcsbWorkload
+{
+    wchar_t Name;
+    const wchar_t* Description;
+    int Mix[YcsbOpCount];
+    YcsbDistribution Distribution;
+};
+
+static const YcsbWorkload Workloads[] = {
+    { L'A', L"update heavy", { 50, 50, 0, 0, 0 }, YcsbZipfian },
+    { L'B', L"read mostly", { 95, 5, 0, 0, 0 }, YcsbZipfian },
+    { L'C', L"read only", { 100, 0, 0, 0, 0 }, YcsbZipfian },
+    { L'D', L"read latest", { 95, 0, 5, 0, 0 }, YcsbLatest },
+    { L'E', L"short ranges", { 0, 0, 5, 95, 0 }, YcsbZipfian },
+    { L'F', L"read-modify-write", { 50, 0, 0, 0, 50 }, YcsbZipfian },
+};
+
+enum YcsbPhase
+{
+    YcsbWarmUp = 0,
+    YcsbMeasure = 1,
+    YcsbStop = 2
+};
+
+struct YcsbSettings
+{
+    std::wstring DbName = L"YcsbWorkload";
+    const YcsbWorkload* Workload = &Workloads[0];
+    int Distribution = -1; // -1 for the default of the workload
+    double ZipfianConstant = YCSB_ZIPFIAN_CONSTANT;
+    int RecordCount = 100000;
+    int Threads = 1;
+    int MinValueLength = 100;
+    int MaxValueLength = 100;
+    int MaxScanLength = 100; // the scan length is uniform in [1, MaxScanLength]
+    int WarmUpSeconds = 2;
+    int MeasureSeconds = 10;
+    int MaxMmfCount = 1000;
+    std::wstring CsvPath;
+
+    YcsbDistribution GetDistribution() const
+    {
+        return Distribution < 0 ? Workload->Distribution : static_cast<YcsbDistribution>(Distribution);
+    }
+
+    ConfigOptions MakeOptions() const
+    {
+        ConfigOptions options;
+        options.MaxKeySize = 32; // L"user" and a hash of up to 19 digits
+        options.MaxValueSize = MaxValueLength + 1;
+        options.MaxBlocksPerMmf = 10000;
+        options.MaxMmfCount = MaxMmfCount;
+        options.OrderedIndex = Workload->Mix[YcsbScan] > 0;
+        options.LogLevel = 0;
+        return options;
+    }
+};
+
+static bool ParseSettings(int argc, wchar_t* argv[], YcsbSettings& settings)
+{
+    try {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::wstring flag = argv[i];
+            std::wstring value = argv[i + 1];
+            if (flag == L"-n") settings.DbName = value;
+            else if (flag == L"-w")
+            {
+                settings.Workload = nullptr;
+                for (const auto& workload : Workloads)
+                {
+                    if (value.size() == 1 && towupper(value[0]) == workload.Name)
+                        settings.Workload = &workload;
+                }
+                if (settings.Workload == nullptr)
+                    return false;
+            }
+            else if (flag == L"-d")
+            {
+                settings.Distribution = -1;
+                for (int d = 0; d < 3; d++)
+                {
+                    if (value == DistributionNames[d])
+                        settings.Distribution = d;
+                }
+                if (settings.Distribution < 0)
+                    return false;
+            }
+            else if (flag == L"-z") settings.ZipfianConstant = std::stod(value);
+            else if (flag == L"-r") settings.RecordCount = std::stoi(value);
+            else if (flag == L"-t") settings.Threads = std::stoi(value);
+            else if (flag == L"-v") // 100 or a range, 100-1000
+            {
+                size_t dash = value.find(L'-');
+                settings.MinValueLength = std::stoi(value.substr(0, dash));
+                settings.MaxValueLength = dash == std::wstring::npos ? settings.MinValueLength : std::stoi(value.substr(dash + 1));
+            }
+            else if (flag == L"-l") settings.MaxScanLength = std::stoi(value);
+            else if (flag == L"-W") settings.WarmUpSeconds = std::stoi(value);
+            else if (flag == L"-s") settings.MeasureSeconds = std::stoi(value);
+            else if (flag == L"-m") settings.MaxMmfCount = std::stoi(value);
+            else if (flag == L"-o") settings.CsvPath = value;
+            else return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return settings.RecordCount >= 1 && settings.Threads >= 1 && settings.MinValueLength >= 1
+        && settings.MaxValueLength >= settings.MinValueLength && settings.MaxScanLength >= 1 && settings.WarmUpSeconds >= 0
+        && settings.MeasureSeconds >= 1 && settings.ZipfianConstant > 0 && settings.ZipfianConstant < 1;
+}
+
+/**
+ * \brief L"user" and the hash of the key number, so the insert order isn't the key order, as in YCSB
+ */
+static std::wstring MakeKey(LONGLONG keyNumber)
+{
+    return L"user" + std::to_wstring(FnvHash64(keyNumber));
+}
+
+/**
+ * \brief the values are slices of one random text, drawing every character would cost more than the Put
+ */
+class ValueSource
+{
+public:
+    ValueSource(const YcsbSettings& settings, int seed)
+        : m_lengths(settings.MinValueLength, settings.MaxValueLength)
+        , m_gen(seed)
+    {
+        std::uniform_int_distribution<int> letter(L'a', L'z');
+        m_text.resize(settings.MaxValueLength * 2);
+        for (auto& c : m_text)
+            c = static_cast<wchar_t>(letter(m_gen));
+    }
+
+    std::wstring Next()
+    {
+        int length = m_lengths(m_gen);
+        size_t offset = std::uniform_int_distribution<size_t>(0, m_text.size() - length)(m_gen);
+        return m_text.substr(offset, length);
+    }
+
+private:
+    std::uniform_int_distribution<int> m_lengths;
+    std::mt19937 m_gen;
+    std::wstring m_text;
+};
+
+/**
+ * \brief what the threads share: the phase, and the count of the inserted keys that the key choosers draw below
+ */
+struct YcsbRun
+{
+    volatile LONG Phase = YcsbWarmUp;
+    volatile LONGLONG NextKeyNumber = 0; // taken by the inserts
+    volatile LONGLONG InsertedCount = 0; // keys done, a key of an insert still running may be counted before it is put
+};
+
+struct ThreadResult
+{
+    LatencyHistogram Latency[YcsbOpCount];
+    LONGLONG NotFound = 0; // reads and read-modify-writes of a missing key
+    LONGLONG Failures = 0; // Puts that found the DB full
+};
+
+static bool CountScanned(const wchar_t*, int, const wchar_t*, int, void* context)
+{
+    ++*static_cast<int*>(context);
+    return true;
+}
+
+/**
+ * \brief one client thread: an op picked by the mix, a key by the distribution, each op timed alone. only the ops
+ * that start in the measure phase are recorded
+ */
+static void RunClientThread(MemoryKV& kv, const YcsbSettings& settings, YcsbRun& run, int seed, ThreadResult& result)
+{
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<int> opDistribution(0, 99);
+    std::uniform_int_distribution<int> scanLengths(1, settings.MaxScanLength);
+    KeyChooser keys(settings.GetDistribution(), settings.RecordCount, settings.ZipfianConstant);
+    ValueSource values(settings, seed);
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    LONG phase = YcsbWarmUp;
+    while ((phase = run.Phase) != YcsbStop)
+    {
+        int dice = opDistribution(gen);
+        int op = 0;
+        for (int sum = settings.Workload->Mix[0]; dice >= sum && op + 1 < YcsbOpCount; sum += settings.Workload->Mix[++op])
+            ;
+        std::wstring value = op == YcsbUpdate || op == YcsbInsert || op == YcsbReadModifyWrite ? values.Next() : std::wstring();
+        std::wstring key = op == YcsbInsert ? MakeKey(InterlockedIncrement64(&run.NextKeyNumber) - 1)
+            : MakeKey(keys.Next(gen, run.InsertedCount));
+
+        bool found = true;
+        bool stored = true;
+        LARGE_INTEGER start;
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&start);
+        switch (op)
+        {
+        case YcsbRead:
+            found = kv.Get(key) != nullptr;
+            break;
+        case YcsbUpdate:
+        case YcsbInsert:
+            stored = kv.Put(key, value);
+            break;
+        case YcsbScan:
+        {
+            int scanned = 0;
+            kv.Scan(key, L"", scanLengths(gen), CountScanned, &scanned);
+            break;
+        }
+        default:
+            found = kv.Get(key) != nullptr;
+            stored = found && kv.Put(key, value);
+            break;
+        }
+        QueryPerformanceCounter(&end);
+        if (op == YcsbInsert)
+            InterlockedIncrement64(&run.InsertedCount);
+        if (phase == YcsbMeasure)
+        {
+            result.Latency[op].Record((end.QuadPart - start.QuadPart) * 1000000000 / frequency.QuadPart);
+            result.NotFound += found ? 0 : 1;
+            result.Failures += found && !stored ? 1 : 0;
+        }
+    }
+}
+
+/**
+ * \brief the records every workload starts with, key numbers [0, RecordCount) split over the threads
+ */
+static double LoadRecords(MemoryKV& kv, const YcsbSettings& settings, LONGLONG& failures)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    std::vector<LONGLONG> threadFailures(settings.Threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < settings.Threads; t++)
+    {
+        threads.emplace_back([&kv, &settings, &threadFailures, t]()
+        {
+            ValueSource values(settings, -1 - t);
+            for (LONGLONG i = t; i < settings.RecordCount; i += settings.Threads)
+            {
+                if (!kv.Put(MakeKey(i), values.Next()))
+                    threadFailures[t]++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    QueryPerformanceCounter(&end);
+    failures = 0;
+    for (auto count : threadFailures)
+        failures += count;
+    return static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+static void WriteCsv(const YcsbSettings& settings, double seconds, const wchar_t* operation, const LatencyHistogram& latency)
+{
+    std::wofstream csv(settings.CsvPath, std::ios::app);
+    if (csv.tellp() == 0) // a new file, the runs of one evaluation append to it
+    {
+        csv << L"workload,distribution,zipfian_constant,records,threads,value_min,value_max,seconds,operation,count,"
+            << L"ops_per_sec,p50_ns,p95_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    }
+    csv << settings.Workload->Name << L"," << DistributionNames[settings.GetDistribution()] << L"," << settings.ZipfianConstant
+        << L"," << settings.RecordCount << L"," << settings.Threads << L"," << settings.MinValueLength << L","
+        << settings.MaxValueLength << L"," << seconds << L"," << operation << L"," << latency.TotalCount << L","
+        << static_cast<LONGLONG>(latency.TotalCount / seconds) << L"," << latency.ValueAtPercentile(50) << L","
+        << latency.ValueAtPercentile(95) << L"," << latency.ValueAtPercentile(99) << L"," << latency.ValueAtPercentile(99.9)
+        << L"," << latency.MaxValue << std::endl;
+}
+
+static void PrintLine(const wchar_t* operation, double seconds, const LatencyHistogram& latency)
+{
+    std::wcout << std::setw(8) << operation << std::setw(12) << latency.TotalCount << std::setw(12)
+        << static_cast<LONGLONG>(latency.TotalCount / seconds);
+    for (double percentile : { 50.0, 95.0, 99.0, 99.9 })
+        std::wcout << std::setw(10) << latency.ValueAtPercentile(percentile) / 1000.0;
+    std::wcout << std::setw(10) << latency.MaxValue / 1000.0 << std::endl;
+}
+
+static int RunWorkload(const YcsbSettings& settings)
+{
+    MemoryKV kv(L"ycsb");
+    kv.Open(settings.DbName.c_str(), settings.MakeOptions());
+
+    std::wcout << L"workload " << settings.Workload->Name << L" (" << settings.Workload->Description << L"), "
+        << DistributionNames[settings.GetDistribution()] << L" keys, " << settings.RecordCount << L" records, value length "
+        << settings.MinValueLength << L"-" << settings.MaxValueLength << L", " << settings.Threads << L" threads" << std::endl;
+    std::wcout << std::fixed << std::setprecision(1);
+    LONGLONG loadFailures;
+    double loadSeconds = LoadRecords(kv, settings, loadFailures);
+    std::wcout << L"load: " << loadSeconds << L" s, " << static_cast<LONGLONG>(settings.RecordCount / loadSeconds) << L" records/s";
+    if (loadFailures > 0)
+        std::wcout << L"  (" << loadFailures << L" Puts failed, the DB is full, raise -m)";
+    std::wcout << std::endl;
+
+    YcsbRun run;
+    run.NextKeyNumber = settings.RecordCount;
+    run.InsertedCount = settings.RecordCount;
+    std::vector<ThreadResult> results(settings.Threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < settings.Threads; t++)
+        threads.emplace_back(RunClientThread, std::ref(kv), std::cref(settings), std::ref(run), t, std::ref(results[t]));
+
+    Sleep(settings.WarmUpSeconds * 1000);
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    InterlockedExchange(&run.Phase, YcsbMeasure);
+    Sleep(settings.MeasureSeconds * 1000);
+    InterlockedExchange(&run.Phase, YcsbStop);
+    QueryPerformanceCounter(&end);
+    for (auto& thread : threads)
+        thread.join();
+    double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+    ThreadResult total;
+    LatencyHistogram all;
+    for (const auto& result : results)
+    {
+        for (int op = 0; op < YcsbOpCount; op++)
+            total.Latency[op].Merge(result.Latency[op]);
+        total.NotFound += result.NotFound;
+        total.Failures += result.Failures;
+    }
+    std::wcout << L"measure: " << seconds << L" s after " << settings.WarmUpSeconds << L" s of warm-up, latency in us" << std::endl;
+    std::wcout << std::setw(8) << L"op" << std::setw(12) << L"count" << std::setw(12) << L"ops/s" << std::setw(10) << L"p50"
+        << std::setw(10) << L"p95" << std::setw(10) << L"p99" << std::setw(10) << L"p99.9" << std::setw(10) << L"max" << std::endl;
+    for (int op = 0; op < YcsbOpCount; op++)
+    {
+        if (total.Latency[op].TotalCount == 0)
+            continue;
+        all.Merge(total.Latency[op]);
+        PrintLine(OpNames[op], seconds, total.Latency[op]);
+        if (!settings.CsvPath.empty())
+            WriteCsv(settings, seconds, OpNames[op], total.Latency[op]);
+    }
+    PrintLine(L"all", seconds, all);
+    if (!settings.CsvPath.empty())
+        WriteCsv(settings, seconds, L"all", all);
+    if (total.NotFound > 0)
+        std::wcout << total.NotFound << L" reads found no value" << std::endl;
+    if (total.Failures > 0)
+        std::wcout << total.Failures << L" Puts failed, the DB is full, raise -m" << std::endl;
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    YcsbSettings settings;
+    if (!ParseSettings(argc, argv, settings))
+    {
+        std::wcout << L"usage: MemoryKVLib_Ycsb [-w workload A-F] [-d uniform|zipfian|latest] [-z zipfian constant]"
+            << L" [-r records] [-t threads] [-v value length, or a range min-max] [-l max scan length]"
+            << L" [-W warm-up seconds] [-s measure seconds] [-m max mmf count] [-n db] [-o csv file]" << std::endl;
+        return 1;
+    }
+    return RunWorkload(settings);
+}
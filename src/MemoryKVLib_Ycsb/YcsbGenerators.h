@@ -0,0 +1,141 @@
+#pragma once
+#include <cmath>
+#include <random>
+#include <Windows.h>
+
+#define YCSB_ZIPFIAN_CONSTANT 0.99
+#define YCSB_SCRAMBLED_ITEM_COUNT 10000000000LL // the zipfian item space of the scrambled generator, as in YCSB
+#define YCSB_ZETA_EXACT_TERMS 1000000 // zeta terms summed one by one, the tail is integrated
+
+/**
+ * \brief FNV-1a over the 8 bytes of value, YCSB hashes the key numbers with it
+ */
+inline LONGLONG FnvHash64(LONGLONG value)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= static_cast<unsigned long long>(value) & 0xFF;
+        hash *= 1099511628211ULL;
+        value = static_cast<LONGLONG>(static_cast<unsigned long long>(value) >> 8);
+    }
+    return static_cast<LONGLONG>(hash & 0x7FFFFFFFFFFFFFFFULL);
+}
+
+/**
+ * \brief sum of 1 / i^theta for i in [from, to]. past YCSB_ZETA_EXACT_TERMS the sum is replaced by the integral,
+ * the error is far below what the draws can show and 10^10 items take as long as 10^6
+ */
+inline double Zeta(LONGLONG from, LONGLONG to, double theta)
+{
+    double sum = 0;
+    LONGLONG exactTo = to < YCSB_ZETA_EXACT_TERMS ? to : YCSB_ZETA_EXACT_TERMS;
+    for (LONGLONG i = from; i <= exactTo; i++)
+        sum += 1 / std::pow(static_cast<double>(i), theta);
+    LONGLONG tailFrom = from > exactTo + 1 ? from : exactTo + 1;
+    if (tailFrom <= to)
+        sum += (std::pow(to + 0.5, 1 - theta) - std::pow(tailFrom - 0.5, 1 - theta)) / (1 - theta);
+    return sum;
+}
+
+/**
+ * \brief zipfian ranks in [0, items), 0 the most popular. Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases", the same algorithm as YCSB. the item count may grow, zeta is extended by the new terms only
+ */
+class ZipfianGenerator
+{
+public:
+    ZipfianGenerator(LONGLONG items, double theta)
+        : m_items(items)
+        , m_theta(theta)
+        , m_alpha(1 / (1 - theta))
+        , m_zeta2(Zeta(1, 2, theta))
+        , m_zetan(Zeta(1, items, theta))
+    {
+        UpdateEta();
+    }
+
+    template <class Random>
+    LONGLONG Next(Random& gen, LONGLONG items)
+    {
+        if (items > m_items)
+        {
+            m_zetan += Zeta(m_items + 1, items, m_theta);
+            m_items = items;
+            UpdateEta();
+        }
+        else if (items < m_items)
+        {
+            m_zetan = Zeta(1, items, m_theta);
+            m_items = items;
+            UpdateEta();
+        }
+        return Next(gen);
+    }
+
+    template <class Random>
+    LONGLONG Next(Random& gen)
+    {
+        double u = std::uniform_real_distribution<double>(0, 1)(gen);
+        double uz = u * m_zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + std::pow(0.5, m_theta))
+            return 1 < m_items ? 1 : 0;
+        LONGLONG rank = static_cast<LONGLONG>(m_items * std::pow(m_eta * u - m_eta + 1, m_alpha));
+        return rank < m_items ? rank : m_items - 1;
+    }
+
+private:
+    void UpdateEta()
+    {
+        m_eta = (1 - std::pow(2.0 / m_items, 1 - m_theta)) / (1 - m_zeta2 / m_zetan);
+    }
+
+    LONGLONG m_items;
+    double m_theta;
+    double m_alpha;
+    double m_zeta2;
+    double m_zetan;
+    double m_eta{};
+};
+
+enum YcsbDistribution
+{
+    YcsbUniform = 0,
+    YcsbZipfian = 1, // scrambled, the popular keys are spread over the key space
+    YcsbLatest = 2 // zipfian over the insert order, the newest keys are the most popular
+};
+
+/**
+ * \brief picks key numbers in [0, items) by a distribution. one per thread, items is the count of the keys inserted
+ * so far and grows with the inserts of workloads D and E
+ */
+class KeyChooser
+{
+public:
+    KeyChooser(YcsbDistribution distribution, LONGLONG items, double theta)
+        : m_distribution(distribution)
+        , m_zipfian(distribution == YcsbZipfian ? YCSB_SCRAMBLED_ITEM_COUNT : items, theta)
+    {
+    }
+
+    template <class Random>
+    LONGLONG Next(Random& gen, LONGLONG items)
+    {
+        switch (m_distribution)
+        {
+        case YcsbUniform:
+            return std::uniform_int_distribution<LONGLONG>(0, items - 1)(gen);
+        case YcsbZipfian:
+            // a fixed item space, so a key keeps its popularity while the count grows
+            return FnvHash64(m_zipfian.Next(gen)) % items;
+        default:
+            return items - 1 - m_zipfian.Next(gen, items);
+        }
+    }
+
+private:
+    YcsbDistribution m_distribution;
+    ZipfianGenerator m_zipfian;
+};
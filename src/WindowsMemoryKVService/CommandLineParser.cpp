@@ -1,4 +1,5 @@
 #include "CommandLineParser.h"
+#include <iomanip>
 #include "../MemoryKVLib/SimpleFileLogger.h"
 
 bool ConfigParser::ParseCommandLineArgs(const std::wstring& input, Config& config, SimpleFileLogger& logger)
@@ -71,6 +72,96 @@ bool ConfigParser::ParseCommandLineArgs(const std::wstring& input, Config& confi
                 logger.Log(L"Missing value for -i");
             }
         }
+        else if (token == L"-e") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-e"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -e");
+            }
+        }
+        else if (token == L"-f") {
+            std::wstring value;
+            if (wiss >> std::quoted(value)) {
+                args[L"-f"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -f");
+            }
+        }
+        else if (token == L"-w") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-w"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -w");
+            }
+        }
+        else if (token == L"-s") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-s"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -s");
+            }
+        }
+        else if (token == L"-t") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-t"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -t");
+            }
+        }
+        else if (token == L"-c") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-c"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -c");
+            }
+        }
+        else if (token == L"-z") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-z"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -z");
+            }
+        }
+        else if (token == L"-u") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-u"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -u");
+            }
+        }
+        else if (token == L"-y") {
+            std::wstring value;
+            if (wiss >> value) {
+                args[L"-y"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -y");
+            }
+        }
+        else if (token == L"-d") {
+            std::wstring value;
+            if (wiss >> std::quoted(value)) {
+                args[L"-d"] = value;
+            }
+            else {
+                logger.Log(L"Missing value for -d");
+            }
+        }
         else {
             std::wstringstream wss;
             wss << L"Unknown flag: " <<token;
@@ -106,6 +197,36 @@ bool ConfigParser::ParseCommandLineArgs(const std::wstring& input, Config& confi
         if (args.find(L"-i") != args.end()) {
             config.refresh_interval = std::stoi(std::string(args[L"-i"].begin(), args[L"-i"].end()));
         }
+        if (args.find(L"-e") != args.end()) {
+            config.eviction_mode = std::stoi(std::string(args[L"-e"].begin(), args[L"-e"].end()));
+        }
+        if (args.find(L"-f") != args.end()) {
+            config.file = args[L"-f"];
+        }
+        if (args.find(L"-w") != args.end()) {
+            config.durability = std::stoi(std::string(args[L"-w"].begin(), args[L"-w"].end()));
+        }
+        if (args.find(L"-s") != args.end()) {
+            config.storage = std::stoi(std::string(args[L"-s"].begin(), args[L"-s"].end()));
+        }
+        if (args.find(L"-t") != args.end()) {
+            config.tiering = std::stoi(std::string(args[L"-t"].begin(), args[L"-t"].end()));
+        }
+        if (args.find(L"-c") != args.end()) {
+            config.compression = std::stoi(std::string(args[L"-c"].begin(), args[L"-c"].end()));
+        }
+        if (args.find(L"-z") != args.end()) {
+            config.compression_threshold = std::stoi(std::string(args[L"-z"].begin(), args[L"-z"].end()));
+        }
+        if (args.find(L"-u") != args.end()) {
+            config.dedup = std::stoi(std::string(args[L"-u"].begin(), args[L"-u"].end()));
+        }
+        if (args.find(L"-y") != args.end()) {
+            config.dedup_threshold = std::stoi(std::string(args[L"-y"].begin(), args[L"-y"].end()));
+        }
+        if (args.find(L"-d") != args.end()) {
+            config.data_directory = args[L"-d"];
+        }
     }
     catch (const std::invalid_argument& e) {
         std::wstringstream wss;
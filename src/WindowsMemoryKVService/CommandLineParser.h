@@ -17,6 +17,16 @@ public:
     int block_per_mmf = 1000;          // Optional, default to 1000
     int log_level = 1;              // Optional, default to 1
     int refresh_interval = 10000;       // Optional, default to 10000
+    int eviction_mode = 0;          // Optional, default to 0 (no eviction)
+    std::wstring file;              // Optional, checkpoint path, may be quoted
+    int durability = 0;             // Optional, default to 0 (no write-ahead log)
+    int storage = 0;                // Optional, default to 0 (page file backed segments)
+    int tiering = 0;                // Optional, default to 0 (no cold store)
+    int compression = 0;            // Optional, default to 0 (values stored as they are)
+    int compression_threshold = -1; // Optional, default to the library one
+    int dedup = 0;                  // Optional, default to 0 (no value pool)
+    int dedup_threshold = -1;       // Optional, default to the library one
+    std::wstring data_directory;    // Optional, write-ahead log, segment and cold file directory, may be quoted
 };
 
 class ConfigParser
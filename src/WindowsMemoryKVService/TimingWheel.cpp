@@ -0,0 +1,85 @@
+#include "TimingWheel.h"
+
+TimingWheel::TimingWheel(LONGLONG tickMs)
+{
+    m_tickMs = tickMs > 0 ? tickMs : 1;
+}
+
+LONGLONG TimingWheel::TickOf(LONGLONG expireAt) const
+{
+    return (expireAt + m_tickMs - 1) / m_tickMs; // round up, an entry is never collected before it is due
+}
+
+void TimingWheel::Place(const ExpiryEntry& entry)
+{
+    LONGLONG tick = TickOf(entry.ExpireAt);
+    if (tick < m_currentTick)
+        tick = m_currentTick; // already due, collected by the next Advance
+
+    LONGLONG delta = tick - m_currentTick;
+    for (int level = 0; level < TIMING_WHEEL_LEVELS; level++)
+    {
+        int shift = level * TIMING_WHEEL_SLOT_BITS;
+        if (delta < (1LL << (shift + TIMING_WHEEL_SLOT_BITS)) || level == TIMING_WHEEL_LEVELS - 1)
+        {
+            if (level == TIMING_WHEEL_LEVELS - 1 && delta >= (1LL << (shift + TIMING_WHEEL_SLOT_BITS)))
+                tick = m_currentTick + (1LL << (shift + TIMING_WHEEL_SLOT_BITS)) - 1; // clamp, placed again later
+            m_slots[level][(tick >> shift) & (TIMING_WHEEL_SLOTS - 1)].push_back(entry);
+            return;
+        }
+    }
+}
+
+void TimingWheel::Cascade(int level)
+{
+    int shift = level * TIMING_WHEEL_SLOT_BITS;
+    std::vector<ExpiryEntry> entries;
+    entries.swap(m_slots[level][(m_currentTick >> shift) & (TIMING_WHEEL_SLOTS - 1)]);
+    for (const auto& entry : entries)
+        Place(entry);
+}
+
+bool TimingWheel::Add(const ExpiryEntry& entry)
+{
+    if (!m_held.insert(std::make_pair(entry.GlobalDbIndex, entry.ExpireAt)).second)
+        return false;
+    if (m_currentTick == 0)
+        m_currentTick = CurrentTimeMs() / m_tickMs; // start the wheel now rather than at 1601
+    Place(entry);
+    m_count++;
+    return true;
+}
+
+void TimingWheel::Advance(LONGLONG now, std::vector<ExpiryEntry>& due)
+{
+    LONGLONG nowTick = now / m_tickMs;
+    if (m_count == 0)
+    {
+        m_currentTick = nowTick; // nothing to walk through
+        return;
+    }
+
+    while (m_currentTick <= nowTick)
+    {
+        // the entries of the upper levels come down once the lower level wraps around
+        for (int level = 1; level < TIMING_WHEEL_LEVELS; level++)
+        {
+            if ((m_currentTick & ((1LL << (level * TIMING_WHEEL_SLOT_BITS)) - 1)) != 0)
+                break;
+            Cascade(level);
+        }
+
+        auto& slot = m_slots[0][m_currentTick & (TIMING_WHEEL_SLOTS - 1)];
+        m_count -= slot.size();
+        for (const auto& entry : slot)
+            m_held.erase(std::make_pair(entry.GlobalDbIndex, entry.ExpireAt));
+        due.insert(due.end(), slot.begin(), slot.end());
+        slot.clear();
+        m_currentTick++;
+        if (m_count == 0)
+        {
+            m_currentTick = nowTick + 1;
+            break;
+        }
+    }
+}
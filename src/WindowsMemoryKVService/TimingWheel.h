@@ -0,0 +1,48 @@
+#pragma once
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <Windows.h>
+#include "../MemoryKVLib/ExpiryQueue.h"
+
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_SLOT_BITS)
+
+/**
+ * \brief hierarchical timing wheel of expiry entries, 4 levels of 64 slots. level 0 spans 64 ticks, each higher level
+ * 64 times the one below, entries beyond the top level wait in its farthest slot and are placed again when it comes up.
+ * an entry is held once, the same block and expiry time added again is dropped
+ */
+class TimingWheel
+{
+private:
+    struct EntryHash
+    {
+        size_t operator()(const std::pair<long, LONGLONG>& key) const
+        {
+            return std::hash<LONGLONG>()(key.second * 31 + key.first);
+        }
+    };
+
+    LONGLONG m_tickMs;
+    LONGLONG m_currentTick{}; // every tick before this one has been collected
+    size_t m_count{};
+    std::vector<ExpiryEntry> m_slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+    std::unordered_set<std::pair<long, LONGLONG>, EntryHash> m_held; // GlobalDbIndex and ExpireAt of the entries
+
+    LONGLONG TickOf(LONGLONG expireAt) const;
+    void Place(const ExpiryEntry& entry);
+    void Cascade(int level);
+public:
+    TimingWheel(LONGLONG tickMs = 100);
+    /**
+     * \return false if the wheel already holds the entry
+     */
+    bool Add(const ExpiryEntry& entry);
+    /**
+     * \brief move the wheel to now and collect the entries that are due
+     */
+    void Advance(LONGLONG now, std::vector<ExpiryEntry>& due);
+    size_t Size() const { return m_count; }
+};
@@ -3,9 +3,13 @@
 #include <thread>
 #include <string>
 #include <cstdlib>  // For std::stoi (string to int conversion)
+#include <chrono>
+#include <vector>
 
 #include "CommandLineParser.h"
 #include "NamedPipeServer.h"
+#include "TimingWheel.h"
+#include "../MemoryKVLib/Consts.h"
 #include "../MemoryKVLib/MemoryKVHostServer.h"
 
 struct command_line_args {
@@ -19,7 +23,9 @@ struct command_line_args {
 };
 int refreshInterval = 10000;
 std::unordered_map<std::wstring, std::shared_ptr<MemoryKV>> watchList;
+std::unordered_map<std::wstring, TimingWheel> expiryWheels;
 std::mutex taskMutex;
+std::vector<std::thread> checkpointThreads;
 SimpleFileLogger logger(L"kvhostserver");
 
 void WatcherThreadHandler(HANDLE hEvent)
@@ -42,12 +48,47 @@ void WatcherThreadHandler(HANDLE hEvent)
                 wss << L"refresh db " << pair.first;
                 logger.Log(wss.str().c_str(), 1, true);
                 pair.second->Get(NONE_EXISTED_KEY);
+                pair.second->RebalanceTiers(); //move the values not read since the last refresh to the cold files
+                pair.second->Flush(false); //queue the writeback of file backed segments, no-op otherwise
             }
             logger.Log(L"refresh db ends", 1, true);
         }
     }
 }
 
+/**
+ * \brief reclaim the blocks of expired keys: entries queued by Put with ttl go into a timing wheel per db,
+ * the due ones are removed every tick
+ */
+void ExpiryThreadHandler(HANDLE hEvent)
+{
+    logger.Log(L"expiry thread begins.", 1, true);
+    while (WaitForSingleObject(hEvent, EXPIRY_TICK_INTERVAL) != WAIT_OBJECT_0)
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        for (const auto& pair : watchList) {
+            auto wheel = expiryWheels.find(pair.first);
+            if (wheel == expiryWheels.end())
+                wheel = expiryWheels.emplace(pair.first, TimingWheel(EXPIRY_TICK_INTERVAL)).first;
+
+            std::vector<ExpiryEntry> entries;
+            pair.second->FetchExpiryEntries(entries);
+            for (const auto& entry : entries)
+                wheel->second.Add(entry);
+
+            std::vector<ExpiryEntry> due;
+            wheel->second.Advance(CurrentTimeMs(), due);
+            if (due.empty())
+                continue;
+            int removed = pair.second->RemoveExpired(due);
+            std::wstringstream wss;
+            wss << L"db " << pair.first << L" removed " << removed << L" expired keys";
+            logger.Log(wss.str().c_str(), 1, true);
+        }
+    }
+    logger.Log(L"expiry thread exiting...", 1, true);
+}
+
 /**
  * \brief 
  * \return continue the service or not, always false
@@ -105,6 +146,17 @@ bool HandleStartRequest(const std::wstring& request)
         if (config.mmf_count> 0)
             options.MaxMmfCount = config.mmf_count;
         options.LogLevel = config.log_level; //log level can be zero
+        options.EvictionMode = config.eviction_mode; //the host server must tolerate evicted blocks too
+        options.Durability = config.durability; //its expiry removals go to the log like the Puts
+        options.Storage = config.storage; //the host keeps the file backed MMFs alive between clients
+        options.Tiering = config.tiering; //the host runs the tiering passes
+        options.Compression = config.compression; //the values it replays from the log are compressed again
+        if (config.compression_threshold >= 0)
+            options.CompressionThreshold = config.compression_threshold;
+        options.Dedup = config.dedup; //the pool is shared, the host keeps it alive between clients
+        if (config.dedup_threshold >= 0)
+            options.DedupThreshold = config.dedup_threshold;
+        wcsncpy_s(options.DataDirectory, MAX_DATA_DIRECTORY_LENGTH, config.data_directory.c_str(), _TRUNCATE);
         if (config.refresh_interval > 1000)
             refreshInterval = config.refresh_interval;
         const std::shared_ptr<MemoryKV> pKV = std::make_shared<MemoryKV>(L"host_server");
@@ -135,6 +187,7 @@ bool HandleStopRequest(std::wstring request)
         if (watchList.find(config.name) != watchList.end())
         {
             watchList.erase(config.name);
+            expiryWheels.erase(config.name);
             std::wstringstream wss;
             wss << L" stop db watcher " << config.name;
             logger.Log(wss.str().c_str(), 1, true);
@@ -149,6 +202,48 @@ bool HandleStopRequest(std::wstring request)
     return true;
 }
 
+/**
+ * \brief write a checkpoint of the db on its own thread, the snapshot keeps writers and the other tasks going
+ * \param request
+ * \return continue the service or not, always true
+ */
+bool HandleCheckpointRequest(const std::wstring& request)
+{
+    std::wstring task = request.substr(11);
+    Config config;
+    ConfigParser::ParseCommandLineArgs(task, config, logger);
+
+    std::shared_ptr<MemoryKV> pKV;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        auto it = watchList.find(config.name);
+        if (it != watchList.end())
+            pKV = it->second;
+    }
+    if (pKV == nullptr || config.file.empty())
+    {
+        std::wstringstream wss;
+        wss << L"cannot checkpoint db " << config.name << L" to \"" << config.file << L"\"";
+        logger.Log(wss.str().c_str(), 2, true);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(taskMutex);
+    checkpointThreads.emplace_back([pKV, config]()
+    {
+        long long bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        KvStatus status = pKV->Checkpoint(config.file.c_str(), &bytes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::wstringstream wss;
+        wss << L"checkpoint db " << config.name << L" to " << config.file << L" status " << status
+            << L", " << bytes << L" bytes in " << seconds << L" s";
+        if (seconds > 0)
+            wss << L", " << bytes / seconds / (1024.0 * 1024 * 1024) << L" GB/s";
+        logger.Log(wss.str().c_str(), status == KvOk ? 1 : 2, true);
+    });
+    return true;
+}
 
 /**
  * \brief
@@ -173,6 +268,10 @@ bool HandleRequest(const std::wstring& request)
         return HandleStopRequest(request);
     }
 
+    if (request.rfind(L"checkpoint ", 0) == 0) {
+        return HandleCheckpointRequest(request);
+    }
+
     logger.Log(L"Unknown request.");
     return true;
 }
@@ -190,7 +289,7 @@ int main()
     logger.Log(L"kv host server starts", 1, true);
     HANDLE hEvent = CreateEvent(
         nullptr,
-        FALSE,
+        TRUE, // manual reset, wakes both the watcher and the expiry thread
         FALSE,
         HOST_SERVER_EXIT_EVENT
     );
@@ -203,10 +302,14 @@ int main()
     }
 
     std::thread watherThread(WatcherThreadHandler, hEvent);
+    std::thread expiryThread(ExpiryThreadHandler, hEvent);
     std::thread listenThread(ListenThreadHandler);
     
     listenThread.join();
     watherThread.join();
+    expiryThread.join();
+    for (auto& thread : checkpointThreads)
+        thread.join();
     CloseHandle(hEvent);
     logger.Log(L"kv host server exits", 1, true);
     return 0;